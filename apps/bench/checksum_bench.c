@@ -0,0 +1,96 @@
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Description:
+ *   CRC32C throughput of each implementation this CPU supports.
+ *
+ *   Checksums a BLOCK sized buffer (a page image by default) until NMB
+ *   megabytes have gone through, then reports GB/s (see `make bench-checksum`).
+ *
+ * Usage:
+ *   ./checksum_bench [NMB] [BLOCK]
+ */
+
+#include <numstore/core/checksums.h>
+#include <numstore/core/error.h>
+#include <numstore/intf/os.h>
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_NMB 1024
+
+int
+main (int argc, char **argv)
+{
+  error e = error_create ();
+  size_t nmb = argc > 1 ? (size_t)atol (argv[1]) : DEFAULT_NMB;
+  u32 block = argc > 2 ? (u32)atol (argv[2]) : (u32)PAGE_SIZE;
+  size_t total = nmb << 20;
+
+  if (block == 0 || total < block)
+    {
+      fprintf (stderr, "Invalid size\n");
+      return -1;
+    }
+
+  u8 *data = malloc (block);
+  if (data == NULL)
+    {
+      fprintf (stderr, "Failed to allocate %u bytes\n", block);
+      return -1;
+    }
+  for (u32 i = 0; i < block; ++i)
+    {
+      data[i] = (u8)(i * 31);
+    }
+
+  for (u32 i = 0; i < CKSUM_NIMPLS; ++i)
+    {
+      checksum_fn fn = checksum_get_impl (i);
+      if (fn == NULL)
+        {
+          printf ("impl=%s unsupported\n", checksum_impl_name (i));
+          continue;
+        }
+
+      i_timer timer;
+      if (i_timer_create (&timer, &e))
+        {
+          fprintf (stderr, "Failed to create timer: %s\n", e.cause_msg);
+          free (data);
+          return -1;
+        }
+
+      u32 state = checksum_init ();
+      size_t done = 0;
+      for (; done + block <= total; done += block)
+        {
+          fn (&state, data, block);
+        }
+
+      f64 s = i_timer_now_s (&timer);
+      i_timer_free (&timer);
+
+      // Print the crc so the loop can't be dropped
+      printf ("impl=%s block=%u bytes=%zu seconds=%.6f GB/s=%.2f crc=%08x\n",
+              checksum_impl_name (i), block, done, s, (f64)done / s / 1e9, state);
+    }
+
+  free (data);
+  return 0;
+}
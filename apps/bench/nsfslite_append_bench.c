@@ -0,0 +1,134 @@
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ *
+ * Description:
+ *   Small record ingestion through nsfslite_insert.
+ *
+ *   Inserts NREC records of RECORD bytes in one transaction, first always at
+ *   the end of the variable (the tail append path) and then one byte short
+ *   of it (a regular seek and insert) for comparison.
+ *
+ * Usage:
+ *   ./nsfslite_append_bench [NREC]
+ */
+
+#include "nsfslite.h"
+
+#include <numstore/core/error.h>
+#include <numstore/intf/os.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DEFAULT_NREC 200000
+#define RECORD 16
+
+static int
+run (nsfslite *n, const char *name, size_t nrec, size_t back)
+{
+  error e = error_create ();
+  u8 rec[RECORD] = { 0 };
+
+  int64_t id = nsfslite_new (n, NULL, name);
+  if (id < 0)
+    {
+      fprintf (stderr, "Failed to create variable: %s\n", nsfslite_error (n));
+      return -1;
+    }
+
+  // Something to be short of
+  if (nsfslite_insert (n, id, NULL, rec, 0, 1, RECORD) < 0)
+    {
+      fprintf (stderr, "Failed to insert: %s\n", nsfslite_error (n));
+      return -1;
+    }
+
+  nsfslite_txn *tx = nsfslite_begin_txn (n);
+  if (tx == NULL)
+    {
+      fprintf (stderr, "Failed to begin transaction: %s\n", nsfslite_error (n));
+      return -1;
+    }
+
+  i_timer timer;
+  if (i_timer_create (&timer, &e))
+    {
+      fprintf (stderr, "Failed to create timer: %s\n", e.cause_msg);
+      return -1;
+    }
+
+  // nsfslite_fsize would wait on the transaction's lock - track it here
+  size_t size = RECORD;
+
+  for (size_t i = 0; i < nrec; ++i, size += RECORD)
+    {
+      rec[0] = (u8)i;
+      if (nsfslite_insert (n, id, tx, rec, size - back, 1, RECORD) < 0)
+        {
+          fprintf (stderr, "Failed to insert record %zu: %s\n", i, nsfslite_error (n));
+          i_timer_free (&timer);
+          return -1;
+        }
+    }
+
+  if (nsfslite_commit (n, tx))
+    {
+      fprintf (stderr, "Failed to commit: %s\n", nsfslite_error (n));
+      i_timer_free (&timer);
+      return -1;
+    }
+
+  f64 s = i_timer_now_s (&timer);
+  i_timer_free (&timer);
+
+  printf ("%-6s records=%zu record_size=%d seconds=%.6f records/s=%.0f\n",
+          name, nrec, RECORD, s, (f64)nrec / s);
+
+  return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  int ret = 0;
+  size_t nrec = argc > 1 ? (size_t)atol (argv[1]) : DEFAULT_NREC;
+
+  unlink ("bench.db");
+  unlink ("bench.wal");
+
+  nsfslite *n = nsfslite_open ("bench.db", "bench.wal", 0);
+  if (!n)
+    {
+      fprintf (stderr, "Failed to open database\n");
+      ret = -1;
+      goto cleanup;
+    }
+
+  if (run (n, "append", nrec, 0) || run (n, "seek", nrec, 1))
+    {
+      ret = -1;
+    }
+
+cleanup:
+  if (n)
+    {
+      nsfslite_close (n);
+    }
+  unlink ("bench.db");
+  unlink ("bench.wal");
+  return ret;
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Description:
+ *   Sequential nsfslite_read throughput at the compiled page size.
+ *
+ *   Writes a variable of NMB megabytes, reopens the database with a cold
+ *   buffer pool and reads it front to back in CHUNK sized reads. Build with
+ *   -DNS_PAGE_SIZE=<size> to compare page sizes (see `make bench-page-size`).
+ *
+ * Usage:
+ *   ./nsfslite_read_bench [NMB]
+ */
+
+#include "nsfslite.h"
+
+#include <numstore/core/error.h>
+#include <numstore/intf/os.h>
+
+#include <config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define DEFAULT_NMB 64
+#define CHUNK ((size_t)1 << 20)
+
+int
+main (int argc, char **argv)
+{
+  int ret = 0;
+  nsfslite *n = NULL;
+  error e = error_create ();
+  size_t nmb = argc > 1 ? (size_t)atol (argv[1]) : DEFAULT_NMB;
+  size_t total = nmb << 20;
+  u8 *chunk = malloc (CHUNK);
+
+  if (chunk == NULL || total == 0)
+    {
+      fprintf (stderr, "Invalid size\n");
+      free (chunk);
+      return -1;
+    }
+
+  unlink ("bench.db");
+  unlink ("bench.wal");
+
+  // Populate
+  n = nsfslite_open ("bench.db", "bench.wal", 0);
+  if (!n)
+    {
+      fprintf (stderr, "Failed to open database\n");
+      ret = -1;
+      goto cleanup;
+    }
+
+  int64_t id = nsfslite_new (n, NULL, "data");
+  if (id < 0)
+    {
+      fprintf (stderr, "Failed to create variable: %s\n", nsfslite_error (n));
+      ret = -1;
+      goto cleanup;
+    }
+
+  for (size_t i = 0; i < CHUNK; ++i)
+    {
+      chunk[i] = (u8)i;
+    }
+
+  for (size_t ofst = 0; ofst < total; ofst += CHUNK)
+    {
+      if (nsfslite_insert (n, id, NULL, chunk, ofst, 1, CHUNK) < 0)
+        {
+          fprintf (stderr, "Failed to insert at %zu: %s\n", ofst, nsfslite_error (n));
+          ret = -1;
+          goto cleanup;
+        }
+    }
+
+  nsfslite_close (n);
+
+  // Read back with a cold pool
+  n = nsfslite_open ("bench.db", "bench.wal", 0);
+  if (!n)
+    {
+      fprintf (stderr, "Failed to reopen database\n");
+      ret = -1;
+      goto cleanup;
+    }
+
+  // Variable ids are page numbers and survive a reopen
+  i_timer timer;
+  if (i_timer_create (&timer, &e))
+    {
+      fprintf (stderr, "Failed to create timer: %s\n", e.cause_msg);
+      ret = -1;
+      goto cleanup;
+    }
+
+  for (size_t ofst = 0; ofst < total; ofst += CHUNK)
+    {
+      struct nsfslite_stride stride = {
+        .bstart = ofst,
+        .stride = 1,
+        .nelems = CHUNK,
+      };
+      if (nsfslite_read (n, id, chunk, 1, stride) < 0)
+        {
+          fprintf (stderr, "Failed to read at %zu: %s\n", ofst, nsfslite_error (n));
+          i_timer_free (&timer);
+          ret = -1;
+          goto cleanup;
+        }
+    }
+
+  f64 s = i_timer_now_s (&timer);
+  i_timer_free (&timer);
+
+  printf ("page_size=%" PRp_size " bytes=%zu seconds=%.6f MB/s=%.2f\n",
+          PAGE_SIZE, total, s, (f64)nmb / s);
+
+cleanup:
+  if (n)
+    {
+      nsfslite_close (n);
+    }
+  unlink ("bench.db");
+  unlink ("bench.wal");
+  free (chunk);
+  return ret;
+}
@@ -42,7 +42,7 @@ main (void)
   unlink ("test10.db");
   unlink ("test10.wal");
 
-  n = nsfslite_open ("test10.db", "test10.wal");
+  n = nsfslite_open ("test10.db", "test10.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -78,7 +78,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test10.db", "test10.wal");
+  n = nsfslite_open ("test10.db", "test10.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
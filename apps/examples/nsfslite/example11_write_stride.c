@@ -54,7 +54,7 @@ main (void)
   unlink ("test11.db");
   unlink ("test11.wal");
 
-  n = nsfslite_open ("test11.db", "test11.wal");
+  n = nsfslite_open ("test11.db", "test11.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -88,7 +88,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test11.db", "test11.wal");
+  n = nsfslite_open ("test11.db", "test11.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
@@ -48,7 +48,7 @@ main (void)
   unlink ("test12.db");
   unlink ("test12.wal");
 
-  n = nsfslite_open ("test12.db", "test12.wal");
+  n = nsfslite_open ("test12.db", "test12.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -96,7 +96,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test12.db", "test12.wal");
+  n = nsfslite_open ("test12.db", "test12.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
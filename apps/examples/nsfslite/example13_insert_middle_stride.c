@@ -55,7 +55,7 @@ main (void)
   unlink ("test13.db");
   unlink ("test13.wal");
 
-  n = nsfslite_open ("test13.db", "test13.wal");
+  n = nsfslite_open ("test13.db", "test13.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -87,7 +87,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test13.db", "test13.wal");
+  n = nsfslite_open ("test13.db", "test13.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
@@ -47,7 +47,7 @@ main (void)
   unlink ("test14.db");
   unlink ("test14.wal");
 
-  n = nsfslite_open ("test14.db", "test14.wal");
+  n = nsfslite_open ("test14.db", "test14.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -87,7 +87,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test14.db", "test14.wal");
+  n = nsfslite_open ("test14.db", "test14.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
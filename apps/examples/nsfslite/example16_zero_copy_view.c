@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Example 16: Zero Copy Views
+ *
+ * Demonstrates streaming a variable without copying it. nsfslite_view_next
+ * hands out spans that point straight into the buffer pool - each one stays
+ * valid until it is released, so a consumer (a checksum here) reads the
+ * data in place.
+ *
+ * Usage:
+ *   ./example16_zero_copy_view
+ */
+
+#include "nsfslite.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define N_ELEMS 200000
+#define OFFSET 1000
+
+int
+main (void)
+{
+  int ret = 0;
+  nsfslite *n = NULL;
+  nsfslite_view *v = NULL;
+  int *data = malloc (N_ELEMS * sizeof (int));
+
+  for (size_t i = 0; i < N_ELEMS; i++)
+    {
+      data[i] = i;
+    }
+
+  unlink ("test16.db");
+  unlink ("test16.wal");
+
+  n = nsfslite_open ("test16.db", "test16.wal", 0);
+  if (!n)
+    {
+      fprintf (stderr, "Failed to open database\n");
+      ret = -1;
+      goto cleanup;
+    }
+
+  int64_t id = nsfslite_new (n, NULL, "data");
+  if (id < 0)
+    {
+      fprintf (stderr, "Failed to create variable: %s\n", nsfslite_error (n));
+      ret = -1;
+      goto cleanup;
+    }
+
+  if (nsfslite_insert (n, id, NULL, data, 0, sizeof (int), N_ELEMS) < 0)
+    {
+      fprintf (stderr, "Failed to insert: %s\n", nsfslite_error (n));
+      ret = -1;
+      goto cleanup;
+    }
+
+  // View everything past OFFSET elements
+  v = nsfslite_view_open (n, id, OFFSET * sizeof (int), 0);
+  if (!v)
+    {
+      fprintf (stderr, "Failed to open view: %s\n", nsfslite_error (n));
+      ret = -1;
+      goto cleanup;
+    }
+
+  const unsigned char *expected = (const unsigned char *)data + OFFSET * sizeof (int);
+  size_t total = 0;
+  size_t nspans = 0;
+  unsigned long sum = 0;
+
+  while (1)
+    {
+      struct nsfslite_span span;
+      int got = nsfslite_view_next (n, v, &span);
+      if (got < 0)
+        {
+          fprintf (stderr, "Failed to get next span: %s\n", nsfslite_error (n));
+          ret = -1;
+          goto cleanup;
+        }
+      if (got == 0)
+        {
+          break;
+        }
+
+      if (memcmp (span.data, expected + total, span.len) != 0)
+        {
+          fprintf (stderr, "Mismatch in span %zu at byte %zu\n", nspans, total);
+          nsfslite_span_release (n, &span);
+          ret = -1;
+          goto cleanup;
+        }
+
+      for (size_t i = 0; i < span.len; ++i)
+        {
+          sum += ((const unsigned char *)span.data)[i];
+        }
+
+      total += span.len;
+      nspans++;
+
+      nsfslite_span_release (n, &span);
+    }
+
+  if (total != (N_ELEMS - OFFSET) * sizeof (int))
+    {
+      fprintf (stderr, "Viewed %zu bytes, expected %zu\n", total, (N_ELEMS - OFFSET) * sizeof (int));
+      ret = -1;
+      goto cleanup;
+    }
+
+  printf ("SUCCESS: Viewed %zu bytes in %zu spans without a copy (byte sum %lu)\n", total, nspans, sum);
+
+cleanup:
+  if (v)
+    nsfslite_view_close (n, v);
+  if (n)
+    nsfslite_close (n);
+  free (data);
+  return ret;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Example 17: Bulk Loading
+ *
+ * Demonstrates filling a fresh variable with nsfslite_load. The tree is
+ * built bottom up - each page is written once - and the fill factor leaves
+ * room in every page so later inserts don't immediately split.
+ *
+ * Usage:
+ *   ./example17_bulk_load
+ */
+
+#include "nsfslite.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define N_ELEMS 500000
+#define FILL 90
+
+int
+main (void)
+{
+  int ret = 0;
+  nsfslite *n = NULL;
+  int *data = malloc (N_ELEMS * sizeof (int));
+  int *out = malloc ((N_ELEMS + 1) * sizeof (int));
+
+  for (size_t i = 0; i < N_ELEMS; i++)
+    {
+      data[i] = i;
+    }
+
+  unlink ("test17.db");
+  unlink ("test17.wal");
+
+  n = nsfslite_open ("test17.db", "test17.wal", 0);
+  if (!n)
+    {
+      fprintf (stderr, "Failed to open database\n");
+      ret = -1;
+      goto cleanup;
+    }
+
+  int64_t id = nsfslite_new (n, NULL, "data");
+  if (id < 0)
+    {
+      fprintf (stderr, "Failed to create variable: %s\n", nsfslite_error (n));
+      ret = -1;
+      goto cleanup;
+    }
+
+  if (nsfslite_load (n, id, NULL, data, sizeof (int), N_ELEMS, FILL) < 0)
+    {
+      fprintf (stderr, "Failed to load: %s\n", nsfslite_error (n));
+      ret = -1;
+      goto cleanup;
+    }
+
+  // The variable is an ordinary one from here on
+  int marker = -1;
+  if (nsfslite_insert (n, id, NULL, &marker, (N_ELEMS / 2) * sizeof (int), sizeof (int), 1) < 0)
+    {
+      fprintf (stderr, "Failed to insert: %s\n", nsfslite_error (n));
+      ret = -1;
+      goto cleanup;
+    }
+
+  struct nsfslite_stride stride = {
+    .bstart = 0,
+    .stride = 1,
+    .nelems = N_ELEMS + 1,
+  };
+  if (nsfslite_read (n, id, out, sizeof (int), stride) < 0)
+    {
+      fprintf (stderr, "Failed to read: %s\n", nsfslite_error (n));
+      ret = -1;
+      goto cleanup;
+    }
+
+  if (memcmp (out, data, (N_ELEMS / 2) * sizeof (int)) != 0
+      || out[N_ELEMS / 2] != marker
+      || memcmp (out + N_ELEMS / 2 + 1, data + N_ELEMS / 2, (N_ELEMS - N_ELEMS / 2) * sizeof (int)) != 0)
+    {
+      fprintf (stderr, "Read back data doesn't match\n");
+      ret = -1;
+      goto cleanup;
+    }
+
+  printf ("SUCCESS: Bulk loaded %d integers at %d%% fill (%zu bytes)\n", N_ELEMS, FILL, nsfslite_fsize (n, id));
+
+cleanup:
+  if (n)
+    nsfslite_close (n);
+  free (data);
+  free (out);
+  return ret;
+}
@@ -54,7 +54,7 @@ main (void)
   unlink ("test1.db");
   unlink ("test1.wal");
 
-  n = nsfslite_open ("test1.db", "test1.wal");
+  n = nsfslite_open ("test1.db", "test1.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -85,7 +85,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test1.db", "test1.wal");
+  n = nsfslite_open ("test1.db", "test1.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
@@ -50,7 +50,7 @@ main (int argc, char **argv)
 
   if (argc > 1 && strcmp (argv[1], "recover") == 0)
     {
-      n = nsfslite_open ("test2.db", "test2.wal");
+      n = nsfslite_open ("test2.db", "test2.wal", 0);
       if (!n)
         {
           fprintf (stderr, "Failed to open database\n");
@@ -92,7 +92,7 @@ main (int argc, char **argv)
       unlink ("test2.db");
       unlink ("test2.wal");
 
-      n = nsfslite_open ("test2.db", "test2.wal");
+      n = nsfslite_open ("test2.db", "test2.wal", 0);
       if (!n)
         {
           fprintf (stderr, "Failed to open database\n");
@@ -68,7 +68,7 @@ main (void)
   unlink ("test3.db");
   unlink ("test3.wal");
 
-  n = nsfslite_open ("test3.db", "test3.wal");
+  n = nsfslite_open ("test3.db", "test3.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -100,7 +100,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test3.db", "test3.wal");
+  n = nsfslite_open ("test3.db", "test3.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
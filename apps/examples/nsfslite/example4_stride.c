@@ -48,7 +48,7 @@ main (void)
   unlink ("test4.db");
   unlink ("test4.wal");
 
-  n = nsfslite_open ("test4.db", "test4.wal");
+  n = nsfslite_open ("test4.db", "test4.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -75,7 +75,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test4.db", "test4.wal");
+  n = nsfslite_open ("test4.db", "test4.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
@@ -48,7 +48,7 @@ main (void)
   unlink ("test5.db");
   unlink ("test5.wal");
 
-  n = nsfslite_open ("test5.db", "test5.wal");
+  n = nsfslite_open ("test5.db", "test5.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -75,7 +75,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test5.db", "test5.wal");
+  n = nsfslite_open ("test5.db", "test5.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
@@ -49,7 +49,7 @@ main (void)
   unlink ("test6.db");
   unlink ("test6.wal");
 
-  n = nsfslite_open ("test6.db", "test6.wal");
+  n = nsfslite_open ("test6.db", "test6.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -76,7 +76,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test6.db", "test6.wal");
+  n = nsfslite_open ("test6.db", "test6.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
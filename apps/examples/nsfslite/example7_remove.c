@@ -58,7 +58,7 @@ main (void)
   unlink ("test7.db");
   unlink ("test7.wal");
 
-  n = nsfslite_open ("test7.db", "test7.wal");
+  n = nsfslite_open ("test7.db", "test7.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -92,7 +92,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test7.db", "test7.wal");
+  n = nsfslite_open ("test7.db", "test7.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
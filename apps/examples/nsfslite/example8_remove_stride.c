@@ -48,7 +48,7 @@ main (void)
   unlink ("test8.db");
   unlink ("test8.wal");
 
-  n = nsfslite_open ("test8.db", "test8.wal");
+  n = nsfslite_open ("test8.db", "test8.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -82,7 +82,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test8.db", "test8.wal");
+  n = nsfslite_open ("test8.db", "test8.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
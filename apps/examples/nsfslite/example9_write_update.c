@@ -60,7 +60,7 @@ main (void)
   unlink ("test9.db");
   unlink ("test9.wal");
 
-  n = nsfslite_open ("test9.db", "test9.wal");
+  n = nsfslite_open ("test9.db", "test9.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to open database\n");
@@ -94,7 +94,7 @@ main (void)
 
   nsfslite_close (n);
 
-  n = nsfslite_open ("test9.db", "test9.wal");
+  n = nsfslite_open ("test9.db", "test9.wal", 0);
   if (!n)
     {
       fprintf (stderr, "Failed to reopen database\n");
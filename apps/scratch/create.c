@@ -43,7 +43,7 @@ main (void)
     i_remove_quiet ("test.db", &e);
     i_remove_quiet ("test.wal", &e);
 
-    p = pgr_open ("test.db", "test.wal", &e);
+    p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
 
     t = pgr_begin_txn (p, &e); // TODO - this is not used - should warn or
     // do something on pager close
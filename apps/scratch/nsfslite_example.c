@@ -60,7 +60,7 @@ main (void)
 {
   i_remove_quiet ("mydb.db", NULL);
   i_remove_quiet ("recovery.wal", NULL);
-  nsfslite *n = nsfslite_open ("mydb.db", "recovery.wal");
+  nsfslite *n = nsfslite_open ("mydb.db", "recovery.wal", 0);
 
   if (n == NULL)
     {
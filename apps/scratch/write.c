@@ -33,7 +33,7 @@ main (void)
 
   arr_range (src);
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   if (p == NULL)
     {
       return e.cause_code;
@@ -31,7 +31,11 @@ const char *nsfslite_error (nsfslite *n);
 void nsfslite_reset_errors (nsfslite *n);
 
 // Lifecycle
-nsfslite *nsfslite_open (const char *fname, const char *recovery_fname);
+nsfslite *nsfslite_open (
+    const char *fname,          // Database file
+    const char *recovery_fname, // Write ahead log file
+    size_t pool_size            // Buffer pool size in bytes - 0 for the default
+);
 int nsfslite_close (nsfslite *n);
 
 // Stride parameters
@@ -85,6 +89,17 @@ ssize_t nsfslite_insert (
     size_t nelem      // number of elements
 );
 
+// Bulk load - builds an empty variable bottom up, much faster than nsfslite_insert
+ssize_t nsfslite_load (
+    nsfslite *n,      // nsfslite handle
+    uint64_t id,      // variable id - from nsfslite_get_id - must be empty
+    nsfslite_txn *tx, // transaction or NULL for implicit transaction
+    const void *src,  // Source data
+    size_t size,      // Size of each element
+    size_t nelem,     // number of elements
+    uint32_t fill     // Percent of each page to fill (50 - 100) - leave room for later inserts
+);
+
 // Write
 ssize_t nsfslite_write (
     nsfslite *n,                  // nsfslite handle
@@ -104,6 +119,30 @@ ssize_t nsfslite_read (
     struct nsfslite_stride stride // Stride pattern
 );
 
+// Zero copy read
+typedef struct nsfslite_view_s nsfslite_view; // An opaque cursor handing out spans of a variable
+
+struct nsfslite_span
+{
+  const void *data; // Points into the buffer pool - valid until nsfslite_span_release
+  size_t len;
+  void *_pin[4]; // Internal
+};
+
+nsfslite_view *nsfslite_view_open (
+    nsfslite *n,  // nsfslite handle
+    uint64_t id,  // variable id - from nsfslite_get_id
+    size_t bofst, // Starting (byte) offset
+    size_t nbytes // Number of bytes to view - 0 for the rest of the variable
+);
+
+// 1 - [dest] holds the next span, 0 - no more spans, < 0 - error
+int nsfslite_view_next (nsfslite *n, nsfslite_view *v, struct nsfslite_span *dest);
+
+// Spans may be held across nsfslite_view_next calls - release them before writing
+int nsfslite_span_release (nsfslite *n, struct nsfslite_span *s);
+int nsfslite_view_close (nsfslite *n, nsfslite_view *v);
+
 // Remove
 ssize_t nsfslite_remove (
     nsfslite *n,                  // nsfslite handle
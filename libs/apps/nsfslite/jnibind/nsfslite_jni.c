@@ -62,8 +62,16 @@ throw_exception (JNIEnv *env, const char *exception_class, const char *message)
 
 JNIEXPORT jlong JNICALL
 Java_com_numstore_nsfslite_NsfsliteNative_open (JNIEnv *env, jclass cls,
-                                                jstring db_path, jstring wal_path)
+                                                jstring db_path, jstring wal_path,
+                                                jlong pool_size)
 {
+  if (pool_size < 0)
+    {
+      throw_exception (env, "java/lang/IllegalArgumentException",
+                       "Pool size cannot be negative");
+      return 0;
+    }
+
   char *db_path_str = jstring_to_cstr (env, db_path);
   char *wal_path_str = jstring_to_cstr (env, wal_path);
 
@@ -79,7 +87,7 @@ Java_com_numstore_nsfslite_NsfsliteNative_open (JNIEnv *env, jclass cls,
   printf ("[nsfslite-jni] Opening database: %s with WAL: %s\n", db_path_str,
           wal_path_str);
 
-  nsfslite *handle = nsfslite_open (db_path_str, wal_path_str);
+  nsfslite *handle = nsfslite_open (db_path_str, wal_path_str, (size_t)pool_size);
 
   free (db_path_str);
   free (wal_path_str);
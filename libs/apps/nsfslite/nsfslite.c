@@ -40,9 +40,18 @@ union cursor
   struct var_cursor vpc;
 };
 
+struct nsfslite_view_s
+{
+  union cursor c;
+};
+
+_Static_assert(sizeof (page_h) <= sizeof (((struct nsfslite_span *)0)->_pin),
+               "nsfslite_span: _pin must hold a page_h");
+
 struct nsfslite_s
 {
   struct pager *p;
+  struct thread_pool *tp; // Pager read-ahead
   struct clck_alloc cursors;
   struct nsfsllt lt;
   struct latch l;
@@ -79,11 +88,20 @@ nsfslite_reset_errors (nsfslite *n)
 }
 
 nsfslite *
-nsfslite_open (const char *fname, const char *recovery_fname)
+nsfslite_open (const char *fname, const char *recovery_fname, size_t pool_size)
 {
   error e = error_create ();
 
-  i_log_info ("nsfslite_open: fname=%s recovery=%s\n", fname, recovery_fname ? recovery_fname : "none");
+  i_log_info ("nsfslite_open: fname=%s recovery=%s pool_size=%zu\n", fname, recovery_fname ? recovery_fname : "none", pool_size);
+
+  // Pool is sized in whole frames
+  u64 nframes = pool_size / PAGE_SIZE;
+  if (pool_size > 0 && (nframes < PGR_MIN_POOL_LEN || nframes > U32_MAX))
+    {
+      error_causef (&e, ERR_INVALID_ARGUMENT, "Invalid buffer pool size: %zu bytes", pool_size);
+      goto failed;
+    }
+  u32 pool_len = (u32)nframes;
 
   // Allocate memory
   nsfslite *ret = i_malloc (1, sizeof *ret, &e);
@@ -93,7 +111,7 @@ nsfslite_open (const char *fname, const char *recovery_fname)
     }
 
   // Create a new pager
-  ret->p = pgr_open (fname, recovery_fname, &ret->e);
+  ret->p = pgr_open (fname, recovery_fname, pool_len, &e);
   if (ret->p == NULL)
     {
       i_free (ret);
@@ -123,8 +141,8 @@ nsfslite_open (const char *fname, const char *recovery_fname)
   if (nsfslt_init (&ret->lt, &e))
     {
       pgr_close (ret->p, &e);
-      i_free (ret);
       clck_alloc_close (&ret->cursors);
+      i_free (ret);
       goto failed;
     }
 
@@ -132,12 +150,61 @@ nsfslite_open (const char *fname, const char *recovery_fname)
   if (i_mutex_create (&ret->dblock, &e) < 0)
     {
       pgr_close (ret->p, &e);
+      clck_alloc_close (&ret->cursors);
+      nsfslt_destroy (&ret->lt);
       i_free (ret);
+      goto failed;
+    }
+#endif
+
+  // Workers for pager read-ahead
+  ret->tp = tp_open (&e);
+  if (ret->tp == NULL || tp_spin (ret->tp, PGR_READAHEAD_THREADS, &e))
+    {
+      if (ret->tp)
+        {
+          tp_free (ret->tp, &e);
+        }
+      pgr_close (ret->p, &e);
       clck_alloc_close (&ret->cursors);
       nsfslt_destroy (&ret->lt);
+#ifdef ENABLE_GLOBAL_DB_LOCK
+      i_mutex_free (&ret->dblock);
+#endif
+      i_free (ret);
       goto failed;
     }
+  pgr_set_thread_pool (ret->p, ret->tp);
+
+  // Writes committed pages back ahead of eviction
+  if (pgr_start_cleaner (ret->p, &e))
+    {
+      pgr_close (ret->p, &e);
+      tp_stop (ret->tp, &e);
+      tp_free (ret->tp, &e);
+      clck_alloc_close (&ret->cursors);
+      nsfslt_destroy (&ret->lt);
+#ifdef ENABLE_GLOBAL_DB_LOCK
+      i_mutex_free (&ret->dblock);
 #endif
+      i_free (ret);
+      goto failed;
+    }
+
+  // Bounds restart time without stalling writers
+  if (pgr_start_checkpointer (ret->p, &e))
+    {
+      pgr_close (ret->p, &e);
+      tp_stop (ret->tp, &e);
+      tp_free (ret->tp, &e);
+      clck_alloc_close (&ret->cursors);
+      nsfslt_destroy (&ret->lt);
+#ifdef ENABLE_GLOBAL_DB_LOCK
+      i_mutex_free (&ret->dblock);
+#endif
+      i_free (ret);
+      goto failed;
+    }
 
   ret->e = e;
 
@@ -162,7 +229,10 @@ nsfslite_close (nsfslite *n)
   i_mutex_free (&n->dblock);
 #endif
 
+  // Drains read-ahead before the workers go away
   pgr_close (n->p, &n->e);
+  tp_stop (n->tp, &n->e);
+  tp_free (n->tp, &n->e);
   clck_alloc_close (&n->cursors);
   nsfslt_destroy (&n->lt);
 
@@ -596,25 +666,37 @@ nsfslite_insert (
 
   rptc_enter_transaction (&c->rptc, tx);
 
-  // SEEK to byte offset
-  if (rptc_start_seek (&c->rptc, bofst, true, &n->e))
+  u32 nbytes = nelem * size;
+  struct cbuffer srcbuf = cbuffer_create_with ((void *)src, nbytes, nbytes);
+
+  // APPEND in place if it fits in the last page
+  if (bofst == c->rptc.total_size && c->rptc.root != PGNO_NULL)
     {
-      goto failed;
+      if (rptc_start_append (&c->rptc, &srcbuf, &n->e))
+        {
+          goto failed;
+        }
     }
 
-  while (c->rptc.state == RPTS_SEEKING)
+  // Otherwise SEEK to byte offset
+  else
     {
-      if (rptc_seeking_execute (&c->rptc, &n->e))
+      if (rptc_start_seek (&c->rptc, bofst, true, &n->e))
         {
           goto failed;
         }
+
+      while (c->rptc.state == RPTS_SEEKING)
+        {
+          if (rptc_seeking_execute (&c->rptc, &n->e))
+            {
+              goto failed;
+            }
+        }
     }
 
   // INSERT
-  u32 nbytes = nelem * size;
-  struct cbuffer srcbuf = cbuffer_create_with ((void *)src, nbytes, nbytes);
-
-  if (rptc_seeked_to_insert (&c->rptc, &srcbuf, nbytes, &n->e))
+  if (c->rptc.state == RPTS_SEEKED && rptc_seeked_to_insert (&c->rptc, &srcbuf, nbytes, &n->e))
     {
       goto failed;
     }
@@ -637,7 +719,10 @@ nsfslite_insert (
     }
 
   // COMMIT
-  rptc_leave_transaction (&c->rptc);
+  if (rptc_leave_transaction (&c->rptc, &n->e))
+    {
+      goto failed;
+    }
   if (auto_txn_started)
     {
       if (pgr_commit (n->p, &auto_txn, &n->e))
@@ -682,6 +767,141 @@ failed:
   return n->e.cause_code;
 }
 
+ssize_t
+nsfslite_load (
+    nsfslite *n,
+    uint64_t id,
+    nsfslite_txn *tx,
+    const void *src,
+    size_t size,
+    size_t nelem,
+    uint32_t fill)
+{
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  bool need_lock = (tx == NULL);
+  if (need_lock)
+    {
+      i_mutex_lock (&n->dblock);
+    }
+#endif
+
+  DBG_ASSERT (nsfslite, n);
+  error_reset (&n->e);
+
+  struct txn auto_txn; // Maybe auto txn
+  bool auto_txn_started = false;
+
+  // INIT
+  union cursor *c = clck_alloc_alloc (&n->cursors, &n->e);
+  if (c == NULL)
+    {
+      i_log_warn ("nsfslite_load failed: cursor allocation error\n");
+      goto failed;
+    }
+
+  // INIT RPTREE CURSOR with rpt_root page ID
+  if (rptc_open (&c->rptc, id, n->p, &n->e))
+    {
+      i_log_warn ("nsfslite_load failed: rptc_open error id=%" PRIu64 "\n", id);
+      goto failed;
+    }
+
+  // BEGIN TXN
+  if (tx == NULL)
+    {
+      if (pgr_begin_txn (&auto_txn, n->p, &n->e))
+        {
+          goto failed;
+        }
+      auto_txn_started = true;
+      tx = &auto_txn;
+      i_log_trace ("nsfslite_load: created implicit tx=%" PRIu64 "\n", auto_txn.tid);
+    }
+
+  rptc_enter_transaction (&c->rptc, tx);
+
+  // LOAD - cbuffers are u32 sized, so feed it in pieces
+  const u8 *head = src;
+  size_t left = nelem * size;
+  u8 none;
+  struct cbuffer srcbuf = cbuffer_create_with (&none, 1, 0);
+
+  if (rptc_start_bulk (&c->rptc, &srcbuf, fill, &n->e))
+    {
+      goto failed;
+    }
+
+  while (left > 0)
+    {
+      u32 next = (u32)MIN (left, (size_t)1 << 30);
+      srcbuf = cbuffer_create_with ((void *)head, next, next);
+
+      if (rptc_bulk_execute (&c->rptc, &n->e))
+        {
+          goto failed;
+        }
+
+      head += next;
+      left -= next;
+    }
+
+  if (rptc_bulk_to_unseeked (&c->rptc, &n->e))
+    {
+      goto failed;
+    }
+
+  // COMMIT
+  if (rptc_leave_transaction (&c->rptc, &n->e))
+    {
+      goto failed;
+    }
+  if (auto_txn_started)
+    {
+      if (pgr_commit (n->p, &auto_txn, &n->e))
+        {
+          goto failed;
+        }
+    }
+
+  // CLEANUP
+  if (rptc_cleanup (&c->rptc, &n->e))
+    {
+      goto failed;
+    }
+
+  clck_alloc_free (&n->cursors, c);
+
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  if (need_lock)
+    {
+      i_mutex_unlock (&n->dblock);
+    }
+#endif
+
+  i_log_trace ("nsfslite_load: success id=%" PRIu64 " tx=%" PRIu64 " loaded=%zu\n", id, tx->tid, nelem);
+  return nelem;
+
+failed:
+  if (c)
+    {
+      clck_alloc_free (&n->cursors, c);
+    }
+
+  if (tx)
+    {
+      pgr_rollback (n->p, tx, 0, &n->e);
+    }
+
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  if (need_lock)
+    {
+      i_mutex_unlock (&n->dblock);
+    }
+#endif
+
+  return n->e.cause_code;
+}
+
 ssize_t
 nsfslite_write (
     nsfslite *n,
@@ -750,27 +970,30 @@ nsfslite_write (
   u32 nbytes = stride.nelems * size;
   struct cbuffer srcbuf = cbuffer_create_with ((void *)src, nbytes, nbytes);
 
-  rptc_seeked_to_write (&c->rptc, &srcbuf, size, stride.stride);
+  ssize_t written = 0;
 
-  while (c->rptc.state == RPTS_DL_WRITING)
+  // An empty variable stays unseeked - nothing to write over
+  if (c->rptc.state == RPTS_SEEKED)
     {
-      if (rptc_write_execute (&c->rptc, &n->e))
+      rptc_seeked_to_write (&c->rptc, &srcbuf, size, stride.stride);
+
+      while (c->rptc.state == RPTS_DL_WRITING)
         {
-          goto failed;
+          if (rptc_write_execute (&c->rptc, &n->e))
+            {
+              goto failed;
+            }
         }
-    }
 
-  ASSERT (c->rptc.writer.total_written % size == 0);
-  ssize_t written = c->rptc.writer.total_written / size;
+      ASSERT (c->rptc.writer.total_written % size == 0);
+      written = c->rptc.writer.total_written / size;
+    }
 
-  // Transition back to unseeked
-  if (rptc_write_to_unseeked (&c->rptc, &n->e))
+  // COMMIT
+  if (rptc_leave_transaction (&c->rptc, &n->e))
     {
       goto failed;
     }
-
-  // COMMIT
-  rptc_leave_transaction (&c->rptc);
   if (auto_txn_started)
     {
       if (pgr_commit (n->p, &auto_txn, &n->e))
@@ -908,6 +1131,164 @@ failed:
   return n->e.cause_code;
 }
 
+nsfslite_view *
+nsfslite_view_open (nsfslite *n, uint64_t id, size_t bofst, size_t nbytes)
+{
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  i_mutex_lock (&n->dblock);
+#endif
+
+  DBG_ASSERT (nsfslite, n);
+  error_reset (&n->e);
+
+  i_log_debug ("nsfslite_view_open: id=%" PRIu64 " bofst=%zu nbytes=%zu\n", id, bofst, nbytes);
+
+  // INIT
+  nsfslite_view *v = clck_alloc_alloc (&n->cursors, &n->e);
+  if (v == NULL)
+    {
+      goto failed;
+    }
+
+  if (rptc_open (&v->c.rptc, id, n->p, &n->e))
+    {
+      goto failed;
+    }
+
+  // SEEK to byte offset - past the end leaves the cursor unseeked (nothing to view)
+  if (rptc_start_seek (&v->c.rptc, bofst, false, &n->e))
+    {
+      goto failed;
+    }
+
+  while (v->c.rptc.state == RPTS_SEEKING)
+    {
+      if (rptc_seeking_execute (&v->c.rptc, &n->e))
+        {
+          goto failed;
+        }
+    }
+
+  if (v->c.rptc.state == RPTS_SEEKED)
+    {
+      rptc_seeked_to_view (&v->c.rptc, nbytes);
+    }
+
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  i_mutex_unlock (&n->dblock);
+#endif
+
+  return v;
+
+failed:
+  if (v)
+    {
+      clck_alloc_free (&n->cursors, v);
+    }
+
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  i_mutex_unlock (&n->dblock);
+#endif
+
+  i_log_warn ("nsfslite_view_open failed: id=%" PRIu64 " code=%d\n", id, n->e.cause_code);
+  return NULL;
+}
+
+int
+nsfslite_view_next (nsfslite *n, nsfslite_view *v, struct nsfslite_span *dest)
+{
+  int ret = 0;
+
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  i_mutex_lock (&n->dblock);
+#endif
+
+  DBG_ASSERT (nsfslite, n);
+  error_reset (&n->e);
+
+  dest->data = NULL;
+  dest->len = 0;
+
+  if (v->c.rptc.state == RPTS_DL_VIEWING)
+    {
+      struct rptc_span span;
+      if (rptc_view_execute (&v->c.rptc, &span, &n->e))
+        {
+          ret = n->e.cause_code;
+        }
+      else if (span.len > 0)
+        {
+          dest->data = span.data;
+          dest->len = span.len;
+          i_memcpy (dest->_pin, &span.pg, sizeof (span.pg));
+          ret = 1;
+        }
+    }
+
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  i_mutex_unlock (&n->dblock);
+#endif
+
+  return ret;
+}
+
+int
+nsfslite_span_release (nsfslite *n, struct nsfslite_span *s)
+{
+  if (s->data == NULL)
+    {
+      return SUCCESS;
+    }
+
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  i_mutex_lock (&n->dblock);
+#endif
+
+  error_reset (&n->e);
+
+  struct rptc_span span = { .data = s->data, .len = s->len };
+  i_memcpy (&span.pg, s->_pin, sizeof (span.pg));
+  rptc_span_release (n->p, &span, &n->e);
+
+  s->data = NULL;
+  s->len = 0;
+
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  i_mutex_unlock (&n->dblock);
+#endif
+
+  return n->e.cause_code;
+}
+
+int
+nsfslite_view_close (nsfslite *n, nsfslite_view *v)
+{
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  i_mutex_lock (&n->dblock);
+#endif
+
+  error_reset (&n->e);
+
+  // Stopped before the end
+  if (v->c.rptc.state == RPTS_DL_VIEWING)
+    {
+      rptc_view_to_unseeked (&v->c.rptc, &n->e);
+    }
+
+  if (n->e.cause_code == SUCCESS)
+    {
+      rptc_cleanup (&v->c.rptc, &n->e);
+    }
+
+  clck_alloc_free (&n->cursors, v);
+
+#ifdef ENABLE_GLOBAL_DB_LOCK
+  i_mutex_unlock (&n->dblock);
+#endif
+
+  return n->e.cause_code;
+}
+
 ssize_t
 nsfslite_remove (
     nsfslite *n,
@@ -1013,7 +1394,10 @@ nsfslite_remove (
   // No need to call vpc_update
 
   // COMMIT
-  rptc_leave_transaction (&c->rptc);
+  if (rptc_leave_transaction (&c->rptc, &n->e))
+    {
+      goto failed;
+    }
   if (auto_txn_started)
     {
       if (pgr_commit (n->p, &auto_txn, &n->e))
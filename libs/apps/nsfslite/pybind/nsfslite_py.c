@@ -54,13 +54,20 @@ py_nsfslite_open (PyObject *Py_UNUSED (self), PyObject *args)
 {
   const char *db_path;
   const char *wal_path;
+  Py_ssize_t pool_size = 0;
 
-  if (!PyArg_ParseTuple (args, "ss", &db_path, &wal_path))
+  if (!PyArg_ParseTuple (args, "ss|n", &db_path, &wal_path, &pool_size))
     {
       return NULL;
     }
 
-  nsfslite *handle = nsfslite_open (db_path, wal_path);
+  if (pool_size < 0)
+    {
+      PyErr_SetString (PyExc_ValueError, "pool_size must be non-negative");
+      return NULL;
+    }
+
+  nsfslite *handle = nsfslite_open (db_path, wal_path, (size_t)pool_size);
   if (!handle)
     {
       PyErr_SetString (PyExc_IOError, "Failed to open nsfslite database");
@@ -21,12 +21,47 @@
 
 #include <numstore/intf/types.h>
 
-#define PAGE_SIZE ((p_size)2048)
+/**
+ * Fixed per build - every page layout is sized from it at compile time.
+ * Databases record it in their root node and opening one made with another
+ * page size fails with ERR_CORRUPT before recovery reads the WAL. The WAL
+ * has no page size of its own, so it's only checked through the root
+ */
+#ifndef NS_PAGE_SIZE
+#define NS_PAGE_SIZE 2048
+#endif
+
+#define PAGE_SIZE ((p_size)NS_PAGE_SIZE)
 #define MEMORY_PAGE_LEN ((u32)100)
+#define PGR_MIN_POOL_LEN ((u32)8)
+#define PGR_PARTITION_MIN_LEN ((u32)64)
+#define PGR_MAX_PARTITIONS ((u32)64)
+#define PGR_2Q_HOT_PCT ((u32)75)
+#define PGR_2Q_GHOST_PCT ((u32)50)
+#define PGR_STICKY_PCT ((u32)25)
+#define PGR_STICKY_MAX_PCT ((u32)50)
+#define PGR_READAHEAD_MIN ((u32)4)
+#define PGR_READAHEAD_MAX ((u32)64)
+#define PGR_READAHEAD_STREAMS ((u32)8)
+#define PGR_READAHEAD_THREADS ((u32)2)
+#define PGR_IO_BATCH ((u32)32)
+#define FPGR_DW_PAGES ((u32)256)
+#define PGR_CKPT_WAL_BYTES ((u64)1 << 23)
+#define PGR_CKPT_INTERVAL_MS ((u64)30000)
+#define PGR_REDO_THREADS ((u32)4)
+#define PGR_REDO_QUEUE_LEN ((u32)64)
 #define MAX_VSTR 10000
 #define MAX_TSTR 10000
 #define TXN_TBL_SIZE 512
 #define WAL_BUFFER_CAP 1000000
+#define WAL_APPEND_SLOTS ((u32)64)
+#define WAL_GROUP_COMMIT_WAIT_US ((u64)200)
+#define WAL_DELTA_MAX_RANGES ((u32)32)
+#define WAL_COMPRESS_MIN_SAVING ((u32)64)
+#define WAL_SEGMENT_SIZE ((u64)1 << 24)
+#define WAL_SEGMENT_SPARES ((u32)2)
+#define WAL_READ_BUFFER_CAP ((u32)1 << 18)
+#define WAL_READ_BLOCK ((u32)4096)
 #define MAX_NUPD_SIZE 200
 #define CURSOR_POOL_SIZE 100
 #define CLI_MAX_FILTERS 32
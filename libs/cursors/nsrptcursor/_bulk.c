@@ -0,0 +1,400 @@
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Description:
+ *   Bottom up R+tree construction. Every level keeps two pages in X:
+ *   [cur] being filled and [prev], the last finished page. [prev] only
+ *   moves up into its parent (and is released) once [cur] is full, so at
+ *   the end an underfull last page can still borrow from (or fold into)
+ *   its left neighbor before anything above it is written
+ */
+
+#include <numstore/core/error.h>
+#include <numstore/core/math.h>
+#include <numstore/core/random.h>
+#include <numstore/intf/logging.h>
+#include <numstore/pager.h>
+#include <numstore/pager/data_list.h>
+#include <numstore/pager/inner_node.h>
+#include <numstore/pager/page_delegate.h>
+#include <numstore/pager/page_h.h>
+#include <numstore/pager/rpt_root.h>
+#include <numstore/rptree/rptree_cursor.h>
+#include <numstore/test/page_fixture.h>
+#include <numstore/test/testing.h>
+
+DEFINE_DBG_ASSERT (
+    struct rptree_cursor, rptc_bulk_loading, r,
+    {
+      ASSERT (r->root == PGNO_NULL);
+      ASSERT (r->tx);
+      ASSERT (r->bulker.src);
+      ASSERT (r->bulker.nlevels <= RPTC_BULK_MAX_LEVELS);
+    })
+
+////////////////////////
+/// BULK LOAD
+
+err_t
+rptc_start_bulk (struct rptree_cursor *r, struct cbuffer *src, u32 fill, error *e)
+{
+  DBG_ASSERT (rptc_unseeked, r);
+  ASSERT (r->tx);
+  ASSERT (src);
+
+  if (r->root != PGNO_NULL)
+    {
+      return error_causef (e, ERR_INVALID_ARGUMENT, "Bulk loads need an empty variable");
+    }
+
+  if (fill == 0 || fill > 100)
+    {
+      return error_causef (e, ERR_INVALID_ARGUMENT, "Invalid fill factor: %" PRIu32 "%%", fill);
+    }
+
+  // Non root pages must stay at least half full
+  p_size dl_fill = (p_size)((u64)DL_DATA_SIZE * fill / 100);
+  p_size in_fill = (p_size)((u64)IN_MAX_KEYS * fill / 100);
+
+  r->bulker = (struct rptc_bulk){
+    .src = src,
+    .dl_fill = MAX (dl_fill, DL_DATA_SIZE / 2),
+    .in_fill = MAX (in_fill, IN_MAX_KEYS / 2),
+    .total_written = 0,
+    .dl_prev = page_h_create (),
+    .nlevels = 0,
+  };
+
+  r->state = RPTS_BULK_LOADING;
+
+  DBG_ASSERT (rptc_bulk_loading, r);
+
+  return SUCCESS;
+}
+
+/**
+ * A fresh page linked after [prev] (if there is one)
+ */
+static err_t
+rptc_bulk_new_page (struct rptree_cursor *r, page_h *dest, page_h *prev, enum page_type type, error *e)
+{
+  err_t_wrap (pgr_new (dest, r->pager, r->tx, type, e), e);
+
+  if (type == PG_DATA_LIST)
+    {
+      dl_init_empty (page_h_w (dest));
+    }
+  else
+    {
+      in_init_empty (page_h_w (dest));
+    }
+
+  if (prev->mode != PHM_NONE)
+    {
+      dlgt_link (page_h_w (prev), page_h_w (dest));
+    }
+
+  return SUCCESS;
+}
+
+static err_t rptc_bulk_push (struct rptree_cursor *r, u32 lvl, pgno pg, b_size key, error *e);
+
+/**
+ * [h] is done - write it out and hand it to the level above
+ */
+static err_t
+rptc_bulk_promote (struct rptree_cursor *r, u32 lvl, page_h *h, error *e)
+{
+  pgno pg = page_h_pgno (h);
+  b_size key = dlgt_get_size (page_h_ro (h));
+
+  err_t_wrap (pgr_release (r->pager, h, page_h_type (h), e), e);
+
+  return rptc_bulk_push (r, lvl, pg, key, e);
+}
+
+static err_t
+rptc_bulk_push (struct rptree_cursor *r, u32 lvl, pgno pg, b_size key, error *e)
+{
+  struct rptc_bulk *b = &r->bulker;
+  ASSERT (lvl <= b->nlevels);
+
+  if (lvl == b->nlevels)
+    {
+      if (lvl == RPTC_BULK_MAX_LEVELS)
+        {
+          return error_causef (
+              e, ERR_RPTREE_PAGE_STACK_OVERFLOW,
+              "Bulk load needs more than %d inner levels", RPTC_BULK_MAX_LEVELS);
+        }
+      b->levels[lvl] = (struct rptc_bulk_level){
+        .prev = page_h_create (),
+        .cur = page_h_create (),
+      };
+      b->nlevels++;
+    }
+
+  struct rptc_bulk_level *l = &b->levels[lvl];
+
+  if (l->cur.mode == PHM_NONE)
+    {
+      err_t_wrap (rptc_bulk_new_page (r, &l->cur, &l->prev, PG_INNER_NODE, e), e);
+    }
+
+  in_push_end (page_h_w (&l->cur), key, pg);
+
+  if (in_get_len (page_h_ro (&l->cur)) == b->in_fill)
+    {
+      if (l->prev.mode != PHM_NONE)
+        {
+          err_t_wrap (rptc_bulk_promote (r, lvl + 1, &l->prev, e), e);
+        }
+      l->prev = page_h_xfer_ownership (&l->cur);
+    }
+
+  return SUCCESS;
+}
+
+err_t
+rptc_bulk_execute (struct rptree_cursor *r, error *e)
+{
+  DBG_ASSERT (rptc_bulk_loading, r);
+  ASSERT (r->state == RPTS_BULK_LOADING);
+
+  struct rptc_bulk *b = &r->bulker;
+
+  while (cbuffer_len (b->src) > 0)
+    {
+      // Only start a page once there's something to put in it
+      if (r->cur.mode == PHM_NONE)
+        {
+          err_t_wrap (rptc_bulk_new_page (r, &r->cur, &b->dl_prev, PG_DATA_LIST, e), e);
+        }
+
+      p_size used = dl_used (page_h_ro (&r->cur));
+      p_size next = MIN (b->dl_fill - used, cbuffer_len (b->src));
+
+      dl_append_from_cbuffer (page_h_w (&r->cur), b->src, next);
+      b->total_written += next;
+
+      if (used + next == b->dl_fill)
+        {
+          if (b->dl_prev.mode != PHM_NONE)
+            {
+              err_t_wrap (rptc_bulk_promote (r, 0, &b->dl_prev, e), e);
+            }
+          b->dl_prev = page_h_xfer_ownership (&r->cur);
+        }
+    }
+
+  return SUCCESS;
+}
+
+/**
+ * [prev] is at the fill target - if [cur] came up short, even them out
+ * or fold [cur] into [prev] when there isn't enough for two pages
+ */
+static err_t
+rptc_bulk_settle (struct rptree_cursor *r, page_h *prev, page_h *cur, p_size min, error *e)
+{
+  if (prev->mode == PHM_NONE || cur->mode == PHM_NONE)
+    {
+      return SUCCESS;
+    }
+
+  page *left = page_h_w (prev);
+  page *right = page_h_w (cur);
+
+  p_size k = dlgt_get_len (right);
+  if (k >= min)
+    {
+      return SUCCESS;
+    }
+
+  p_size total = dlgt_get_len (left) + k;
+  if (total >= 2 * min)
+    {
+      dlgt_move_right (left, right, total / 2 - k);
+      return SUCCESS;
+    }
+
+  dlgt_move_left (left, right, k);
+  dlgt_set_next (left, PGNO_NULL);
+
+  return pgr_delete_and_release (r->pager, r->tx, cur, e);
+}
+
+/**
+ * Moves what's left of a level up into [lvl], unless it's a
+ * single page with nothing above it - then it's the root
+ */
+static err_t
+rptc_bulk_finish_level (struct rptree_cursor *r, u32 lvl, page_h *prev, page_h *cur, pgno *root, error *e)
+{
+  bool has_prev = prev->mode != PHM_NONE;
+  bool has_cur = cur->mode != PHM_NONE;
+
+  if (has_prev != has_cur && lvl == r->bulker.nlevels)
+    {
+      page_h *h = has_prev ? prev : cur;
+      *root = page_h_pgno (h);
+      return pgr_release (r->pager, h, page_h_type (h), e);
+    }
+
+  if (has_prev)
+    {
+      err_t_wrap (rptc_bulk_promote (r, lvl, prev, e), e);
+    }
+  if (has_cur)
+    {
+      err_t_wrap (rptc_bulk_promote (r, lvl, cur, e), e);
+    }
+
+  return SUCCESS;
+}
+
+err_t
+rptc_bulk_to_unseeked (struct rptree_cursor *r, error *e)
+{
+  DBG_ASSERT (rptc_bulk_loading, r);
+  ASSERT (r->state == RPTS_BULK_LOADING);
+
+  struct rptc_bulk *b = &r->bulker;
+  pgno root = PGNO_NULL;
+
+  // Data list layer
+  err_t_wrap (rptc_bulk_settle (r, &b->dl_prev, &r->cur, DL_DATA_SIZE / 2, e), e);
+  err_t_wrap (rptc_bulk_finish_level (r, 0, &b->dl_prev, &r->cur, &root, e), e);
+
+  // Each level can add the one above it
+  for (u32 lvl = 0; lvl < b->nlevels; ++lvl)
+    {
+      struct rptc_bulk_level *l = &b->levels[lvl];
+      err_t_wrap (rptc_bulk_settle (r, &l->prev, &l->cur, IN_MAX_KEYS / 2, e), e);
+      err_t_wrap (rptc_bulk_finish_level (r, lvl + 1, &l->prev, &l->cur, &root, e), e);
+    }
+
+  if (root != PGNO_NULL)
+    {
+      err_t_wrap (rptc_set_root (r, root, e), e);
+    }
+
+  i_log_trace ("Bulk loaded %" PRb_size " bytes - root %" PRpgno " with %" PRIu32 " inner levels\n",
+               b->total_written, root, b->nlevels);
+
+  r->total_size = b->total_written;
+  r->lidx = 0;
+  r->stack_state.sp = 0;
+  r->state = RPTS_UNSEEKED;
+
+  DBG_ASSERT (rptc_unseeked, r);
+
+  return SUCCESS;
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, rptc_bulk)
+{
+  struct pgr_fixture f;
+  struct rptree_cursor r;
+  error e = error_create ();
+
+  u32 cap = 600 * DL_DATA_SIZE;
+  u8 *data = i_malloc (cap, 1, &e);
+  u8 *out = i_malloc (cap, 1, &e);
+  u8 stage[3 * DL_DATA_SIZE / 2];
+  test_fail_if_null (data);
+  test_fail_if_null (out);
+  rand_bytes (data, cap);
+
+  struct
+  {
+    u32 len;
+    u32 fill;
+  } cases[] = {
+    { 0, 100 },
+    { 10, 100 },
+    { DL_DATA_SIZE + 1, 100 },          // Last page borrows from the first
+    { DL_DATA_SIZE * 3 / 4 + 1, 70 },   // Too little for two pages - folded into one
+    { 600 * DL_DATA_SIZE, 100 },        // Two inner levels
+    { 600 * DL_DATA_SIZE - 17, 60 },
+  };
+
+  for (u32 c = 0; c < arrlen (cases); ++c)
+    {
+      TEST_CASE ("Bulk load %" PRIu32 " bytes at %" PRIu32 "%%", cases[c].len, cases[c].fill)
+      {
+        test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+
+        struct txn tx;
+        test_err_t_wrap (pgr_begin_txn (&tx, f.p, &f.e), &f.e);
+        test_err_t_wrap (rptc_new (&r, &tx, f.p, &f.e), &f.e);
+        rptc_enter_transaction (&r, &tx);
+
+        // Feed it in uneven pieces
+        struct cbuffer src = cbuffer_create (stage, sizeof (stage));
+        test_err_t_wrap (rptc_start_bulk (&r, &src, cases[c].fill, &f.e), &f.e);
+
+        u32 fed = 0;
+        while (fed < cases[c].len)
+          {
+            u32 next = MIN (cbuffer_avail (&src), cases[c].len - fed);
+            cbuffer_write_expect (data + fed, 1, next, &src);
+            fed += next;
+            test_err_t_wrap (rptc_bulk_execute (&r, &f.e), &f.e);
+          }
+
+        test_err_t_wrap (rptc_bulk_to_unseeked (&r, &f.e), &f.e);
+        test_assert_int_equal (r.state, RPTS_UNSEEKED);
+        test_assert_int_equal (r.total_size, cases[c].len);
+        test_err_t_wrap (rptc_validate (&r, &f.e), &f.e);
+
+        test_err_t_wrap (rptc_leave_transaction (&r, &f.e), &f.e);
+        test_err_t_wrap (pgr_commit (f.p, &tx, &f.e), &f.e);
+
+        // Read it all back through a fresh cursor
+        if (cases[c].len > 0)
+          {
+            struct rptree_cursor rd;
+            test_err_t_wrap (rptc_open (&rd, r.meta_root, f.p, &f.e), &f.e);
+            test_assert_int_equal (rd.total_size, cases[c].len);
+
+            test_err_t_wrap (rptc_start_seek (&rd, 0, false, &f.e), &f.e);
+            while (rd.state == RPTS_SEEKING)
+              {
+                test_err_t_wrap (rptc_seeking_execute (&rd, &f.e), &f.e);
+              }
+
+            struct cbuffer dest = cbuffer_create (out, cap);
+            rptc_seeked_to_read (&rd, &dest, cases[c].len, 1, 1);
+            while (rd.state == RPTS_DL_READING)
+              {
+                test_err_t_wrap (rptc_read_execute (&rd, &f.e), &f.e);
+              }
+
+            test_assert_int_equal (cbuffer_len (&dest), cases[c].len);
+            test_assert_memequal (out, data, cases[c].len);
+            test_err_t_wrap (rptc_cleanup (&rd, &f.e), &f.e);
+          }
+
+        test_err_t_wrap (rptc_cleanup (&r, &f.e), &f.e);
+        test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
+      }
+    }
+
+  i_free (data);
+  i_free (out);
+}
+#endif
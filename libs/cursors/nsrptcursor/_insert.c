@@ -19,6 +19,7 @@
 
 #include <numstore/core/assert.h>
 #include <numstore/core/error.h>
+#include <numstore/core/math.h>
 #include <numstore/core/random.h>
 #include <numstore/intf/logging.h>
 #include <numstore/pager/data_list.h>
@@ -211,3 +212,330 @@ rptc_insert_to_rebalancing_or_unseeked (struct rptree_cursor *r, error *e)
 
   return rptc_rebalance_move_up_stack (r, root, e);
 }
+
+err_t
+rptc_flush_appends (struct rptree_cursor *r, error *e)
+{
+  page_h h = page_h_create ();
+
+  for (u32 i = 0; r->spine.pending > 0 && i < r->spine.len; ++i)
+    {
+      ASSERT (r->tx);
+
+      // Nothing split since, so it's still the last key
+      err_t_wrap_goto (pgr_get_writable (&h, r->tx, PG_INNER_NODE, r->spine.pgs[i], r->pager, e), theend, e);
+      p_size last = in_get_len (page_h_ro (&h)) - 1;
+      in_set_key (page_h_w (&h), last, in_get_key (page_h_ro (&h), last) + r->spine.pending);
+      err_t_wrap_goto (pgr_release (r->pager, &h, PG_INNER_NODE, e), theend, e);
+    }
+
+theend:
+  if (h.mode != PHM_NONE)
+    {
+      pgr_release (r->pager, &h, PG_INNER_NODE, e);
+    }
+
+  // Never reuse a spine that may be half written
+  r->spine.len = 0;
+  r->spine.leaf = PGNO_NULL;
+  r->spine.pending = 0;
+
+  return e->cause_code;
+}
+
+/**
+ * Gives back every page the descent in rptc_start_append pinned
+ */
+static void
+rptc_append_unwind (struct rptree_cursor *r, error *e)
+{
+  if (r->cur.mode != PHM_NONE)
+    {
+      pgr_release (r->pager, &r->cur, PG_DATA_LIST | PG_INNER_NODE, e);
+    }
+  while (r->stack_state.sp > 0)
+    {
+      pgr_release (r->pager, &r->stack_state.stack[--r->stack_state.sp].pg, PG_INNER_NODE, e);
+    }
+}
+
+/**
+ * Writes all of [src] into the last leaf, pinned in [r->cur]
+ */
+static err_t
+rptc_append_to_leaf (struct rptree_cursor *r, struct cbuffer *src, p_size n, error *e)
+{
+  if (pgr_maybe_make_writable (r->pager, r->tx, &r->cur, e))
+    {
+      rptc_append_unwind (r, e);
+      return e->cause_code;
+    }
+  dl_append_from_cbuffer (page_h_w (&r->cur), src, n);
+  err_t_wrap (pgr_release (r->pager, &r->cur, PG_DATA_LIST, e), e);
+
+  i_log_trace ("Appended %" PRp_size " bytes in place\n", n);
+
+  r->spine.pending += n;
+  r->lidx = 0;
+  r->total_size += n;
+
+  DBG_ASSERT (rptc_unseeked, r);
+
+  return SUCCESS;
+}
+
+err_t
+rptc_start_append (struct rptree_cursor *r, struct cbuffer *src, error *e)
+{
+  DBG_ASSERT (rptc_unseeked, r);
+  ASSERT (r->tx);
+  ASSERT (r->root != PGNO_NULL);
+  ASSERT (r->stack_state.sp == 0);
+
+  p_size n = cbuffer_len (src);
+
+  // Straight to the last leaf if the last append left it behind
+  if (r->spine.leaf != PGNO_NULL)
+    {
+      err_t_wrap (pgr_get (&r->cur, PG_DATA_LIST, r->spine.leaf, r->pager, e), e);
+      if (n > 0 && n <= dl_avail (page_h_ro (&r->cur)))
+        {
+          return rptc_append_to_leaf (r, src, n, e);
+        }
+      err_t_wrap (pgr_release (r->pager, &r->cur, PG_DATA_LIST, e), e);
+    }
+
+  // The descent below reads keys - they have to be current
+  err_t_wrap (rptc_flush_appends (r, e), e);
+
+  // The end is always under the last key - no need to choose
+  err_t_wrap (pgr_get (&r->cur, PG_DATA_LIST | PG_INNER_NODE, r->root, r->pager, e), e);
+  while (page_h_type (&r->cur) == PG_INNER_NODE)
+    {
+      if (r->stack_state.sp == arrlen (r->stack_state.stack))
+        {
+          error_causef (e, ERR_RPTREE_PAGE_STACK_OVERFLOW, "Append: Page stack overflow");
+          rptc_append_unwind (r, e);
+          return e->cause_code;
+        }
+
+      p_size last = in_get_len (page_h_ro (&r->cur)) - 1;
+      page_h next = page_h_create ();
+      if (pgr_get (&next, PG_DATA_LIST | PG_INNER_NODE, in_get_leaf (page_h_ro (&r->cur), last), r->pager, e))
+        {
+          rptc_append_unwind (r, e);
+          return e->cause_code;
+        }
+
+      r->stack_state.stack[r->stack_state.sp++] = (struct seek_v){
+        .pg = page_h_xfer_ownership (&r->cur),
+        .lidx = last,
+      };
+      r->cur = page_h_xfer_ownership (&next);
+    }
+
+  r->lidx = dl_used (page_h_ro (&r->cur));
+
+  // Doesn't fit - same place a seek to total_size ends up
+  if (n == 0 || n > dl_avail (page_h_ro (&r->cur)))
+    {
+      r->state = RPTS_SEEKED;
+      DBG_ASSERT (rptc_seeked, r);
+      return SUCCESS;
+    }
+
+  // Remember the spine - appends that follow only touch the leaf
+  ASSERT (arrlen (r->spine.pgs) == arrlen (r->stack_state.stack));
+  r->spine.len = r->stack_state.sp;
+  r->spine.leaf = page_h_pgno (&r->cur);
+  while (r->stack_state.sp > 0)
+    {
+      struct seek_v *v = &r->stack_state.stack[--r->stack_state.sp];
+      r->spine.pgs[r->stack_state.sp] = page_h_pgno (&v->pg);
+      if (pgr_release (r->pager, &v->pg, PG_INNER_NODE, e))
+        {
+          r->spine.len = 0;
+          r->spine.leaf = PGNO_NULL;
+          rptc_append_unwind (r, e);
+          return e->cause_code;
+        }
+    }
+
+  return rptc_append_to_leaf (r, src, n, e);
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, rptc_start_append)
+{
+  struct pgr_fixture f;
+  struct rptree_cursor r;
+  error e = error_create ();
+
+  // Enough for a couple of inner levels
+  u32 cap = 300 * DL_DATA_SIZE;
+  u8 *data = i_malloc (cap, 1, &e);
+  u8 *out = i_malloc (cap, 1, &e);
+  test_fail_if_null (data);
+  test_fail_if_null (out);
+  rand_bytes (data, cap);
+
+  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, f.p, &f.e), &f.e);
+  test_err_t_wrap (rptc_new (&r, &tx, f.p, &f.e), &f.e);
+  rptc_enter_transaction (&r, &tx);
+
+  // Seed it so there's a tree to append to
+  u32 written = 10;
+  struct cbuffer src = cbuffer_create_with (data, written, written);
+  test_err_t_wrap (rptc_start_seek (&r, 0, true, &f.e), &f.e);
+  test_err_t_wrap (rptc_seeked_to_insert (&r, &src, 0, &f.e), &f.e);
+  test_err_t_wrap (rptc_insert_execute (&r, &f.e), &f.e);
+  test_err_t_wrap (rptc_insert_to_rebalancing_or_unseeked (&r, &f.e), &f.e);
+  test_assert_int_equal (r.state, RPTS_UNSEEKED);
+
+  u32 napp = 0;
+  u32 nfallback = 0;
+
+  TEST_CASE ("Append records of mixed sizes")
+  {
+    while (written < cap)
+      {
+        u32 len = MIN (randu32r (1, 300), cap - written);
+
+        // Every so often something bigger than a page
+        if (napp % 97 == 0)
+          {
+            len = MIN (2 * DL_DATA_SIZE + 5, cap - written);
+          }
+
+        src = cbuffer_create_with (data + written, len, len);
+        test_err_t_wrap (rptc_start_append (&r, &src, &f.e), &f.e);
+
+        if (r.state == RPTS_SEEKED)
+          {
+            nfallback++;
+            test_err_t_wrap (rptc_seeked_to_insert (&r, &src, 0, &f.e), &f.e);
+            while (cbuffer_len (&src) > 0)
+              {
+                test_err_t_wrap (rptc_insert_execute (&r, &f.e), &f.e);
+              }
+            test_err_t_wrap (rptc_insert_to_rebalancing_or_unseeked (&r, &f.e), &f.e);
+            while (r.state == RPTS_IN_REBALANCING)
+              {
+                test_err_t_wrap (rptc_rebalance_execute (&r, &f.e), &f.e);
+              }
+          }
+
+        test_assert_int_equal (r.state, RPTS_UNSEEKED);
+        test_assert_int_equal (cbuffer_len (&src), 0);
+
+        written += len;
+        napp++;
+
+        test_assert_int_equal (r.total_size, written);
+      }
+
+    // Most appends never leave the last page
+    test_assert (nfallback < napp / 4);
+    test_err_t_wrap (rptc_flush_appends (&r, &f.e), &f.e);
+    test_err_t_wrap (rptc_validate (&r, &f.e), &f.e);
+  }
+
+  TEST_CASE ("Read it all back")
+  {
+    struct cbuffer dest = cbuffer_create (out, cap);
+    test_err_t_wrap (rptc_start_seek (&r, 0, false, &f.e), &f.e);
+    while (r.state == RPTS_SEEKING)
+      {
+        test_err_t_wrap (rptc_seeking_execute (&r, &f.e), &f.e);
+      }
+    rptc_seeked_to_read (&r, &dest, cap, 1, 1);
+    while (r.state == RPTS_DL_READING)
+      {
+        test_err_t_wrap (rptc_read_execute (&r, &f.e), &f.e);
+      }
+
+    test_assert_int_equal (cbuffer_len (&dest), cap);
+    test_assert_memequal (out, data, cap);
+  }
+
+  TEST_CASE ("Appends to a remembered leaf don't touch the inner nodes")
+  {
+    page_h h = page_h_create ();
+    u32 ncached = 0;
+
+    for (u32 i = 0; i < 64; ++i)
+      {
+        bool cached = r.spine.leaf != PGNO_NULL;
+
+        test_err_t_wrap (pgr_get (&h, PG_INNER_NODE, r.root, f.p, &f.e), &f.e);
+        lsn before = page_get_page_lsn (page_h_ro (&h));
+        test_err_t_wrap (pgr_release (f.p, &h, PG_INNER_NODE, &f.e), &f.e);
+
+        src = cbuffer_create_with (data, 100, 100);
+        test_err_t_wrap (rptc_start_append (&r, &src, &f.e), &f.e);
+        if (r.state == RPTS_SEEKED)
+          {
+            test_err_t_wrap (rptc_seeked_to_insert (&r, &src, 0, &f.e), &f.e);
+            while (cbuffer_len (&src) > 0)
+              {
+                test_err_t_wrap (rptc_insert_execute (&r, &f.e), &f.e);
+              }
+            test_err_t_wrap (rptc_insert_to_rebalancing_or_unseeked (&r, &f.e), &f.e);
+            while (r.state == RPTS_IN_REBALANCING)
+              {
+                test_err_t_wrap (rptc_rebalance_execute (&r, &f.e), &f.e);
+              }
+            continue;
+          }
+
+        if (cached)
+          {
+            ncached++;
+            test_err_t_wrap (pgr_get (&h, PG_INNER_NODE, r.root, f.p, &f.e), &f.e);
+            test_assert (page_get_page_lsn (page_h_ro (&h)) == before);
+            test_err_t_wrap (pgr_release (f.p, &h, PG_INNER_NODE, &f.e), &f.e);
+          }
+      }
+
+    test_assert (ncached > 0);
+
+    // Keys catch up in one pass
+    test_assert (r.spine.pending > 0);
+    test_err_t_wrap (rptc_flush_appends (&r, &f.e), &f.e);
+    test_assert (r.spine.leaf == PGNO_NULL);
+    test_err_t_wrap (rptc_validate (&r, &f.e), &f.e);
+  }
+
+  TEST_CASE ("A failed descent gives back the pages it pinned")
+  {
+    // Point the root's last key somewhere unreadable
+    page_h h = page_h_create ();
+    test_err_t_wrap (pgr_get_writable (&h, &tx, PG_INNER_NODE, r.root, f.p, &f.e), &f.e);
+    p_size last = in_get_len (page_h_ro (&h)) - 1;
+    pgno child = in_get_leaf (page_h_ro (&h), last);
+    in_set_leaf (page_h_w (&h), last, pgr_get_npages (f.p) + 10);
+    test_err_t_wrap (pgr_release (f.p, &h, PG_INNER_NODE, &f.e), &f.e);
+
+    src = cbuffer_create_with (data, 1, 1);
+    test_assert (rptc_start_append (&r, &src, &f.e) != SUCCESS);
+    test_assert_int_equal (r.stack_state.sp, 0);
+    test_assert_int_equal (r.cur.mode, PHM_NONE);
+    f.e.cause_code = SUCCESS;
+
+    test_err_t_wrap (pgr_get_writable (&h, &tx, PG_INNER_NODE, r.root, f.p, &f.e), &f.e);
+    in_set_leaf (page_h_w (&h), last, child);
+    test_err_t_wrap (pgr_release (f.p, &h, PG_INNER_NODE, &f.e), &f.e);
+  }
+
+  test_err_t_wrap (rptc_leave_transaction (&r, &f.e), &f.e);
+  test_err_t_wrap (pgr_commit (f.p, &tx, &f.e), &f.e);
+  test_err_t_wrap (rptc_cleanup (&r, &f.e), &f.e);
+  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
+
+  i_free (data);
+  i_free (out);
+}
+#endif
@@ -148,7 +148,26 @@ rptc_read_execute (struct rptree_cursor *r, error *e)
         {
         case DLREAD_ACTIVE:
           {
-            if (next > 0)
+            // On an element boundary - take every whole element in this page at once
+            if (r->reader.dest && r->reader.bnext == r->reader.bsize)
+              {
+                b_size step = r->reader.stride * r->reader.bsize;
+                b_size maxn = UINT64_MAX;
+                if (r->reader.max_bread > 0)
+                  {
+                    maxn = (r->reader.max_bread - r->reader.total_bread) / r->reader.bsize;
+                  }
+
+                p_size n = dl_gather_into_cbuffer (cur, r->reader.dest, r->lidx, r->reader.bsize, step, maxn);
+                if (n > 0)
+                  {
+                    r->lidx += (n - 1) * step + r->reader.bsize;
+                    r->reader.total_bread += (b_size)n * r->reader.bsize;
+                    r->reader.bnext = 0;
+                  }
+              }
+
+            if (next > 0 && r->reader.bnext > 0)
               {
                 if (r->reader.dest)
                   {
@@ -165,7 +184,6 @@ rptc_read_execute (struct rptree_cursor *r, error *e)
                 r->reader.bnext = (r->reader.stride - 1) * r->reader.bsize;
                 r->reader.state = DLREAD_SKIPPING;
 
-                // TODO - Optimize stride = 1
                 if (r->reader.bnext == 0)
                   {
                     r->reader.bnext = r->reader.bsize;
@@ -259,7 +259,7 @@ rptc_rebalance_move_up_stack (struct rptree_cursor *r, struct root_update root,
 
       // Set state for unseeked
       r->lidx = 0;
-      r->root = root.root;
+      err_t_wrap (rptc_set_root (r, root.root, e), e);
       r->state = RPTS_UNSEEKED;
 
       return SUCCESS;
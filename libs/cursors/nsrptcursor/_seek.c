@@ -102,7 +102,15 @@ rptc_seek_load_choice (struct rptree_cursor *r)
       {
         b_size nleft;
         p_size lidx;
-        in_choose_lidx (&lidx, &nleft, page_h_ro (&r->cur), r->seeker.remaining);
+        const b_size *sums = page_h_in_sums (&r->cur);
+        if (sums)
+          {
+            in_choose_lidx_sums (&lidx, &nleft, sums, in_get_len (page_h_ro (&r->cur)), r->seeker.remaining);
+          }
+        else
+          {
+            in_choose_lidx (&lidx, &nleft, page_h_ro (&r->cur), r->seeker.remaining);
+          }
         r->lidx = lidx;
 
         ASSERT (nleft <= r->seeker.remaining);
@@ -297,6 +305,9 @@ rptc_start_seek (
 {
   DBG_ASSERT (rptc_unseeked, r);
 
+  // Seeks choose by key
+  err_t_wrap (rptc_flush_appends (r, e), e);
+
   if (r->root == PGNO_NULL)
     {
       if (newroot)
@@ -0,0 +1,260 @@
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Description:
+ *   Zero copy reads. Each span takes over the cursor's pin on the page
+ *   it points into, so handing one out costs no copy and no extra pin
+ */
+
+#include <numstore/core/error.h>
+#include <numstore/core/math.h>
+#include <numstore/pager.h>
+#include <numstore/pager/data_list.h>
+#include <numstore/pager/page.h>
+#include <numstore/pager/page_h.h>
+#include <numstore/pager/pager_routines.h>
+#include <numstore/rptree/rptree_cursor.h>
+#include <numstore/test/page_fixture.h>
+#include <numstore/test/testing.h>
+
+DEFINE_DBG_ASSERT (
+    struct rptree_cursor, rptc_viewing, r,
+    {
+      ASSERT (r->root != PGNO_NULL);
+      ASSERT (r->cur.mode != PHM_NONE);
+      ASSERT (r->viewer.max_bview == 0 || r->viewer.total_bviewed < r->viewer.max_bview);
+    })
+
+////////////////////////
+/// VIEW
+
+void
+rptc_seeked_to_view (struct rptree_cursor *r, b_size max_nbytes)
+{
+  DBG_ASSERT (rptc_seeked, r);
+
+  r->viewer = (struct rptc_view){
+    .total_bviewed = 0,
+    .max_bview = max_nbytes,
+  };
+
+  r->state = RPTS_DL_VIEWING;
+
+  DBG_ASSERT (rptc_viewing, r);
+}
+
+static err_t
+rptc_view_done (struct rptree_cursor *r, error *e)
+{
+  ASSERT (r->cur.mode == PHM_NONE);
+
+  r->state = RPTS_PERMISSIVE;
+  err_t_wrap (rptc_pop_all (r, e), e);
+
+  r->state = RPTS_UNSEEKED;
+  r->lidx = 0;
+
+  return SUCCESS;
+}
+
+err_t
+rptc_view_execute (struct rptree_cursor *r, struct rptc_span *dest, error *e)
+{
+  DBG_ASSERT (rptc_viewing, r);
+  ASSERT (r->state == RPTS_DL_VIEWING);
+
+  while (true)
+    {
+      const page *cur = page_h_ro (&r->cur);
+
+      p_size len = dl_used (cur) - r->lidx;
+      if (r->viewer.max_bview > 0)
+        {
+          len = MIN (len, r->viewer.max_bview - r->viewer.total_bviewed);
+        }
+
+      bool last = r->viewer.max_bview > 0
+                  && r->viewer.total_bviewed + len == r->viewer.max_bview;
+
+      // Get the next page before this one is handed away
+      page_h next = page_h_create ();
+      if (!last)
+        {
+          err_t_wrap (pgr_dlgt_get_next (&r->cur, &next, r->tx, r->pager, e), e);
+        }
+
+      // Seeked to the very end of a page - nothing to hand out here
+      if (len == 0)
+        {
+          err_t_wrap (pgr_release (r->pager, &r->cur, PG_DATA_LIST, e), e);
+          r->lidx = 0;
+
+          if (next.mode == PHM_NONE)
+            {
+              *dest = (struct rptc_span){ .data = NULL, .len = 0, .pg = page_h_create () };
+              return rptc_view_done (r, e);
+            }
+
+          r->cur = page_h_xfer_ownership (&next);
+          continue;
+        }
+
+      *dest = (struct rptc_span){
+        .data = (const u8 *)dl_get_data (cur) + r->lidx,
+        .len = len,
+        .pg = page_h_xfer_ownership (&r->cur),
+      };
+      r->viewer.total_bviewed += len;
+      r->lidx = 0;
+
+      if (next.mode == PHM_NONE)
+        {
+          return rptc_view_done (r, e);
+        }
+
+      r->cur = page_h_xfer_ownership (&next);
+
+      return SUCCESS;
+    }
+}
+
+err_t
+rptc_span_release (struct pager *p, struct rptc_span *s, error *e)
+{
+  if (s->pg.mode == PHM_NONE)
+    {
+      return SUCCESS;
+    }
+
+  s->data = NULL;
+  s->len = 0;
+
+  return pgr_release (p, &s->pg, PG_DATA_LIST, e);
+}
+
+err_t
+rptc_view_to_unseeked (struct rptree_cursor *r, error *e)
+{
+  DBG_ASSERT (rptc_viewing, r);
+  ASSERT (r->state == RPTS_DL_VIEWING);
+
+  err_t_wrap (pgr_release (r->pager, &r->cur, PG_DATA_LIST, e), e);
+
+  return rptc_view_done (r, e);
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, rptc_view)
+{
+  struct pgr_fixture f;
+  struct rptree_cursor r;
+  u32 data[DL_DATA_SIZE];
+  arr_range (data);
+  struct cbuffer src;
+
+  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, f.p, &f.e), &f.e);
+  test_err_t_wrap (rptc_new (&r, &tx, f.p, &f.e), &f.e);
+
+  // A few pages of data
+  rptc_enter_transaction (&r, &tx);
+  test_err_t_wrap (rptc_start_seek (&r, 0, true, &f.e), &f.e);
+  src = cbuffer_create_full_from (data);
+  test_err_t_wrap (rptc_seeked_to_insert (&r, &src, 0, &f.e), &f.e);
+  while (cbuffer_len (&src) > 0)
+    {
+      test_err_t_wrap (rptc_insert_execute (&r, &f.e), &f.e);
+    }
+  test_err_t_wrap (rptc_insert_to_rebalancing_or_unseeked (&r, &f.e), &f.e);
+  while (r.state == RPTS_IN_REBALANCING)
+    {
+      test_err_t_wrap (rptc_rebalance_execute (&r, &f.e), &f.e);
+    }
+  test_err_t_wrap (rptc_leave_transaction (&r, &f.e), &f.e);
+  test_err_t_wrap (pgr_commit (f.p, &tx, &f.e), &f.e);
+
+  const u8 *expected = (const u8 *)data;
+
+  struct
+  {
+    b_size ofst;
+    b_size max;
+    b_size expect;
+  } cases[] = {
+    { 0, 0, sizeof (data) },
+    { 13, 0, sizeof (data) - 13 },
+    { 13, 5000, 5000 },
+    { DL_DATA_SIZE, 1, 1 },
+  };
+
+  for (u32 c = 0; c < arrlen (cases); ++c)
+    {
+      TEST_CASE ("View from %" PRb_size " max %" PRb_size, cases[c].ofst, cases[c].max)
+      {
+        struct rptc_span spans[64];
+        u32 nspans = 0;
+
+        test_err_t_wrap (rptc_start_seek (&r, cases[c].ofst, false, &f.e), &f.e);
+        while (r.state == RPTS_SEEKING)
+          {
+            test_err_t_wrap (rptc_seeking_execute (&r, &f.e), &f.e);
+          }
+        rptc_seeked_to_view (&r, cases[c].max);
+
+        // Hold every span at once - they all stay valid until released
+        while (r.state == RPTS_DL_VIEWING)
+          {
+            test_assert (nspans < arrlen (spans));
+            test_err_t_wrap (rptc_view_execute (&r, &spans[nspans++], &f.e), &f.e);
+          }
+        test_assert_int_equal (r.state, RPTS_UNSEEKED);
+
+        b_size total = 0;
+        for (u32 i = 0; i < nspans; ++i)
+          {
+            test_assert_memequal (spans[i].data, expected + cases[c].ofst + total, spans[i].len);
+            total += spans[i].len;
+          }
+        test_assert_int_equal (total, cases[c].expect);
+
+        for (u32 i = 0; i < nspans; ++i)
+          {
+            test_err_t_wrap (rptc_span_release (f.p, &spans[i], &f.e), &f.e);
+          }
+      }
+    }
+
+  TEST_CASE ("Stop early")
+  {
+    struct rptc_span span;
+
+    test_err_t_wrap (rptc_start_seek (&r, 0, false, &f.e), &f.e);
+    while (r.state == RPTS_SEEKING)
+      {
+        test_err_t_wrap (rptc_seeking_execute (&r, &f.e), &f.e);
+      }
+    rptc_seeked_to_view (&r, 0);
+    test_err_t_wrap (rptc_view_execute (&r, &span, &f.e), &f.e);
+    test_assert_int_equal (r.state, RPTS_DL_VIEWING);
+    test_err_t_wrap (rptc_view_to_unseeked (&r, &f.e), &f.e);
+    test_err_t_wrap (rptc_span_release (f.p, &span, &f.e), &f.e);
+  }
+
+  test_err_t_wrap (rptc_cleanup (&r, &f.e), &f.e);
+  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
+}
+#endif
@@ -17,8 +17,11 @@
  *   TODO: Add description for _write.c
  */
 
+#include <numstore/core/math.h>
 #include <numstore/pager/pager_routines.h>
 #include <numstore/rptree/rptree_cursor.h>
+#include <numstore/test/page_fixture.h>
+#include <numstore/test/testing.h>
 
 DEFINE_DBG_ASSERT (
     struct rptree_cursor, rptc_writing, r,
@@ -52,18 +55,39 @@ rptc_seeked_to_write (struct rptree_cursor *r, struct cbuffer *src, t_size bsize
   DBG_ASSERT (rptc_writing, r);
 }
 
+/**
+ * Nothing left to place - a trailing skip doesn't touch any bytes
+ */
+static inline bool
+rptc_write_drained (const struct rptree_cursor *r)
+{
+  if (cbuffer_len (r->writer.src) > 0)
+    {
+      return false;
+    }
+  return r->writer.state == DLWRITE_SKIPPING || r->writer.bnext == r->writer.bsize;
+}
+
 err_t
 rptc_write_execute (struct rptree_cursor *r, error *e)
 {
   DBG_ASSERT (rptc_writing, r);
   ASSERT (r->state == RPTS_DL_WRITING);
 
-  page *cur = page_h_w (&r->cur);
+  if (rptc_write_drained (r))
+    {
+      return rptc_write_to_unseeked (r, e);
+    }
 
-  p_size limit = dl_used (cur);
+  p_size limit = dl_used (page_h_ro (&r->cur));
 
   while (r->lidx < limit)
     {
+      if (rptc_write_drained (r))
+        {
+          return rptc_write_to_unseeked (r, e);
+        }
+
       // Get the next total we should write on
       p_size page_avail = limit - r->lidx; // Available in this page
       p_size next = MIN (page_avail, r->writer.bnext);
@@ -72,11 +96,38 @@ rptc_write_execute (struct rptree_cursor *r, error *e)
         {
         case DLWRITE_ACTIVE:
           {
-            p_size written = dl_write_from_buffer (cur, r->writer.src, r->lidx, next);
+            // Block on backpressure part way through an element
+            if (cbuffer_len (r->writer.src) == 0)
+              {
+                return SUCCESS;
+              }
+
+            // Seeks and skips hand pages over read only - only copy the ones we write
+            err_t_wrap (pgr_maybe_make_writable (r->pager, r->tx, &r->cur, e), e);
+            page *cur = page_h_w (&r->cur);
+
+            // On an element boundary - place every whole element in this page at once
+            if (r->writer.bnext == r->writer.bsize)
+              {
+                p_size n = dl_scatter_from_cbuffer (
+                    cur, r->writer.src, r->lidx, r->writer.bsize,
+                    r->writer.bstrlen, UINT64_MAX);
+                if (n > 0)
+                  {
+                    r->lidx += (n - 1) * r->writer.bstrlen + r->writer.bsize;
+                    r->writer.total_written += (b_size)n * r->writer.bsize;
+                    r->writer.bnext = 0;
+                  }
+              }
 
-            r->lidx += written;
-            r->writer.total_written += written;
-            r->writer.bnext -= written;
+            if (r->writer.bnext > 0)
+              {
+                p_size written = dl_write_from_buffer (cur, r->writer.src, r->lidx, next);
+
+                r->lidx += written;
+                r->writer.total_written += written;
+                r->writer.bnext -= written;
+              }
 
             if (r->writer.bnext == 0)
               {
@@ -88,10 +139,8 @@ rptc_write_execute (struct rptree_cursor *r, error *e)
           }
         case DLWRITE_SKIPPING:
           {
-            p_size written = dl_write (cur, NULL, r->lidx, next);
-
-            r->lidx += written;
-            r->writer.bnext -= written;
+            r->lidx += next;
+            r->writer.bnext -= next;
 
             if (r->writer.bnext == 0)
               {
@@ -108,10 +157,14 @@ rptc_write_execute (struct rptree_cursor *r, error *e)
         }
     }
 
+  // Drained right at the end of the page - don't load the next one
+  if (rptc_write_drained (r))
+    {
+      return rptc_write_to_unseeked (r, e);
+    }
+
   // EOF
-  bool done_this_page = r->lidx == dl_used (page_h_ro (&r->cur));
-  bool last_page = dlgt_get_next (page_h_ro (&r->cur)) == PGNO_NULL;
-  if (done_this_page && last_page)
+  if (dlgt_get_next (page_h_ro (&r->cur)) == PGNO_NULL)
     {
       if (r->writer.total_written % r->writer.bsize != 0)
         {
@@ -124,7 +177,9 @@ rptc_write_execute (struct rptree_cursor *r, error *e)
       return rptc_write_to_unseeked (r, e);
     }
 
-  err_t_wrap (pgr_dlgt_advance_next (&r->cur, r->tx, r->pager, e), e);
+  // Next page comes in read only until something is written to it
+  err_t_wrap (pgr_dlgt_advance_next (&r->cur, NULL, r->pager, e), e);
+  r->lidx = 0;
 
   return SUCCESS;
 }
@@ -148,3 +203,156 @@ rptc_write_to_unseeked (struct rptree_cursor *r, error *e)
 
   return SUCCESS;
 }
+
+#ifndef NTEST
+/**
+ * Writes [nelem] elements of [src] at [ofst] and runs the write to the end
+ */
+static err_t
+rptc_write_test_run (struct rptree_cursor *r, b_size ofst, const u8 *src, t_size bsize, u32 stride, u32 nelem, error *e)
+{
+  err_t_wrap (rptc_start_seek (r, ofst, false, e), e);
+  while (r->state == RPTS_SEEKING)
+    {
+      err_t_wrap (rptc_seeking_execute (r, e), e);
+    }
+
+  struct cbuffer buf = cbuffer_create_with ((void *)src, bsize * nelem, bsize * nelem);
+  rptc_seeked_to_write (r, &buf, bsize, stride);
+  while (r->state == RPTS_DL_WRITING)
+    {
+      err_t_wrap (rptc_write_execute (r, e), e);
+    }
+
+  return SUCCESS;
+}
+
+TEST (TT_UNIT, rptc_write)
+{
+  struct pgr_fixture f;
+  struct rptree_cursor r;
+  u8 shadow[3 * DL_DATA_SIZE];
+  u8 src[64 * 4];
+  u8 out[sizeof (shadow)];
+
+  for (u32 i = 0; i < sizeof (shadow); ++i)
+    {
+      shadow[i] = (u8)i;
+    }
+  for (u32 i = 0; i < sizeof (src); ++i)
+    {
+      src[i] = (u8)(0xA0 + i);
+    }
+
+  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, f.p, &f.e), &f.e);
+  test_err_t_wrap (rptc_new (&r, &tx, f.p, &f.e), &f.e);
+  rptc_enter_transaction (&r, &tx);
+
+  // A few pages to write over
+  struct cbuffer ins = cbuffer_create_full_from (shadow);
+  test_err_t_wrap (rptc_start_seek (&r, 0, true, &f.e), &f.e);
+  test_err_t_wrap (rptc_seeked_to_insert (&r, &ins, 0, &f.e), &f.e);
+  while (cbuffer_len (&ins) > 0)
+    {
+      test_err_t_wrap (rptc_insert_execute (&r, &f.e), &f.e);
+    }
+  test_err_t_wrap (rptc_insert_to_rebalancing_or_unseeked (&r, &f.e), &f.e);
+  while (r.state == RPTS_IN_REBALANCING)
+    {
+      test_err_t_wrap (rptc_rebalance_execute (&r, &f.e), &f.e);
+    }
+
+  // Where the first page ends and the second one starts
+  struct rptc_span span;
+  test_err_t_wrap (rptc_start_seek (&r, 0, false, &f.e), &f.e);
+  while (r.state == RPTS_SEEKING)
+    {
+      test_err_t_wrap (rptc_seeking_execute (&r, &f.e), &f.e);
+    }
+  rptc_seeked_to_view (&r, 0);
+  test_err_t_wrap (rptc_view_execute (&r, &span, &f.e), &f.e);
+  test_err_t_wrap (rptc_view_to_unseeked (&r, &f.e), &f.e);
+  p_size boundary = span.len;
+  pgno second = dlgt_get_next (page_h_ro (&span.pg));
+  test_assert (second != PGNO_NULL);
+  test_err_t_wrap (rptc_span_release (f.p, &span, &f.e), &f.e);
+
+  struct
+  {
+    t_size bsize;
+    u32 stride;
+    u32 nelem;
+    p_size back; // Start this far before the page boundary
+  } cases[] = {
+    { 3, 5, 10, 2 },  // First element straddles the boundary
+    { 3, 5, 10, 7 },  // A skip straddles the boundary
+    { 4, 3, 20, 21 }, // A few elements, then a straddling one
+    { 8, 1, 30, 13 }, // Contiguous across the boundary
+    { 1, 7, 64, 5 },
+  };
+
+  for (u32 c = 0; c < arrlen (cases); ++c)
+    {
+      TEST_CASE ("Stride %" PRIu32 " of %" PRt_size " byte elements %" PRp_size " before a page boundary",
+                 cases[c].stride, cases[c].bsize, cases[c].back)
+      {
+        b_size ofst = boundary - cases[c].back;
+        test_err_t_wrap (rptc_write_test_run (&r, ofst, src, cases[c].bsize, cases[c].stride, cases[c].nelem, &f.e), &f.e);
+        test_assert_int_equal (r.state, RPTS_UNSEEKED);
+        test_assert_int_equal (r.writer.total_written, cases[c].bsize * cases[c].nelem);
+
+        for (u32 i = 0; i < cases[c].nelem; ++i)
+          {
+            i_memcpy (shadow + ofst + (b_size)i * cases[c].stride * cases[c].bsize,
+                      src + i * cases[c].bsize, cases[c].bsize);
+          }
+
+        struct cbuffer dest = cbuffer_create (out, sizeof (out));
+        test_err_t_wrap (rptc_start_seek (&r, 0, false, &f.e), &f.e);
+        while (r.state == RPTS_SEEKING)
+          {
+            test_err_t_wrap (rptc_seeking_execute (&r, &f.e), &f.e);
+          }
+        rptc_seeked_to_read (&r, &dest, sizeof (out), 1, 1);
+        while (r.state == RPTS_DL_READING)
+          {
+            test_err_t_wrap (rptc_read_execute (&r, &f.e), &f.e);
+          }
+        test_assert_memequal (out, shadow, sizeof (shadow));
+      }
+    }
+
+  TEST_CASE ("Source drains exactly at the end of a page")
+  {
+    page_h h = page_h_create ();
+    test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, second, f.p, &f.e), &f.e);
+    lsn before = page_get_page_lsn (page_h_ro (&h));
+    test_err_t_wrap (pgr_release (f.p, &h, PG_DATA_LIST, &f.e), &f.e);
+
+    // One execute places both elements and finishes without loading the next page
+    test_err_t_wrap (rptc_start_seek (&r, boundary - 8, false, &f.e), &f.e);
+    while (r.state == RPTS_SEEKING)
+      {
+        test_err_t_wrap (rptc_seeking_execute (&r, &f.e), &f.e);
+      }
+    struct cbuffer buf = cbuffer_create_with (src, 8, 8);
+    rptc_seeked_to_write (&r, &buf, 4, 1);
+    test_err_t_wrap (rptc_write_execute (&r, &f.e), &f.e);
+    test_assert_int_equal (r.state, RPTS_UNSEEKED);
+    test_assert_int_equal (r.writer.total_written, 8);
+
+    // The second page was never saved
+    test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, second, f.p, &f.e), &f.e);
+    test_assert_int_equal (page_get_page_lsn (page_h_ro (&h)), before);
+    test_err_t_wrap (pgr_release (f.p, &h, PG_DATA_LIST, &f.e), &f.e);
+  }
+
+  test_err_t_wrap (rptc_leave_transaction (&r, &f.e), &f.e);
+  test_err_t_wrap (pgr_commit (f.p, &tx, &f.e), &f.e);
+  test_err_t_wrap (rptc_cleanup (&r, &f.e), &f.e);
+  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
+}
+#endif
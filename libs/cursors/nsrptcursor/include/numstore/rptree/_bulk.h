@@ -0,0 +1,59 @@
+#pragma once
+
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Description:
+ *   Bulk loading - builds a whole R+tree bottom up into an empty
+ *   variable. Data list pages are filled to a target fill factor and
+ *   each inner level is built as the level below it finishes pages, so
+ *   every new page is written (and logged) exactly once
+ */
+
+#include <numstore/core/cbuffer.h>
+#include <numstore/pager/page_h.h>
+
+struct rptree_cursor;
+
+#define RPTC_BULK_MAX_LEVELS 20
+
+struct rptc_bulk_level
+{
+  page_h prev; // Finished and linked to [cur] - not in the level above yet
+  page_h cur;  // Being filled
+};
+
+struct rptc_bulk
+{
+  struct cbuffer *src;
+  p_size dl_fill; // Target bytes per data list page
+  p_size in_fill; // Target keys per inner node
+  b_size total_written;
+
+  // [r->cur] is the data list page being filled
+  page_h dl_prev;
+
+  struct rptc_bulk_level levels[RPTC_BULK_MAX_LEVELS];
+  u32 nlevels;
+};
+
+// UNSEEKED (empty variable) -> BULK LOADING - [fill] is a percent
+err_t rptc_start_bulk (struct rptree_cursor *r, struct cbuffer *src, u32 fill, error *e);
+
+// Drains [src] - refill it and call again for more
+err_t rptc_bulk_execute (struct rptree_cursor *r, error *e);
+
+// Finishes every level and installs the root
+err_t rptc_bulk_to_unseeked (struct rptree_cursor *r, error *e);
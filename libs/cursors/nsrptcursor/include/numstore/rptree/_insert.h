@@ -47,4 +47,22 @@ err_t rptc_seeked_to_insert (
 
 err_t rptc_insert_execute (struct rptree_cursor *r, error *e);
 
+/**
+ * Appends [src] at total_size. If it all fits in the last data list page
+ * it's written there and nothing else - the right spine is remembered and
+ * its last keys catch up in one pass when the appends stop (see
+ * rptc_flush_appends). Otherwise the cursor is left seeked at the end for
+ * a regular insert
+ *
+ * UNSEEKED -> UNSEEKED | SEEKED
+ */
+err_t rptc_start_append (struct rptree_cursor *r, struct cbuffer *src, error *e);
+
+/**
+ * Adds the bytes appended in place to the last key of each inner node on
+ * the right spine and forgets the spine. Anything that reads keys or
+ * changes the tree's shape calls this first
+ */
+err_t rptc_flush_appends (struct rptree_cursor *r, error *e);
+
 err_t rptc_insert_to_rebalancing_or_unseeked (struct rptree_cursor *r, error *e);
@@ -0,0 +1,54 @@
+#pragma once
+
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Description:
+ *   Zero copy reads - hands out spans that point straight into pinned
+ *   data_list frames
+ */
+
+#include <numstore/pager/page_h.h>
+
+struct rptree_cursor;
+struct pager;
+
+/**
+ * [data, data + len) lives in the buffer pool. The frame stays pinned
+ * (and [data] stays valid) until rptc_span_release - release spans
+ * before writing to the same variable
+ */
+struct rptc_span
+{
+  const u8 *data;
+  p_size len;
+  page_h pg;
+};
+
+struct rptc_view
+{
+  b_size total_bviewed;
+  b_size max_bview; // 0 for the rest of the variable
+};
+
+// Hands out the next span - moves to UNSEEKED after the last one
+err_t rptc_view_execute (struct rptree_cursor *r, struct rptc_span *dest, error *e);
+err_t rptc_span_release (struct pager *p, struct rptc_span *s, error *e);
+
+// SEEKED -> VIEWING
+void rptc_seeked_to_view (struct rptree_cursor *r, b_size max_nbytes);
+
+// VIEWING -> UNSEEKED (stop early)
+err_t rptc_view_to_unseeked (struct rptree_cursor *r, error *e);
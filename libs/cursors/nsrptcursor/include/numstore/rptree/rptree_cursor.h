@@ -23,11 +23,13 @@
 #include <numstore/core/latch.h>
 #include <numstore/pager.h>
 #include <numstore/pager/inner_node.h>
+#include <numstore/rptree/_bulk.h>
 #include <numstore/rptree/_insert.h>
 #include <numstore/rptree/_read.h>
 #include <numstore/rptree/_rebalance.h>
 #include <numstore/rptree/_remove.h>
 #include <numstore/rptree/_seek.h>
+#include <numstore/rptree/_view.h>
 #include <numstore/rptree/_write.h>
 
 struct rptree_cursor
@@ -42,6 +44,8 @@ struct rptree_cursor
     RPTS_IN_REBALANCING,
     RPTS_DL_READING,
     RPTS_DL_WRITING,
+    RPTS_DL_VIEWING,
+    RPTS_BULK_LOADING,
     RPTS_PERMISSIVE,
   } state;
 
@@ -65,6 +69,15 @@ struct rptree_cursor
     u32 sp;
   } stack_state;
 
+  // Right spine left behind by in place appends - their keys lag by [pending]
+  struct
+  {
+    pgno pgs[20]; // Inner nodes from the root down
+    u32 len;
+    pgno leaf;      // Last leaf, PGNO_NULL if nothing is cached
+    b_size pending; // Bytes appended since the keys were last written
+  } spine;
+
   ////////////////////////////////////////////////////////////
   // /
   /// Sub States
@@ -75,6 +88,8 @@ struct rptree_cursor
     struct rptc_insert inserter;
     struct rptc_read reader;
     struct rptc_write writer;
+    struct rptc_view viewer;
+    struct rptc_bulk bulker;
     struct rptc_rebalance rebalancer;
   };
 };
@@ -95,6 +110,7 @@ DEFINE_DBG_ASSERT (
 
 // State Utils
 err_t rptc_pop_all (struct rptree_cursor *r, error *e);
+err_t rptc_set_root (struct rptree_cursor *r, pgno root, error *e);
 err_t rptc_load_new_root (struct rptree_cursor *r, error *e);
 
 err_t rptc_balance_and_release (
@@ -116,4 +132,4 @@ err_t rptc_validate (struct rptree_cursor *r, error *e);
 
 // Transactions
 void rptc_enter_transaction (struct rptree_cursor *r, struct txn *tx);
-void rptc_leave_transaction (struct rptree_cursor *r);
+err_t rptc_leave_transaction (struct rptree_cursor *r, error *e); // Writes out keys appends left behind
@@ -21,6 +21,7 @@
 
 #include <numstore/core/assert.h>
 #include <numstore/core/error.h>
+#include <numstore/core/math.h>
 #include <numstore/intf/logging.h>
 #include <numstore/intf/types.h>
 #include <numstore/pager.h>
@@ -42,12 +43,91 @@
 #undef KTYPE
 #undef SUFFIX
 
-static inline err_t
+err_t
 rptc_set_root (struct rptree_cursor *r, pgno root, error *e)
 {
+  ASSERT (r->tx);
+
+  // Only touch the meta root if it actually moved
+  page_h dest = page_h_create ();
+  err_t_wrap (pgr_get (&dest, PG_RPT_ROOT, r->meta_root, r->pager, e), e);
+
+  if (rr_get_root (page_h_ro (&dest)) != root)
+    {
+      err_t_wrap (pgr_maybe_make_writable (r->pager, r->tx, &dest, e), e);
+      rr_set_root (page_h_w (&dest), root);
+    }
+
+  err_t_wrap (pgr_release (r->pager, &dest, PG_RPT_ROOT, e), e);
+
+  r->root = root;
+
   return SUCCESS;
 }
 
+#ifndef NTEST
+TEST (TT_UNIT, rptc_set_root)
+{
+  struct pgr_fixture f;
+  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, f.p, &f.e), &f.e);
+
+  struct rptree_cursor r;
+  struct rptree_cursor rd;
+  test_err_t_wrap (rptc_new (&r, &tx, f.p, &f.e), &f.e);
+  rptc_enter_transaction (&r, &tx);
+
+  TEST_CASE ("A single data list root survives a reopen")
+  {
+    u8 data[10];
+    arr_range (data);
+    struct cbuffer src = cbuffer_create_full_from (data);
+
+    test_err_t_wrap (rptc_start_seek (&r, 0, true, &f.e), &f.e);
+    test_err_t_wrap (rptc_seeked_to_insert (&r, &src, 0, &f.e), &f.e);
+    test_err_t_wrap (rptc_insert_execute (&r, &f.e), &f.e);
+    test_err_t_wrap (rptc_insert_to_rebalancing_or_unseeked (&r, &f.e), &f.e);
+    test_assert_int_equal (r.state, RPTS_UNSEEKED);
+
+    test_err_t_wrap (rptc_open (&rd, r.meta_root, f.p, &f.e), &f.e);
+    test_assert (rd.root != PGNO_NULL);
+    test_assert_int_equal (rd.root, r.root);
+    test_assert_int_equal (rd.total_size, sizeof (data));
+    test_err_t_wrap (rptc_cleanup (&rd, &f.e), &f.e);
+  }
+
+  TEST_CASE ("Setting the same root doesn't touch the meta root")
+  {
+    page_h h = page_h_create ();
+    test_err_t_wrap (pgr_get (&h, PG_RPT_ROOT, r.meta_root, f.p, &f.e), &f.e);
+    lsn before = page_get_page_lsn (page_h_ro (&h));
+    test_err_t_wrap (pgr_release (f.p, &h, PG_RPT_ROOT, &f.e), &f.e);
+
+    test_err_t_wrap (rptc_set_root (&r, r.root, &f.e), &f.e);
+
+    test_err_t_wrap (pgr_get (&h, PG_RPT_ROOT, r.meta_root, f.p, &f.e), &f.e);
+    test_assert_int_equal (page_get_page_lsn (page_h_ro (&h)), before);
+    test_err_t_wrap (pgr_release (f.p, &h, PG_RPT_ROOT, &f.e), &f.e);
+  }
+
+  TEST_CASE ("Clearing the root empties the variable")
+  {
+    test_err_t_wrap (rptc_set_root (&r, PGNO_NULL, &f.e), &f.e);
+    test_err_t_wrap (rptc_open (&rd, r.meta_root, f.p, &f.e), &f.e);
+    test_assert (rd.root == PGNO_NULL);
+    test_assert_int_equal (rd.total_size, 0);
+    test_err_t_wrap (rptc_cleanup (&rd, &f.e), &f.e);
+  }
+
+  test_err_t_wrap (rptc_leave_transaction (&r, &f.e), &f.e);
+  test_err_t_wrap (pgr_commit (f.p, &tx, &f.e), &f.e);
+  test_err_t_wrap (rptc_cleanup (&r, &f.e), &f.e);
+  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
+}
+#endif
+
 err_t
 rptc_load_new_root (struct rptree_cursor *r, error *e)
 {
@@ -60,16 +140,11 @@ rptc_load_new_root (struct rptree_cursor *r, error *e)
 
   ASSERT (r->cur.mode == PHM_NONE);
 
-  // Update meta root root
-  page_h dest = page_h_create ();
-  err_t_wrap (pgr_get_writable (&dest, r->tx, PG_RPT_ROOT, r->meta_root, r->pager, e), e);
-  rr_set_root (page_h_w (&dest), page_h_pgno (&root));
-  err_t_wrap (pgr_release (r->pager, &dest, PG_RPT_ROOT, e), e);
+  err_t_wrap (rptc_set_root (r, page_h_pgno (&root), e), e);
 
-  r->root = page_h_pgno (&root);
   r->cur = page_h_xfer_ownership (&root);
   r->lidx = 0;
-  i_log_trace ("Created new layer with new root %" PRpgno "\n", page_h_pgno (&root));
+  i_log_trace ("Created new layer with new root %" PRpgno "\n", page_h_pgno (&r->cur));
 
   return SUCCESS;
 }
@@ -733,16 +808,21 @@ rptc_enter_transaction (struct rptree_cursor *r, struct txn *tx)
   latch_unlock (&r->latch);
 }
 
-void
-rptc_leave_transaction (struct rptree_cursor *r)
+err_t
+rptc_leave_transaction (struct rptree_cursor *r, error *e)
 {
   latch_lock (&r->latch);
 
   DBG_ASSERT (rptc_unseeked, r);
   ASSERT (r->tx);
+
+  // Keys have to be right before the transaction can commit
+  err_t ret = rptc_flush_appends (r, e);
   r->tx = NULL;
 
   latch_unlock (&r->latch);
+
+  return ret;
 }
 
 err_t
@@ -754,6 +834,9 @@ rptc_open (struct rptree_cursor *r, pgno root, struct pager *p, error *e)
   r->cur = page_h_create ();
   r->lidx = 0;
   r->stack_state.sp = 0;
+  r->spine.len = 0;
+  r->spine.leaf = PGNO_NULL;
+  r->spine.pending = 0;
   r->state = RPTS_UNSEEKED;
   latch_init (&r->latch);
 
@@ -793,8 +876,12 @@ rptc_new (struct rptree_cursor *r, struct txn *tx, struct pager *p, error *e)
   r->tx = tx;
   r->cur = page_h_create ();
   r->lidx = 0;
+  r->total_size = 0;
 
   r->stack_state.sp = 0;
+  r->spine.len = 0;
+  r->spine.leaf = PGNO_NULL;
+  r->spine.pending = 0;
 
   r->state = RPTS_UNSEEKED;
   latch_init (&r->latch);
@@ -808,6 +895,7 @@ err_t
 rptc_cleanup (struct rptree_cursor *r, error *e)
 {
   DBG_ASSERT (rptc_unseeked, r);
+  ASSERT (r->spine.pending == 0);
   return e->cause_code;
 }
 
@@ -820,7 +908,13 @@ TEST (TT_UNIT, rptree_cursor_init_teardown)
 
   struct txn tx;
   test_err_t_wrap (pgr_begin_txn (&tx, pf.p, &pf.e), &pf.e);
+
+  // Nothing may leak through from whatever was here before
+  i_memset (&r, 0xFF, sizeof (r));
   test_err_t_wrap (rptc_new (&r, &tx, pf.p, &pf.e), &pf.e);
+  test_assert (r.root == PGNO_NULL);
+  test_assert_int_equal (r.total_size, 0);
+  test_assert_int_equal (r.state, RPTS_UNSEEKED);
   test_err_t_wrap (rptc_cleanup (&r, &pf.e), &pf.e);
 
   test_err_t_wrap (pgr_fixture_teardown (&pf), &pf.e);
@@ -991,6 +1085,7 @@ err_t
 rptc_validate (struct rptree_cursor *r, error *e)
 {
   DBG_ASSERT (rptc_unseeked, r);
+  ASSERT (r->spine.pending == 0);
 
   if (r->root == PGNO_NULL)
     {
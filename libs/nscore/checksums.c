@@ -14,17 +14,27 @@
  * limitations under the License.
  *
  * Description:
- *   TODO: Add description for checksums.c
+ *   CRC32C. Table, slicing-by-8 and SSE4.2 implementations, the fastest
+ *   one the CPU supports is picked on first use
  */
 
 #include <numstore/core/checksums.h>
 
 #include <numstore/core/assert.h>
+#include <numstore/core/macros.h>
+#include <numstore/core/random.h>
 #include <numstore/test/testing.h>
 
+#include <stdatomic.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32C_HAVE_SSE42
+#include <nmmintrin.h>
+#endif
+
 // core
-static u32 _crc32c_tbl[256];
-static int _crc32c_inited = 0;
+static u32 _crc32c_tbl[8][256];
+static _Atomic (checksum_fn) _crc32c_fn = NULL;
 
 static void
 _crc32c_init (void)
@@ -34,9 +44,171 @@ _crc32c_init (void)
       u32 c = i;
       for (int k = 0; k < 8; ++k)
         c = (c >> 1) ^ (0x82F63B78u & -(c & 1));
-      _crc32c_tbl[i] = c;
+      _crc32c_tbl[0][i] = c;
+    }
+
+  // _crc32c_tbl[k][i] is the crc of byte i followed by k zero bytes
+  for (u32 k = 1; k < 8; ++k)
+    {
+      for (u32 i = 0; i < 256; ++i)
+        {
+          u32 c = _crc32c_tbl[k - 1][i];
+          _crc32c_tbl[k][i] = (c >> 8) ^ _crc32c_tbl[0][c & 0xFF];
+        }
+    }
+}
+
+static void
+_crc32c_table (u32 *state, const u8 *data, u32 len)
+{
+  u32 c = ~(*state);
+  for (u32 i = 0; i < len; ++i)
+    {
+      c = (c >> 8) ^ _crc32c_tbl[0][(c ^ data[i]) & 0xFF];
     }
-  _crc32c_inited = 1;
+  *state = ~c;
+}
+
+static void
+_crc32c_slice8 (u32 *state, const u8 *data, u32 len)
+{
+  u32 c = ~(*state);
+
+  for (; len >= 8; len -= 8, data += 8)
+    {
+      u32 lo = c ^ ((u32)data[0] | (u32)data[1] << 8 | (u32)data[2] << 16 | (u32)data[3] << 24);
+      u32 hi = (u32)data[4] | (u32)data[5] << 8 | (u32)data[6] << 16 | (u32)data[7] << 24;
+
+      c = _crc32c_tbl[7][lo & 0xFF]
+          ^ _crc32c_tbl[6][(lo >> 8) & 0xFF]
+          ^ _crc32c_tbl[5][(lo >> 16) & 0xFF]
+          ^ _crc32c_tbl[4][lo >> 24]
+          ^ _crc32c_tbl[3][hi & 0xFF]
+          ^ _crc32c_tbl[2][(hi >> 8) & 0xFF]
+          ^ _crc32c_tbl[1][(hi >> 16) & 0xFF]
+          ^ _crc32c_tbl[0][hi >> 24];
+    }
+
+  for (; len > 0; --len, ++data)
+    {
+      c = (c >> 8) ^ _crc32c_tbl[0][(c ^ *data) & 0xFF];
+    }
+
+  *state = ~c;
+}
+
+#ifdef CRC32C_HAVE_SSE42
+__attribute__ ((target ("sse4.2"))) static void
+_crc32c_sse42 (u32 *state, const u8 *data, u32 len)
+{
+  u64 c = ~(*state);
+
+  // Byte steps up to an 8 byte boundary
+  for (; len > 0 && ((uintptr_t)data & 7) != 0; --len, ++data)
+    {
+      c = _mm_crc32_u8 ((u32)c, *data);
+    }
+
+  for (; len >= 8; len -= 8, data += 8)
+    {
+      u64 word;
+      __builtin_memcpy (&word, data, sizeof (word));
+      c = _mm_crc32_u64 (c, word);
+    }
+
+  for (; len > 0; --len, ++data)
+    {
+      c = _mm_crc32_u8 ((u32)c, *data);
+    }
+
+  *state = ~(u32)c;
+}
+#endif
+
+static checksum_fn
+_crc32c_impl (enum checksum_impl impl)
+{
+  switch (impl)
+    {
+    case CKSUM_TABLE:
+      {
+        return _crc32c_table;
+      }
+    case CKSUM_SLICE8:
+      {
+        return _crc32c_slice8;
+      }
+    case CKSUM_SSE42:
+      {
+#ifdef CRC32C_HAVE_SSE42
+        if (__builtin_cpu_supports ("sse4.2"))
+          {
+            return _crc32c_sse42;
+          }
+#endif
+        return NULL;
+      }
+    case CKSUM_NIMPLS:
+      {
+        break;
+      }
+    }
+  UNREACHABLE ();
+}
+
+const char *
+checksum_impl_name (enum checksum_impl impl)
+{
+  switch (impl)
+    {
+    case CKSUM_TABLE:
+      {
+        return "table";
+      }
+    case CKSUM_SLICE8:
+      {
+        return "slice8";
+      }
+    case CKSUM_SSE42:
+      {
+        return "sse42";
+      }
+    case CKSUM_NIMPLS:
+      {
+        break;
+      }
+    }
+  UNREACHABLE ();
+}
+
+static checksum_fn
+_crc32c_resolve (void)
+{
+  // Racing threads build the same tables and pick the same function
+  checksum_fn fn = atomic_load (&_crc32c_fn);
+  if (fn != NULL)
+    {
+      return fn;
+    }
+
+  _crc32c_init ();
+
+  fn = _crc32c_impl (CKSUM_SSE42);
+  if (fn == NULL)
+    {
+      fn = _crc32c_impl (CKSUM_SLICE8);
+    }
+
+  atomic_store (&_crc32c_fn, fn);
+
+  return fn;
+}
+
+checksum_fn
+checksum_get_impl (enum checksum_impl impl)
+{
+  _crc32c_resolve ();
+  return _crc32c_impl (impl);
 }
 
 u32
@@ -52,17 +224,7 @@ checksum_execute (u32 *state, const u8 *data, u32 len)
   ASSERT (data);
   ASSERT (len > 0);
 
-  if (!_crc32c_inited)
-    {
-      _crc32c_init ();
-    }
-
-  u32 c = ~(*state);
-  for (u32 i = 0; i < len; ++i)
-    {
-      c = (c >> 8) ^ _crc32c_tbl[(c ^ data[i]) & 0xFF];
-    }
-  *state = ~c;
+  _crc32c_resolve () (state, data, len);
 }
 
 #ifndef NTEST
@@ -104,4 +266,63 @@ TEST (TT_UNIT, checksum_execute_incremental)
 
   test_assert_equal (state1, state2);
 }
+
+TEST (TT_UNIT, checksum_known_vector)
+{
+  const u8 *data = (const u8 *)"123456789";
+
+  for (u32 i = 0; i < CKSUM_NIMPLS; ++i)
+    {
+      checksum_fn fn = checksum_get_impl (i);
+      if (fn == NULL)
+        {
+          continue;
+        }
+
+      u32 state = checksum_init ();
+      fn (&state, data, 9);
+      test_assert_equal (state, 0xE3069283u);
+    }
+}
+
+TEST (TT_UNIT, checksum_impls_agree)
+{
+  u8 data[4096 + 16];
+  rand_bytes (data, sizeof (data));
+
+  // Every length and alignment the fast paths split on
+  u32 lens[] = { 1, 3, 7, 8, 9, 15, 16, 17, 63, 64, 65, 1000, 4096 };
+
+  for (u32 l = 0; l < arrlen (lens); ++l)
+    {
+      for (u32 ofst = 0; ofst < 8; ++ofst)
+        {
+          u32 expected = checksum_init ();
+          checksum_get_impl (CKSUM_TABLE) (&expected, data + ofst, lens[l]);
+
+          for (u32 i = 0; i < CKSUM_NIMPLS; ++i)
+            {
+              checksum_fn fn = checksum_get_impl (i);
+              if (fn == NULL)
+                {
+                  continue;
+                }
+
+              // Split in two to check the running state carries over
+              u32 state = checksum_init ();
+              u32 half = lens[l] / 2;
+              if (half > 0)
+                {
+                  fn (&state, data + ofst, half);
+                }
+              fn (&state, data + ofst + half, lens[l] - half);
+              test_assert_equal (state, expected);
+            }
+
+          u32 actual = checksum_init ();
+          checksum_execute (&actual, data + ofst, lens[l]);
+          test_assert_equal (actual, expected);
+        }
+    }
+}
 #endif
@@ -156,7 +156,7 @@ chunk_alloc_free_all (struct chunk_alloc *ca)
   while (cur != NULL)
     {
       struct chunk *next = cur->next;
-      DBG_ASSERT (chunk, next);
+      DBG_ASSERT (chunk, cur);
       i_free (cur);
       cur = next;
     }
@@ -23,4 +23,18 @@
 #include <numstore/intf/types.h>
 
 u32 checksum_init (void);
-void checksum_execute (u32 *dest, const u8 *data, u32 len);
+void checksum_execute (u32 *dest, const u8 *data, u32 len); // Fastest this CPU supports
+
+// CRC32C implementations, exposed for tests and benchmarks
+typedef void (*checksum_fn) (u32 *dest, const u8 *data, u32 len);
+
+enum checksum_impl
+{
+  CKSUM_TABLE,  // Byte at a time
+  CKSUM_SLICE8, // 8 bytes at a time - portable
+  CKSUM_SSE42,  // crc32 instruction - x86_64 only
+  CKSUM_NIMPLS,
+};
+
+checksum_fn checksum_get_impl (enum checksum_impl impl); // NULL if this CPU can't run it
+const char *checksum_impl_name (enum checksum_impl impl);
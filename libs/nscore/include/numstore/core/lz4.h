@@ -0,0 +1,40 @@
+#pragma once
+
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Description:
+ *   LZ4 block format codec (no frame header). Blocks are readable by
+ *   any LZ4 block decoder and the other way around
+ */
+
+// core
+#include <numstore/intf/types.h>
+
+// Worst case compressed size of [len] bytes
+#define LZ4_COMPRESS_BOUND(len) ((len) + (len) / 255 + 16)
+
+/**
+ * Compresses [len] bytes of [src] into [dest]. Returns the compressed
+ * size, or 0 if it doesn't fit in [cap]
+ */
+u32 lz4_compress (u8 *dest, u32 cap, const u8 *src, u32 len);
+
+/**
+ * Decompresses the [len] byte block [src] into [dest]. Returns the
+ * decompressed size, or -1 if the block is malformed or would overflow
+ * [cap]. Never reads or writes out of bounds, whatever [src] holds
+ */
+i32 lz4_decompress (u8 *dest, u32 cap, const u8 *src, u32 len);
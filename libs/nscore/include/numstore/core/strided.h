@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Description:
+ *   Copies between packed element arrays and elements spaced a fixed
+ *   number of bytes apart (strided reads and writes)
+ */
+
+// core
+#include <numstore/intf/types.h>
+
+/**
+ * [step] is the distance in bytes from the start of one strided
+ * element to the next (bsize * stride) - [step] >= [bsize]
+ */
+void strided_gather (u8 *dest, const u8 *src, u32 bsize, u32 step, u32 n);  // src strided -> dest packed
+void strided_scatter (u8 *dest, const u8 *src, u32 bsize, u32 step, u32 n); // src packed -> dest strided
+
+// The portable gather - exposed for tests and benchmarks
+void strided_gather_portable (u8 *dest, const u8 *src, u32 bsize, u32 step, u32 n);
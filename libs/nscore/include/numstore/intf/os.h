@@ -152,6 +152,7 @@ i64 i_file_size (i_file *fp, error *e);
 err_t i_remove_quiet (const char *fname, error *e);
 err_t i_mkstemp (i_file *dest, char *tmpl, error *e);
 err_t i_unlink (const char *name, error *e);
+err_t i_rename (const char *from, const char *to, error *e); // Replaces [to] if it exists
 
 typedef enum
 {
@@ -187,6 +188,10 @@ void i_free (void *ptr);
     }                   \
   while (0)
 
+// Large zeroed regions (e.g. buffer pools) - huge page backed when the OS allows it
+void *i_huge_alloc (u64 bytes, error *e);
+void i_huge_free (void *ptr, u64 bytes);
+
 ////////////////////////////////////////////////////////////
 // Mutex
 #if PLATFORM_WINDOWS
@@ -280,6 +285,7 @@ typedef struct
 err_t i_cond_create (i_cond *c, error *e);
 void i_cond_free (i_cond *c);
 void i_cond_wait (i_cond *c, i_mutex *m);
+bool i_cond_timedwait (i_cond *c, i_mutex *m, u64 usec); // false if usec passed first
 void i_cond_signal (i_cond *c);
 void i_cond_broadcast (i_cond *c);
 
@@ -296,3 +302,55 @@ void i_rwlock_x_unlock (i_rwlock *m);
 // Additional Thread functions
 void i_thread_cancel (i_thread *t);
 u64 get_available_threads (void);
+
+////////////////////////////////////////////////////////////
+// Batched Positional Read / Write
+//
+// Keeps up to depth requests in flight at once - io_uring on Linux,
+// one pread / pwrite at a time everywhere else (and on Linux kernels
+// that refuse io_uring)
+#define I_AIO_MAX_DEPTH 64
+
+struct i_aio_req
+{
+  void *buf;
+  u64 n;
+  u64 offset;
+};
+
+typedef struct i_aio i_aio;
+
+#if PLATFORM_LINUX
+struct i_aio
+{
+  int ring_fd; // -1 = synchronous fallback
+  u32 depth;
+  i_mutex l; // One submitter at a time
+
+  void *sq_ring;
+  u64 sq_ring_len;
+  void *cq_ring;
+  u64 cq_ring_len;
+  void *sqes;
+  u64 sqes_len;
+
+  u32 *sq_tail;
+  u32 *sq_mask;
+  u32 *sq_array;
+  u32 *cq_head;
+  u32 *cq_tail;
+  u32 *cq_mask;
+  void *cqes;
+};
+#else
+struct i_aio
+{
+  u32 depth;
+};
+#endif
+
+err_t i_aio_open (i_aio *dest, u32 depth, error *e);
+void i_aio_close (i_aio *a);
+bool i_aio_is_async (const i_aio *a);
+err_t i_aio_pread_all (i_aio *a, i_file *fp, const struct i_aio_req *reqs, u32 n, error *e);
+err_t i_aio_pwrite_all (i_aio *a, i_file *fp, const struct i_aio_req *reqs, u32 n, error *e);
@@ -37,6 +37,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/errno.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -309,6 +310,53 @@ i_print_stack_trace (void)
   fflush (stdout);
 }
 
+////////////////////////////////////////////////////////////
+// Batched Positional Read / Write - no async backend here
+
+err_t
+i_aio_open (i_aio *dest, u32 depth, error *e)
+{
+  ASSERT (dest);
+  ASSERT (depth > 0 && depth <= I_AIO_MAX_DEPTH);
+  dest->depth = depth;
+  return SUCCESS;
+}
+
+void
+i_aio_close (i_aio *a)
+{
+  ASSERT (a);
+}
+
+bool
+i_aio_is_async (const i_aio *a)
+{
+  ASSERT (a);
+  return false;
+}
+
+err_t
+i_aio_pread_all (i_aio *a, i_file *fp, const struct i_aio_req *reqs, u32 n, error *e)
+{
+  ASSERT (a);
+  for (u32 i = 0; i < n; ++i)
+    {
+      err_t_wrap (i_pread_all_expect (fp, reqs[i].buf, reqs[i].n, reqs[i].offset, e), e);
+    }
+  return SUCCESS;
+}
+
+err_t
+i_aio_pwrite_all (i_aio *a, i_file *fp, const struct i_aio_req *reqs, u32 n, error *e)
+{
+  ASSERT (a);
+  for (u32 i = 0; i < n; ++i)
+    {
+      err_t_wrap (i_pwrite_all (fp, reqs[i].buf, reqs[i].n, reqs[i].offset, e), e);
+    }
+  return SUCCESS;
+}
+
 //////////////// Stream Read / Write
 
 i64
@@ -506,6 +554,17 @@ i_unlink (const char *name, error *e)
   return SUCCESS;
 }
 
+err_t
+i_rename (const char *from, const char *to, error *e)
+{
+  if (rename (from, to))
+    {
+      error_causef (e, ERR_IO, "rename: %s", strerror (errno));
+      return e->cause_code;
+    }
+  return SUCCESS;
+}
+
 i64
 i_seek (i_file *fp, u64 offset, seek_t whence, error *e)
 {
@@ -1034,6 +1093,30 @@ i_free (void *ptr)
   free (ptr);
 }
 
+void *
+i_huge_alloc (u64 bytes, error *e)
+{
+  ASSERT (bytes > 0);
+
+  // Anonymous mappings are zeroed and let the kernel use superpages on its own
+  errno = 0;
+  void *ret = mmap (NULL, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+  if (ret == MAP_FAILED)
+    {
+      error_causef (e, ERR_NOMEM, "mmap failed to allocate %" PRIu64 " bytes: %s", bytes, strerror (errno));
+      return NULL;
+    }
+
+  return ret;
+}
+
+void
+i_huge_free (void *ptr, u64 bytes)
+{
+  ASSERT (ptr);
+  munmap (ptr, bytes);
+}
+
 ////////////////// Mutex
 
 struct i_mutex_s
@@ -1712,6 +1795,52 @@ i_cond_wait (i_cond *c, i_mutex *m)
     }
 }
 
+bool
+i_cond_timedwait (i_cond *c, i_mutex *m, u64 usec)
+{
+  ASSERT (c);
+  ASSERT (m);
+
+  // pthread wants an absolute CLOCK_REALTIME deadline
+  struct timespec ts;
+  clock_gettime (CLOCK_REALTIME, &ts);
+  u64 nsec = (u64)ts.tv_nsec + (usec % 1000000ULL) * 1000ULL;
+  ts.tv_sec += (time_t)(usec / 1000000ULL + nsec / 1000000000ULL);
+  ts.tv_nsec = (long)(nsec % 1000000000ULL);
+
+  int ret = pthread_cond_timedwait (&c->c, &m->m, &ts);
+  switch (ret)
+    {
+    case 0:
+      {
+        return true;
+      }
+
+    case ETIMEDOUT:
+      {
+        return false;
+      }
+
+    case EINVAL:
+      {
+        i_log_error ("cond_timedwait: invalid cond, mutex or time: %s\n", strerror (ret));
+        UNREACHABLE ();
+      }
+
+    case EPERM:
+      {
+        i_log_error ("cond_timedwait: mutex not owned by thread: %s\n", strerror (ret));
+        UNREACHABLE ();
+      }
+
+    default:
+      {
+        i_log_error ("cond_timedwait: unknown error: %s\n", strerror (ret));
+        UNREACHABLE ();
+      }
+    }
+}
+
 void
 i_cond_signal (i_cond *c)
 {
@@ -36,10 +36,16 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/errno.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
+#if PLATFORM_LINUX
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
 // os
 // system
 #undef bool
@@ -439,6 +445,389 @@ i_readv_all (i_file *fp, struct bytes *iov, int iovcnt, error *e)
   return (i64)nread;
 }
 
+////////////////////////////////////////////////////////////
+// Batched Positional Read / Write
+
+static err_t
+i_aio_sync (i_file *fp, const struct i_aio_req *reqs, u32 n, bool write, error *e)
+{
+  for (u32 i = 0; i < n; ++i)
+    {
+      if (write)
+        {
+          err_t_wrap (i_pwrite_all (fp, reqs[i].buf, reqs[i].n, reqs[i].offset, e), e);
+        }
+      else
+        {
+          err_t_wrap (i_pread_all_expect (fp, reqs[i].buf, reqs[i].n, reqs[i].offset, e), e);
+        }
+    }
+  return SUCCESS;
+}
+
+#if PLATFORM_LINUX
+
+/**
+ * io_uring through raw syscalls - one ring per i_aio, readv / writev
+ * opcodes so that any kernel with io_uring (5.1+) works
+ */
+static inline int
+i_io_uring_setup (u32 entries, struct io_uring_params *params)
+{
+  return (int)syscall (__NR_io_uring_setup, entries, params);
+}
+
+static inline int
+i_io_uring_enter (int fd, u32 to_submit, u32 min_complete, u32 flags)
+{
+  return (int)syscall (__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static void
+i_aio_unmap (i_aio *a)
+{
+  if (a->sqes)
+    {
+      munmap (a->sqes, a->sqes_len);
+    }
+  if (a->cq_ring && a->cq_ring != a->sq_ring)
+    {
+      munmap (a->cq_ring, a->cq_ring_len);
+    }
+  if (a->sq_ring)
+    {
+      munmap (a->sq_ring, a->sq_ring_len);
+    }
+  if (a->ring_fd >= 0)
+    {
+      close (a->ring_fd);
+    }
+  a->sqes = NULL;
+  a->cq_ring = NULL;
+  a->sq_ring = NULL;
+  a->ring_fd = -1;
+}
+
+static inline void *
+i_aio_mmap (int fd, u64 len, u64 offset)
+{
+  void *ret = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, (off_t)offset);
+  return ret == MAP_FAILED ? NULL : ret;
+}
+
+err_t
+i_aio_open (i_aio *dest, u32 depth, error *e)
+{
+  ASSERT (dest);
+  ASSERT (depth > 0 && depth <= I_AIO_MAX_DEPTH);
+
+  *dest = (i_aio){ .ring_fd = -1, .depth = depth };
+  err_t_wrap (i_mutex_create (&dest->l, e), e);
+
+  struct io_uring_params params;
+  memset (&params, 0, sizeof params);
+
+  errno = 0;
+  int fd = i_io_uring_setup (depth, &params);
+  if (fd < 0)
+    {
+      // Old kernel, seccomp or kernel.io_uring_disabled - not an error
+      i_log_debug ("io_uring unavailable (%s), falling back to pread / pwrite\n", strerror (errno));
+      return SUCCESS;
+    }
+  dest->ring_fd = fd;
+
+  dest->sq_ring_len = params.sq_off.array + params.sq_entries * sizeof (u32);
+  dest->cq_ring_len = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      dest->sq_ring_len = MAX (dest->sq_ring_len, dest->cq_ring_len);
+      dest->cq_ring_len = dest->sq_ring_len;
+    }
+
+  dest->sq_ring = i_aio_mmap (fd, dest->sq_ring_len, IORING_OFF_SQ_RING);
+  if (dest->sq_ring == NULL)
+    {
+      goto fallback;
+    }
+
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      dest->cq_ring = dest->sq_ring;
+    }
+  else
+    {
+      dest->cq_ring = i_aio_mmap (fd, dest->cq_ring_len, IORING_OFF_CQ_RING);
+      if (dest->cq_ring == NULL)
+        {
+          goto fallback;
+        }
+    }
+
+  dest->sqes_len = params.sq_entries * sizeof (struct io_uring_sqe);
+  dest->sqes = i_aio_mmap (fd, dest->sqes_len, IORING_OFF_SQES);
+  if (dest->sqes == NULL)
+    {
+      goto fallback;
+    }
+
+  u8 *sq = dest->sq_ring;
+  u8 *cq = dest->cq_ring;
+  dest->sq_tail = (u32 *)(sq + params.sq_off.tail);
+  dest->sq_mask = (u32 *)(sq + params.sq_off.ring_mask);
+  dest->sq_array = (u32 *)(sq + params.sq_off.array);
+  dest->cq_head = (u32 *)(cq + params.cq_off.head);
+  dest->cq_tail = (u32 *)(cq + params.cq_off.tail);
+  dest->cq_mask = (u32 *)(cq + params.cq_off.ring_mask);
+  dest->cqes = cq + params.cq_off.cqes;
+  dest->depth = MIN (depth, params.sq_entries);
+
+  return SUCCESS;
+
+fallback:
+  i_log_debug ("io_uring ring mmap failed (%s), falling back to pread / pwrite\n", strerror (errno));
+  i_aio_unmap (dest);
+  return SUCCESS;
+}
+
+void
+i_aio_close (i_aio *a)
+{
+  ASSERT (a);
+  i_aio_unmap (a);
+  i_mutex_free (&a->l);
+}
+
+bool
+i_aio_is_async (const i_aio *a)
+{
+  ASSERT (a);
+  return a->ring_fd >= 0;
+}
+
+/**
+ * Submits [n] <= depth requests in one io_uring_enter and waits for
+ * all of them. Short transfers are finished with pread / pwrite.
+ *
+ * Caller holds [a->l]
+ */
+static err_t
+i_aio_submit (i_aio *a, i_file *fp, const struct i_aio_req *reqs, u32 n, bool write, error *e)
+{
+  ASSERT (n <= a->depth);
+
+  struct iovec iov[I_AIO_MAX_DEPTH];
+  struct io_uring_sqe *sqes = a->sqes;
+  struct io_uring_cqe *cqes = a->cqes;
+
+  u32 tail = *a->sq_tail;
+  for (u32 i = 0; i < n; ++i)
+    {
+      u32 idx = tail & *a->sq_mask;
+      struct io_uring_sqe *sqe = &sqes[idx];
+
+      iov[i].iov_base = reqs[i].buf;
+      iov[i].iov_len = reqs[i].n;
+
+      memset (sqe, 0, sizeof *sqe);
+      sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->fd = fp->fd;
+      sqe->addr = (u64)(uintptr_t)&iov[i];
+      sqe->len = 1;
+      sqe->off = reqs[i].offset;
+      sqe->user_data = i;
+
+      a->sq_array[idx] = idx;
+      tail++;
+    }
+  __atomic_store_n (a->sq_tail, tail, __ATOMIC_RELEASE);
+
+  err_t ret = SUCCESS;
+  u32 submitted = 0;
+  u32 reaped = 0;
+
+  while (reaped < n)
+    {
+      errno = 0;
+      int r = i_io_uring_enter (a->ring_fd, n - submitted, n - reaped, IORING_ENTER_GETEVENTS);
+      if (r < 0)
+        {
+          if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            {
+              // Ring is unusable - drop it (the kernel waits out anything in flight)
+              i_log_warn ("io_uring_enter: %s, falling back to pread / pwrite\n", strerror (errno));
+              i_aio_unmap (a);
+              return i_aio_sync (fp, reqs, n, write, e);
+            }
+        }
+      else
+        {
+          submitted += (u32)r;
+        }
+
+      u32 head = *a->cq_head;
+      u32 ctail = __atomic_load_n (a->cq_tail, __ATOMIC_ACQUIRE);
+      while (head != ctail)
+        {
+          struct io_uring_cqe *cqe = &cqes[head & *a->cq_mask];
+          const struct i_aio_req *req = &reqs[cqe->user_data];
+          i32 res = cqe->res;
+          head++;
+          reaped++;
+
+          if (ret)
+            {
+              continue;
+            }
+
+          if (res < 0)
+            {
+              ret = error_causef (e, ERR_IO, "io_uring %s: %s", write ? "pwrite" : "pread", strerror (-res));
+            }
+          else if ((u64)res < req->n)
+            {
+              // Short transfer - finish it inline
+              u8 *buf = (u8 *)req->buf + res;
+              if (write)
+                {
+                  ret = i_pwrite_all (fp, buf, req->n - res, req->offset + res, e);
+                }
+              else
+                {
+                  ret = i_pread_all_expect (fp, buf, req->n - res, req->offset + res, e);
+                }
+            }
+        }
+      __atomic_store_n (a->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+  return ret;
+}
+
+static err_t
+i_aio_all (i_aio *a, i_file *fp, const struct i_aio_req *reqs, u32 n, bool write, error *e)
+{
+  ASSERT (a);
+  DBG_ASSERT (i_file, fp);
+
+  err_t ret = SUCCESS;
+
+  i_mutex_lock (&a->l);
+
+  for (u32 i = 0; i < n && ret == SUCCESS; i += a->depth)
+    {
+      u32 len = MIN (a->depth, n - i);
+      if (a->ring_fd >= 0)
+        {
+          ret = i_aio_submit (a, fp, &reqs[i], len, write, e);
+        }
+      else
+        {
+          ret = i_aio_sync (fp, &reqs[i], len, write, e);
+        }
+    }
+
+  i_mutex_unlock (&a->l);
+
+  return ret;
+}
+
+#else
+
+err_t
+i_aio_open (i_aio *dest, u32 depth, error *e)
+{
+  ASSERT (dest);
+  ASSERT (depth > 0 && depth <= I_AIO_MAX_DEPTH);
+  dest->depth = depth;
+  return SUCCESS;
+}
+
+void
+i_aio_close (i_aio *a)
+{
+  ASSERT (a);
+}
+
+bool
+i_aio_is_async (const i_aio *a)
+{
+  ASSERT (a);
+  return false;
+}
+
+static err_t
+i_aio_all (i_aio *a, i_file *fp, const struct i_aio_req *reqs, u32 n, bool write, error *e)
+{
+  ASSERT (a);
+  return i_aio_sync (fp, reqs, n, write, e);
+}
+
+#endif
+
+err_t
+i_aio_pread_all (i_aio *a, i_file *fp, const struct i_aio_req *reqs, u32 n, error *e)
+{
+  return i_aio_all (a, fp, reqs, n, false, e);
+}
+
+err_t
+i_aio_pwrite_all (i_aio *a, i_file *fp, const struct i_aio_req *reqs, u32 n, error *e)
+{
+  return i_aio_all (a, fp, reqs, n, true, e);
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, i_aio_batch)
+{
+  enum
+  {
+    NREQ = 3 * 16 + 5,
+    LEN = 512,
+  };
+
+  error e = error_create ();
+  i_file fp;
+  test_err_t_wrap (i_open_rw (&fp, "test.db", &e), &e);
+  test_fail_if (i_truncate (&fp, 0, &e));
+
+  static u8 out[NREQ][LEN];
+  static u8 in[NREQ][LEN];
+  struct i_aio_req wreqs[NREQ];
+  struct i_aio_req rreqs[NREQ];
+
+  // Out of order offsets so each request lands somewhere different
+  for (u32 i = 0; i < NREQ; ++i)
+    {
+      u32 slot = (i * 7) % NREQ;
+      memset (out[i], (int)(i + 1), LEN);
+      wreqs[i] = (struct i_aio_req){ .buf = out[i], .n = LEN, .offset = (u64)slot * LEN };
+      rreqs[i] = (struct i_aio_req){ .buf = in[i], .n = LEN, .offset = (u64)slot * LEN };
+    }
+
+  i_aio a;
+  test_err_t_wrap (i_aio_open (&a, 16, &e), &e);
+
+  test_err_t_wrap (i_aio_pwrite_all (&a, &fp, wreqs, NREQ, &e), &e);
+  test_assert_int_equal (i_file_size (&fp, &e), NREQ * LEN);
+
+  test_err_t_wrap (i_aio_pread_all (&a, &fp, rreqs, NREQ, &e), &e);
+  for (u32 i = 0; i < NREQ; ++i)
+    {
+      test_assert_memequal (in[i], out[i], LEN);
+    }
+
+  // Reading past the end is an error, not a short read
+  struct i_aio_req past = { .buf = in[0], .n = LEN, .offset = (u64)NREQ * LEN };
+  test_assert (i_aio_pread_all (&a, &fp, &past, 1, &e) < SUCCESS);
+  error_reset (&e);
+
+  i_aio_close (&a);
+  test_fail_if (i_close (&fp, &e));
+  test_fail_if (i_unlink ("test.db", &e));
+}
+#endif
+
 ////////////////////////////////////////////////////////////
 // File Stream
 
@@ -790,6 +1179,17 @@ i_unlink (const char *name, error *e)
   return SUCCESS;
 }
 
+err_t
+i_rename (const char *from, const char *to, error *e)
+{
+  if (rename (from, to))
+    {
+      error_causef (e, ERR_IO, "rename: %s", strerror (errno));
+      return e->cause_code;
+    }
+  return SUCCESS;
+}
+
 i64
 i_seek (i_file *fp, u64 offset, seek_t whence, error *e)
 {
@@ -1318,6 +1718,64 @@ i_free (void *ptr)
   free (ptr);
 }
 
+// Huge pages are 2MB on every platform we care about
+#define I_HUGE_PAGE_SIZE ((u64)2 << 20)
+
+static inline u64
+i_huge_round (u64 bytes)
+{
+  if (bytes < I_HUGE_PAGE_SIZE)
+    {
+      return bytes;
+    }
+  return (bytes + I_HUGE_PAGE_SIZE - 1) & ~(I_HUGE_PAGE_SIZE - 1);
+}
+
+void *
+i_huge_alloc (u64 bytes, error *e)
+{
+  ASSERT (bytes > 0);
+
+  u64 len = i_huge_round (bytes);
+  void *ret = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+  // Explicit huge pages - fails unless the admin reserved some
+  if (len >= I_HUGE_PAGE_SIZE)
+    {
+      ret = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+#endif
+
+  if (ret == MAP_FAILED)
+    {
+      errno = 0;
+      ret = mmap (NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (ret == MAP_FAILED)
+        {
+          error_causef (e, ERR_NOMEM, "mmap failed to allocate %" PRIu64 " bytes: %s", bytes, strerror (errno));
+          return NULL;
+        }
+
+#ifdef MADV_HUGEPAGE
+      // Fall back to transparent huge pages - best effort
+      if (len >= I_HUGE_PAGE_SIZE)
+        {
+          madvise (ret, len, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+  return ret;
+}
+
+void
+i_huge_free (void *ptr, u64 bytes)
+{
+  ASSERT (ptr);
+  munmap (ptr, i_huge_round (bytes));
+}
+
 ////////////////// Mutex
 
 struct i_mutex_s
@@ -2035,6 +2493,52 @@ i_cond_wait (i_cond *c, i_mutex *m)
     }
 }
 
+bool
+i_cond_timedwait (i_cond *c, i_mutex *m, u64 usec)
+{
+  ASSERT (c);
+  ASSERT (m);
+
+  // pthread wants an absolute CLOCK_REALTIME deadline
+  struct timespec ts;
+  clock_gettime (CLOCK_REALTIME, &ts);
+  u64 nsec = (u64)ts.tv_nsec + (usec % 1000000ULL) * 1000ULL;
+  ts.tv_sec += (time_t)(usec / 1000000ULL + nsec / 1000000000ULL);
+  ts.tv_nsec = (long)(nsec % 1000000000ULL);
+
+  int ret = pthread_cond_timedwait (&c->cond, &m->m, &ts);
+  switch (ret)
+    {
+    case 0:
+      {
+        return true;
+      }
+
+    case ETIMEDOUT:
+      {
+        return false;
+      }
+
+    case EINVAL:
+      {
+        i_log_error ("cond_timedwait: invalid cond, mutex or time: %s\n", strerror (ret));
+        UNREACHABLE ();
+      }
+
+    case EPERM:
+      {
+        i_log_error ("cond_timedwait: mutex not owned by thread: %s\n", strerror (ret));
+        UNREACHABLE ();
+      }
+
+    default:
+      {
+        i_log_error ("cond_timedwait: unknown error: %s\n", strerror (ret));
+        UNREACHABLE ();
+      }
+    }
+}
+
 void
 i_cond_signal (i_cond *c)
 {
@@ -276,6 +276,53 @@ i_pwrite_all (i_file *fp, const void *src, u64 n, u64 offset, error *e)
   return SUCCESS;
 }
 
+////////////////////////////////////////////////////////////
+// Batched Positional Read / Write - no async backend here
+
+err_t
+i_aio_open (i_aio *dest, u32 depth, error *e)
+{
+  ASSERT (dest);
+  ASSERT (depth > 0 && depth <= I_AIO_MAX_DEPTH);
+  dest->depth = depth;
+  return SUCCESS;
+}
+
+void
+i_aio_close (i_aio *a)
+{
+  ASSERT (a);
+}
+
+bool
+i_aio_is_async (const i_aio *a)
+{
+  ASSERT (a);
+  return false;
+}
+
+err_t
+i_aio_pread_all (i_aio *a, i_file *fp, const struct i_aio_req *reqs, u32 n, error *e)
+{
+  ASSERT (a);
+  for (u32 i = 0; i < n; ++i)
+    {
+      err_t_wrap (i_pread_all_expect (fp, reqs[i].buf, reqs[i].n, reqs[i].offset, e), e);
+    }
+  return SUCCESS;
+}
+
+err_t
+i_aio_pwrite_all (i_aio *a, i_file *fp, const struct i_aio_req *reqs, u32 n, error *e)
+{
+  ASSERT (a);
+  for (u32 i = 0; i < n; ++i)
+    {
+      err_t_wrap (i_pwrite_all (fp, reqs[i].buf, reqs[i].n, reqs[i].offset, e), e);
+    }
+  return SUCCESS;
+}
+
 ////////////////////////////////////////////////////////////
 // Runtime
 void
@@ -456,6 +503,16 @@ i_unlink (const char *name, error *e)
   return SUCCESS;
 }
 
+err_t
+i_rename (const char *from, const char *to, error *e)
+{
+  if (!MoveFileExA (from, to, MOVEFILE_REPLACE_EXISTING))
+    {
+      return error_causef (e, ERR_IO, "rename %s -> %s: Error %lu", from, to, GetLastError ());
+    }
+  return SUCCESS;
+}
+
 i64
 i_seek (i_file *fp, u64 offset, seek_t whence, error *e)
 {
@@ -603,6 +660,30 @@ i_free (void *ptr)
   free (ptr);
 }
 
+void *
+i_huge_alloc (u64 bytes, error *e)
+{
+  ASSERT (bytes > 0);
+
+  // Large pages need SeLockMemoryPrivilege - plain committed pages are zeroed too
+  void *ret = VirtualAlloc (NULL, (SIZE_T)bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+  if (ret == NULL)
+    {
+      error_causef (e, ERR_NOMEM, "VirtualAlloc failed to allocate %" PRIu64 " bytes: %lu", bytes, GetLastError ());
+      return NULL;
+    }
+
+  return ret;
+}
+
+void
+i_huge_free (void *ptr, u64 bytes)
+{
+  (void)bytes;
+  ASSERT (ptr);
+  VirtualFree (ptr, 0, MEM_RELEASE);
+}
+
 ////////////////////////////////////////////////////////////
 // Mutex
 err_t
@@ -747,6 +828,13 @@ i_cond_wait (i_cond *c, i_mutex *m)
   SleepConditionVariableCS (&c->cond, &m->cs, INFINITE);
 }
 
+bool
+i_cond_timedwait (i_cond *c, i_mutex *m, u64 usec)
+{
+  // Rounded up so short waits still sleep
+  return SleepConditionVariableCS (&c->cond, &m->cs, (DWORD)((usec + 999) / 1000)) != 0;
+}
+
 void
 i_cond_signal (i_cond *c)
 {
@@ -0,0 +1,428 @@
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Description:
+ *   LZ4 block format codec. Compression is the single pass greedy hash
+ *   match from the format description: 4 byte minimum match, 64 KiB
+ *   window, the last 5 bytes are always literals and the last match
+ *   starts at least 12 bytes before the end of the input
+ */
+
+#include <numstore/core/lz4.h>
+
+#include <numstore/core/assert.h>
+#include <numstore/core/macros.h>
+#include <numstore/core/random.h>
+#include <numstore/intf/stdlib.h>
+#include <numstore/test/testing.h>
+
+#define LZ4_MINMATCH 4
+#define LZ4_LASTLITERALS 5
+#define LZ4_MFLIMIT 12
+#define LZ4_MAX_DISTANCE 65535
+#define LZ4_ML_MASK 15
+#define LZ4_RUN_MASK 15
+
+#define LZ4_HASH_LOG 12
+#define LZ4_HASH_SIZE (1 << LZ4_HASH_LOG)
+
+static inline u32
+lz4_read32 (const u8 *p)
+{
+  u32 v;
+  i_memcpy (&v, p, sizeof v);
+  return v;
+}
+
+static inline u32
+lz4_hash (u32 v)
+{
+  return (v * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+// Writes the 255 run continuation bytes of a length over 15
+static inline u8 *
+lz4_write_len (u8 *op, u32 len)
+{
+  while (len >= 255)
+    {
+      *op++ = 255;
+      len -= 255;
+    }
+  *op++ = (u8)len;
+  return op;
+}
+
+// Room for a token, [litlen] literals and their length bytes
+static inline u64
+lz4_lit_bytes (u32 litlen)
+{
+  return 1 + (u64)litlen / 255 + 1 + litlen;
+}
+
+u32
+lz4_compress (u8 *dest, u32 cap, const u8 *src, u32 len)
+{
+  const u8 *ip = src;
+  const u8 *anchor = src;
+  const u8 *const iend = src + len;
+
+  u8 *op = dest;
+  u8 *const oend = dest + cap;
+
+  u32 table[LZ4_HASH_SIZE];
+
+  if (len >= LZ4_MFLIMIT + 1)
+    {
+      const u8 *const mflimit = iend - LZ4_MFLIMIT;
+      const u8 *const matchlimit = iend - LZ4_LASTLITERALS;
+
+      i_memset (table, 0, sizeof table);
+
+      while (ip < mflimit)
+        {
+          u32 h = lz4_hash (lz4_read32 (ip));
+          const u8 *ref = src + table[h];
+          table[h] = (u32)(ip - src);
+
+          if (ref >= ip || ip - ref > LZ4_MAX_DISTANCE || lz4_read32 (ref) != lz4_read32 (ip))
+            {
+              ip++;
+              continue;
+            }
+
+          // Extend the match forward
+          const u8 *mp = ip + LZ4_MINMATCH;
+          const u8 *rp = ref + LZ4_MINMATCH;
+          while (mp < matchlimit && *mp == *rp)
+            {
+              mp++;
+              rp++;
+            }
+
+          u32 litlen = (u32)(ip - anchor);
+          u32 mlen = (u32)(mp - ip) - LZ4_MINMATCH;
+
+          // Literals, offset and match length bytes
+          if ((u64)(oend - op) < lz4_lit_bytes (litlen) + 2 + mlen / 255 + 1)
+            {
+              return 0;
+            }
+
+          u8 *token = op++;
+
+          if (litlen >= LZ4_RUN_MASK)
+            {
+              *token = LZ4_RUN_MASK << 4;
+              op = lz4_write_len (op, litlen - LZ4_RUN_MASK);
+            }
+          else
+            {
+              *token = (u8)(litlen << 4);
+            }
+          i_memcpy (op, anchor, litlen);
+          op += litlen;
+
+          u32 offset = (u32)(ip - ref);
+          *op++ = (u8)(offset & 0xFF);
+          *op++ = (u8)(offset >> 8);
+
+          if (mlen >= LZ4_ML_MASK)
+            {
+              *token |= LZ4_ML_MASK;
+              op = lz4_write_len (op, mlen - LZ4_ML_MASK);
+            }
+          else
+            {
+              *token |= (u8)mlen;
+            }
+
+          ip = mp;
+          anchor = ip;
+        }
+    }
+
+  // Last literals
+  u32 litlen = (u32)(iend - anchor);
+  if ((u64)(oend - op) < lz4_lit_bytes (litlen))
+    {
+      return 0;
+    }
+
+  u8 *token = op++;
+  if (litlen >= LZ4_RUN_MASK)
+    {
+      *token = LZ4_RUN_MASK << 4;
+      op = lz4_write_len (op, litlen - LZ4_RUN_MASK);
+    }
+  else
+    {
+      *token = (u8)(litlen << 4);
+    }
+  i_memcpy (op, anchor, litlen);
+  op += litlen;
+
+  return (u32)(op - dest);
+}
+
+// Adds the continuation bytes of a length to [len] - false if [src] ran out
+static inline bool
+lz4_read_len (const u8 **ip, const u8 *iend, u64 *len)
+{
+  u8 s;
+  do
+    {
+      if (*ip >= iend)
+        {
+          return false;
+        }
+      s = *(*ip)++;
+      *len += s;
+    }
+  while (s == 255);
+
+  return true;
+}
+
+i32
+lz4_decompress (u8 *dest, u32 cap, const u8 *src, u32 len)
+{
+  const u8 *ip = src;
+  const u8 *const iend = src + len;
+
+  u8 *op = dest;
+  u8 *const oend = dest + cap;
+
+  if (len == 0)
+    {
+      return -1;
+    }
+
+  while (true)
+    {
+      u8 token = *ip++;
+
+      // Literals
+      u64 litlen = token >> 4;
+      if (litlen == LZ4_RUN_MASK && !lz4_read_len (&ip, iend, &litlen))
+        {
+          return -1;
+        }
+      if (litlen > (u64)(iend - ip) || litlen > (u64)(oend - op))
+        {
+          return -1;
+        }
+      i_memcpy (op, ip, (u32)litlen);
+      op += litlen;
+      ip += litlen;
+
+      // The last sequence is literals only
+      if (ip == iend)
+        {
+          break;
+        }
+
+      // Match
+      if (iend - ip < 2)
+        {
+          return -1;
+        }
+      u64 offset = (u64)ip[0] | ((u64)ip[1] << 8);
+      ip += 2;
+      if (offset == 0 || offset > (u64)(op - dest))
+        {
+          return -1;
+        }
+
+      u64 mlen = token & LZ4_ML_MASK;
+      if (mlen == LZ4_ML_MASK && !lz4_read_len (&ip, iend, &mlen))
+        {
+          return -1;
+        }
+      mlen += LZ4_MINMATCH;
+      if (mlen > (u64)(oend - op))
+        {
+          return -1;
+        }
+
+      // Byte at a time - the match may overlap its own output
+      const u8 *match = op - offset;
+      for (u64 i = 0; i < mlen; ++i)
+        {
+          op[i] = match[i];
+        }
+      op += mlen;
+
+      // A block always ends on literals
+      if (ip >= iend)
+        {
+          return -1;
+        }
+    }
+
+  return (i32)(op - dest);
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, lz4_round_trip)
+{
+  enum
+  {
+    LEN = 4096,
+  };
+
+  u8 src[LEN];
+  u8 packed[LZ4_COMPRESS_BOUND (LEN)];
+  u8 out[LEN];
+
+  // Compressible - short runs of a few symbols
+  for (u32 i = 0; i < LEN; ++i)
+    {
+      src[i] = (u8)("numstore"[(i / 3) % 8] + (i % 97 == 0));
+    }
+
+  u32 lens[] = { 1, 5, 12, 13, 14, 100, 255, 256, 1000, LEN };
+
+  for (u32 l = 0; l < arrlen (lens); ++l)
+    {
+      u32 clen = lz4_compress (packed, sizeof packed, src, lens[l]);
+      test_assert (clen > 0);
+      test_assert_int_equal (lz4_decompress (out, sizeof out, packed, clen), lens[l]);
+      test_assert_memequal (out, src, lens[l]);
+    }
+
+  TEST_CASE ("Repetitive input shrinks")
+  {
+    i_memset (src, 0, LEN);
+    u32 clen = lz4_compress (packed, sizeof packed, src, LEN);
+    test_assert (clen > 0 && clen < LEN / 32);
+    test_assert_int_equal (lz4_decompress (out, sizeof out, packed, clen), LEN);
+    test_assert_memequal (out, src, LEN);
+  }
+
+  TEST_CASE ("Empty input")
+  {
+    u32 clen = lz4_compress (packed, sizeof packed, src, 0);
+    test_assert_int_equal (clen, 1);
+    test_assert_int_equal (lz4_decompress (out, sizeof out, packed, clen), 0);
+  }
+}
+
+TEST (TT_UNIT, lz4_incompressible)
+{
+  enum
+  {
+    LEN = 4096,
+  };
+
+  u8 src[LEN];
+  u8 packed[LZ4_COMPRESS_BOUND (LEN)];
+  u8 out[LEN];
+  rand_bytes (src, LEN);
+
+  TEST_CASE ("Doesn't fit in less than the input")
+  {
+    test_assert_int_equal (lz4_compress (packed, LEN, src, LEN), 0);
+  }
+
+  TEST_CASE ("Fits in the bound and round trips")
+  {
+    u32 clen = lz4_compress (packed, sizeof packed, src, LEN);
+    test_assert (clen > 0 && clen <= LZ4_COMPRESS_BOUND (LEN));
+    test_assert_int_equal (lz4_decompress (out, sizeof out, packed, clen), LEN);
+    test_assert_memequal (out, src, LEN);
+  }
+}
+
+TEST (TT_UNIT, lz4_reference_block)
+{
+  // Literal 'a', match of 18 at offset 1 (overlapping), 5 last literals
+  const u8 block[] = { 0x1E, 'a', 0x01, 0x00, 0x50, 'a', 'a', 'a', 'a', 'a' };
+  u8 expect[24];
+  u8 out[24];
+  i_memset (expect, 'a', sizeof expect);
+
+  test_assert_int_equal (lz4_decompress (out, sizeof out, block, sizeof block), 24);
+  test_assert_memequal (out, expect, sizeof expect);
+
+  // One byte short of the output
+  test_assert_int_equal (lz4_decompress (out, sizeof out - 1, block, sizeof block), -1);
+}
+
+TEST (TT_UNIT, lz4_malformed)
+{
+  enum
+  {
+    LEN = 1024,
+  };
+
+  u8 src[LEN];
+  u8 packed[LZ4_COMPRESS_BOUND (LEN)];
+  u8 out[LEN];
+
+  for (u32 i = 0; i < LEN; ++i)
+    {
+      src[i] = (u8)(i % 7);
+    }
+  u32 clen = lz4_compress (packed, sizeof packed, src, LEN);
+  test_assert (clen > 0);
+
+  TEST_CASE ("Truncations never decode to the whole input")
+  {
+    // A cut right after a literal run is itself a valid (shorter) block
+    for (u32 n = 0; n < clen; ++n)
+      {
+        i32 ret = lz4_decompress (out, sizeof out, packed, n);
+        test_assert (ret >= -1 && ret < LEN);
+        if (ret > 0)
+          {
+            test_assert_memequal (out, src, (u32)ret);
+          }
+      }
+  }
+
+  TEST_CASE ("Output that doesn't fit is rejected")
+  {
+    test_assert_int_equal (lz4_decompress (out, LEN - 1, packed, clen), -1);
+  }
+
+  TEST_CASE ("Offsets before the start of the output are rejected")
+  {
+    const u8 zero[] = { 0x10, 'a', 0x00, 0x00, 0x50, 'a', 'a', 'a', 'a', 'a' };
+    const u8 behind[] = { 0x10, 'a', 0x02, 0x00, 0x50, 'a', 'a', 'a', 'a', 'a' };
+    test_assert_int_equal (lz4_decompress (out, sizeof out, zero, sizeof zero), -1);
+    test_assert_int_equal (lz4_decompress (out, sizeof out, behind, sizeof behind), -1);
+  }
+
+  TEST_CASE ("Run lengths past the input are rejected")
+  {
+    const u8 lits[] = { 0xF0, 0xFF, 0xFF };
+    const u8 match[] = { 0x1F, 'a', 0x01, 0x00, 0xFF };
+    test_assert_int_equal (lz4_decompress (out, sizeof out, lits, sizeof lits), -1);
+    test_assert_int_equal (lz4_decompress (out, sizeof out, match, sizeof match), -1);
+  }
+
+  TEST_CASE ("Random garbage never gets out of bounds")
+  {
+    u8 junk[256];
+    for (u32 i = 0; i < 1000; ++i)
+      {
+        rand_bytes (junk, sizeof junk);
+        i32 ret = lz4_decompress (out, sizeof out, junk, randu32r (1, sizeof junk));
+        test_assert (ret >= -1 && ret <= (i32)sizeof out);
+      }
+  }
+}
+#endif
@@ -0,0 +1,262 @@
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Description:
+ *   Strided gather / scatter. Stride 1 is a memcpy, 1 / 2 / 4 / 8 / 16
+ *   byte elements use fixed width copies and 4 / 8 byte gathers use
+ *   AVX2 when the CPU has it
+ */
+
+#include <numstore/core/strided.h>
+
+#include <numstore/core/assert.h>
+#include <numstore/core/macros.h>
+#include <numstore/core/random.h>
+#include <numstore/intf/stdlib.h>
+#include <numstore/test/testing.h>
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define STRIDED_HAVE_AVX2
+#include <immintrin.h>
+#endif
+
+// Constant sizes so each copy compiles down to a single load / store
+#define STRIDED_LOOP(_dest, _dstep, _src, _sstep, _size, _n) \
+  do                                                        \
+    {                                                       \
+      for (u32 _i = 0; _i < (_n); ++_i)                     \
+        {                                                   \
+          __builtin_memcpy ((_dest) + (size_t)_i * (_dstep), \
+                            (_src) + (size_t)_i * (_sstep),  \
+                            (_size));                       \
+        }                                                   \
+    }                                                       \
+  while (0)
+
+static void
+strided_copy (u8 *dest, u32 dstep, const u8 *src, u32 sstep, u32 bsize, u32 n)
+{
+  switch (bsize)
+    {
+    case 1:
+      {
+        STRIDED_LOOP (dest, dstep, src, sstep, 1, n);
+        return;
+      }
+    case 2:
+      {
+        STRIDED_LOOP (dest, dstep, src, sstep, 2, n);
+        return;
+      }
+    case 4:
+      {
+        STRIDED_LOOP (dest, dstep, src, sstep, 4, n);
+        return;
+      }
+    case 8:
+      {
+        STRIDED_LOOP (dest, dstep, src, sstep, 8, n);
+        return;
+      }
+    case 16:
+      {
+        STRIDED_LOOP (dest, dstep, src, sstep, 16, n);
+        return;
+      }
+    default:
+      {
+        STRIDED_LOOP (dest, dstep, src, sstep, bsize, n);
+        return;
+      }
+    }
+}
+
+void
+strided_gather_portable (u8 *dest, const u8 *src, u32 bsize, u32 step, u32 n)
+{
+  strided_copy (dest, bsize, src, step, bsize, n);
+}
+
+#ifdef STRIDED_HAVE_AVX2
+__attribute__ ((target ("avx2"))) static void
+strided_gather_avx2_4 (u8 *dest, const u8 *src, u32 step, u32 n)
+{
+  const __m256i idx = _mm256_mullo_epi32 (
+      _mm256_setr_epi32 (0, 1, 2, 3, 4, 5, 6, 7),
+      _mm256_set1_epi32 ((int)step));
+
+  u32 i = 0;
+  for (; i + 8 <= n; i += 8)
+    {
+      __m256i v = _mm256_i32gather_epi32 ((const int *)(src + (size_t)i * step), idx, 1);
+      _mm256_storeu_si256 ((__m256i *)(dest + (size_t)i * 4), v);
+    }
+
+  STRIDED_LOOP (dest + (size_t)i * 4, 4, src + (size_t)i * step, step, 4, n - i);
+}
+
+__attribute__ ((target ("avx2"))) static void
+strided_gather_avx2_8 (u8 *dest, const u8 *src, u32 step, u32 n)
+{
+  const __m128i idx = _mm_mullo_epi32 (
+      _mm_setr_epi32 (0, 1, 2, 3),
+      _mm_set1_epi32 ((int)step));
+
+  u32 i = 0;
+  for (; i + 4 <= n; i += 4)
+    {
+      __m256i v = _mm256_i32gather_epi64 ((const long long *)(src + (size_t)i * step), idx, 1);
+      _mm256_storeu_si256 ((__m256i *)(dest + (size_t)i * 8), v);
+    }
+
+  STRIDED_LOOP (dest + (size_t)i * 8, 8, src + (size_t)i * step, step, 8, n - i);
+}
+#endif
+
+static atomic_int _strided_avx2 = -1;
+
+static bool
+strided_use_avx2 (void)
+{
+  // Racing threads all come to the same answer
+  int ret = atomic_load (&_strided_avx2);
+  if (ret < 0)
+    {
+      ret = 0;
+#ifdef STRIDED_HAVE_AVX2
+      ret = __builtin_cpu_supports ("avx2") ? 1 : 0;
+#endif
+      atomic_store (&_strided_avx2, ret);
+    }
+  return ret == 1;
+}
+
+void
+strided_gather (u8 *dest, const u8 *src, u32 bsize, u32 step, u32 n)
+{
+  ASSERT (bsize > 0);
+  ASSERT (step >= bsize);
+
+  if (n == 0)
+    {
+      return;
+    }
+
+  if (step == bsize)
+    {
+      i_memcpy (dest, src, (size_t)bsize * n);
+      return;
+    }
+
+#ifdef STRIDED_HAVE_AVX2
+  // Lane offsets are signed 32 bit
+  if ((bsize == 4 || bsize == 8) && step <= INT32_MAX / 8 && strided_use_avx2 ())
+    {
+      if (bsize == 4)
+        {
+          strided_gather_avx2_4 (dest, src, step, n);
+        }
+      else
+        {
+          strided_gather_avx2_8 (dest, src, step, n);
+        }
+      return;
+    }
+#else
+  (void)strided_use_avx2;
+#endif
+
+  strided_gather_portable (dest, src, bsize, step, n);
+}
+
+void
+strided_scatter (u8 *dest, const u8 *src, u32 bsize, u32 step, u32 n)
+{
+  ASSERT (bsize > 0);
+  ASSERT (step >= bsize);
+
+  if (n == 0)
+    {
+      return;
+    }
+
+  if (step == bsize)
+    {
+      i_memcpy (dest, src, (size_t)bsize * n);
+      return;
+    }
+
+  // No scatter instruction worth using below AVX-512
+  strided_copy (dest, step, src, bsize, bsize, n);
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, strided_gather_scatter)
+{
+  u8 strided[4096];
+  u8 packed[4096];
+  u8 expected[4096];
+
+  u32 bsizes[] = { 1, 2, 3, 4, 8, 12, 16 };
+  u32 strides[] = { 1, 2, 3, 5, 8 };
+  u32 ns[] = { 0, 1, 3, 4, 7, 8, 9, 17 };
+
+  for (u32 b = 0; b < arrlen (bsizes); ++b)
+    {
+      for (u32 s = 0; s < arrlen (strides); ++s)
+        {
+          for (u32 k = 0; k < arrlen (ns); ++k)
+            {
+              u32 bsize = bsizes[b];
+              u32 step = bsize * strides[s];
+              u32 n = ns[k];
+
+              TEST_CASE ("bsize=%" PRIu32 " step=%" PRIu32 " n=%" PRIu32, bsize, step, n)
+              {
+                rand_bytes (strided, sizeof (strided));
+
+                // Gather
+                for (u32 i = 0; i < n; ++i)
+                  {
+                    i_memcpy (expected + i * bsize, strided + i * step, bsize);
+                  }
+
+                i_memset (packed, 0, sizeof (packed));
+                strided_gather (packed, strided, bsize, step, n);
+                test_assert_memequal (packed, expected, n * bsize);
+
+                i_memset (packed, 0, sizeof (packed));
+                strided_gather_portable (packed, strided, bsize, step, n);
+                test_assert_memequal (packed, expected, n * bsize);
+
+                // Scatter leaves the gaps alone
+                i_memcpy (expected, strided, sizeof (strided));
+                rand_bytes (packed, sizeof (packed));
+                for (u32 i = 0; i < n; ++i)
+                  {
+                    i_memcpy (expected + i * step, packed + i * bsize, bsize);
+                  }
+
+                strided_scatter (strided, packed, bsize, step, n);
+                test_assert_memequal (strided, expected, sizeof (strided));
+              }
+            }
+        }
+    }
+}
+#endif
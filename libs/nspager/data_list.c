@@ -24,6 +24,7 @@
 #include <numstore/core/error.h>
 #include <numstore/core/math.h>
 #include <numstore/core/random.h>
+#include <numstore/core/strided.h>
 #include <numstore/intf/logging.h>
 #include <numstore/intf/types.h>
 #include <numstore/pager/page.h>
@@ -315,6 +316,98 @@ dl_read_into_cbuffer (const page *d, struct cbuffer *dest, p_size offset, p_size
   return toread;
 }
 
+/**
+ * Whole elements [bsize] wide and [step] bytes apart starting at
+ * [offset] that sit in this page, capped by [maxn] and by the contiguous
+ * space [contig]
+ */
+static p_size
+dl_strided_count (const page *d, p_size offset, t_size bsize, b_size step, b_size maxn, u32 contig)
+{
+  ASSERT (bsize > 0);
+  ASSERT (step >= bsize);
+
+  p_size dlen = dl_used (d);
+  ASSERT (offset <= dlen);
+
+  if (dlen - offset < bsize)
+    {
+      return 0;
+    }
+
+  b_size n = (dlen - offset - bsize) / step + 1;
+  n = MIN (n, maxn);
+  n = MIN (n, contig / bsize);
+
+  return (p_size)n;
+}
+
+p_size
+dl_gather_into_cbuffer (const page *d, struct cbuffer *dest, p_size offset, t_size bsize, b_size step, b_size maxn)
+{
+  struct bytes avail = cbuffer_get_next_avail_bytes (dest);
+
+  p_size n = dl_strided_count (d, offset, bsize, step, maxn, avail.len);
+  if (n == 0)
+    {
+      return 0;
+    }
+
+  // One element only ever needs [bsize] - keeps [step] in a u32
+  const u8 *base = dl_get_data (d);
+  strided_gather (avail.head, base + offset, bsize, n > 1 ? (u32)step : bsize, n);
+  cbuffer_fakewrite (dest, n * bsize);
+
+  return n;
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, dl_gather_into_cbuffer)
+{
+  page p;
+  u8 src[DL_DATA_SIZE];
+  u8 raw[64];
+
+  page_init_empty (&p, PG_DATA_LIST);
+  rand_bytes (src, sizeof (src));
+  i_memcpy (dl_get_data (&p), src, 100);
+  dl_set_used (&p, 100);
+
+  TEST_CASE ("Whole elements in page only")
+  {
+    struct cbuffer c = cbuffer_create (raw, sizeof (raw));
+
+    // 4 byte elements 12 apart from 90 - only [90, 94) fits before 100
+    p_size n = dl_gather_into_cbuffer (&p, &c, 90, 4, 12, 100);
+    test_assert_int_equal (n, 1);
+    test_assert_int_equal (cbuffer_len (&c), 4);
+    test_assert_memequal (raw, src + 90, 4);
+
+    // [98, 102) crosses the end
+    test_assert_int_equal (dl_gather_into_cbuffer (&p, &c, 98, 4, 12, 100), 0);
+  }
+
+  TEST_CASE ("Capped by destination and maxn")
+  {
+    struct cbuffer c = cbuffer_create (raw, sizeof (raw));
+
+    // 8 byte elements 16 apart - 6 fit in the page, 8 in the buffer
+    p_size n = dl_gather_into_cbuffer (&p, &c, 0, 8, 16, 100);
+    test_assert_int_equal (n, 6);
+    for (u32 i = 0; i < n; ++i)
+      {
+        test_assert_memequal (raw + i * 8, src + i * 16, 8);
+      }
+
+    c = cbuffer_create (raw, sizeof (raw));
+    test_assert_int_equal (dl_gather_into_cbuffer (&p, &c, 0, 8, 16, 3), 3);
+
+    c = cbuffer_create (raw, 20);
+    test_assert_int_equal (dl_gather_into_cbuffer (&p, &c, 0, 8, 8, 100), 2);
+  }
+}
+#endif
+
 p_size
 dl_read_out_into_cbuffer (page *d, struct cbuffer *dest, p_size offset, p_size b)
 {
@@ -756,6 +849,52 @@ dl_write_from_buffer (page *d, struct cbuffer *src, p_size offset, p_size nbytes
   return toread;
 }
 
+p_size
+dl_scatter_from_cbuffer (page *d, struct cbuffer *src, p_size offset, t_size bsize, b_size step, b_size maxn)
+{
+  struct bytes data = cbuffer_get_next_data_bytes (src);
+
+  p_size n = dl_strided_count (d, offset, bsize, step, maxn, data.len);
+  if (n == 0)
+    {
+      return 0;
+    }
+
+  u8 *base = dl_get_data (d);
+  strided_scatter (base + offset, data.head, bsize, n > 1 ? (u32)step : bsize, n);
+  cbuffer_fakeread (src, n * bsize);
+
+  return n;
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, dl_scatter_from_cbuffer)
+{
+  page p;
+  u8 before[DL_DATA_SIZE];
+  u8 raw[24];
+
+  page_init_empty (&p, PG_DATA_LIST);
+  rand_bytes (dl_get_data (&p), 100);
+  dl_set_used (&p, 100);
+  i_memcpy (before, dl_get_data (&p), 100);
+
+  rand_bytes (raw, sizeof (raw));
+  struct cbuffer c = cbuffer_create_with (raw, sizeof (raw), sizeof (raw));
+
+  // 3 elements of 8 bytes, 40 apart - the gaps stay as they were
+  p_size n = dl_scatter_from_cbuffer (&p, &c, 10, 8, 40, 100);
+  test_assert_int_equal (n, 3);
+  test_assert_int_equal (cbuffer_len (&c), 0);
+
+  for (u32 i = 0; i < n; ++i)
+    {
+      i_memcpy (before + 10 + i * 40, raw + i * 8, 8);
+    }
+  test_assert_memequal (dl_get_data (&p), before, 100);
+}
+#endif
+
 p_size
 dl_memset_from_buffer (page *d, struct cbuffer *src, p_size nbytes)
 {
@@ -1006,6 +1145,146 @@ TEST (TT_UNIT, dl_shift_right)
 }
 #endif
 
+p_size
+dl_insert (page *d, const u8 *src, p_size offset, p_size nbytes)
+{
+  DBG_ASSERT (data_list, d);
+  ASSERT (src);
+  ASSERT (offset <= dl_used (d));
+
+  p_size used = dl_used (d);
+  p_size next = MIN (dl_avail (d), nbytes);
+  u8 *data = dl_get_data (d);
+
+  // Make room, then fill it
+  i_memmove (data + offset + next, data + offset, used - offset);
+  i_memcpy (data + offset, src, next);
+
+  dl_set_used (d, used + next);
+
+  return next;
+}
+
+void
+dl_remove (page *d, p_size offset, p_size nbytes)
+{
+  DBG_ASSERT (data_list, d);
+  ASSERT (offset + nbytes <= dl_used (d));
+
+  p_size used = dl_used (d);
+  u8 *data = dl_get_data (d);
+
+  i_memmove (data + offset, data + offset + nbytes, used - offset - nbytes);
+
+  dl_set_used (d, used - nbytes);
+}
+
+/**
+ * True if the only difference between [before] and [after] is [nbytes]
+ * inserted at [offset] (an append when offset is the old used count).
+ * Bytes past used aren't part of the page's contents and are ignored
+ */
+bool
+dl_diff_insert (const page *before, const page *after, p_size *offset, p_size *nbytes)
+{
+  p_size bused = dl_used (before);
+  p_size aused = dl_used (after);
+
+  if (aused <= bused || i_memcmp (before->raw, after->raw, DL_BLEN_OFST) != 0)
+    {
+      return false;
+    }
+
+  const u8 *b = dl_get_data (before);
+  const u8 *a = dl_get_data (after);
+  p_size n = aused - bused;
+
+  // Common prefix
+  p_size x = 0;
+  while (x < bused && a[x] == b[x])
+    {
+      x++;
+    }
+
+  // The rest moved right by n
+  if (i_memcmp (a + x + n, b + x, bused - x) != 0)
+    {
+      return false;
+    }
+
+  *offset = x;
+  *nbytes = n;
+
+  return true;
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, dl_insert_remove)
+{
+  page before, after;
+  u8 src[32];
+  u8 ins[8];
+  p_size ofst, n;
+
+  rand_bytes (src, sizeof src);
+  rand_bytes (ins, sizeof ins);
+
+  rand_bytes (before.raw, PAGE_SIZE);
+  page_init_empty (&before, PG_DATA_LIST);
+  dl_memset (&before, src, sizeof src);
+
+  TEST_CASE ("insert in the middle")
+  {
+    after = before;
+    test_assert_int_equal (dl_insert (&after, ins, 10, sizeof ins), sizeof ins);
+    test_assert_int_equal (dl_used (&after), sizeof src + sizeof ins);
+    test_assert_memequal (dl_get_data (&after), src, 10);
+    test_assert_memequal ((u8 *)dl_get_data (&after) + 10, ins, sizeof ins);
+    test_assert_memequal ((u8 *)dl_get_data (&after) + 10 + sizeof ins, src + 10, sizeof src - 10);
+
+    test_assert (dl_diff_insert (&before, &after, &ofst, &n));
+    test_assert_int_equal (n, sizeof ins);
+
+    // Replaying the diff gives the same contents
+    page redo = before;
+    dl_insert (&redo, (u8 *)dl_get_data (&after) + ofst, ofst, n);
+    test_assert_memequal (dl_get_data (&redo), dl_get_data (&after), dl_used (&after));
+
+    dl_remove (&after, ofst, n);
+    test_assert_int_equal (dl_used (&after), sizeof src);
+    test_assert_memequal (dl_get_data (&after), src, sizeof src);
+  }
+
+  TEST_CASE ("append")
+  {
+    after = before;
+    dl_append (&after, ins, sizeof ins);
+
+    test_assert (dl_diff_insert (&before, &after, &ofst, &n));
+    test_assert_int_equal (ofst, sizeof src);
+    test_assert_int_equal (n, sizeof ins);
+  }
+
+  TEST_CASE ("overwrite is not an insert")
+  {
+    after = before;
+    dl_append (&after, ins, sizeof ins);
+    dl_write (&after, ins, 0, sizeof ins);
+
+    test_assert (!dl_diff_insert (&before, &after, &ofst, &n));
+  }
+
+  TEST_CASE ("header change is not an insert")
+  {
+    after = before;
+    dl_append (&after, ins, sizeof ins);
+    dl_set_next (&after, 5);
+
+    test_assert (!dl_diff_insert (&before, &after, &ofst, &n));
+  }
+}
+#endif
+
 void
 dl_move_right (page *src, page *dest, p_size len)
 {
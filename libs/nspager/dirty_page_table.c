@@ -41,19 +41,30 @@ DEFINE_DBG_ASSERT (
 
 // Lifecycle
 struct dpg_table *
-dpgt_open (error *e)
+dpgt_open (u32 cap, error *e)
 {
+  ASSERT (cap > 0);
+
   struct dpg_table *ret = i_calloc (1, sizeof *ret, e);
   if (ret == NULL)
     {
       return NULL;
     }
 
-  ht_init_dpt (&ret->table, ret->_table, arrlen (ret->_table));
+  ret->_table = i_calloc (cap, sizeof *ret->_table, e);
+  if (ret->_table == NULL)
+    {
+      i_free (ret);
+      return NULL;
+    }
+  ret->cap = cap;
+
+  ht_init_dpt (&ret->table, ret->_table, cap);
 
-  err_t result = clck_alloc_open (&ret->alloc, sizeof (struct dpg_entry), arrlen (ret->_table), e);
+  err_t result = clck_alloc_open (&ret->alloc, sizeof (struct dpg_entry), cap, e);
   if (result != SUCCESS)
     {
+      i_free (ret->_table);
       i_free (ret);
       return NULL;
     }
@@ -68,6 +79,7 @@ dpgt_close (struct dpg_table *t)
 {
   DBG_ASSERT (dirty_pg_table, t);
   clck_alloc_close (&t->alloc);
+  i_free (t->_table);
   i_free (t);
 }
 
@@ -80,7 +92,7 @@ dpgt_equal (struct dpg_table *left, struct dpg_table *right)
   spx_latch_lock_s (&left->l);
   spx_latch_lock_s (&right->l);
 
-  for (u32 i = 0; i < arrlen (left->_table); ++i)
+  for (u32 i = 0; i < left->cap; ++i)
     {
       hentry_dpt entry = left->_table[i];
 
@@ -112,7 +124,7 @@ dpgt_equal (struct dpg_table *left, struct dpg_table *right)
     }
 
   u32 right_len = 0;
-  for (u32 i = 0; i < arrlen (right->_table); ++i)
+  for (u32 i = 0; i < right->cap; ++i)
     {
       hentry_dpt entry = right->_table[i];
 
@@ -136,7 +148,7 @@ dpgt_rand_populate (struct dpg_table *dpt)
 {
   u32 len = 0;
 
-  for (u32 i = 0; i < arrlen (dpt->_table); i++)
+  for (u32 i = 0; i < dpt->cap; i++)
     {
       if (dpt->_table[i].present)
         {
@@ -144,7 +156,7 @@ dpgt_rand_populate (struct dpg_table *dpt)
         }
     }
 
-  len = randu32r (0, arrlen (dpt->_table) - len);
+  len = randu32r (0, dpt->cap - len);
 
   for (u32 i = 0; i < len; ++i)
     {
@@ -162,7 +174,7 @@ i_log_dpgt (int log_level, struct dpg_table *dpt)
 
   i_log (log_level, "================ Dirty Page Table START ================\n");
   i_printf (log_level, "txid recLSN\n");
-  for (u32 i = 0; i < arrlen (dpt->_table); ++i)
+  for (u32 i = 0; i < dpt->cap; ++i)
     {
       const hentry_dpt e = dpt->_table[i];
 
@@ -181,6 +193,76 @@ i_log_dpgt (int log_level, struct dpg_table *dpt)
 }
 
 // Methods
+
+/**
+ * Doubles the capacity of [t]
+ *
+ * Entries are copied into a fresh table and allocator. Callers only
+ * ever hold copies of entries, so moving them is safe.
+ *
+ * Caller holds [t->l] in X
+ */
+static err_t
+dpgt_grow (struct dpg_table *t, error *e)
+{
+  if (t->cap > U32_MAX / 2)
+    {
+      return error_causef (e, ERR_DPGT_FULL, "Not enough space in the dirty page table");
+    }
+
+  u32 cap = t->cap * 2;
+
+  hentry_dpt *_table = i_calloc (cap, sizeof *_table, e);
+  if (_table == NULL)
+    {
+      return e->cause_code;
+    }
+
+  struct clck_alloc alloc;
+  if (clck_alloc_open (&alloc, sizeof (struct dpg_entry), cap, e))
+    {
+      i_free (_table);
+      return e->cause_code;
+    }
+
+  hash_table_dpt table;
+  ht_init_dpt (&table, _table, cap);
+
+  for (u32 i = 0; i < t->cap; ++i)
+    {
+      if (t->_table[i].present)
+        {
+          struct dpg_entry *src = t->_table[i].data.value;
+
+          // Can't fail - the new allocator is twice as big
+          struct dpg_entry *v = clck_alloc_alloc (&alloc, NULL);
+          ASSERT (v);
+
+          *v = (struct dpg_entry){
+            .rec_lsn = src->rec_lsn,
+            .pg = src->pg,
+          };
+          spx_latch_init (&v->l);
+
+          ht_insert_expect_dpt (&table, (hdata_dpt){
+                                            .key = src->pg,
+                                            .value = v,
+                                        });
+        }
+    }
+
+  clck_alloc_close (&t->alloc);
+  i_free (t->_table);
+
+  t->alloc = alloc;
+  spx_latch_init (&t->alloc.l);
+  t->_table = _table;
+  t->table = table;
+  t->cap = cap;
+
+  return SUCCESS;
+}
+
 err_t
 dpgt_add (struct dpg_table *t, pgno pg, lsn rec_lsn, error *e)
 {
@@ -188,11 +270,17 @@ dpgt_add (struct dpg_table *t, pgno pg, lsn rec_lsn, error *e)
 
   spx_latch_lock_x (&t->l);
 
-  struct dpg_entry *v = clck_alloc_alloc (&t->alloc, e);
+  struct dpg_entry *v = clck_alloc_alloc (&t->alloc, NULL);
   if (v == NULL)
     {
-      spx_latch_unlock_x (&t->l);
-      return error_change_causef (e, ERR_DPGT_FULL, "Not enough space in the dirty page table");
+      // Full - recovery can see more dirty pages than the pool holds
+      if (dpgt_grow (t, e))
+        {
+          spx_latch_unlock_x (&t->l);
+          return e->cause_code;
+        }
+      v = clck_alloc_alloc (&t->alloc, NULL);
+      ASSERT (v);
     }
 
   hdata_dpt data = {
@@ -321,7 +409,7 @@ dpgt_min_rec_lsn (struct dpg_table *d)
   spx_latch_lock_s (&d->l);
 
   lsn ret = (lsn)-1;
-  for (p_size i = 0; i < arrlen (d->_table); ++i)
+  for (p_size i = 0; i < d->cap; ++i)
     {
       hentry_dpt *entry = &d->_table[i];
       if (entry->present)
@@ -342,49 +430,81 @@ dpgt_min_rec_lsn (struct dpg_table *d)
   return ret;
 }
 
-void
-dpgt_merge_into (struct dpg_table *dest, struct dpg_table *src)
+err_t
+dpgt_merge_into (struct dpg_table *dest, struct dpg_table *src, error *e)
 {
   spx_latch_lock_s (&src->l);
   spx_latch_lock_x (&dest->l);
 
-  for (p_size i = 0; i < arrlen (src->_table); ++i)
+  for (p_size i = 0; i < src->cap; ++i)
     {
       hentry_dpt *entry = &src->_table[i];
       if (entry->present)
         {
+          // Entries are copied - the values belong to src's allocator
           hdata_dpt data;
-          switch (ht_delete_dpt (&dest->table, &data, entry->data.key))
+          switch (ht_get_dpt (&dest->table, &data, entry->data.key))
             {
             case HTAR_DOESNT_EXIST:
               {
-                ht_insert_expect_dpt (&dest->table, entry->data);
+                struct dpg_entry *v = clck_alloc_alloc (&dest->alloc, NULL);
+                if (v == NULL)
+                  {
+                    if (dpgt_grow (dest, e))
+                      {
+                        goto theend;
+                      }
+                    v = clck_alloc_alloc (&dest->alloc, NULL);
+                    ASSERT (v);
+                  }
+
+                *v = (struct dpg_entry){
+                  .rec_lsn = entry->data.value->rec_lsn,
+                  .pg = entry->data.value->pg,
+                };
+                spx_latch_init (&v->l);
+
+                ht_insert_expect_dpt (&dest->table, (hdata_dpt){
+                                                        .key = entry->data.key,
+                                                        .value = v,
+                                                    });
                 break;
               }
             case HTAR_SUCCESS:
               {
-                ht_insert_expect_dpt (&dest->table, entry->data);
+                data.value->rec_lsn = entry->data.value->rec_lsn;
                 break;
               }
             }
         }
     }
 
+theend:
   spx_latch_unlock_x (&dest->l);
   spx_latch_unlock_s (&src->l);
+
+  return e->cause_code;
 }
 
 //////////////////////////////////////////////////
 ///// Serialization / Deserialization for checkpoint
 
 u32
-dpgt_serialize (u8 dest[MAX_DPGT_SRL_SIZE], struct dpg_table *t)
+dpgt_max_serialize_size (const struct dpg_table *t)
 {
-  struct serializer s = srlizr_create (dest, MAX_DPGT_SRL_SIZE);
+  DBG_ASSERT (dirty_pg_table, t);
+  return MAX_DPGT_SRL_SIZE (t->cap);
+}
+
+u32
+dpgt_serialize (u8 *dest, u32 dlen, struct dpg_table *t)
+{
+  ASSERT (dlen >= dpgt_max_serialize_size (t));
+  struct serializer s = srlizr_create (dest, dlen);
 
   spx_latch_lock_s (&t->l);
 
-  for (u32 i = 0; i < arrlen (t->_table); ++i)
+  for (u32 i = 0; i < t->cap; ++i)
     {
       if (t->_table[i].present)
         {
@@ -411,7 +531,15 @@ dpgt_serialize (u8 dest[MAX_DPGT_SRL_SIZE], struct dpg_table *t)
 struct dpg_table *
 dpgt_deserialize (const u8 *src, u32 dlen, error *e)
 {
-  struct dpg_table *t = dpgt_open (e);
+  if (dlen % DPGT_SRL_ENTRY_SIZE != 0)
+    {
+      error_causef (e, ERR_CORRUPT, "DPG table size: %d is invalid", dlen);
+      return NULL;
+    }
+
+  // The table is sized to what was serialized - the writer bounded it by its own capacity
+  u32 nentries = dlen / DPGT_SRL_ENTRY_SIZE;
+  struct dpg_table *t = dpgt_open (nentries > 0 ? nentries : 1, e);
   if (t == NULL)
     {
       return NULL;
@@ -424,12 +552,6 @@ dpgt_deserialize (const u8 *src, u32 dlen, error *e)
 
   struct deserializer d = dsrlizr_create (src, dlen);
 
-  if (d.dlen > MAX_DPGT_SRL_SIZE)
-    {
-      error_causef (e, ERR_CORRUPT, "DPG table size: %d is invalid", d.dlen);
-      return NULL;
-    }
-
   while (true)
     {
       pgno pg;
@@ -457,6 +579,7 @@ dpgt_crash (struct dpg_table *t)
 {
   DBG_ASSERT (dirty_pg_table, t);
   clck_alloc_close (&t->alloc);
+  i_free (t->_table);
   i_free (t);
 }
 #endif
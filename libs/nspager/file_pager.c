@@ -20,9 +20,11 @@
 #include <file_pager.h>
 
 #include <numstore/core/assert.h>
+#include <numstore/core/checksums.h>
 #include <numstore/core/error.h>
 #include <numstore/intf/logging.h>
 #include <numstore/intf/os.h>
+#include <numstore/intf/stdlib.h>
 #include <numstore/test/testing.h>
 
 #include <config.h>
@@ -57,22 +59,320 @@ fpgr_set_len (struct file_pager *p, error *e)
   return SUCCESS;
 }
 
+///////////////////////////////////////////////////////
+/// Double-write file
+
+/**
+ * One slot: [seq][pg][crc] then the page. [seq] orders copies of the
+ * same page, the crc covers everything else
+ */
+#define FPGR_DW_HDR (2 * sizeof (u64) + sizeof (u32))
+#define FPGR_DW_ENTRY ((u64)FPGR_DW_HDR + PAGE_SIZE)
+#define FPGR_DW_FNAME_LEN 1024
+
+static void
+fpgr_dw_fname (char dest[FPGR_DW_FNAME_LEN], const char *fname)
+{
+  int len = i_snprintf (dest, FPGR_DW_FNAME_LEN, "%s.dwb", fname);
+  ASSERT (len > 0 && len < (int)FPGR_DW_FNAME_LEN);
+}
+
+static void
+fpgr_dw_pack (u8 *dest, u64 seq, pgno pg, const u8 *page)
+{
+  u32 checksum = checksum_init ();
+  i_memcpy (dest, &seq, sizeof (u64));
+  i_memcpy (dest + sizeof (u64), &pg, sizeof (u64));
+  checksum_execute (&checksum, dest, 2 * sizeof (u64));
+  checksum_execute (&checksum, page, PAGE_SIZE);
+  i_memcpy (dest + 2 * sizeof (u64), &checksum, sizeof (u32));
+  i_memcpy (dest + FPGR_DW_HDR, page, PAGE_SIZE);
+}
+
+static bool
+fpgr_dw_unpack (u64 *seq, pgno *pg, const u8 *src)
+{
+  u32 checksum = checksum_init ();
+  u32 actual;
+  checksum_execute (&checksum, src, 2 * sizeof (u64));
+  checksum_execute (&checksum, src + FPGR_DW_HDR, PAGE_SIZE);
+  i_memcpy (&actual, src + 2 * sizeof (u64), sizeof (u32));
+  if (checksum != actual)
+    {
+      return false;
+    }
+
+  i_memcpy (seq, src, sizeof (u64));
+  i_memcpy (pg, src + sizeof (u64), sizeof (u64));
+  return true;
+}
+
+static err_t
+fpgr_dw_truncate (struct file_pager *p, error *e)
+{
+  err_t_wrap (i_truncate (&p->dw, 0, e), e);
+  err_t_wrap (i_fsync (&p->dw, e), e);
+  p->dw_next = 0;
+  return SUCCESS;
+}
+
+/**
+ * Everything written in place so far is made durable and the
+ * double-write file starts over.
+ *
+ * Caller holds [p->dw_l] with nothing in flight
+ */
+static err_t
+fpgr_dw_reset (struct file_pager *p, error *e)
+{
+  ASSERT (p->dw_inflight == 0);
+
+  err_t_wrap (i_fsync (&p->f, e), e);
+  if (p->dw_next > 0)
+    {
+      err_t_wrap (fpgr_dw_truncate (p, e), e);
+    }
+
+  return SUCCESS;
+}
+
+/**
+ * Puts back the newest whole copy of every page in the double-write
+ * file. Each one was synced before its in place write started, which
+ * may have been torn. Copies from before the last sync were dropped
+ * with the file, so nothing here is older than what's in place
+ */
+static err_t
+fpgr_dw_recover (struct file_pager *p, error *e)
+{
+  i64 size = i_file_size (&p->dw, e);
+  if (size < 0)
+    {
+      return e->cause_code;
+    }
+
+  u32 n = (u32)MIN ((u64)size / FPGR_DW_ENTRY, (u64)FPGR_DW_PAGES);
+  if (size == 0)
+    {
+      return SUCCESS;
+    }
+
+  // Left behind by a database that was since deleted
+  if (n == 0 || p->npages == 0)
+    {
+      return fpgr_dw_truncate (p, e);
+    }
+
+  err_t ret = SUCCESS;
+  u8 *entries = i_malloc (n, FPGR_DW_ENTRY, e);
+  u64 *seqs = i_malloc (n, sizeof *seqs, e);
+  pgno *pgs = i_malloc (n, sizeof *pgs, e);
+  if (entries == NULL || seqs == NULL || pgs == NULL)
+    {
+      goto theend;
+    }
+
+  i64 nread = i_pread_all (&p->dw, entries, (u64)n * FPGR_DW_ENTRY, 0, e);
+  if (nread < 0)
+    {
+      goto theend;
+    }
+
+  // Torn copies belong to batches that never started writing in place
+  for (u32 i = 0; i < n; ++i)
+    {
+      if (!fpgr_dw_unpack (&seqs[i], &pgs[i], entries + (u64)i * FPGR_DW_ENTRY))
+        {
+          pgs[i] = PGNO_NULL;
+        }
+    }
+
+  u32 nrepaired = 0;
+  for (u32 i = 0; i < n; ++i)
+    {
+      if (pgs[i] == PGNO_NULL)
+        {
+          continue;
+        }
+
+      bool newest = true;
+      for (u32 j = 0; j < n && newest; ++j)
+        {
+          newest = j == i || pgs[j] != pgs[i] || seqs[j] < seqs[i];
+        }
+      if (!newest)
+        {
+          continue;
+        }
+
+      const u8 *page = entries + (u64)i * FPGR_DW_ENTRY + FPGR_DW_HDR;
+      err_t_wrap_goto (i_pwrite_all (&p->f, page, PAGE_SIZE, pgs[i] * PAGE_SIZE, e), theend, e);
+      nrepaired++;
+    }
+
+  i_log_info ("Rewrote %u pages from the double-write file\n", nrepaired);
+
+  err_t_wrap_goto (i_fsync (&p->f, e), theend, e);
+  err_t_wrap_goto (fpgr_dw_truncate (p, e), theend, e);
+
+theend:
+  ret = e->cause_code;
+  if (pgs)
+    {
+      i_free (pgs);
+    }
+  if (seqs)
+    {
+      i_free (seqs);
+    }
+  if (entries)
+    {
+      i_free (entries);
+    }
+  return ret;
+}
+
+/**
+ * Takes [n] consecutive slots for a write, starting the file over
+ * once it's full and every earlier write has landed in place
+ */
+static err_t
+fpgr_dw_reserve (struct file_pager *p, u32 n, u32 *slot, u64 *seq, error *e)
+{
+  ASSERT (n > 0 && n <= FPGR_DW_PAGES);
+
+  err_t ret = SUCCESS;
+
+  i_mutex_lock (&p->dw_l);
+
+  while (p->dw_next + n > FPGR_DW_PAGES)
+    {
+      if (p->dw_inflight > 0)
+        {
+          i_cond_wait (&p->dw_drained, &p->dw_l);
+          continue;
+        }
+      err_t_wrap_goto (fpgr_dw_reset (p, e), theend, e);
+    }
+
+  *slot = p->dw_next;
+  *seq = p->dw_seq;
+  p->dw_next += n;
+  p->dw_seq += n;
+  p->dw_inflight++;
+
+theend:
+  ret = e->cause_code;
+  i_mutex_unlock (&p->dw_l);
+  return ret;
+}
+
+static void
+fpgr_dw_release (struct file_pager *p)
+{
+  i_mutex_lock (&p->dw_l);
+  ASSERT (p->dw_inflight > 0);
+  if (--p->dw_inflight == 0)
+    {
+      i_cond_broadcast (&p->dw_drained);
+    }
+  i_mutex_unlock (&p->dw_l);
+}
+
+/**
+ * Copies [n] pages into the slots from [slot] on and syncs them. The
+ * caller writes them in place after and then releases the slots
+ */
+static err_t
+fpgr_dw_write (struct file_pager *p, const struct fpgr_io *ios, u32 nios, u32 n, error *e)
+{
+  u32 slot;
+  u64 seq;
+  err_t_wrap (fpgr_dw_reserve (p, n, &slot, &seq, e), e);
+
+  u8 *entries = i_malloc (n, FPGR_DW_ENTRY, e);
+  if (entries == NULL)
+    {
+      fpgr_dw_release (p);
+      return e->cause_code;
+    }
+
+  u32 k = 0;
+  for (u32 i = 0; i < nios; ++i)
+    {
+      for (u32 j = 0; j < ios[i].npages; ++j, ++k)
+        {
+          fpgr_dw_pack (entries + (u64)k * FPGR_DW_ENTRY, seq + k, ios[i].pg + j, ios[i].buf + (u64)j * PAGE_SIZE);
+        }
+    }
+  ASSERT (k == n);
+
+  err_t ret = i_pwrite_all (&p->dw, entries, (u64)n * FPGR_DW_ENTRY, (u64)slot * FPGR_DW_ENTRY, e);
+  i_free (entries);
+  if (ret == SUCCESS)
+    {
+      ret = i_fsync (&p->dw, e);
+    }
+  if (ret)
+    {
+      fpgr_dw_release (p);
+    }
+
+  return ret;
+}
+
+///////////////////////////////////////////////////////
+/// Lifecycle
+
 err_t
 fpgr_open (struct file_pager *dest, const char *fname, error *e)
 {
+  char dwname[FPGR_DW_FNAME_LEN];
+  fpgr_dw_fname (dwname, fname);
+
   if (i_open_rw (&dest->f, fname, e))
     {
       return e->cause_code;
     }
-  if (fpgr_set_len (dest, e))
+  if (i_open_rw (&dest->dw, dwname, e))
     {
-      i_close (&dest->f, e);
-      return e->cause_code;
+      goto failed_file;
+    }
+  if (i_mutex_create (&dest->dw_l, e))
+    {
+      goto failed_dw;
+    }
+  if (i_cond_create (&dest->dw_drained, e))
+    {
+      goto failed_mutex;
+    }
+  dest->dw_next = 0;
+  dest->dw_inflight = 0;
+  dest->dw_seq = 0;
+
+  // Torn pages are put back before anything reads them
+  if (fpgr_set_len (dest, e) || fpgr_dw_recover (dest, e) || fpgr_set_len (dest, e))
+    {
+      goto failed_cond;
+    }
+  if (i_aio_open (&dest->aio, PGR_IO_BATCH, e))
+    {
+      goto failed_cond;
     }
 
   DBG_ASSERT (file_pager, dest);
 
   return SUCCESS;
+
+failed_cond:
+  i_cond_free (&dest->dw_drained);
+failed_mutex:
+  i_mutex_free (&dest->dw_l);
+failed_dw:
+  i_close (&dest->dw, e);
+failed_file:
+  i_close (&dest->f, e);
+  return e->cause_code;
 }
 
 #ifndef NTEST
@@ -111,11 +411,28 @@ TEST (TT_UNIT, fpgr_open)
 }
 #endif
 
+static void
+fpgr_free (struct file_pager *f, error *e)
+{
+  i_aio_close (&f->aio);
+  i_cond_free (&f->dw_drained);
+  i_mutex_free (&f->dw_l);
+  i_close (&f->dw, e);
+  i_close (&f->f, e);
+}
+
 err_t
 fpgr_close (struct file_pager *f, error *e)
 {
   DBG_ASSERT (file_pager, f);
-  i_close (&f->f, e);
+
+  // Nothing is in flight once the pager is closing
+  if (f->dw_next > 0)
+    {
+      fpgr_dw_reset (f, e);
+    }
+
+  fpgr_free (f, e);
   return e->cause_code;
 }
 
@@ -125,7 +442,22 @@ fpgr_reset (struct file_pager *f, error *e)
   DBG_ASSERT (file_pager, f);
   err_t_wrap (i_truncate (&f->f, 0, e), e);
   f->npages = 0;
-  return e->cause_code;
+
+  i_mutex_lock (&f->dw_l);
+  err_t ret = fpgr_dw_reset (f, e);
+  i_mutex_unlock (&f->dw_l);
+
+  return ret;
+}
+
+err_t
+fpgr_remove (const char *fname, error *e)
+{
+  char dwname[FPGR_DW_FNAME_LEN];
+  fpgr_dw_fname (dwname, fname);
+
+  err_t_wrap (i_remove_quiet (dwname, e), e);
+  return i_remove_quiet (fname, e);
 }
 
 p_size
@@ -244,11 +576,182 @@ fpgr_write (struct file_pager *p, const u8 *src, pgno pg, error *e)
   ASSERT (src);
   ASSERT (pg < p->npages);
 
-  err_t_wrap (i_pwrite_all (&p->f, src, PAGE_SIZE, pg * PAGE_SIZE, e), e);
+  struct fpgr_io io = { .pg = pg, .npages = 1, .buf = (u8 *)src };
+  err_t_wrap (fpgr_dw_write (p, &io, 1, 1, e), e);
+
+  err_t ret = i_pwrite_all (&p->f, src, PAGE_SIZE, pg * PAGE_SIZE, e);
+  fpgr_dw_release (p);
 
+  return ret;
+}
+
+err_t
+fpgr_sync (struct file_pager *p, error *e)
+{
+  DBG_ASSERT (file_pager, p);
+
+  err_t ret = SUCCESS;
+
+  i_mutex_lock (&p->dw_l);
+  if (p->dw_inflight == 0)
+    {
+      ret = fpgr_dw_reset (p, e);
+    }
+  else
+    {
+      // Their copies stay until a later sync
+      ret = i_fsync (&p->f, e);
+    }
+  i_mutex_unlock (&p->dw_l);
+
+  return ret;
+}
+
+static inline err_t
+fpgr_check_range (const struct file_pager *p, const struct fpgr_io *io, error *e)
+{
+  ASSERT (io->npages > 0);
+  if (io->pg >= p->npages || io->npages > p->npages - io->pg)
+    {
+      return error_causef (e, ERR_PG_OUT_OF_RANGE,
+                           "File Pager: Invalid page index. "
+                           "Got pages: %" PRpgno " + %" PRIu32 " but total "
+                           "amount of pages is %" PRpgno,
+                           io->pg, io->npages, p->npages);
+    }
   return SUCCESS;
 }
 
+static err_t
+fpgr_batch (struct file_pager *p, const struct fpgr_io *ios, u32 n, bool write, error *e)
+{
+  DBG_ASSERT (file_pager, p);
+
+  struct i_aio_req reqs[I_AIO_MAX_DEPTH];
+
+  for (u32 i = 0; i < n; i += I_AIO_MAX_DEPTH)
+    {
+      u32 len = MIN (I_AIO_MAX_DEPTH, n - i);
+      for (u32 j = 0; j < len; ++j)
+        {
+          const struct fpgr_io *io = &ios[i + j];
+          err_t_wrap (fpgr_check_range (p, io, e), e);
+          reqs[j] = (struct i_aio_req){
+            .buf = io->buf,
+            .n = (u64)io->npages * PAGE_SIZE,
+            .offset = (u64)io->pg * PAGE_SIZE,
+          };
+        }
+
+      if (write)
+        {
+          err_t_wrap (i_aio_pwrite_all (&p->aio, &p->f, reqs, len, e), e);
+        }
+      else
+        {
+          err_t_wrap (i_aio_pread_all (&p->aio, &p->f, reqs, len, e), e);
+        }
+    }
+
+  return SUCCESS;
+}
+
+err_t
+fpgr_read_batch (struct file_pager *p, const struct fpgr_io *ios, u32 n, error *e)
+{
+  return fpgr_batch (p, ios, n, false, e);
+}
+
+err_t
+fpgr_write_batch (struct file_pager *p, const struct fpgr_io *ios, u32 n, error *e)
+{
+  DBG_ASSERT (file_pager, p);
+
+  // Nothing out of range gets a copy to put back later
+  u32 npages = 0;
+  for (u32 i = 0; i < n; ++i)
+    {
+      err_t_wrap (fpgr_check_range (p, &ios[i], e), e);
+      npages += ios[i].npages;
+    }
+  if (npages == 0)
+    {
+      return SUCCESS;
+    }
+
+  err_t_wrap (fpgr_dw_write (p, ios, n, npages, e), e);
+
+  err_t ret = fpgr_batch (p, ios, n, true, e);
+  fpgr_dw_release (p);
+
+  return ret;
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, fpgr_read_write_batch)
+{
+  enum
+  {
+    NPAGES = 2 * PGR_IO_BATCH + 3,
+  };
+
+  error e = error_create ();
+  i_file fp;
+  test_fail_if (i_open_rw (&fp, "test.db", &e));
+  test_fail_if (i_truncate (&fp, 0, &e));
+
+  struct file_pager pager;
+  test_err_t_wrap (fpgr_open (&pager, "test.db", &e), &e);
+
+  static u8 pages[NPAGES][PAGE_SIZE];
+  struct fpgr_io ios[NPAGES];
+  for (u32 i = 0; i < NPAGES; ++i)
+    {
+      pgno pg;
+      test_fail_if (fpgr_new (&pager, &pg, &e));
+      i_memset (pages[i], (int)(i + 1), PAGE_SIZE);
+
+      // Back to front
+      ios[i] = (struct fpgr_io){ .pg = NPAGES - 1 - i, .npages = 1, .buf = pages[i] };
+    }
+
+  test_err_t_wrap (fpgr_write_batch (&pager, ios, NPAGES, &e), &e);
+
+  i_memset (pages, 0, sizeof pages);
+  test_err_t_wrap (fpgr_read_batch (&pager, ios, NPAGES, &e), &e);
+  for (u32 i = 0; i < NPAGES; ++i)
+    {
+      for (u32 j = 0; j < PAGE_SIZE; ++j)
+        {
+          test_assert_int_equal (pages[i][j], (u8)(i + 1));
+        }
+    }
+
+  // Same bytes through the one page path
+  u8 _page[PAGE_SIZE];
+  test_fail_if (fpgr_read (&pager, _page, NPAGES - 1, &e));
+  test_assert_int_equal (_page[0], 1);
+
+  // A run of pages in one request
+  struct fpgr_io run = { .pg = NPAGES - 3, .npages = 3, .buf = pages[0] };
+  i_memset (pages, 0, 3 * PAGE_SIZE);
+  test_err_t_wrap (fpgr_read_batch (&pager, &run, 1, &e), &e);
+  test_assert_int_equal (pages[0][0], 3);
+  test_assert_int_equal (pages[1][0], 2);
+  test_assert_int_equal (pages[2][PAGE_SIZE - 1], 1);
+
+  // Out of range
+  struct fpgr_io bad = { .pg = NPAGES, .npages = 1, .buf = _page };
+  test_err_t_check (fpgr_read_batch (&pager, &bad, 1, &e), ERR_PG_OUT_OF_RANGE, &e);
+  run.npages = 4;
+  test_err_t_check (fpgr_read_batch (&pager, &run, 1, &e), ERR_PG_OUT_OF_RANGE, &e);
+
+  test_fail_if (fpgr_close (&pager, &e));
+  test_fail_if (i_close (&fp, &e));
+  test_fail_if (i_unlink ("test.db", &e));
+}
+#endif
+
 #ifndef NTEST
 TEST (TT_UNIT, fpgr_read_write)
 {
@@ -303,7 +806,76 @@ err_t
 fpgr_crash (struct file_pager *p, error *e)
 {
   DBG_ASSERT (file_pager, p);
-  i_close (&p->f, e);
+  fpgr_free (p, e);
   return e->cause_code;
 }
 #endif
+
+#ifndef NTEST
+TEST (TT_UNIT, fpgr_torn_write)
+{
+  error e = error_create ();
+  struct file_pager pager;
+  u8 a[PAGE_SIZE], b[PAGE_SIZE], c[PAGE_SIZE], _page[PAGE_SIZE];
+  pgno pg;
+
+  i_memset (a, 'a', PAGE_SIZE);
+  i_memset (b, 'b', PAGE_SIZE);
+  i_memset (c, 'c', PAGE_SIZE);
+
+  test_err_t_wrap (fpgr_remove ("test.db", &e), &e);
+
+  // Stands in for an in place write the crash tore
+  i_file raw;
+  u8 zeros[PAGE_SIZE / 2];
+  i_memset (zeros, 0, sizeof (zeros));
+
+  TEST_CASE ("Torn pages come back whole on open")
+  {
+    test_err_t_wrap (fpgr_open (&pager, "test.db", &e), &e);
+    test_err_t_wrap (fpgr_new (&pager, &pg, &e), &e);
+    test_err_t_wrap (fpgr_new (&pager, &pg, &e), &e);
+    test_err_t_wrap (fpgr_write (&pager, a, 0, &e), &e);
+    struct fpgr_io io = { .pg = 1, .npages = 1, .buf = b };
+    test_err_t_wrap (fpgr_write_batch (&pager, &io, 1, &e), &e);
+    test_err_t_wrap (fpgr_crash (&pager, &e), &e);
+
+    test_err_t_wrap (i_open_rw (&raw, "test.db", &e), &e);
+    test_err_t_wrap (i_pwrite_all (&raw, zeros, sizeof (zeros), PAGE_SIZE / 2, &e), &e);
+    test_err_t_wrap (i_close (&raw, &e), &e);
+
+    test_err_t_wrap (fpgr_open (&pager, "test.db", &e), &e);
+    test_err_t_wrap (fpgr_read (&pager, _page, 0, &e), &e);
+    test_assert_memequal (_page, a, PAGE_SIZE);
+    test_err_t_wrap (fpgr_read (&pager, _page, 1, &e), &e);
+    test_assert_memequal (_page, b, PAGE_SIZE);
+  }
+
+  TEST_CASE ("The newest copy wins")
+  {
+    test_err_t_wrap (fpgr_write (&pager, a, 0, &e), &e);
+    test_err_t_wrap (fpgr_write (&pager, c, 0, &e), &e);
+    test_err_t_wrap (fpgr_crash (&pager, &e), &e);
+
+    test_err_t_wrap (i_open_rw (&raw, "test.db", &e), &e);
+    test_err_t_wrap (i_pwrite_all (&raw, zeros, sizeof (zeros), 0, &e), &e);
+    test_err_t_wrap (i_close (&raw, &e), &e);
+
+    test_err_t_wrap (fpgr_open (&pager, "test.db", &e), &e);
+    test_err_t_wrap (fpgr_read (&pager, _page, 0, &e), &e);
+    test_assert_memequal (_page, c, PAGE_SIZE);
+  }
+
+  TEST_CASE ("Syncing drops the copies")
+  {
+    test_err_t_wrap (fpgr_write (&pager, a, 0, &e), &e);
+    test_assert (pager.dw_next > 0);
+    test_err_t_wrap (fpgr_sync (&pager, &e), &e);
+    test_assert_int_equal (pager.dw_next, 0);
+    test_assert_int_equal (i_file_size (&pager.dw, &e), 0);
+    test_err_t_wrap (fpgr_close (&pager, &e), &e);
+  }
+
+  test_err_t_wrap (fpgr_remove ("test.db", &e), &e);
+}
+#endif
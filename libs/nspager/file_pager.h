@@ -27,17 +27,42 @@ struct file_pager
 {
   pgno npages;
   i_file f;
+  i_aio aio; // Batched reads / writes - io_uring where available
+
+  /**
+   * Double-write file "<fname>.dwb". Pages land here, synced, before
+   * they're written in place, so a write torn by a crash is redone from
+   * the whole copy on the next open. It's emptied once the database
+   * file is synced with nothing in flight.
+   */
+  i_file dw;
+  i_mutex dw_l;
+  i_cond dw_drained;
+  u32 dw_next;     // Next free slot
+  u32 dw_inflight; // Writers between taking slots and writing in place
+  u64 dw_seq;
+};
+
+struct fpgr_io
+{
+  pgno pg;
+  u32 npages; // Pages pg ... pg + npages - 1, back to back in buf
+  u8 *buf;
 };
 
 err_t fpgr_open (struct file_pager *dest, const char *fname, error *e);
 err_t fpgr_close (struct file_pager *f, error *e);
 err_t fpgr_reset (struct file_pager *f, error *e);
+err_t fpgr_remove (const char *fname, error *e); // Deletes the database and its double-write file
 
 p_size fpgr_get_npages (const struct file_pager *fp);
 err_t fpgr_new (struct file_pager *p, pgno *pgno_dest, error *e);
 err_t fpgr_read (struct file_pager *p, u8 *dest, pgno pgno, error *e);
 err_t fpgr_write (struct file_pager *p, const u8 *src, pgno pgno, error *e);
+err_t fpgr_read_batch (struct file_pager *p, const struct fpgr_io *ios, u32 n, error *e);
+err_t fpgr_write_batch (struct file_pager *p, const struct fpgr_io *ios, u32 n, error *e);
 err_t fpgr_delete (struct file_pager *p, pgno pgno, error *e);
+err_t fpgr_sync (struct file_pager *p, error *e); // Also empties the double-write file
 
 #ifndef NTEST
 err_t fpgr_crash (struct file_pager *p, error *e);
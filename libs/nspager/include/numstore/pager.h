@@ -28,24 +28,69 @@
 #define VHASH_PGNO ((pgno)1) // Variable hash table page
 
 // Lifecycle
-struct pager *pgr_open (const char *fname, const char *walname, error *e);
+struct pager *pgr_open (const char *fname, const char *walname, u32 pool_len, error *e); // pool_len = 0 for MEMORY_PAGE_LEN frames
 err_t pgr_close (struct pager *p, error *e);
-void pgr_set_thread_pool (struct thread_pool *tp);
+void pgr_set_thread_pool (struct pager *p, struct thread_pool *tp); // Runs read-ahead, NULL to disable
+err_t pgr_start_cleaner (struct pager *p, error *e);                 // Background writer for durable dirty pages
+void pgr_stop_cleaner (struct pager *p);
+err_t pgr_start_checkpointer (struct pager *p, error *e); // Checkpoints every PGR_CKPT_WAL_BYTES of log or PGR_CKPT_INTERVAL_MS
+void pgr_stop_checkpointer (struct pager *p);
+void pgr_set_redo_threads (u32 nthreads); // Restart redo workers for later opens, 0 redoes on the caller
 
 // Utils
 p_size pgr_get_npages (const struct pager *p);
+u32 pgr_get_pool_len (const struct pager *p);
 void i_log_page_table (int log_level, struct pager *p);
 
+// Replacement policy
+enum pgr_policy
+{
+  PGR_POLICY_CLOCK, // One bit CLOCK
+  PGR_POLICY_2Q,    // CLOCK approximation of 2Q - the default
+};
+
+struct pgr_stats
+{
+  u64 hits;       // pgr_get served from the pool
+  u64 misses;     // pgr_get read from disk
+  u64 evictions;  // Frames given up for another page
+  u64 promotions; // 2Q - pages moved into the hot set
+  u64 ghost_hits; // 2Q - misses on recently evicted pages
+
+  // Sticky region - PG_RPT_ROOT and PG_INNER_NODE pages the clock passes over
+  u64 sticky_hits;     // Hits on sticky frames
+  u64 sticky_resident; // Frames currently in the sticky region
+
+  // Read-ahead
+  u64 prefetches;    // Pages loaded ahead of a sequential data list reader
+  u64 prefetch_hits; // First touches of a prefetched page
+
+  // Write back
+  u64 cleaned;         // Dirty pages written ahead of eviction
+  u64 dirty_evictions; // Victims that still had to be written back first
+
+  // Latching
+  u64 x_latched; // Gets and releases that had to latch their partition in X
+};
+
+void pgr_set_policy (struct pager *p, enum pgr_policy policy);
+enum pgr_policy pgr_get_policy (const struct pager *p);
+void pgr_get_stats (struct pager *p, struct pgr_stats *dest);
+void pgr_reset_stats (struct pager *p);
+void pgr_set_sticky_len (struct pager *p, u32 frames); // Capped at PGR_STICKY_MAX_PCT of the pool
+u32 pgr_get_sticky_len (struct pager *p);
+
 // Transaction control
 err_t pgr_begin_txn (struct txn *tx, struct pager *p, error *e);
 err_t pgr_commit (struct pager *p, struct txn *tx, error *e);
-err_t pgr_checkpoint (struct pager *p, error *e); // Blocking - should be called in a sepearte thread
+err_t pgr_checkpoint (struct pager *p, error *e); // Fuzzy - transactions keep running
 
 // Page fetching
 err_t pgr_get (page_h *dest, int flags, pgno pgno, struct pager *p, error *e);
 err_t pgr_new (page_h *dest, struct pager *p, struct txn *tx, enum page_type ptype, error *e);
 err_t pgr_get_unverified (page_h *dest, pgno pgno, struct pager *p, error *e);
 err_t pgr_new_blank (page_h *dest, struct pager *p, struct txn *tx, enum page_type ptype, error *e);
+void pgr_readahead (struct pager *p, pgno cur, pgno next); // Hint - a reader is stepping from data list page [cur] to [next]
 err_t pgr_make_writable (struct pager *p, struct txn *tx, page_h *h, error *e);
 err_t pgr_maybe_make_writable (struct pager *p, struct txn *tx, page_h *cur, error *e);
 
@@ -59,6 +104,7 @@ err_t pgr_delete_and_release (struct pager *p, struct txn *tx, page_h *h, error
 err_t pgr_release_if_exists (struct pager *p, page_h *h, int flags, error *e);
 err_t pgr_release (struct pager *p, page_h *h, int flags, error *e);
 err_t pgr_flush_wall (struct pager *p, error *e);
+err_t pgr_clean (struct pager *p, error *e); // One cleaner pass on the calling thread
 
 // ARIES
 err_t pgr_rollback (struct pager *p, struct txn *tx, lsn save_lsn, error *e);
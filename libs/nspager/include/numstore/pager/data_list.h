@@ -53,6 +53,7 @@ p_size dl_append (page *d, const u8 *src, p_size bytes);
 void dl_append_from_cbuffer (page *d, struct cbuffer *src, p_size amnt);
 p_size dl_write (page *d, const u8 *src, p_size offset, p_size bytes);
 p_size dl_write_from_buffer (page *d, struct cbuffer *src, p_size offset, p_size nbytes);
+p_size dl_scatter_from_cbuffer (page *d, struct cbuffer *src, p_size offset, t_size bsize, b_size step, b_size maxn); // Returns elements
 p_size dl_memset_from_buffer (page *d, struct cbuffer *src, p_size nbytes);
 void dl_memset_from_buffer_expect (page *d, struct cbuffer *src, p_size nbytes);
 void dl_memset (page *d, u8 *buf, p_size len);
@@ -62,10 +63,14 @@ void dl_move_right (page *src, page *dest, p_size len);
 void i_log_dl (int level, const page *d);
 p_size dl_read (const page *d, u8 *dest, p_size offset, p_size bytes);
 p_size dl_read_into_cbuffer (const page *d, struct cbuffer *c, p_size offset, p_size bytes);
+p_size dl_gather_into_cbuffer (const page *d, struct cbuffer *dest, p_size offset, t_size bsize, b_size step, b_size maxn); // Returns elements
 p_size dl_read_out_into_cbuffer (page *d, struct cbuffer *dest, p_size offset, p_size bytes);
 void dl_read_expect (const page *d, u8 *dest, p_size offset, p_size bytes);
 p_size dl_read_out_from (page *d, u8 *dest, p_size offset);
 void dl_shift_right (page *d, p_size len);
+p_size dl_insert (page *d, const u8 *src, p_size offset, p_size nbytes);
+void dl_remove (page *d, p_size offset, p_size nbytes);
+bool dl_diff_insert (const page *before, const page *after, p_size *offset, p_size *nbytes);
 void dl_make_valid (page *d);
 
 ////////////////////////////////////////////////////////////
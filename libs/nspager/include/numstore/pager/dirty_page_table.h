@@ -45,12 +45,13 @@ struct dpg_table
 {
   hash_table_dpt table;
   struct clck_alloc alloc;
-  hentry_dpt _table[100000];
+  hentry_dpt *_table;
+  u32 cap;
   struct spx_latch l;
 };
 
 // LIFECYCLE
-struct dpg_table *dpgt_open (error *e);
+struct dpg_table *dpgt_open (u32 cap, error *e);
 void dpgt_close (struct dpg_table *t);
 
 // UTILS
@@ -58,7 +59,7 @@ void dpgt_rand_populate (struct dpg_table *dpt);
 void i_log_dpgt (int log_level, struct dpg_table *dpt);
 bool dpgt_equal (struct dpg_table *left, struct dpg_table *right);
 lsn dpgt_min_rec_lsn (struct dpg_table *d);
-void dpgt_merge_into (struct dpg_table *dest, struct dpg_table *src);
+err_t dpgt_merge_into (struct dpg_table *dest, struct dpg_table *src, error *e);
 
 // INSERT
 err_t dpgt_add (struct dpg_table *t, pgno pg, lsn rec_lsn, error *e);
@@ -75,8 +76,10 @@ void dpgt_remove_expect (struct dpg_table *t, pgno pg);
 void dpgt_update (struct dpg_table *d, pgno pg, lsn new_rec_lsn);
 
 // SERIALIZATION
-#define MAX_DPGT_SRL_SIZE (MEMORY_PAGE_LEN * (sizeof (pgno) + sizeof (lsn)))
-u32 dpgt_serialize (u8 dest[MAX_DPGT_SRL_SIZE], struct dpg_table *t);
+#define DPGT_SRL_ENTRY_SIZE (sizeof (pgno) + sizeof (lsn))
+#define MAX_DPGT_SRL_SIZE(cap) ((cap) * DPGT_SRL_ENTRY_SIZE)
+u32 dpgt_max_serialize_size (const struct dpg_table *t);
+u32 dpgt_serialize (u8 *dest, u32 dlen, struct dpg_table *t);
 struct dpg_table *dpgt_deserialize (const u8 *src, u32 dlen, error *e);
 
 #ifndef NTEST
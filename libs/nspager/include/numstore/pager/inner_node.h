@@ -86,6 +86,8 @@ void in_set_data (page *p, struct in_data data);
 void in_move_left (page *dest, page *src, p_size len);
 void in_move_right (page *src, page *dest, p_size len);
 void in_choose_lidx (p_size *idx, b_size *nleft, const page *node, b_size loc);
+void in_prefix_sums (b_size *dest, const page *in);                                           // dest[i] = keys 0..i summed
+void in_choose_lidx_sums (p_size *idx, b_size *nleft, const b_size *sums, p_size n, b_size loc); // in_choose_lidx over in_prefix_sums
 void i_log_in (int level, const page *in);
 void in_make_valid (page *in);
 
@@ -133,12 +135,16 @@ in_get_key (const page *in, p_size idx)
 HEADER_FUNC b_size
 in_get_size (const page *in)
 {
+  const p_size n = in_get_len (in);
+  const u8 *base = in_get_backwards_keys_imut (in);
   b_size ret = 0;
-  // TODO - this could be cached
 
-  for (p_size i = 0; i < in_get_len (in); ++i)
+  // Keys are contiguous (reversed) - sum them in one pass
+  for (p_size i = 0; i < n; ++i)
     {
-      ret += in_get_key (in, i);
+      b_size key;
+      i_memcpy (&key, base + i * sizeof (b_size), sizeof key);
+      ret += key;
     }
 
   return ret;
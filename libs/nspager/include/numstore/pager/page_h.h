@@ -29,6 +29,8 @@ struct page_frame
   u32 pin;
   u32 flags;
   i32 wsibling;
+  lsn wal_end;     // WAL up to here has to be durable before page is written
+  b_size *in_sums; // in_prefix_sums of an inner node page - NULL if not kept
   struct spx_latch latch;
 };
 
@@ -175,6 +177,21 @@ page_h_ro (const page_h *h)
   UNREACHABLE ();
 }
 
+/**
+ * Running key totals of a read only inner node, kept by the
+ * pager - NULL if it has none (or the page is being written)
+ */
+HEADER_FUNC const b_size *
+page_h_in_sums (const page_h *h)
+{
+  DBG_ASSERT (page_h, h);
+  if (h->mode != PHM_S)
+    {
+      return NULL;
+    }
+  return h->pgr->in_sums;
+}
+
 HEADER_FUNC const page *
 page_h_ro_or_null (const page_h *h)
 {
@@ -27,13 +27,18 @@
  * HEADER
  * FSTS     [pgno]  - First tombstone
  * MLSN     [lsn]   - Master lsn
+ * PGSZ     [p_size] - Page size the database was created with (0 - legacy)
  * ============ PAGE END
  */
 
+// Files from before the page size was recorded leave PGSZ zeroed
+#define RN_LEGACY_PAGE_SIZE 2048
+
 // OFFSETS and _Static_asserts
 #define RN_FSTS_OFST PG_COMMN_END                              // First tombstone
 #define RN_TXNN_OFST ((p_size) (RN_FSTS_OFST + sizeof (pgno))) // Transaction id
 #define RN_MLSN_OFST ((p_size) (RN_TXNN_OFST + sizeof (txid))) // Master LSN
+#define RN_PGSZ_OFST ((p_size) (RN_MLSN_OFST + sizeof (lsn)))  // Page size
 
 // Initialization
 
@@ -50,12 +55,19 @@ rn_set_master_lsn (page *p, lsn pg)
   PAGE_SIMPLE_SET_IMPL (p, pg, RN_MLSN_OFST);
 }
 
+HEADER_FUNC void
+rn_set_page_size (page *p, p_size size)
+{
+  PAGE_SIMPLE_SET_IMPL (p, size, RN_PGSZ_OFST);
+}
+
 HEADER_FUNC void
 rn_init_empty (page *rn)
 {
   ASSERT (page_get_type (rn) == PG_ROOT_NODE);
   rn_set_first_tmbst (rn, 1);
   rn_set_master_lsn (rn, 0);
+  rn_set_page_size (rn, PAGE_SIZE);
 }
 
 // Getters
@@ -71,6 +83,14 @@ rn_get_master_lsn (const page *p)
   PAGE_SIMPLE_GET_IMPL (p, pgno, RN_MLSN_OFST);
 }
 
+HEADER_FUNC p_size
+rn_get_page_size (const page *p)
+{
+  p_size ret;
+  i_memcpy (&ret, &p->raw[RN_PGSZ_OFST], sizeof (ret));
+  return ret == 0 ? RN_LEGACY_PAGE_SIZE : ret;
+}
+
 // Validation
 err_t rn_validate_for_db (const page *p, error *e);
 
@@ -72,6 +72,7 @@ struct txn
 {
   txid tid;
   struct txn_data data;
+  lsn first_lsn; // Oldest record the txn may need to undo to - set from data.last_lsn on init
   struct spx_latch l;
   struct hnode node;
 };
@@ -22,8 +22,8 @@
 #include <numstore/core/adptv_hash_table.h>
 #include <numstore/core/alloc.h>
 #include <numstore/core/bytes.h>
+#include <numstore/core/chunk_alloc.h>
 #include <numstore/core/clock_allocator.h>
-#include <numstore/core/dbl_buffer.h>
 #include <numstore/core/error.h>
 #include <numstore/core/spx_latch.h>
 #include <numstore/pager/txn.h>
@@ -40,8 +40,10 @@ void txnt_close (struct txn_table *t);
 
 // Utils
 void i_log_txnt (int log_level, struct txn_table *t);
-err_t txnt_merge_into (struct txn_table *dest, struct txn_table *src, struct dbl_buffer *txn_dest, error *e);
+err_t txnt_merge_into (struct txn_table *dest, struct txn_table *src, struct chunk_alloc *txn_dest, error *e);
+err_t txnt_snapshot (struct txn_table *dest, struct txn **txn_bank, struct txn_table *src, error *e); // Free *txn_bank after closing dest
 slsn txnt_max_u_undo_lsn (struct txn_table *t);
+lsn txnt_min_first_lsn (struct txn_table *t); // (lsn)-1 if empty
 void txnt_foreach (struct txn_table *t, void (*action) (struct txn *, void *ctx), void *ctx);
 u32 txnt_get_size (struct txn_table *dest);
 
@@ -42,11 +42,15 @@ err_t walf_open (struct wal_file *dest, const char *fname, error *e);
 err_t walf_reset (struct wal_file *dest, error *e);
 err_t walf_close (struct wal_file *w, error *e);
 err_t walf_write_mode (struct wal_file *w, error *e);
+err_t walf_truncate (struct wal_file *w, lsn l, error *e); // Drops segments wholly before [l]
+err_t walf_remove (const char *fname, error *e);           // Deletes the anchor and every segment
 
 lsn walf_get_next_lsn (struct wal_file *w);
+lsn walf_get_flushed_lsn (struct wal_file *w);
 
 // WRITE
 slsn walf_write (struct wal_file *w, const struct wal_rec_hdr_write *src, error *e);
+lsn walf_commit_end (lsn start); // End of the commit record appended at [start]
 
 // READ
 err_t walf_pread (struct wal_rec_hdr_read *dest, struct wal_file *w, lsn ofst, error *e);
@@ -54,6 +58,7 @@ err_t walf_read (struct wal_rec_hdr_read *dest, lsn *rlsn, struct wal_file *w, e
 
 // FLUSH
 err_t walf_flush_all (struct wal_file *w, error *e);
+err_t walf_flush_to (struct wal_file *w, lsn l, error *e);
 
 #ifndef NTEST
 err_t walf_crash (struct wal_file *w, error *e);
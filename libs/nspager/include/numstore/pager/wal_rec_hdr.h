@@ -25,11 +25,25 @@
 
 #include <config.h>
 
+// A run of bytes inside a page
+struct wal_range
+{
+  p_size ofst;
+  p_size len;
+};
+
+/**
+ * WL_UPDATE and WL_UPDATE_DELTA both read into this. A full
+ * update is a single range over the whole page. A delta only
+ * fills in the bytes inside [ranges], at their page offsets
+ */
 struct wal_update_read
 {
   txid tid;
   lsn prev;
   pgno pg;
+  u32 nranges;
+  struct wal_range ranges[WAL_DELTA_MAX_RANGES];
   u8 undo[PAGE_SIZE];
   u8 redo[PAGE_SIZE];
 };
@@ -41,6 +55,31 @@ struct wal_update_write
   pgno pg;
   u8 *redo;
   u8 *undo;
+
+  // WL_UPDATE_DELTA only - the bytes of [undo] and [redo] to log
+  u32 nranges;
+  const struct wal_range *ranges;
+};
+
+// [len] bytes inserted at [ofst] of a data list page's data
+struct wal_dl_insert_read
+{
+  txid tid;
+  lsn prev;
+  pgno pg;
+  p_size ofst;
+  p_size len;
+  u8 data[PAGE_SIZE];
+};
+
+struct wal_dl_insert_write
+{
+  txid tid;
+  lsn prev;
+  pgno pg;
+  p_size ofst;
+  p_size len;
+  const u8 *data;
 };
 
 struct wal_begin
@@ -102,8 +141,13 @@ enum wal_rec_hdr_type
   WL_CKPT_BEGIN = 6,
   WL_CKPT_END = 7,
   WL_EOF = 8,
+  WL_UPDATE_DELTA = 9,
+  WL_DL_INSERT = 10,
 };
 
+// Header flag set when the page images of an UPDATE or CLR are LZ4 compressed
+#define WL_COMPRESSED ((wlh)0x80)
+
 struct wal_rec_hdr_read
 {
   enum wal_rec_hdr_type type;
@@ -111,6 +155,7 @@ struct wal_rec_hdr_read
   union
   {
     struct wal_update_read update;
+    struct wal_dl_insert_read dl_insert;
     struct wal_begin begin;
     struct wal_commit commit;
     struct wal_end end;
@@ -126,6 +171,7 @@ struct wal_rec_hdr_write
   union
   {
     struct wal_update_write update;
+    struct wal_dl_insert_write dl_insert;
     struct wal_begin begin;
     struct wal_commit commit;
     struct wal_end end;
@@ -162,6 +208,30 @@ struct wal_rec_hdr_write wrhw_from_wrhr (struct wal_rec_hdr_read *src);
                        + PAGE_SIZE     /* Redo */           \
                        + sizeof (u32)) /* Checksum */
 
+// Size of a delta update entry with [nranges] ranges covering [nbytes]
+#define WL_UPDATE_DELTA_LEN(nranges, nbytes) (sizeof (wlh)                      /* header */         \
+                                              + sizeof (txid)                   /* transaction id */ \
+                                              + sizeof (lsn)                    /* prev lsn */       \
+                                              + sizeof (pgno)                   /* ref page */       \
+                                              + sizeof (u32)                    /* nranges */        \
+                                              + (nranges) * 2 * sizeof (p_size) /* ranges */         \
+                                              + 2 * (nbytes)                    /* Undo and Redo */  \
+                                              + sizeof (u32))                   /* Checksum */
+
+#define WL_UPDATE_DELTA_MAX_LEN WL_UPDATE_DELTA_LEN (WAL_DELTA_MAX_RANGES, PAGE_SIZE)
+
+// Size of a data list insert entry inserting [nbytes]
+#define WL_DL_INSERT_LEN(nbytes) (sizeof (wlh)      /* header */         \
+                                  + sizeof (txid)   /* transaction id */ \
+                                  + sizeof (lsn)    /* prev lsn */       \
+                                  + sizeof (pgno)   /* ref page */       \
+                                  + sizeof (p_size) /* offset */         \
+                                  + sizeof (p_size) /* length */         \
+                                  + (nbytes)        /* Data */           \
+                                  + sizeof (u32))   /* Checksum */
+
+#define WL_DL_INSERT_MAX_LEN WL_DL_INSERT_LEN (PAGE_SIZE)
+
 // Size of CLR entry
 #define WL_CLR_LEN (sizeof (wlh)    /* header */          \
                     + sizeof (txid) /* transaction id */  \
@@ -171,6 +241,25 @@ struct wal_rec_hdr_write wrhw_from_wrhr (struct wal_rec_hdr_read *src);
                     + PAGE_SIZE     /* Data */            \
                     + sizeof (u32)) /* Checksum */
 
+// Size of a compressed UPDATE entry with [clen] payload bytes
+#define WL_UPDATE_COMPRESSED_LEN(clen) (sizeof (wlh)    /* header */              \
+                                        + sizeof (txid) /* transaction id */      \
+                                        + sizeof (lsn)  /* prev lsn */            \
+                                        + sizeof (pgno) /* ref page */            \
+                                        + sizeof (u32)  /* clen */                \
+                                        + (clen)        /* Undo and Redo (LZ4) */ \
+                                        + sizeof (u32)) /* Checksum */
+
+// Size of a compressed CLR entry with [clen] payload bytes
+#define WL_CLR_COMPRESSED_LEN(clen) (sizeof (wlh)    /* header */          \
+                                     + sizeof (txid) /* transaction id */  \
+                                     + sizeof (lsn)  /* prev lsn */        \
+                                     + sizeof (pgno) /* ref page */        \
+                                     + sizeof (lsn)  /* update next lsn */ \
+                                     + sizeof (u32)  /* clen */            \
+                                     + (clen)        /* Data (LZ4) */      \
+                                     + sizeof (u32)) /* Checksum */
+
 #define WL_CKPT_BEGIN_LEN (sizeof (wlh)    /* Header */ \
                            + sizeof (u32)) /* Checksum */
 
@@ -181,11 +270,18 @@ struct wal_rec_hdr_write wrhw_from_wrhr (struct wal_rec_hdr_read *src);
 
 stxid wrh_get_tid (struct wal_rec_hdr_read *h);
 slsn wrh_get_prev_lsn (struct wal_rec_hdr_read *h);
+spgno wrh_get_pgno (struct wal_rec_hdr_read *h);
 void i_log_wal_rec_hdr_read (int log_level, struct wal_rec_hdr_read *r);
 void i_print_wal_rec_hdr_read_light (int log_level, const struct wal_rec_hdr_read *w, lsn l);
 
+// DELTA
+bool wrh_diff_ranges (struct wal_range *dest, u32 *nranges, p_size *nbytes, const u8 *before, const u8 *after);
+void wrh_apply_ranges (u8 *dest, const struct wal_range *ranges, u32 nranges, const u8 *src);
+
 // DECODE
 void walf_decode_update (struct wal_rec_hdr_read *r, const u8 buf[WL_UPDATE_LEN]);
+void walf_decode_update_delta (struct wal_rec_hdr_read *r, const u8 *buf);
+void walf_decode_dl_insert (struct wal_rec_hdr_read *r, const u8 *buf);
 void walf_decode_clr (struct wal_rec_hdr_read *r, const u8 buf[WL_CLR_LEN]);
 void walf_decode_begin (struct wal_rec_hdr_read *r, const u8 buf[WL_BEGIN_LEN]);
 void walf_decode_commit (struct wal_rec_hdr_read *r, const u8 buf[WL_COMMIT_LEN]);
@@ -26,14 +26,72 @@
 
 #include "config.h"
 
+/**
+ * The log is split into WAL_SEGMENT_SIZE segment files named
+ * "<fname>.<n>". Segment n holds lsns [n * WAL_SEGMENT_SIZE,
+ * (n + 1) * WAL_SEGMENT_SIZE) and records may span two segments.
+ *
+ * [fname] itself is an anchor holding the first live segment. Live
+ * segments run from there up to the last non empty one - any empty
+ * segments after it are spares recycled from truncated segments.
+ */
+#define WALSEG_FNAME_LEN 1024
+
+void walseg_fname (char dest[WALSEG_FNAME_LEN], const char *fname, u64 seg);
+err_t walseg_read_anchor (u64 *first, const char *fname, error *e);
+err_t walseg_write_anchor (const char *fname, u64 first, error *e);
+err_t walseg_remove_all (const char *fname, error *e);
+
 struct wal_ostream
 {
-  i_file fd;
-  struct spx_latch l;
-  lsn flushed_lsn;
+  const char *fname;
+  i_file fd; // Current segment
+  u64 seg;
+  u64 first;     // First live segment
+  u32 nspares;   // Empty segments after [seg]
+  i_mutex seg_l; // Switching [fd] vs syncing it
+  i_mutex wo_l;  // One write out at a time - owns [fd]'s offset and [seg]
 
-  struct cbuffer buffer;
-  u8 _buffer[WAL_BUFFER_CAP];
+  /**
+   * Appends don't take a lock. A writer bumps [next_lsn] to reserve its
+   * record, claims one of the append slots and copies into [ring]
+   * alongside everyone else, keeping the first byte it hasn't copied
+   * yet in its slot. Everything below [next_lsn] and every slot is
+   * complete - that prefix is written out in order, which moves
+   * [flushed_lsn] up and frees the ring behind it.
+   */
+  atomic_uint_fast64_t next_lsn;
+  atomic_uint_fast64_t flushed_lsn;            // Written to the file
+  atomic_uint_fast64_t slots[WAL_APPEND_SLOTS]; // WALOS_IDLE when free
+  atomic_uint_fast32_t slot_hint;
+  atomic_uint_fast32_t ring_waiters;
+  i_mutex ring_l;
+  i_cond ring_moved; // A copy or a write out made progress
+
+  // Background flusher - drains the ring once it's half full
+  i_thread fl_thread;
+  i_mutex fl_l;
+  i_cond fl_wake;
+  bool fl_stop;
+  bool fl_wanted;
+
+  /**
+   * Group commit - one caller of walos_flush_to (the leader) writes and
+   * syncs for everyone waiting on it. If the last group had company the
+   * leader waits up to WAL_GROUP_COMMIT_WAIT_US for as many to show up
+   * again. The sync runs without [wo_l] so the next group can be
+   * written out.
+   */
+  i_mutex gc_l;
+  lsn durable_lsn; // Synced
+  i_cond gc_done;  // A leader finished
+  i_cond gc_join;  // The group the leader is waiting for is complete
+  bool gc_flushing;
+  u32 gc_waiting;    // Callers of walos_flush_to that aren't durable yet
+  u32 gc_last_group; // Callers the last leader synced for
+  u64 nsyncs;
+
+  u8 ring[WAL_BUFFER_CAP];
 };
 
 // Lifecycle
@@ -43,16 +101,25 @@ err_t walos_close (struct wal_ostream *w, error *e);
 // Writing
 err_t walos_flush_to (struct wal_ostream *w, lsn l, error *e);
 err_t walos_flush_all (struct wal_ostream *w, error *e);
-err_t walos_write_all (struct wal_ostream *w, u32 *checksum, const void *data, u32 len, error *e);
+err_t walos_append (struct wal_ostream *w, lsn *start, const void *data, u32 len, error *e); // [start] nullable
 lsn walos_get_next_lsn (struct wal_ostream *w);
-err_t walos_truncate (struct wal_ostream *w, u64 howmuch, error *e);
+lsn walos_get_flushed_lsn (struct wal_ostream *w); // Durable
+err_t walos_truncate (struct wal_ostream *w, lsn l, error *e); // Drops segments wholly before [l]
 
 struct wal_istream
 {
   struct latch latch;
-  i_file fd;
+  const char *fname;
+  i_file fd; // Segment [seg] if [fd_open]
+  bool fd_open;
+  u64 seg;
   lsn curlsn;
   lsn lsnidx;
+
+  // Read-ahead - [buf_len] bytes of the log starting at [buf_lsn]
+  u8 *buf; // WAL_READ_BUFFER_CAP
+  lsn buf_lsn;
+  u32 buf_len;
 };
 
 // Lifecycle
@@ -63,8 +130,8 @@ err_t walis_close (struct wal_istream *w, error *e);
 err_t walis_seek (struct wal_istream *w, u64 pos, error *e);
 void walis_mark_start_log (struct wal_istream *w);
 err_t walis_read_all (struct wal_istream *w, bool *iseof, lsn *rlsn, u32 *checksum, void *data, u32 len, error *e);
+err_t walis_read_view (struct wal_istream *w, bool *iseof, u32 *checksum, const u8 **dest, u32 len, error *e); // Good until the next read
 void walis_mark_end_log (struct wal_istream *w);
-err_t walis_truncate (struct wal_istream *w, u64 howmuch, error *e);
 
 #ifndef NTEST
 err_t walos_crash (struct wal_ostream *w, error *e);
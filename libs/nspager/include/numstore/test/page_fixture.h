@@ -38,6 +38,24 @@ struct pgr_fixture
 err_t pgr_fixture_create (struct pgr_fixture *dest);
 err_t pgr_fixture_teardown (struct pgr_fixture *f);
 
+//////////////////////////////////
+/// RECOVERY TESTS
+
+// Defines [name] with serial restart redo and [name]_parallel with redo workers
+#define ARIES_TEST(name)                             \
+  static void aries_##name (void);                   \
+  TEST (TT_UNIT, name)                               \
+  {                                                  \
+    pgr_set_redo_threads (0);                        \
+    aries_##name ();                                 \
+    pgr_set_redo_threads (PGR_REDO_THREADS);         \
+  }                                                  \
+  TEST (TT_UNIT, name##_parallel)                    \
+  {                                                  \
+    aries_##name ();                                 \
+  }                                                  \
+  static void aries_##name (void)
+
 //////////////////////////////////
 /// FAKE DB BUILDING
 
@@ -813,31 +813,60 @@ TEST (TT_UNIT, in_move_right_into_empty_right)
 #endif
 
 // Utils
+
+/**
+ * Keys are stored back to front at the end of the page, so keys
+ * [i, i + IN_SCAN_BLOCK) are one contiguous run. Seeks sum a whole
+ * block at a time (the compiler vectorizes the fixed width add) and
+ * only walk key by key inside the block that holds [loc]
+ */
+#define IN_SCAN_BLOCK 8
+
 void
 in_choose_lidx (p_size *idx, b_size *nleft, const page *node, b_size loc)
 {
-  u32 n = in_get_len (node);
+  const p_size n = in_get_len (node);
   ASSERT (n != 0);
+
+  const u8 *base = in_get_backwards_keys_imut (node);
+  b_size keys[IN_SCAN_BLOCK];
   b_size key_total = 0;
-  *nleft = 0;
 
+  // The last child takes everything past the end, so only n - 1 are tested
   p_size i = 0;
-  for (; i < n - 1; ++i)
+  for (; i + IN_SCAN_BLOCK <= n - 1; i += IN_SCAN_BLOCK)
     {
+      i_memcpy (keys, base + (n - i - IN_SCAN_BLOCK) * sizeof (b_size), sizeof keys);
 
-      b_size key = in_get_key (node, i);
-      key_total += key;
+      b_size block = 0;
+      for (u32 j = 0; j < IN_SCAN_BLOCK; ++j)
+        {
+          block += keys[j];
+        }
+
+      if (loc < key_total + block)
+        {
+          break;
+        }
 
-      if (loc < key_total)
+      key_total += block;
+    }
+
+  for (; i < n - 1; ++i)
+    {
+      b_size key;
+      i_memcpy (&key, base + (n - 1 - i) * sizeof (b_size), sizeof key);
+
+      if (loc < key_total + key)
         {
-          *idx = i;
-          return;
+          break;
         }
 
-      *nleft += key;
+      key_total += key;
     }
 
   *idx = i;
+  *nleft = key_total;
 }
 
 #ifndef NTEST
@@ -917,6 +946,129 @@ TEST (TT_UNIT, in_choose_lidx)
 }
 #endif
 
+#ifndef NTEST
+TEST (TT_UNIT, in_choose_lidx_blocks)
+{
+  page in;
+
+  // Lengths on and around block boundaries, checked against a plain scan
+  p_size lens[] = { 1, 2, 7, 8, 9, 16, 17, 31, IN_MAX_KEYS - 1, IN_MAX_KEYS };
+
+  for (u32 l = 0; l < arrlen (lens); ++l)
+    {
+      page_init_empty (&in, PG_INNER_NODE);
+
+      b_size total = 0;
+      for (p_size i = 0; i < lens[l]; ++i)
+        {
+          b_size key = (b_size)randu32r (0, 20);
+          in_push_end (&in, key, i);
+          total += key;
+        }
+
+      test_assert_int_equal (in_get_size (&in), total);
+
+      for (b_size loc = 0; loc < total + 3; ++loc)
+        {
+          p_size expidx = 0;
+          b_size expleft = 0;
+          while (expidx < lens[l] - 1 && loc >= expleft + in_get_key (&in, expidx))
+            {
+              expleft += in_get_key (&in, expidx);
+              expidx++;
+            }
+
+          p_size idx;
+          b_size nleft;
+          in_choose_lidx (&idx, &nleft, &in, loc);
+          test_assert_int_equal (idx, expidx);
+          test_assert_int_equal (nleft, expleft);
+        }
+    }
+}
+#endif
+
+void
+in_prefix_sums (b_size *dest, const page *in)
+{
+  const p_size n = in_get_len (in);
+  const u8 *base = in_get_backwards_keys_imut (in);
+  b_size total = 0;
+
+  for (p_size i = 0; i < n; ++i)
+    {
+      b_size key;
+      i_memcpy (&key, base + (n - 1 - i) * sizeof (b_size), sizeof key);
+      total += key;
+      dest[i] = total;
+    }
+}
+
+void
+in_choose_lidx_sums (p_size *idx, b_size *nleft, const b_size *sums, p_size n, b_size loc)
+{
+  ASSERT (n != 0);
+
+  // First child whose running total passes loc - the last one takes everything past the end
+  p_size lo = 0;
+  p_size hi = n - 1;
+  while (lo < hi)
+    {
+      p_size mid = lo + (hi - lo) / 2;
+      if (loc < sums[mid])
+        {
+          hi = mid;
+        }
+      else
+        {
+          lo = mid + 1;
+        }
+    }
+
+  *idx = lo;
+  *nleft = lo == 0 ? 0 : sums[lo - 1];
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, in_choose_lidx_sums)
+{
+  page in;
+  b_size sums[IN_MAX_KEYS];
+
+  // Random layouts, checked against the scan
+  for (u32 iter = 0; iter < 200; ++iter)
+    {
+      page_init_empty (&in, PG_INNER_NODE);
+
+      p_size len = randu32r (1, IN_MAX_KEYS);
+      u32 kmax = (iter & 1) ? 4 : 1000;
+      for (p_size i = 0; i < len; ++i)
+        {
+          in_push_end (&in, (b_size)randu32r (0, kmax), i);
+        }
+
+      in_prefix_sums (sums, &in);
+      test_assert_int_equal (sums[len - 1], in_get_size (&in));
+
+      b_size total = in_get_size (&in);
+      for (u32 j = 0; j < 64; ++j)
+        {
+          b_size loc = (b_size)randu32r (0, (u32)total + 3);
+
+          p_size expidx;
+          b_size expleft;
+          in_choose_lidx (&expidx, &expleft, &in, loc);
+
+          p_size idx;
+          b_size nleft;
+          in_choose_lidx_sums (&idx, &nleft, sums, len, loc);
+          test_assert_int_equal (idx, expidx);
+          test_assert_int_equal (nleft, expleft);
+        }
+    }
+}
+#endif
+
 void
 in_cut_left (page *in, p_size end)
 {
@@ -22,6 +22,7 @@
 
 #include <numstore/core/adptv_hash_table.h>
 #include <numstore/core/assert.h>
+#include <numstore/core/chunk_alloc.h>
 #include <numstore/core/dbl_buffer.h>
 #include <numstore/core/error.h>
 #include <numstore/core/max_capture.h>
@@ -62,6 +63,11 @@ enum
   PW_ACCESS = 1u << 0, // Only used for readable
   PW_DIRTY = 1u << 1,  // Only used for readable
   PW_PRESENT = 1u << 2,
+  PW_HOT = 1u << 3,    // 2Q - frame is in the protected (Am) set
+  PW_STICKY = 1u << 4, // R+tree upper level held in the sticky region
+  PW_PREFETCH = 1u << 5, // Loaded by read-ahead and not touched yet
+  PW_INFLIGHT = 1u << 6, // Pinned, page being read in with the partition unlatched
+  PW_WRITING = 1u << 7,  // Pinned, page being written back with the partition unlatched
 };
 
 static inline bool
@@ -82,6 +88,81 @@ pf_clr (struct page_frame *pf, int flag)
   pf->flags &= ~flag;
 }
 
+///////// Buffer pool partitions
+
+/**
+ * The buffer pool is split into independent partitions. Each one owns a
+ * contiguous slice of frames, its own pgno -> frame hash table and its
+ * own CLOCK hand. A page always lives in the partition its pgno hashes
+ * to (including its write sibling), so lookups, pin changes and eviction
+ * only ever contend on that partition's latch.
+ *
+ * Under PGR_POLICY_2Q each partition also keeps a ghost ring (A1out) of
+ * recently evicted page numbers. A page that faults back in while it's
+ * still a ghost was re-referenced after a full trip through the cold set
+ * and goes straight into the hot set.
+ *
+ * Independently of the policy, up to sticky_max frames of a partition
+ * hold PG_RPT_ROOT and PG_INNER_NODE pages that the clock hand passes
+ * over, so a seek only ever misses on the data list page it lands on.
+ */
+struct pgr_partition
+{
+  struct spx_latch l;
+  hash_table_idx pgno_to_value;
+  u32 start; // First frame index owned by this partition
+  u32 len;   // Number of frames owned by this partition
+  u32 clock; // Clock hand - relative to start
+
+  // 2Q
+  u32 nhot;                // Frames with PW_HOT
+  u32 hot_max;             // Cap on nhot
+  u32 demote;              // Hot pages the hand owes a demotion
+  pgno *ghost;             // Ring of evicted page numbers (PGNO_NULL = empty)
+  hash_table_idx ghost_at; // pgno -> ghost ring slot
+  u32 ghost_len;
+  u32 ghost_head;
+
+  // Sticky region
+  u32 nsticky;    // Frames with PW_STICKY
+  u32 sticky_max; // Cap on nsticky
+
+  // Inner node key totals - one slot of IN_MAX_KEYS per inner node frame
+  b_size *sums;
+  u32 *sums_free; // Stack of free slots
+  u32 sums_len;
+  u32 nsums_free;
+
+  u64 wepoch; // Bumped every time a dirty page is written back
+
+  struct pgr_stats stats;
+};
+
+///////// Read-ahead
+
+/**
+ * A reader walking a data list chain one dl_get_next at a time. Each
+ * hop that starts on the page the last one ended on extends the stream;
+ * anything else starts a new one. Once a stream is sequential a task on
+ * the pager's thread pool walks the chain ahead of the reader, loading
+ * pages into the pool unpinned. The window doubles every time the reader
+ * gets within half a window of the read-ahead, up to PGR_READAHEAD_MAX.
+ *
+ * [from] and [count] belong to the task while [inflight] is set.
+ */
+struct pgr_ra_stream
+{
+  struct pager *p;
+  pgno expect;   // Page the next sequential hop starts from
+  pgno frontier; // Last page read ahead
+  u32 hops;      // Sequential hops so far
+  u32 issued;    // Hops covered by read-ahead
+  u32 window;    // Pages to keep ahead of the reader
+  pgno from;     // Task - walk starts after this page
+  u32 count;     // Task - pages to load
+  bool inflight;
+};
+
 ///////// Pager object
 
 struct pager
@@ -95,20 +176,66 @@ struct pager
 
   txid next_tid;
 
-  hash_table_idx pgno_to_value;
-  struct page_frame pages[MEMORY_PAGE_LEN];
-  hentry_idx _hdata[MEMORY_PAGE_LEN];
-  u32 clock;
+  // Buffer pool - sized at open
+  struct page_frame *pages;
+  hentry_idx *_hdata;
+  pgno *_ghost;
+  hentry_idx *_ghdata;
+  b_size *_insums; // Key total slots - PGR_STICKY_MAX_PCT of the pool
+  u32 *_insums_free;
+  u32 insums_len;
+  u32 pool_len;
+  struct pgr_partition parts[PGR_MAX_PARTITIONS];
+  u32 nparts;
+  enum pgr_policy policy;
   bool wal_enabled;
 
+  // Read-ahead - runs on tp if one is set
+  struct thread_pool *tp;
+  i_mutex ra_l;
+  i_cond ra_idle;
+  u32 ra_inflight;
+  u32 ra_victim;
+  struct pgr_ra_stream streams[PGR_READAHEAD_STREAMS];
+
+  // Background cleaner - runs while cl_running is set
+  i_thread cl_thread;
+  i_mutex cl_l;
+  i_cond cl_wake;
+  bool cl_running;
+  bool cl_stop;
+  bool cl_wanted; // Kicked since the last pass
+  u8 *cl_bufs;    // PGR_IO_BATCH pages
+
+  // Background checkpointer - runs while ck_running is set
+  i_thread ck_thread;
+  i_mutex ck_l;
+  i_cond ck_wake;
+  bool ck_running;
+  bool ck_stop;
+  bool ck_wanted; // PGR_CKPT_WAL_BYTES logged since the last checkpoint
+  lsn ck_last;    // Next lsn when the last checkpoint finished
+
+  // Serializes file extension
   struct spx_latch l;
 
+  // Held while the root node is writable
+  i_mutex rn_l;
+
   // CACHE
   lsn master_lsn;
   pgno first_tombstone;
 
-  // Checkpoint state
+  // Checkpoint state - one checkpoint at a time
+  i_mutex ckpt_l;
   lsn ckpt_begin_lsn;
+
+  /**
+   * S around a log append and the table insert that goes with it, X
+   * around the checkpoint begin record and the table copies. A record
+   * logged before the begin record is then always in the copies.
+   */
+  struct spx_latch ckpt_latch;
 };
 
 DEFINE_DBG_ASSERT (
@@ -116,9 +243,342 @@ DEFINE_DBG_ASSERT (
     {
       ASSERT (p);
       ASSERT (p->dpt);
-      ASSERT (p->clock < MEMORY_PAGE_LEN);
+      ASSERT (p->pages);
+      ASSERT (p->pool_len >= PGR_MIN_POOL_LEN);
+      ASSERT (p->nparts > 0);
+      ASSERT (p->nparts <= PGR_MAX_PARTITIONS);
     })
 
+static inline u32
+pgr_hash_pgno (pgno pg)
+{
+  // Fibonacci hashing so that strided access patterns still spread out
+  u64 h = (u64)pg * 0x9E3779B97F4A7C15ULL;
+  return (u32)(h >> 32);
+}
+
+static inline struct pgr_partition *
+pgr_partition_of (struct pager *p, pgno pg)
+{
+  return &p->parts[pgr_hash_pgno (pg) % p->nparts];
+}
+
+static inline struct pgr_partition *
+pgr_partition_of_frame (struct pager *p, const struct page_frame *pf)
+{
+  return pgr_partition_of (p, pf->page.pg);
+}
+
+static void
+pgr_partitions_init (struct pager *p)
+{
+  u32 nparts = p->pool_len / PGR_PARTITION_MIN_LEN;
+  if (nparts == 0)
+    {
+      nparts = 1;
+    }
+  if (nparts > PGR_MAX_PARTITIONS)
+    {
+      nparts = PGR_MAX_PARTITIONS;
+    }
+
+  u32 start = 0;
+  u32 sums_start = 0;
+  for (u32 i = 0; i < nparts; ++i)
+    {
+      struct pgr_partition *part = &p->parts[i];
+      u32 len = p->pool_len / nparts + (i < p->pool_len % nparts ? 1 : 0);
+
+      spx_latch_init (&part->l);
+      ht_init_idx (&part->pgno_to_value, &p->_hdata[start], len);
+      part->start = start;
+      part->len = len;
+      part->clock = 0;
+
+      part->nsticky = 0;
+      part->sticky_max = len * PGR_STICKY_PCT / 100;
+
+      part->nhot = 0;
+      part->demote = 0;
+      part->hot_max = (len - part->sticky_max) * PGR_2Q_HOT_PCT / 100;
+      part->ghost_len = len * PGR_2Q_GHOST_PCT / 100;
+      if (part->ghost_len == 0)
+        {
+          part->ghost_len = 1;
+        }
+      part->ghost = &p->_ghost[start];
+      part->ghost_head = 0;
+      for (u32 j = 0; j < part->ghost_len; ++j)
+        {
+          part->ghost[j] = PGNO_NULL;
+        }
+      ht_init_idx (&part->ghost_at, &p->_ghdata[start], part->ghost_len);
+
+      // As many inner nodes as the sticky region could ever hold
+      part->sums_len = len * PGR_STICKY_MAX_PCT / 100;
+      part->sums = &p->_insums[(u64)sums_start * IN_MAX_KEYS];
+      part->sums_free = &p->_insums_free[sums_start];
+      for (u32 j = 0; j < part->sums_len; ++j)
+        {
+          part->sums_free[j] = j;
+        }
+      part->nsums_free = part->sums_len;
+
+      part->stats = (struct pgr_stats){ 0 };
+
+      start += len;
+      sums_start += part->sums_len;
+    }
+  ASSERT (start == p->pool_len);
+  ASSERT (sums_start <= p->insums_len);
+
+  p->nparts = nparts;
+}
+
+///////// 2Q ghost ring
+
+// Caller holds [part->l] in X
+static void
+pgr_ghost_push (struct pgr_partition *part, pgno pg)
+{
+  hdata_idx data;
+  if (ht_get_idx (&part->ghost_at, &data, pg) == HTAR_SUCCESS)
+    {
+      return;
+    }
+
+  // Overwrite the oldest ghost
+  pgno old = part->ghost[part->ghost_head];
+  if (old != PGNO_NULL)
+    {
+      ht_delete_expect_idx (&part->ghost_at, NULL, old);
+    }
+
+  part->ghost[part->ghost_head] = pg;
+  ht_insert_expect_idx (&part->ghost_at, (hdata_idx){ .key = pg, .value = part->ghost_head });
+  part->ghost_head = (part->ghost_head + 1) % part->ghost_len;
+}
+
+// Caller holds [part->l] in X
+static bool
+pgr_ghost_take (struct pgr_partition *part, pgno pg)
+{
+  hdata_idx data;
+  if (ht_delete_idx (&part->ghost_at, &data, pg) == HTAR_DOESNT_EXIST)
+    {
+      return false;
+    }
+  part->ghost[data.value] = PGNO_NULL;
+  return true;
+}
+
+static void
+pgr_ghost_clear (struct pgr_partition *part)
+{
+  for (u32 j = 0; j < part->ghost_len; ++j)
+    {
+      part->ghost[j] = PGNO_NULL;
+    }
+  ht_init_idx (&part->ghost_at, part->ghost_at.elems, part->ghost_len);
+  part->ghost_head = 0;
+}
+
+/**
+ * Pages every query walks through - protected from one-touch scans
+ * of data list pages from their first load
+ */
+static inline bool
+pgr_2q_is_structural (const page *pg)
+{
+  switch (page_get_type (pg))
+    {
+    case PG_ROOT_NODE:
+    case PG_INNER_NODE:
+    case PG_RPT_ROOT:
+    case PG_VAR_HASH_PAGE:
+      {
+        return true;
+      }
+    default:
+      {
+        return false;
+      }
+    }
+}
+
+// Caller holds [part->l] in X
+static inline void
+pgr_2q_make_hot (struct pgr_partition *part, struct page_frame *pf)
+{
+  if (pf_check (pf, PW_HOT))
+    {
+      return;
+    }
+
+  if (part->nhot < part->hot_max)
+    {
+      pf_set (pf, PW_HOT);
+      part->nhot++;
+      part->stats.promotions++;
+    }
+  else if (part->demote < part->nhot)
+    {
+      // Make room - the hand demotes the next idle hot page
+      part->demote++;
+    }
+}
+
+///////// Sticky region
+
+static inline bool
+pgr_is_sticky_type (const page *pg)
+{
+  enum page_type type = page_get_type (pg);
+  return type == PG_RPT_ROOT || type == PG_INNER_NODE;
+}
+
+static inline void
+pgr_unstick (struct pgr_partition *part, struct page_frame *pf)
+{
+  ASSERT (part->nsticky > 0);
+  pf_clr (pf, PW_STICKY);
+  part->nsticky--;
+}
+
+/**
+ * Moves [pf] in or out of the sticky region to match the type of the
+ * page it holds - pages change type when they're created or deleted
+ *
+ * Caller holds [part->l] in X
+ */
+static void
+pgr_sticky_update (struct pgr_partition *part, struct page_frame *pf)
+{
+  bool want = pgr_is_sticky_type (&pf->page);
+  bool is = pf_check (pf, PW_STICKY);
+
+  if (want && !is && part->nsticky < part->sticky_max)
+    {
+      // The sticky region is budgeted on its own - don't hold a hot slot too
+      if (pf_check (pf, PW_HOT))
+        {
+          pf_clr (pf, PW_HOT);
+          part->nhot--;
+        }
+      pf_set (pf, PW_STICKY);
+      part->nsticky++;
+    }
+  else if (!want && is)
+    {
+      pgr_unstick (part, pf);
+    }
+}
+
+// Caller holds [part->l] in X
+static void
+pgr_in_sums_release (struct pgr_partition *part, struct page_frame *pf)
+{
+  if (pf->in_sums != NULL)
+    {
+      ASSERT (part->nsums_free < part->sums_len);
+      part->sums_free[part->nsums_free++] = (u32)((pf->in_sums - part->sums) / IN_MAX_KEYS);
+      pf->in_sums = NULL;
+    }
+}
+
+/**
+ * Rebuilds the running key totals of [pf] if it holds an inner node,
+ * so seeks binary search them instead of summing keys. Called wherever
+ * [pf->page] changes, next to pgr_sticky_update. Once the partition's
+ * slots run out further inner nodes go without - their seeks sum keys.
+ *
+ * Caller holds [part->l] in X
+ */
+static void
+pgr_in_sums_update (struct pgr_partition *part, struct page_frame *pf)
+{
+  if (page_get_type (&pf->page) != PG_INNER_NODE)
+    {
+      pgr_in_sums_release (part, pf);
+      return;
+    }
+
+  if (pf->in_sums == NULL)
+    {
+      if (part->nsums_free == 0)
+        {
+          return;
+        }
+      u32 slot = part->sums_free[--part->nsums_free];
+      pf->in_sums = &part->sums[(u64)slot * IN_MAX_KEYS];
+    }
+
+  in_prefix_sums (pf->in_sums, &pf->page);
+}
+
+// Caller holds every partition latch in X
+static void
+pgr_partition_set_sticky_max (struct pager *p, struct pgr_partition *part, u32 sticky_max)
+{
+  part->sticky_max = sticky_max;
+
+  for (u32 j = 0; j < part->len && part->nsticky > part->sticky_max; ++j)
+    {
+      struct page_frame *pf = &p->pages[part->start + j];
+      if (pf_check (pf, PW_STICKY))
+        {
+          pgr_unstick (part, pf);
+        }
+    }
+
+  part->hot_max = (part->len - part->sticky_max) * PGR_2Q_HOT_PCT / 100;
+  part->demote = part->nhot > part->hot_max ? part->nhot - part->hot_max : 0;
+}
+
+/**
+ * Sets the replacement state of a frame that was just filled
+ * with [pf->page] from disk
+ *
+ * Caller holds [part->l] in X
+ */
+static void
+pgr_on_load (struct pager *p, struct pgr_partition *part, struct page_frame *pf)
+{
+  pgr_sticky_update (part, pf);
+  pgr_in_sums_update (part, pf);
+
+  switch (p->policy)
+    {
+    case PGR_POLICY_CLOCK:
+      {
+        // Start page at access_bit = 1
+        pf_set (pf, PW_ACCESS);
+        return;
+      }
+    case PGR_POLICY_2Q:
+      {
+        bool ghost = pgr_ghost_take (part, pf->page.pg);
+        if (ghost)
+          {
+            part->stats.ghost_hits++;
+          }
+
+        if (pf_check (pf, PW_STICKY))
+          {
+            return;
+          }
+
+        // Everything else enters cold (A1in) and has to earn its place
+        if (ghost || pgr_2q_is_structural (&pf->page))
+          {
+            pgr_2q_make_hot (part, pf);
+          }
+        return;
+      }
+    }
+  UNREACHABLE ();
+}
+
 struct aries_ctx
 {
   // Input
@@ -130,8 +590,9 @@ struct aries_ctx
   // Hash table of transactions
   struct txn_table txt;
 
-  // List of open transactions
-  struct dbl_buffer txns;
+  // Backing store for the transactions in txt - chunks never move,
+  // so the table's pointers stay valid as it fills
+  struct chunk_alloc txns;
 
   // Dirty page table
   struct dpg_table *dpt;
@@ -144,25 +605,30 @@ aries_ctx_free (struct aries_ctx *ctx)
   ASSERT (ctx);
   txnt_close (&ctx->txt);
   dpgt_close (ctx->dpt);
-  dblb_free (&ctx->txns);
+  chunk_alloc_free_all (&ctx->txns);
 }
 
 static inline err_t
-aries_ctx_create (struct aries_ctx *dest, lsn master_lsn, error *e)
+aries_ctx_create (struct aries_ctx *dest, lsn master_lsn, u32 dpt_cap, error *e)
 {
   bool txt_open = false;
-  bool txns_open = false;
   dest->master_lsn = master_lsn;
   dest->max_tid = 0;
+  dest->dpt = NULL;
 
   err_t_wrap_goto (txnt_open (&dest->txt, e), failed, e);
   txt_open = true;
 
-  dest->dpt = dpgt_open (e);
+  // Starts at the pool size and grows - analysis also picks up pages
+  // flushed since the checkpoint, and the checkpoint's own table may
+  // come from a bigger pool
+  dest->dpt = dpgt_open (dpt_cap, e);
   err_t_wrap_null_goto (dest->dpt, failed, e);
 
-  err_t_wrap_goto (dblb_create (&dest->txns, sizeof (struct txn), 100, e), failed, e);
-  txns_open = true;
+  chunk_alloc_create (&dest->txns, (struct chunk_alloc_settings){
+                                      .target_chunk_mult = 1,
+                                      .min_chunk_size = 64 * sizeof (struct txn),
+                                  });
 
   return SUCCESS;
 
@@ -172,10 +638,6 @@ failed:
     {
       txnt_close (&dest->txt);
     }
-  if (txns_open)
-    {
-      dblb_free (&dest->txns);
-    }
   if (dest->dpt)
     {
       dpgt_close (dest->dpt);
@@ -186,1407 +648,4543 @@ failed:
 
 // Forward declarations
 static err_t pgr_restart (struct pager *p, struct aries_ctx *ctx, error *e);
+static void pgr_cancel_w (struct pager *p, page_h *h);
 
-static inline err_t
-pgr_evict (struct pager *p, struct page_frame *mp, error *e)
+/**
+ * Evicts a present, unpinned, clean frame from [part]. Dirty frames
+ * are written back first with pgr_write_behind, never from here.
+ *
+ * Caller holds [part->l] in X
+ */
+static inline void
+pgr_evict (struct pager *p, struct pgr_partition *part, struct page_frame *mp)
 {
   DBG_ASSERT (pager, p);
   ASSERT (pf_check (mp, PW_PRESENT));
-  ASSERT (mp->pin == 0); // TODO - latch
+  ASSERT (!pf_check (mp, PW_DIRTY));
+  ASSERT (mp->pin == 0);
   ASSERT (mp->wsibling == -1);
 
-  // Only need to write it out if it's dirty
-  if (pf_check (mp, PW_DIRTY))
-    {
-      i_log_trace ("Evicting page: %" PRpgno " from the pager\n", mp->page.pg);
-      i_log_trace ("Page: %" PRpgno " is dirty, flushing to wal\n", mp->page.pg);
+  i_log_trace ("Evicting page: %" PRpgno " from the pager\n", mp->page.pg);
 
-      if (p->wal_enabled)
+  ht_delete_expect_idx (&part->pgno_to_value, NULL, mp->page.pg);
+  if (pf_check (mp, PW_HOT))
+    {
+      ASSERT (part->nhot > 0);
+      part->nhot--;
+      if (part->demote > part->nhot)
         {
-          /**
-           * When we're in analysis phase we're reading and there's
-           * no point in writing pages during evict because we SHOULDN't
-           * be creating new data.
-           */
-          if (!p->restarting)
-            {
-              err_t_wrap (wal_flush_all (&p->ww, e), e);
-            }
+          part->demote = part->nhot;
         }
-
-      i_log_trace ("Page: %" PRpgno " flushed to wal, writing to file now\n", mp->page.pg);
-      err_t_wrap (fpgr_write (&p->fp, mp->page.raw, mp->page.pg, e), e);
-
-      pf_clr (mp, PW_DIRTY);
-
-      dpgt_remove (p->dpt, mp->page.pg);
     }
-
-  ht_delete_expect_idx (&p->pgno_to_value, NULL, mp->page.pg);
+  if (pf_check (mp, PW_STICKY))
+    {
+      pgr_unstick (part, mp);
+    }
+  pgr_in_sums_release (part, mp);
   mp->flags = 0;
   pf_clr (mp, PW_PRESENT);
-
-  return SUCCESS;
+  part->stats.evictions++;
 }
 
-static inline err_t
-pgr_evict_all (struct pager *pg, error *e)
+/**
+ * Puts [mp] into [frames] (holding [n] frames) in page number order
+ */
+static inline void
+pgr_frames_insert (struct page_frame **frames, u32 n, struct page_frame *mp)
 {
-  DBG_ASSERT (pager, pg);
+  u32 j = n;
+  for (; j > 0 && frames[j - 1]->page.pg > mp->page.pg; --j)
+    {
+      frames[j] = frames[j - 1];
+    }
+  frames[j] = mp;
+}
 
-  i_log_trace ("Pager before evict all:\n");
-  i_log_page_table (LOG_TRACE, pg);
+/**
+ * Writes back the [n] dirty frames of [part] in [frames], in page number
+ * order. They are pinned, marked PW_WRITING and copied into [bufs] under
+ * the latch, then written without it - one double write and one sync
+ * for the batch, runs of consecutive pages as one request. A frame that
+ * changed while the write was out stays dirty. [ncleaned] is the number
+ * of frames left clean.
+ *
+ * Caller holds [part->l] in X. It is dropped for the write and held
+ * again on return.
+ */
+static err_t
+pgr_write_frames (
+    struct pager *p,
+    struct pgr_partition *part,
+    struct page_frame **frames,
+    u32 n,
+    u8 *bufs,
+    u32 *ncleaned,
+    error *e)
+{
+  lsn wal_end[PGR_IO_BATCH];
+  struct fpgr_io ios[PGR_IO_BATCH];
+  u32 nios = 0;
+  lsn flush_to = 0;
 
-  err_t ret = SUCCESS;
+  ASSERT (n > 0 && n <= PGR_IO_BATCH);
 
-  for (u32 i = 0; i < MEMORY_PAGE_LEN; ++i)
+  for (u32 i = 0; i < n; ++i)
     {
-      struct page_frame *mp = &pg->pages[pg->clock];
+      struct page_frame *mp = frames[i];
+      u8 *buf = &bufs[(u64)i * PAGE_SIZE];
 
-      if (pf_check (mp, PW_PRESENT))
+      mp->pin++;
+      pf_set (mp, PW_WRITING);
+      spx_latch_lock_x (&mp->latch);
+      wal_end[i] = mp->wal_end;
+      flush_to = MAX (flush_to, mp->wal_end);
+      i_memcpy (buf, mp->page.raw, PAGE_SIZE);
+
+      if (nios > 0 && ios[nios - 1].pg + ios[nios - 1].npages == mp->page.pg)
         {
-          if (ret)
-            {
-              pgr_evict (pg, mp, NULL);
-            }
-          else
-            {
-              ret = pgr_evict (pg, mp, e);
-            }
+          ios[nios - 1].npages++;
+        }
+      else
+        {
+          ios[nios++] = (struct fpgr_io){ .pg = mp->page.pg, .npages = 1, .buf = buf };
         }
-
-      pg->clock = (pg->clock + 1) % MEMORY_PAGE_LEN;
     }
 
-  return e->cause_code;
-}
+  spx_latch_unlock_x (&part->l);
 
-static inline err_t
-pgr_reserve_at_clock_thread_unsafe (struct pager *p, error *e)
-{
-  DBG_ASSERT (pager, p);
+  i_log_trace ("Writing back %u dirty pages in %u writes\n", n, nios);
 
-  i_log_trace ("Pager reserving a spot in buffer pool\n");
+  err_t ret = SUCCESS;
 
-  // 2 times so that we might clear an access bit
-  struct page_frame *mp;
-  for (u32 i = 0; i < 2 * MEMORY_PAGE_LEN; ++i)
+  /**
+   * WAL before data - only these pages' records have to be durable.
+   * While restarting nothing new is logged, so there's nothing to flush.
+   */
+  if (p->wal_enabled && !p->restarting)
+    {
+      ret = wal_flush_to (&p->ww, flush_to, e);
+    }
+  if (ret == SUCCESS)
     {
-      i_log_trace ("Reserve: checking page: %u\n", p->clock);
+      ret = fpgr_write_batch (&p->fp, ios, nios, e);
+    }
 
-      mp = &p->pages[p->clock];
+  spx_latch_lock_x (&part->l);
 
-      // Found an empty spot
-      if (!pf_check (mp, PW_PRESENT))
-        {
-          i_log_trace ("Page: %u is not present, using this spot\n", p->clock);
-          goto found_spot;
-        }
+  *ncleaned = 0;
+  for (u32 i = 0; i < n; ++i)
+    {
+      struct page_frame *mp = frames[i];
 
-      // Pinned, skip it
-      if (mp->pin > 0)
+      ASSERT (mp->pin > 0);
+      mp->pin--;
+      pf_clr (mp, PW_WRITING);
+      spx_latch_unlock_x (&mp->latch);
+
+      if (ret || mp->wsibling != -1 || mp->wal_end != wal_end[i])
         {
-          i_log_trace ("Page: %u is pinned with pin: %u, using this spot\n", p->clock, mp->pin);
-          p->clock = (p->clock + 1) % MEMORY_PAGE_LEN;
           continue;
         }
-
-      // Access bit is on - set off and continue
-      if (pf_check (mp, PW_ACCESS))
+      if (i_memcmp (mp->page.raw, &bufs[(u64)i * PAGE_SIZE], PAGE_SIZE) != 0)
         {
-          i_log_trace ("Page: %u has access bit: 1, clearing then skipping\n", p->clock);
-          pf_clr (mp, PW_ACCESS);
-          p->clock = (p->clock + 1) % MEMORY_PAGE_LEN;
           continue;
         }
 
-      // EVICT
-      i_log_trace ("Page: %u is present but doesn't have access bit, evicting\n", p->clock);
-      err_t_wrap (pgr_evict (p, mp, e), e);
-      goto found_spot;
+      pf_clr (mp, PW_DIRTY);
+      dpgt_remove (p->dpt, mp->page.pg);
+      (*ncleaned)++;
     }
+  part->wepoch++;
 
-  return error_causef (e, ERR_PAGER_FULL, "Memory buffer pool is full");
-
-found_spot:
-  ASSERT (!pf_check (&p->pages[p->clock], PW_PRESENT));
-  return SUCCESS;
+  return ret;
 }
 
+/**
+ * Writes back up to PGR_IO_BATCH dirty, unpinned frames of [part] in
+ * one batch, walking from the clock hand. They stay resident, just
+ * clean. With [cold_only] set only frames the hand could evict right
+ * away are taken - the victims of the next few reservations. [nwritten]
+ * is the number of frames taken.
+ *
+ * Caller holds [part->l] in X. It is dropped while the batch is written,
+ * so anything looked up under it has to be looked up again.
+ */
 static err_t
-pgr_new_extend (page_h *dest, struct pager *p, struct txn *tx, error *e)
+pgr_write_behind (struct pager *p, struct pgr_partition *part, bool cold_only, u32 *nwritten, error *e)
 {
-  DBG_ASSERT (pager, p);
-  DBG_ASSERT (page_h, dest);
-  ASSERT (dest->mode == PHM_NONE);
-
-  i_log_trace ("Creating new page by extending file\n");
-
-  pgno pg;
-  struct page_frame *pgr = NULL, *pgw = NULL;
-  u32 pgrloc;
-
-  err_t ret = SUCCESS;
-
-  // Reserve the read page spot
-  spx_latch_lock_x (&p->l);
-  {
-    ret = pgr_reserve_at_clock_thread_unsafe (p, e);
-    if (ret)
-      {
-        spx_latch_unlock_x (&p->l);
-        goto theend;
-      }
-    pgrloc = p->clock;
-
-    pgr = &p->pages[pgrloc];
-    pgr->pin = 1;
-    pgr->flags = 0;
-    pgr->wsibling = -1;
-    pf_set (pgr, PW_ACCESS);
-    pf_set (pgr, PW_PRESENT);
-  }
-  spx_latch_unlock_x (&p->l);
-
-  page_init_empty (&pgr->page, PG_TOMBSTONE);
-  tmbst_set_next (&pgr->page, fpgr_get_npages (&p->fp) + 1);
-
-  i_printf_trace ("Read buffer pool location: %d\n", pgrloc);
-
-  // Reserve the write page spot
-  spx_latch_lock_x (&p->l);
-  {
-    ret = pgr_reserve_at_clock_thread_unsafe (p, e);
-    if (ret)
-      {
-        pgr->pin = 0;
-        pgr->flags = 0;
-        spx_latch_unlock_x (&p->l);
-        goto theend;
-      }
+  struct page_frame *frames[PGR_IO_BATCH];
+  u32 n = 0;
 
-    pgr->wsibling = p->clock;
+  for (u32 i = 0; i < part->len && n < PGR_IO_BATCH; ++i)
+    {
+      struct page_frame *mp = &p->pages[part->start + (part->clock + i) % part->len];
 
-    pgw = &p->pages[p->clock];
-    pgw->pin = 1;
-    pgw->flags = 0;
-    pgw->wsibling = -1;
-    pf_set (pgw, PW_PRESENT);
-  }
-  spx_latch_unlock_x (&p->l);
+      if (!pf_check (mp, PW_PRESENT) || !pf_check (mp, PW_DIRTY) || mp->pin > 0 || mp->wsibling != -1)
+        {
+          continue;
+        }
+      if (cold_only && (mp->flags & (PW_ACCESS | PW_HOT | PW_STICKY)))
+        {
+          continue;
+        }
 
-  i_printf_trace ("Write buffer pool location: %d\n", pgr->wsibling);
+      pgr_frames_insert (frames, n++, mp);
+    }
 
-  /**
-   * Now we can actually extend the file
-   * TODO - You don't need to do this and we
-   * could reduce system calls by lazily extending the
-   * file and truncating it once on large pages
-   */
-  ret = fpgr_new (&p->fp, &pg, e);
-  if (ret)
+  *nwritten = n;
+  if (n == 0)
     {
-      spx_latch_lock_x (&p->l);
-      pgr->pin = 0;
-      pgr->flags = 0;
-      pgw->pin = 0;
-      pgw->flags = 0;
-      spx_latch_unlock_x (&p->l);
-      goto theend;
+      return SUCCESS;
     }
 
-  i_printf_trace ("New page number: %" PRpgno "\n", pg);
-  i_memcpy (pgw->page.raw, pgr->page.raw, PAGE_SIZE);
-  pgr->page.pg = pg;
-  pgw->page.pg = pg;
-
-  // Mark page as dirty (will be added to DPT in pgr_save with proper LSN)
-  pf_set (pgr, PW_DIRTY);
+  u8 *bufs = i_malloc (n, PAGE_SIZE, e);
+  if (bufs == NULL)
+    {
+      return e->cause_code;
+    }
 
-  // Insert page into the hash table
-  hdata_idx hd = (hdata_idx){ .key = pg, .value = pgrloc };
-  ht_insert_expect_idx (&p->pgno_to_value, hd);
+  u32 ncleaned;
+  err_t ret = pgr_write_frames (p, part, frames, n, bufs, &ncleaned, e);
 
-  // Initialize page_h
-  dest->pgr = pgr;
-  dest->pgw = pgw;
-  dest->mode = PHM_X;
-  dest->tx = tx;
+  i_free (bufs);
 
-theend:
-  i_log_trace ("Done trying to extend new page. Exit code: %d\n", ret);
   return ret;
 }
 
-///////////////////////////////////////////////////////////
-////// LIFECYCLE
+///////// Background cleaner
 
-static struct pager *
-pgr_open_new (const char *fname, const char *walname, struct pager *p, error *e)
+/**
+ * Wakes the cleaner thread if there is one
+ */
+static void
+pgr_cleaner_kick (struct pager *p)
 {
-  i_log_info ("Creating new database: %s\n", fname);
-  if (fpgr_reset (&p->fp, e))
+  i_mutex_lock (&p->cl_l);
+  if (p->cl_running)
     {
-      return NULL;
+      p->cl_wanted = true;
+      i_cond_signal (&p->cl_wake);
     }
-  if (p->wal_enabled && wal_reset (&p->ww, e))
+  i_mutex_unlock (&p->cl_l);
+}
+
+/**
+ * Wakes the checkpointer if [next] is PGR_CKPT_WAL_BYTES past the
+ * last checkpoint
+ */
+static void
+pgr_checkpointer_kick (struct pager *p, lsn next)
+{
+  i_mutex_lock (&p->ck_l);
+  if (p->ck_running && !p->ck_wanted && next - p->ck_last >= PGR_CKPT_WAL_BYTES)
     {
-      return NULL;
+      p->ck_wanted = true;
+      i_cond_signal (&p->ck_wake);
     }
+  i_mutex_unlock (&p->ck_l);
+}
 
-  if (txnt_open (&p->tnxt, e))
+/**
+ * Writes back up to PGR_IO_BATCH cold, dirty, unpinned frames of [part]
+ * whose log records are already durable, so reservations find clean
+ * victims and never wait on the WAL. See pgr_write_frames. [ntaken] is
+ * the number of frames written.
+ */
+static err_t
+pgr_clean_partition (struct pager *p, struct pgr_partition *part, u8 *bufs, u32 *ntaken, error *e)
+{
+  struct page_frame *frames[PGR_IO_BATCH];
+  u32 n = 0;
+
+  lsn durable = p->wal_enabled ? wal_get_flushed_lsn (&p->ww) : 0;
+
+  spx_latch_lock_x (&part->l);
+
+  // Starting at the hand - the next victims go first
+  for (u32 i = 0; i < part->len && n < PGR_IO_BATCH; ++i)
     {
-      return NULL;
-    }
+      struct page_frame *mp = &p->pages[part->start + (part->clock + i) % part->len];
 
-  p->next_tid = 1;
+      if (!pf_check (mp, PW_PRESENT) || !pf_check (mp, PW_DIRTY) || mp->pin > 0 || mp->wsibling != -1)
+        {
+          continue;
+        }
+      if (mp->flags & (PW_ACCESS | PW_HOT | PW_STICKY))
+        {
+          continue;
+        }
+      if (p->wal_enabled && mp->wal_end > durable)
+        {
+          continue;
+        }
 
-  // The first transaction - create the root page
-  {
-    struct txn tx;
+      pgr_frames_insert (frames, n++, mp);
+    }
 
-    if (p->wal_enabled)
-      {
-        if (pgr_begin_txn (&tx, p, e))
-          {
-            return NULL;
-          }
-      }
+  *ntaken = n;
+  if (n == 0)
+    {
+      spx_latch_unlock_x (&part->l);
+      return SUCCESS;
+    }
 
-    page_h root = page_h_create ();
-    pgr_new_extend (&root, p, &tx, e);
-    page_init_empty (page_h_w (&root), PG_ROOT_NODE);
+  u32 ncleaned;
+  err_t ret = pgr_write_frames (p, part, frames, n, bufs, &ncleaned, e);
+  part->stats.cleaned += ncleaned;
 
-    // Save the root page to WAL before releasing
-    err_t_wrap_null_goto (pgr_save (p, &root, PG_ROOT_NODE, e) == SUCCESS ? p : NULL, failed, e);
-    pgr_release (p, &root, PG_ROOT_NODE, e);
+  spx_latch_unlock_x (&part->l);
 
-    if (p->wal_enabled)
-      {
-        err_t ret = pgr_commit (p, &tx, e);
-        if (ret)
-          {
-            goto failed;
-          }
-      }
-  }
+  return ret;
+}
 
-  return p;
+static err_t
+pgr_clean_with (struct pager *p, u8 *bufs, error *e)
+{
+  for (u32 i = 0; i < p->nparts; ++i)
+    {
+      struct pgr_partition *part = &p->parts[i];
 
-failed:
-  txnt_close (&p->tnxt);
-  return NULL;
+      // Until a batch comes up short, bounded in case frames keep changing
+      u32 ntaken = PGR_IO_BATCH;
+      for (u32 round = 0; ntaken == PGR_IO_BATCH && round <= part->len / PGR_IO_BATCH; ++round)
+        {
+          err_t_wrap (pgr_clean_partition (p, part, bufs, &ntaken, e), e);
+        }
+    }
+
+  return SUCCESS;
 }
 
-static struct pager *
-pgr_open_existing (const char *fname, const char *walname, struct pager *ret, error *e)
+err_t
+pgr_clean (struct pager *p, error *e)
 {
-  i_log_info ("Opening existing database: %s\n", fname);
+  DBG_ASSERT (pager, p);
 
-  // Open the transaction table
-  if (txnt_open (&ret->tnxt, e))
+  u8 *bufs = i_malloc (PGR_IO_BATCH, PAGE_SIZE, e);
+  if (bufs == NULL)
     {
-      return NULL;
+      return e->cause_code;
     }
 
-  // Run ARIES recovery if WAL is enabled
-  if (ret->wal_enabled)
-    {
-      i_log_info ("Running ARIES recovery (analysis/redo/undo)...\n");
+  err_t ret = pgr_clean_with (p, bufs, e);
+  i_free (bufs);
 
-      i_log_info ("Read master LSN: %" PRlsn "\n", ret->master_lsn);
+  return ret;
+}
 
-      if (ret->master_lsn == 0)
-        {
-          i_log_info ("No checkpoint found, starting recovery from beginning\n");
-        }
-      else
-        {
-          i_log_info ("Starting recovery from checkpoint at LSN %" PRlsn "\n", ret->master_lsn);
-        }
+static void *
+pgr_cleaner_main (void *ctx)
+{
+  struct pager *p = ctx;
+  error e = error_create ();
 
-      struct aries_ctx ctx;
-      if (aries_ctx_create (&ctx, ret->master_lsn, e))
+  i_mutex_lock (&p->cl_l);
+  while (!p->cl_stop)
+    {
+      if (!p->cl_wanted)
         {
-          goto failed;
+          i_cond_wait (&p->cl_wake, &p->cl_l);
+          continue;
         }
-      err_t result = pgr_restart (ret, &ctx, e);
-      // Go back to write mode
-      if (result != SUCCESS)
+      p->cl_wanted = false;
+      i_mutex_unlock (&p->cl_l);
+
+      // Only a head start - eviction still writes whatever is left dirty
+      if (pgr_clean_with (p, p->cl_bufs, &e))
         {
-          i_log_error ("ARIES recovery failed with error code %d: %s\n", e->cause_code, e->cause_msg);
-          goto failed;
+          i_log_debug ("Page cleaner pass failed: %s\n", e.cause_msg);
+          error_reset (&e);
         }
 
-      i_log_info ("ARIES recovery completed successfully\n");
-
-      // Enter optimized write mode
-      err_t_wrap_goto (wal_write_mode (&ret->ww, e), failed, e);
-      ret->next_tid = ctx.max_tid + 1;
-
-      i_log_info ("Opened existing database, starting with next_tid: %" PRtxid "\n", ret->next_tid);
+      i_mutex_lock (&p->cl_l);
     }
+  i_mutex_unlock (&p->cl_l);
 
-  return ret;
-
-failed:
-  txnt_close (&ret->tnxt);
   return NULL;
 }
 
-static inline err_t
-pgr_is_new_guard (struct pager *p, bool *isnew, error *e)
+err_t
+pgr_start_cleaner (struct pager *p, error *e)
 {
-  *isnew = false;
+  DBG_ASSERT (pager, p);
+  ASSERT (!p->cl_running);
 
-  if (fpgr_get_npages (&p->fp) == 0)
+  p->cl_bufs = i_malloc (PGR_IO_BATCH, PAGE_SIZE, e);
+  if (p->cl_bufs == NULL)
     {
-      *isnew = true;
-      return SUCCESS;
+      return e->cause_code;
     }
 
-  page root;
+  p->cl_stop = false;
+  p->cl_wanted = false;
 
-  err_t_wrap (fpgr_read (&p->fp, root.raw, 0, e), e);
-  root.pg = 0;
+  if (i_thread_create (&p->cl_thread, pgr_cleaner_main, p, e))
+    {
+      i_free (p->cl_bufs);
+      p->cl_bufs = NULL;
+      return e->cause_code;
+    }
 
-  p->master_lsn = rn_get_master_lsn (&root);
-  p->first_tombstone = rn_get_first_tmbst (&root);
+  i_mutex_lock (&p->cl_l);
+  p->cl_running = true;
+  i_mutex_unlock (&p->cl_l);
 
   return SUCCESS;
 }
 
-struct pager *
-pgr_open (const char *fname, const char *walname, error *e)
+void
+pgr_stop_cleaner (struct pager *p)
 {
-  struct pager *ret = NULL;
-  struct dpg_table *dpt = NULL;
-  bool is_new = !i_exists_rw (fname);
-  bool fpgr_opened = false;
+  DBG_ASSERT (pager, p);
 
-  // Initialize internals
-  {
-    // Allocate the pager
-    err_t_wrap_null_goto (ret = i_calloc (1, sizeof *ret, e), failed, e);
+  i_mutex_lock (&p->cl_l);
+  if (!p->cl_running)
+    {
+      i_mutex_unlock (&p->cl_l);
+      return;
+    }
+  p->cl_running = false;
+  p->cl_stop = true;
+  i_cond_signal (&p->cl_wake);
+  i_mutex_unlock (&p->cl_l);
 
-    // Initialize the file pager
-    err_t_wrap_goto (fpgr_open (&ret->fp, fname, e), failed, e);
+  error e = error_create ();
+  if (i_thread_join (&p->cl_thread, &e))
+    {
+      i_log_warn ("Failed to join the page cleaner: %s\n", e.cause_msg);
+    }
+
+  i_free (p->cl_bufs);
+  p->cl_bufs = NULL;
+}
+
+static inline err_t
+pgr_evict_all (struct pager *pg, error *e)
+{
+  DBG_ASSERT (pager, pg);
+
+  i_log_trace ("Pager before evict all:\n");
+  i_log_page_table (LOG_TRACE, pg);
+
+  err_t ret = SUCCESS;
+
+  for (u32 i = 0; i < pg->nparts; ++i)
+    {
+      struct pgr_partition *part = &pg->parts[i];
+
+      spx_latch_lock_x (&part->l);
+
+      // Dirty pages go out in batches first, so evicting is only bookkeeping
+      u32 nwritten = PGR_IO_BATCH;
+      while (ret == SUCCESS && nwritten == PGR_IO_BATCH)
+        {
+          ret = pgr_write_behind (pg, part, false, &nwritten, e);
+        }
+
+      for (u32 j = 0; j < part->len; ++j)
+        {
+          struct page_frame *mp = &pg->pages[part->start + part->clock];
+
+          // Only still dirty if writing it back failed - it stays
+          if (pf_check (mp, PW_PRESENT) && !pf_check (mp, PW_DIRTY))
+            {
+              pgr_evict (pg, part, mp);
+            }
+
+          part->clock = (part->clock + 1) % part->len;
+        }
+
+      spx_latch_unlock_x (&part->l);
+    }
+
+  return e->cause_code;
+}
+
+/**
+ * Runs the clock on [part] until it finds a free frame, evicting
+ * an unpinned page if it needs to. On success, [dest] is the global
+ * index of the free frame and the clock hand is left pointing at it.
+ *
+ * Under 2Q the hand only evicts cold pages. A hot page leaves the hot
+ * set when a promotion was refused for lack of room (part->demote) or,
+ * on the last lap, when no cold page could be evicted at all.
+ *
+ * Caller holds [part->l] in X. If the victim is dirty it is dropped
+ * while the write back is out, so a page looked up as missing before
+ * the call might be resident after it. It is also dropped to wait when
+ * the only unpinned frames left are pinned by someone else's write back.
+ */
+static inline err_t
+pgr_reserve_at_clock (struct pager *p, struct pgr_partition *part, u32 *dest, error *e)
+{
+  DBG_ASSERT (pager, p);
+
+  i_log_trace ("Pager reserving a spot in buffer pool\n");
+
+  // 2 times so that we might clear an access bit, a 3rd to demote hot pages
+  struct page_frame *mp;
+again:
+  for (u32 i = 0; i < 3 * part->len; ++i)
+    {
+      u32 idx = part->start + part->clock;
+
+      i_log_trace ("Reserve: checking page: %u\n", idx);
+
+      mp = &p->pages[idx];
+
+      // Found an empty spot - a failed read stays in flight until its waiters leave
+      if (!pf_check (mp, PW_PRESENT | PW_INFLIGHT))
+        {
+          i_log_trace ("Page: %u is not present, using this spot\n", idx);
+          goto found_spot;
+        }
+
+      // Pinned (or in flight), skip it
+      if (mp->pin > 0)
+        {
+          i_log_trace ("Page: %u is pinned with pin: %u, skipping\n", idx, mp->pin);
+          part->clock = (part->clock + 1) % part->len;
+          continue;
+        }
+
+      // Sticky - only given up on the last lap when nothing else could be
+      if (pf_check (mp, PW_STICKY))
+        {
+          if (i < 2 * part->len)
+            {
+              part->clock = (part->clock + 1) % part->len;
+              continue;
+            }
+          i_log_trace ("Page: %u is sticky but the pool is exhausted, unsticking\n", idx);
+          pgr_unstick (part, mp);
+        }
+
+      // Access bit is on - set off and continue
+      if (pf_check (mp, PW_ACCESS))
+        {
+          i_log_trace ("Page: %u has access bit: 1, clearing then skipping\n", idx);
+          pf_clr (mp, PW_ACCESS);
+
+          // 2Q - re-referenced while cold, protect it
+          if (p->policy == PGR_POLICY_2Q)
+            {
+              pgr_2q_make_hot (part, mp);
+            }
+
+          part->clock = (part->clock + 1) % part->len;
+          continue;
+        }
+
+      // Hot - stays unless something else needs its place
+      if (pf_check (mp, PW_HOT))
+        {
+          if (part->demote > 0 || i >= 2 * part->len)
+            {
+              i_log_trace ("Page: %u is hot with access bit: 0, demoting\n", idx);
+              pf_clr (mp, PW_HOT);
+              part->nhot--;
+              if (part->demote > 0)
+                {
+                  part->demote--;
+                }
+            }
+          part->clock = (part->clock + 1) % part->len;
+          continue;
+        }
+
+      // Dirty - the cleaner fell behind, write it back with the next few victims
+      if (pf_check (mp, PW_DIRTY))
+        {
+          part->stats.dirty_evictions++;
+          pgr_cleaner_kick (p);
+
+          u32 nwritten;
+          err_t_wrap (pgr_write_behind (p, part, true, &nwritten, e), e);
+
+          // The latch was dropped for the write - the hand may have moved on
+          part->clock = idx - part->start;
+          if (!pf_check (mp, PW_PRESENT | PW_INFLIGHT))
+            {
+              goto found_spot;
+            }
+
+          // Picked up or written to in the mean time
+          if (mp->pin > 0 || (mp->flags & (PW_DIRTY | PW_ACCESS | PW_HOT | PW_STICKY)))
+            {
+              part->clock = (part->clock + 1) % part->len;
+              continue;
+            }
+        }
+
+      // EVICT
+      i_log_trace ("Page: %u is present but doesn't have access bit, evicting\n", idx);
+      pgno victim = mp->page.pg;
+
+      pgr_evict (p, part, mp);
+      if (p->policy == PGR_POLICY_2Q)
+        {
+          pgr_ghost_push (part, victim);
+        }
+      goto found_spot;
+    }
+
+  // Frames pinned only for a write back come free once it lands
+  for (u32 i = 0; i < part->len; ++i)
+    {
+      mp = &p->pages[part->start + i];
+      if (pf_check (mp, PW_WRITING))
+        {
+          i_log_trace ("Pool is pinned, waiting on the write back of frame: %u\n", part->start + i);
+          spx_latch_unlock_x (&part->l);
+          spx_latch_lock_s (&mp->latch);
+          spx_latch_unlock_s (&mp->latch);
+          spx_latch_lock_x (&part->l);
+          goto again;
+        }
+    }
+
+  return error_causef (e, ERR_PAGER_FULL, "Memory buffer pool is full");
+
+found_spot:
+  *dest = part->start + part->clock;
+  ASSERT (!pf_check (&p->pages[*dest], PW_PRESENT));
+  return SUCCESS;
+}
+
+static inline void
+pgr_advance_clock (struct pgr_partition *part)
+{
+  part->clock = (part->clock + 1) % part->len;
+}
+
+static err_t
+pgr_new_extend (page_h *dest, struct pager *p, struct txn *tx, error *e)
+{
+  DBG_ASSERT (pager, p);
+  DBG_ASSERT (page_h, dest);
+  ASSERT (dest->mode == PHM_NONE);
+
+  i_log_trace ("Creating new page by extending file\n");
+
+  pgno pg;
+  struct page_frame *pgr = NULL, *pgw = NULL;
+  u32 pgrloc, pgwloc;
+
+  err_t ret = SUCCESS;
+
+  /**
+   * The new page's partition depends on its page number, so hold
+   * the extension latch until the file actually grows
+   */
+  spx_latch_lock_x (&p->l);
+
+  pg = fpgr_get_npages (&p->fp);
+  struct pgr_partition *part = pgr_partition_of (p, pg);
+
+  // Reserve the read and write page spots
+  spx_latch_lock_x (&part->l);
+  {
+    ret = pgr_reserve_at_clock (p, part, &pgrloc, e);
+    if (ret)
+      {
+        spx_latch_unlock_x (&part->l);
+        goto theend;
+      }
+
+    pgr = &p->pages[pgrloc];
+    pgr->pin = 1;
+    pgr->flags = 0;
+    pgr->wsibling = -1;
+    pgr->wal_end = 0;
+    if (p->policy == PGR_POLICY_CLOCK)
+      {
+        pf_set (pgr, PW_ACCESS);
+      }
+    pf_set (pgr, PW_PRESENT);
+
+    i_printf_trace ("Read buffer pool location: %d\n", pgrloc);
+
+    ret = pgr_reserve_at_clock (p, part, &pgwloc, e);
+    if (ret)
+      {
+        pgr->pin = 0;
+        pgr->flags = 0;
+        spx_latch_unlock_x (&part->l);
+        goto theend;
+      }
+
+    pgr->wsibling = pgwloc;
+
+    pgw = &p->pages[pgwloc];
+    pgw->pin = 1;
+    pgw->flags = 0;
+    pgw->wsibling = -1;
+    pf_set (pgw, PW_PRESENT);
+
+    i_printf_trace ("Write buffer pool location: %d\n", pgwloc);
+  }
+  spx_latch_unlock_x (&part->l);
+
+  page_init_empty (&pgr->page, PG_TOMBSTONE);
+  tmbst_set_next (&pgr->page, pg + 1);
+  ASSERT (pgr->in_sums == NULL);
+
+  /**
+   * Now we can actually extend the file
+   * TODO - You don't need to do this and we
+   * could reduce system calls by lazily extending the
+   * file and truncating it once on large pages
+   */
+  ret = fpgr_new (&p->fp, &pg, e);
+  if (ret)
+    {
+      spx_latch_lock_x (&part->l);
+      pgr->pin = 0;
+      pgr->flags = 0;
+      pgr->wsibling = -1;
+      pgw->pin = 0;
+      pgw->flags = 0;
+      spx_latch_unlock_x (&part->l);
+      goto theend;
+    }
+
+  i_printf_trace ("New page number: %" PRpgno "\n", pg);
+  i_memcpy (pgw->page.raw, pgr->page.raw, PAGE_SIZE);
+  pgr->page.pg = pg;
+  pgw->page.pg = pg;
+
+  spx_latch_lock_x (&part->l);
+  {
+    // Mark page as dirty (will be added to DPT in pgr_save with proper LSN)
+    pf_set (pgr, PW_DIRTY);
+
+    // Insert page into the hash table
+    hdata_idx hd = (hdata_idx){ .key = pg, .value = pgrloc };
+    ht_insert_expect_idx (&part->pgno_to_value, hd);
+  }
+  spx_latch_unlock_x (&part->l);
+
+  // Initialize page_h
+  dest->pgr = pgr;
+  dest->pgw = pgw;
+  dest->mode = PHM_X;
+  dest->tx = tx;
+
+theend:
+  spx_latch_unlock_x (&p->l);
+  i_log_trace ("Done trying to extend new page. Exit code: %d\n", ret);
+  return ret;
+}
+
+///////////////////////////////////////////////////////////
+////// LIFECYCLE
+
+static struct pager *
+pgr_open_new (const char *fname, const char *walname, struct pager *p, error *e)
+{
+  i_log_info ("Creating new database: %s\n", fname);
+  if (fpgr_reset (&p->fp, e))
+    {
+      return NULL;
+    }
+  if (p->wal_enabled && wal_reset (&p->ww, e))
+    {
+      return NULL;
+    }
+
+  if (txnt_open (&p->tnxt, e))
+    {
+      return NULL;
+    }
+
+  p->next_tid = 1;
+
+  // The first transaction - create the root page
+  {
+    struct txn tx;
+
+    if (p->wal_enabled)
+      {
+        if (pgr_begin_txn (&tx, p, e))
+          {
+            return NULL;
+          }
+      }
+
+    page_h root = page_h_create ();
+    pgr_new_extend (&root, p, &tx, e);
+    page_init_empty (page_h_w (&root), PG_ROOT_NODE);
+
+    // Save the root page to WAL before releasing
+    err_t_wrap_null_goto (pgr_save (p, &root, PG_ROOT_NODE, e) == SUCCESS ? p : NULL, failed, e);
+    pgr_release (p, &root, PG_ROOT_NODE, e);
+
+    if (p->wal_enabled)
+      {
+        err_t ret = pgr_commit (p, &tx, e);
+        if (ret)
+          {
+            goto failed;
+          }
+      }
+  }
+
+  return p;
+
+failed:
+  txnt_close (&p->tnxt);
+  return NULL;
+}
+
+static struct pager *
+pgr_open_existing (const char *fname, const char *walname, struct pager *ret, error *e)
+{
+  i_log_info ("Opening existing database: %s\n", fname);
+
+  // Open the transaction table
+  if (txnt_open (&ret->tnxt, e))
+    {
+      return NULL;
+    }
+
+  // Run ARIES recovery if WAL is enabled
+  if (ret->wal_enabled)
+    {
+      i_log_info ("Running ARIES recovery (analysis/redo/undo)...\n");
+
+      i_log_info ("Read master LSN: %" PRlsn "\n", ret->master_lsn);
+
+      if (ret->master_lsn == 0)
+        {
+          i_log_info ("No checkpoint found, starting recovery from beginning\n");
+        }
+      else
+        {
+          i_log_info ("Starting recovery from checkpoint at LSN %" PRlsn "\n", ret->master_lsn);
+        }
+
+      struct aries_ctx ctx;
+      if (aries_ctx_create (&ctx, ret->master_lsn, ret->pool_len, e))
+        {
+          goto failed;
+        }
+      err_t result = pgr_restart (ret, &ctx, e);
+      // Go back to write mode
+      if (result != SUCCESS)
+        {
+          i_log_error ("ARIES recovery failed with error code %d: %s\n", e->cause_code, e->cause_msg);
+          goto failed;
+        }
+
+      i_log_info ("ARIES recovery completed successfully\n");
+
+      // Enter optimized write mode
+      err_t_wrap_goto (wal_write_mode (&ret->ww, e), failed, e);
+      ret->next_tid = ctx.max_tid + 1;
+
+      i_log_info ("Opened existing database, starting with next_tid: %" PRtxid "\n", ret->next_tid);
+    }
+
+  return ret;
+
+failed:
+  txnt_close (&ret->tnxt);
+  return NULL;
+}
+
+static inline err_t
+pgr_is_new_guard (struct pager *p, bool *isnew, error *e)
+{
+  *isnew = false;
+
+  if (fpgr_get_npages (&p->fp) == 0)
+    {
+      *isnew = true;
+      return SUCCESS;
+    }
+
+  page root;
+
+  err_t_wrap (fpgr_read (&p->fp, root.raw, 0, e), e);
+  root.pg = 0;
+
+  // Layouts are sized at compile time - refuse files made with another page size.
+  // A root that never reached disk is rebuilt by recovery and validated on fetch
+  if (page_get_type (&root) == PG_ROOT_NODE)
+    {
+      err_t_wrap (rn_validate_for_db (&root, e), e);
+    }
+
+  p->master_lsn = rn_get_master_lsn (&root);
+  p->first_tombstone = rn_get_first_tmbst (&root);
+
+  return SUCCESS;
+}
+
+static void
+pgr_pool_free (struct pager *p)
+{
+  if (p->pages)
+    {
+      i_huge_free (p->pages, (u64)p->pool_len * sizeof *p->pages);
+      p->pages = NULL;
+    }
+  if (p->_hdata)
+    {
+      i_huge_free (p->_hdata, (u64)p->pool_len * sizeof *p->_hdata);
+      p->_hdata = NULL;
+    }
+  if (p->_ghost)
+    {
+      i_huge_free (p->_ghost, (u64)p->pool_len * sizeof *p->_ghost);
+      p->_ghost = NULL;
+    }
+  if (p->_ghdata)
+    {
+      i_huge_free (p->_ghdata, (u64)p->pool_len * sizeof *p->_ghdata);
+      p->_ghdata = NULL;
+    }
+  if (p->_insums)
+    {
+      i_free (p->_insums);
+      p->_insums = NULL;
+    }
+  if (p->_insums_free)
+    {
+      i_free (p->_insums_free);
+      p->_insums_free = NULL;
+    }
+}
+
+static err_t
+pgr_pool_alloc (struct pager *p, u32 pool_len, error *e)
+{
+  p->pages = i_huge_alloc ((u64)pool_len * sizeof *p->pages, e);
+  if (p->pages == NULL)
+    {
+      return e->cause_code;
+    }
+
+  p->pool_len = pool_len;
+
+  p->_hdata = i_huge_alloc ((u64)pool_len * sizeof *p->_hdata, e);
+  if (p->_hdata == NULL)
+    {
+      goto failed;
+    }
+
+  // Ghost rings - every partition's ring is at most as long as its slice of frames
+  p->_ghost = i_huge_alloc ((u64)pool_len * sizeof *p->_ghost, e);
+  if (p->_ghost == NULL)
+    {
+      goto failed;
+    }
+
+  p->_ghdata = i_huge_alloc ((u64)pool_len * sizeof *p->_ghdata, e);
+  if (p->_ghdata == NULL)
+    {
+      goto failed;
+    }
+
+  /**
+   * Key totals only for as many inner nodes as the sticky region could
+   * hold at most - not for every frame. Each slot is IN_MAX_KEYS totals,
+   * half a page.
+   */
+  p->insums_len = MAX (pool_len * PGR_STICKY_MAX_PCT / 100, 1);
+  p->_insums = i_malloc (p->insums_len, IN_MAX_KEYS * sizeof *p->_insums, e);
+  if (p->_insums == NULL)
+    {
+      goto failed;
+    }
+  p->_insums_free = i_malloc (p->insums_len, sizeof *p->_insums_free, e);
+  if (p->_insums_free == NULL)
+    {
+      goto failed;
+    }
+
+  return SUCCESS;
+
+failed:
+  pgr_pool_free (p);
+  return e->cause_code;
+}
+
+struct pager *
+pgr_open (const char *fname, const char *walname, u32 pool_len, error *e)
+{
+  struct pager *ret = NULL;
+  struct dpg_table *dpt = NULL;
+  bool is_new = !i_exists_rw (fname);
+  bool fpgr_opened = false;
+  bool ra_opened = false;
+  bool cl_opened = false;
+  bool ck_opened = false;
+
+  if (pool_len == 0)
+    {
+      pool_len = MEMORY_PAGE_LEN;
+    }
+
+  if (pool_len < PGR_MIN_POOL_LEN)
+    {
+      error_causef (e, ERR_INVALID_ARGUMENT,
+                    "Buffer pool needs at least %" PRIu32 " pages, got %" PRIu32,
+                    PGR_MIN_POOL_LEN, pool_len);
+      return NULL;
+    }
+
+  // Initialize internals
+  {
+    // Allocate the pager
+    err_t_wrap_null_goto (ret = i_calloc (1, sizeof *ret, e), failed, e);
+
+    // Allocate the buffer pool frames
+    err_t_wrap_goto (pgr_pool_alloc (ret, pool_len, e), failed, e);
+
+    // Read-ahead stream table - idle until a thread pool is set
+    err_t_wrap_goto (i_mutex_create (&ret->ra_l, e), failed, e);
+    if (i_cond_create (&ret->ra_idle, e))
+      {
+        i_mutex_free (&ret->ra_l);
+        goto failed;
+      }
+    ra_opened = true;
+
+    // Page cleaner - idle until pgr_start_cleaner
+    err_t_wrap_goto (i_mutex_create (&ret->cl_l, e), failed, e);
+    if (i_cond_create (&ret->cl_wake, e))
+      {
+        i_mutex_free (&ret->cl_l);
+        goto failed;
+      }
+    cl_opened = true;
+
+    // Checkpointer - idle until pgr_start_checkpointer
+    err_t_wrap_goto (i_mutex_create (&ret->ck_l, e), failed, e);
+    if (i_cond_create (&ret->ck_wake, e))
+      {
+        i_mutex_free (&ret->ck_l);
+        goto failed;
+      }
+    if (i_mutex_create (&ret->ckpt_l, e))
+      {
+        i_cond_free (&ret->ck_wake);
+        i_mutex_free (&ret->ck_l);
+        goto failed;
+      }
+    if (i_mutex_create (&ret->rn_l, e))
+      {
+        i_mutex_free (&ret->ckpt_l);
+        i_cond_free (&ret->ck_wake);
+        i_mutex_free (&ret->ck_l);
+        goto failed;
+      }
+    ck_opened = true;
+
+    // Initialize the file pager
+    err_t_wrap_goto (fpgr_open (&ret->fp, fname, e), failed, e);
     fpgr_opened = true;
 
-    // Pull in the root node data values
-    err_t_wrap_goto (pgr_is_new_guard (ret, &is_new, e), failed, e);
+    // Pull in the root node data values
+    err_t_wrap_goto (pgr_is_new_guard (ret, &is_new, e), failed, e);
+
+    // Open the dirty page table - it never holds more pages than the pool
+    err_t_wrap_null_goto (dpt = dpgt_open (pool_len, e), failed, e);
+
+    // Initialize the WAL
+    if (walname)
+      {
+        err_t_wrap_goto (wal_open (&ret->ww, walname, e), failed, e);
+        ret->wal_enabled = true;
+      }
+    else
+      {
+        ret->wal_enabled = false;
+      }
+
+    // Split the buffer pool into partitions
+    pgr_partitions_init (ret);
+
+    // Initialize internal latch
+    spx_latch_init (&ret->l);
+    spx_latch_init (&ret->ckpt_latch);
+
+    // Initialize page frame latches
+    for (u32 i = 0; i < ret->pool_len; ++i)
+      {
+        spx_latch_init (&ret->pages[i].latch);
+      }
+
+    // Simple variables
+    ret->dpt = dpt;
+    ret->next_tid = 1;
+    ret->policy = PGR_POLICY_2Q;
+  }
+
+  if (is_new)
+    {
+      err_t_wrap_null_goto (pgr_open_new (fname, walname, ret, e), failed, e);
+    }
+  else
+    {
+      err_t_wrap_null_goto (pgr_open_existing (fname, walname, ret, e), failed, e);
+    }
+
+  DBG_ASSERT (pager, ret);
+  return ret;
+
+failed:
+  ASSERT (e->cause_code);
+  // spx_latch doesn't need cleanup
+  if (dpt)
+    {
+      dpgt_close (dpt);
+    }
+  if (ret && ret->wal_enabled)
+    {
+      wal_close (&ret->ww, e);
+    }
+  if (ret && fpgr_opened)
+    {
+      fpgr_close (&ret->fp, e);
+    }
+  if (ret && ra_opened)
+    {
+      i_cond_free (&ret->ra_idle);
+      i_mutex_free (&ret->ra_l);
+    }
+  if (ret && cl_opened)
+    {
+      i_cond_free (&ret->cl_wake);
+      i_mutex_free (&ret->cl_l);
+    }
+  if (ret && ck_opened)
+    {
+      i_mutex_free (&ret->rn_l);
+      i_mutex_free (&ret->ckpt_l);
+      i_cond_free (&ret->ck_wake);
+      i_mutex_free (&ret->ck_l);
+    }
+  if (ret)
+    {
+      pgr_pool_free (ret);
+      i_free (ret);
+    }
+  if (is_new)
+    {
+      fpgr_remove (fname, e);
+      if (walname)
+        {
+          wal_remove (walname, e);
+        }
+    }
+  return NULL;
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, pager_open)
+{
+  error e = error_create ();
+
+  /* Green path */
+  {
+    test_fail_if (i_remove_quiet ("test.db", &e));
+    test_fail_if (i_remove_quiet ("test.wal", &e));
+
+    struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+
+    test_fail_if_null (p);
+    test_err_t_wrap (pgr_close (p, &e), &e);
+  }
+}
+#endif
+
+#ifndef NTEST
+TEST (TT_UNIT, pgr_open_pool_len)
+{
+  error e = error_create ();
+
+  /* Default pool */
+  {
+    test_fail_if (i_remove_quiet ("test.db", &e));
+    test_fail_if (i_remove_quiet ("test.wal", &e));
+
+    struct pager *p = pgr_open ("test.db", "test.wal", 0, &e);
+    test_fail_if_null (p);
+    test_assert_int_equal (pgr_get_pool_len (p), MEMORY_PAGE_LEN);
+    test_err_t_wrap (pgr_close (p, &e), &e);
+  }
+
+  /* Too small */
+  {
+    test_fail_if (i_remove_quiet ("test.db", &e));
+    test_fail_if (i_remove_quiet ("test.wal", &e));
+
+    struct pager *p = pgr_open ("test.db", "test.wal", PGR_MIN_POOL_LEN - 1, &e);
+    test_assert_equal (p, NULL);
+    test_assert_int_equal (e.cause_code, ERR_INVALID_ARGUMENT);
+    error_reset (&e);
+  }
+
+  /* Larger than the default - every page stays resident */
+  {
+    test_fail_if (i_remove_quiet ("test.db", &e));
+    test_fail_if (i_remove_quiet ("test.wal", &e));
+
+    u32 pool_len = 4 * PGR_PARTITION_MIN_LEN;
+    struct pager *p = pgr_open ("test.db", "test.wal", pool_len, &e);
+    test_fail_if_null (p);
+    test_assert_int_equal (pgr_get_pool_len (p), pool_len);
+    test_assert_int_equal (p->nparts, 4);
+
+    struct txn tx;
+    test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+
+    u32 npages = pool_len - PGR_PARTITION_MIN_LEN;
+    for (u32 i = 0; i < npages; ++i)
+      {
+        page_h h = page_h_create ();
+        test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+        dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+        test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+      }
+    test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+    test_assert_int_equal (pgr_get_npages (p), npages + 1);
+
+    test_err_t_wrap (pgr_close (p, &e), &e);
+  }
+}
+#endif
+
+#ifndef NTEST
+TEST (TT_UNIT, pgr_open_basic)
+{
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
+
+  i_file fp;
+  test_err_t_wrap (i_open_rw (&fp, "test.db", &e), &e);
+
+  struct pager *p;
+
+  /* File is shorter than page size */
+  test_fail_if (i_truncate (&fp, PAGE_SIZE - 1, &e));
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_assert_int_equal (e.cause_code, ERR_CORRUPT);
+  test_assert_equal (p, NULL);
+  e.cause_code = SUCCESS;
+
+  /* Half a page */
+  test_fail_if (i_truncate (&fp, PAGE_SIZE / 2, &e));
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_assert_int_equal (e.cause_code, ERR_CORRUPT);
+  test_assert_equal (p, NULL);
+  e.cause_code = SUCCESS;
+
+  /* 0 pages */
+  test_fail_if (i_truncate (&fp, 0, &e));
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_assert_int_equal (e.cause_code, SUCCESS);
+  test_fail_if_null (p);
+  test_assert_int_equal ((int)pgr_get_npages (p), 1);
+  test_fail_if (pgr_close (p, &e));
+
+  /* Tear down */
+  test_fail_if (i_close (&fp, &e));
+  test_fail_if (i_unlink ("test.db", &e));
+}
+#endif
+
+#ifndef NTEST
+TEST (TT_UNIT, pgr_open_page_size_mismatch)
+{
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
+
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
+  test_fail_if (pgr_close (p, &e));
+
+  /* Same page size - reopens */
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
+  test_fail_if (pgr_close (p, &e));
+
+  /* Root claims another page size */
+  i_file fp;
+  p_size other = PAGE_SIZE * 2;
+  test_err_t_wrap (i_open_rw (&fp, "test.db", &e), &e);
+  test_err_t_wrap (i_pwrite_all (&fp, &other, sizeof other, RN_PGSZ_OFST, &e), &e);
+  test_fail_if (i_close (&fp, &e));
+
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_assert_equal (p, NULL);
+  test_assert_int_equal (e.cause_code, ERR_CORRUPT);
+  error_reset (&e);
+
+  /* Made before the page size was recorded - legacy 2048 */
+  other = 0;
+  test_err_t_wrap (i_open_rw (&fp, "test.db", &e), &e);
+  test_err_t_wrap (i_pwrite_all (&fp, &other, sizeof other, RN_PGSZ_OFST, &e), &e);
+  test_fail_if (i_close (&fp, &e));
+
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  if (PAGE_SIZE == RN_LEGACY_PAGE_SIZE)
+    {
+      test_fail_if_null (p);
+
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_get (&h, PG_ROOT_NODE, 0, p, &e), &e);
+      test_assert_int_equal (rn_get_page_size (page_h_ro (&h)), RN_LEGACY_PAGE_SIZE);
+      test_err_t_wrap (pgr_release (p, &h, PG_ROOT_NODE, &e), &e);
+
+      test_fail_if (pgr_close (p, &e));
+    }
+  else
+    {
+      test_assert_equal (p, NULL);
+      test_assert_int_equal (e.cause_code, ERR_CORRUPT);
+      error_reset (&e);
+    }
+
+  test_fail_if (i_unlink ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
+}
+#endif
+
+err_t
+pgr_close (struct pager *p, error *e)
+{
+  DBG_ASSERT (pager, p);
+
+  // Read-ahead tasks and the background threads hold on to p
+  pgr_set_thread_pool (p, NULL);
+  pgr_stop_checkpointer (p);
+  pgr_stop_cleaner (p);
+
+  // Save all in memory pages
+  pgr_evict_all (p, e);
+
+  if (p->wal_enabled)
+    {
+      wal_close (&p->ww, e);
+    }
+  fpgr_close (&p->fp, e);
+
+  txnt_close (&p->tnxt);
+  dpgt_close (p->dpt);
+
+  i_cond_free (&p->ra_idle);
+  i_mutex_free (&p->ra_l);
+  i_cond_free (&p->cl_wake);
+  i_mutex_free (&p->cl_l);
+  i_mutex_free (&p->rn_l);
+  i_mutex_free (&p->ckpt_l);
+  i_cond_free (&p->ck_wake);
+  i_mutex_free (&p->ck_l);
+  pgr_pool_free (p);
+  i_free (p);
+
+  return e->cause_code;
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, pgr_close_success)
+{
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
+
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
+
+  /* Delete file i_close should fail */
+  test_assert_equal (pgr_close (p, &e), SUCCESS);
+  test_fail_if (i_remove_quiet ("foo.db", &e));
+}
+#endif
+
+///////////////////////////////////////////////////////////
+////// COMMON
+
+p_size
+pgr_get_npages (const struct pager *p)
+{
+  DBG_ASSERT (pager, p);
+  return fpgr_get_npages (&p->fp);
+}
+
+u32
+pgr_get_pool_len (const struct pager *p)
+{
+  DBG_ASSERT (pager, p);
+  return p->pool_len;
+}
+
+///////////////////////////////////////////////////////////
+////// REPLACEMENT POLICY
+
+void
+pgr_set_policy (struct pager *p, enum pgr_policy policy)
+{
+  DBG_ASSERT (pager, p);
+
+  for (u32 i = 0; i < p->nparts; ++i)
+    {
+      spx_latch_lock_x (&p->parts[i].l);
+    }
+
+  // Resident pages keep their frames, only the 2Q bookkeeping is dropped
+  for (u32 i = 0; i < p->nparts; ++i)
+    {
+      struct pgr_partition *part = &p->parts[i];
+      for (u32 j = 0; j < part->len; ++j)
+        {
+          pf_clr (&p->pages[part->start + j], PW_HOT);
+        }
+      part->nhot = 0;
+      part->demote = 0;
+      pgr_ghost_clear (part);
+    }
+
+  p->policy = policy;
+
+  for (u32 i = 0; i < p->nparts; ++i)
+    {
+      spx_latch_unlock_x (&p->parts[i].l);
+    }
+}
+
+enum pgr_policy
+pgr_get_policy (const struct pager *p)
+{
+  DBG_ASSERT (pager, p);
+  return p->policy;
+}
+
+void
+pgr_get_stats (struct pager *p, struct pgr_stats *dest)
+{
+  DBG_ASSERT (pager, p);
+
+  *dest = (struct pgr_stats){ 0 };
+
+  for (u32 i = 0; i < p->nparts; ++i)
+    {
+      struct pgr_partition *part = &p->parts[i];
+
+      spx_latch_lock_s (&part->l);
+      dest->hits += part->stats.hits;
+      dest->misses += part->stats.misses;
+      dest->evictions += part->stats.evictions;
+      dest->promotions += part->stats.promotions;
+      dest->ghost_hits += part->stats.ghost_hits;
+      dest->sticky_hits += part->stats.sticky_hits;
+      dest->sticky_resident += part->nsticky;
+      dest->prefetches += part->stats.prefetches;
+      dest->prefetch_hits += part->stats.prefetch_hits;
+      dest->cleaned += part->stats.cleaned;
+      dest->dirty_evictions += part->stats.dirty_evictions;
+      dest->x_latched += part->stats.x_latched;
+      spx_latch_unlock_s (&part->l);
+    }
+}
+
+void
+pgr_set_sticky_len (struct pager *p, u32 frames)
+{
+  DBG_ASSERT (pager, p);
+
+  for (u32 i = 0; i < p->nparts; ++i)
+    {
+      spx_latch_lock_x (&p->parts[i].l);
+    }
+
+  // Spread the budget over partitions by size, always leaving room for data pages
+  for (u32 i = 0; i < p->nparts; ++i)
+    {
+      struct pgr_partition *part = &p->parts[i];
+      u64 share = (u64)frames * part->len / p->pool_len;
+      u32 cap = part->len * PGR_STICKY_MAX_PCT / 100;
+      pgr_partition_set_sticky_max (p, part, share < cap ? (u32)share : cap);
+    }
+
+  for (u32 i = 0; i < p->nparts; ++i)
+    {
+      spx_latch_unlock_x (&p->parts[i].l);
+    }
+}
+
+u32
+pgr_get_sticky_len (struct pager *p)
+{
+  DBG_ASSERT (pager, p);
+
+  u32 ret = 0;
+  for (u32 i = 0; i < p->nparts; ++i)
+    {
+      spx_latch_lock_s (&p->parts[i].l);
+      ret += p->parts[i].sticky_max;
+      spx_latch_unlock_s (&p->parts[i].l);
+    }
+  return ret;
+}
+
+void
+pgr_reset_stats (struct pager *p)
+{
+  DBG_ASSERT (pager, p);
+
+  for (u32 i = 0; i < p->nparts; ++i)
+    {
+      spx_latch_lock_x (&p->parts[i].l);
+      p->parts[i].stats = (struct pgr_stats){ 0 };
+      spx_latch_unlock_x (&p->parts[i].l);
+    }
+}
+
+///////////////////////////////////////////////////////////
+////// TRANSACTION CONTROL
+
+err_t
+pgr_begin_txn (struct txn *tx, struct pager *p, error *e)
+{
+  DBG_ASSERT (pager, p);
+
+  if (p->wal_enabled)
+    {
+      // Generate a new transaction ID
+      txid tid = __atomic_fetch_add (&p->next_tid, 1, __ATOMIC_RELAXED);
+
+      spx_latch_lock_s (&p->ckpt_latch);
+
+      // Append begin record
+      slsn l = wal_append_begin_log (&p->ww, tid, e);
+      if (l < 0)
+        {
+          spx_latch_unlock_s (&p->ckpt_latch);
+          return e->cause_code;
+        }
+
+      txn_init (tx, tid, (struct txn_data){
+                             .last_lsn = l,
+                             .undo_next_lsn = 0,
+                             .state = TX_RUNNING,
+                         });
+
+      // Create a new transaction entry
+      err_t ret = txnt_insert_txn (&p->tnxt, tx, e);
+
+      spx_latch_unlock_s (&p->ckpt_latch);
+
+      return ret;
+    }
+  return SUCCESS;
+}
+
+err_t
+pgr_commit (struct pager *p, struct txn *tx, error *e)
+{
+  DBG_ASSERT (pager, p);
+
+  if (p->wal_enabled)
+    {
+      spx_latch_lock_s (&tx->l);
+
+      if (tx->data.state != TX_RUNNING)
+        {
+          spx_latch_unlock_s (&tx->l);
+          return error_causef (e, ERR_DUPLICATE_COMMIT, "Committing a transaction that is already committed\n");
+        }
+
+      // Append a commit log for this transaction
+      slsn l = wal_append_commit_log (&p->ww, tx->tid, tx->data.last_lsn, e);
+      if (l < 0)
+        {
+          spx_latch_unlock_s (&tx->l);
+          return e->cause_code;
+        }
+
+      // Only this commit has to be durable - concurrent commits share
+      // the sync instead of each waiting on everything appended so far
+      if (wal_flush_to (&p->ww, wal_commit_log_end ((lsn)l), e))
+        {
+          spx_latch_unlock_s (&tx->l);
+          return e->cause_code;
+        }
+
+      // Everything this transaction dirtied can be written back now
+      pgr_cleaner_kick (p);
+      pgr_checkpointer_kick (p, (lsn)l);
+
+      // Append an end log to the wal
+      l = wal_append_end_log (&p->ww, tx->tid, l, e);
+      if (l < 0)
+        {
+          spx_latch_unlock_s (&tx->l);
+          return e->cause_code;
+        }
+
+      err_t_wrap (txnt_remove_txn_expect (&p->tnxt, tx, e), e);
+
+      spx_latch_upgrade_s_x (&tx->l);
+
+      tx->data.state = TX_DONE;
+
+      spx_latch_unlock_x (&tx->l);
+
+      return SUCCESS;
+    }
+  return SUCCESS;
+}
+
+/**
+ * Points the master lsn on the root node at [begin] and writes the root
+ * through so restart finds it. The change is logged under a transaction
+ * of its own like any other root update
+ */
+static err_t
+pgr_set_master_lsn (struct pager *p, lsn begin, error *e)
+{
+  struct txn tx;
+  page_h root = page_h_create ();
+
+  i_mutex_lock (&p->rn_l);
+
+  err_t_wrap_goto (pgr_begin_txn (&tx, p, e), theend, e);
+  err_t_wrap_goto (pgr_get_writable (&root, &tx, PG_ROOT_NODE, ROOT_PGNO, p, e), theend, e);
+
+  // Recovery expects the begin record, not the end record
+  rn_set_master_lsn (page_h_w (&root), begin);
+
+  if (pgr_save (p, &root, PG_ROOT_NODE, e))
+    {
+      pgr_cancel_w (p, &root);
+      pgr_release (p, &root, PG_ROOT_NODE, NULL);
+      goto theend;
+    }
+
+  // Only the log up to the root's own update has to go first
+  if (wal_flush_to (&p->ww, root.pgr->wal_end, e)
+      || fpgr_write (&p->fp, page_h_ro (&root)->raw, ROOT_PGNO, e))
+    {
+      pgr_release (p, &root, PG_ROOT_NODE, NULL);
+      goto theend;
+    }
+
+  err_t_wrap_goto (pgr_release (p, &root, PG_ROOT_NODE, e), theend, e);
+  err_t_wrap_goto (pgr_commit (p, &tx, e), theend, e);
+
+theend:
+  i_mutex_unlock (&p->rn_l);
+  return e->cause_code;
+}
+
+err_t
+pgr_checkpoint (struct pager *p, error *e)
+{
+  DBG_ASSERT (pager, p);
+
+  if (!p->wal_enabled)
+    {
+      return SUCCESS;
+    }
+
+  struct txn_table att;
+  struct txn *txn_bank = NULL;
+  struct dpg_table *dpt = NULL;
+
+  i_mutex_lock (&p->ckpt_l);
+
+  /**
+   * Fuzzy - the tables are copied right after the begin record while
+   * transactions keep running. Nothing is logged in between without
+   * landing in its table first, and anything that changes after is in
+   * the log after the begin record, where analysis picks it up. The
+   * copies keep the live tables out of the log write
+   */
+  spx_latch_lock_x (&p->ckpt_latch);
+
+  slsn l = wal_append_ckpt_begin (&p->ww, e);
+  if (l < 0)
+    {
+      spx_latch_unlock_x (&p->ckpt_latch);
+      goto theend;
+    }
+  p->ckpt_begin_lsn = l;
+
+  if (txnt_snapshot (&att, &txn_bank, &p->tnxt, e)
+      || (dpt = dpgt_open (p->dpt->cap, e)) == NULL
+      || dpgt_merge_into (dpt, p->dpt, e))
+    {
+      spx_latch_unlock_x (&p->ckpt_latch);
+      goto theend;
+    }
+
+  spx_latch_unlock_x (&p->ckpt_latch);
+
+  // Oldest lsn restart can reach from this checkpoint
+  lsn keep = (lsn)l;
+  keep = MIN (keep, dpgt_min_rec_lsn (dpt));
+  keep = MIN (keep, txnt_min_first_lsn (&att));
+
+  slsn ckpt_lsn = wal_append_ckpt_end (&p->ww, &att, dpt, e);
+  if (ckpt_lsn < 0)
+    {
+      goto theend;
+    }
+
+  err_t_wrap_goto (pgr_set_master_lsn (p, p->ckpt_begin_lsn, e), theend, e);
+
+  i_log_info ("Checkpoint written at LSN %" PRlsn "\n", ckpt_lsn);
+
+  // Pages that left the dirty page table (and the new master lsn)
+  // have to be on disk before the log that could redo them goes
+  err_t_wrap_goto (fpgr_sync (&p->fp, e), theend, e);
+  err_t_wrap_goto (wal_truncate (&p->ww, keep, e), theend, e);
+
+  i_mutex_lock (&p->ck_l);
+  p->ck_last = wal_get_next_lsn (&p->ww);
+  i_mutex_unlock (&p->ck_l);
+
+theend:
+  if (txn_bank)
+    {
+      txnt_close (&att);
+      i_free (txn_bank);
+    }
+  if (dpt)
+    {
+      dpgt_close (dpt);
+    }
+  i_mutex_unlock (&p->ckpt_l);
+  return e->cause_code;
+}
+
+///////// Background checkpointer
+
+static void *
+pgr_checkpointer_main (void *ctx)
+{
+  struct pager *p = ctx;
+  error e = error_create ();
+
+  i_mutex_lock (&p->ck_l);
+  while (!p->ck_stop)
+    {
+      if (!p->ck_wanted)
+        {
+          // Woken up - check again. Timed out - checkpoint if anything was logged
+          if (i_cond_timedwait (&p->ck_wake, &p->ck_l, PGR_CKPT_INTERVAL_MS * 1000))
+            {
+              continue;
+            }
+          if (wal_get_next_lsn (&p->ww) == p->ck_last)
+            {
+              continue;
+            }
+        }
+      p->ck_wanted = false;
+      i_mutex_unlock (&p->ck_l);
+
+      if (pgr_checkpoint (p, &e))
+        {
+          i_log_warn ("Background checkpoint failed: %s\n", e.cause_msg);
+          error_reset (&e);
+        }
+
+      i_mutex_lock (&p->ck_l);
+    }
+  i_mutex_unlock (&p->ck_l);
+
+  return NULL;
+}
+
+err_t
+pgr_start_checkpointer (struct pager *p, error *e)
+{
+  DBG_ASSERT (pager, p);
+  ASSERT (!p->ck_running);
+
+  if (!p->wal_enabled)
+    {
+      return SUCCESS;
+    }
+
+  p->ck_stop = false;
+  p->ck_wanted = false;
+  p->ck_last = wal_get_next_lsn (&p->ww);
+
+  err_t_wrap (i_thread_create (&p->ck_thread, pgr_checkpointer_main, p, e), e);
+
+  i_mutex_lock (&p->ck_l);
+  p->ck_running = true;
+  i_mutex_unlock (&p->ck_l);
+
+  return SUCCESS;
+}
+
+void
+pgr_stop_checkpointer (struct pager *p)
+{
+  DBG_ASSERT (pager, p);
+
+  i_mutex_lock (&p->ck_l);
+  if (!p->ck_running)
+    {
+      i_mutex_unlock (&p->ck_l);
+      return;
+    }
+  p->ck_running = false;
+  p->ck_stop = true;
+  i_cond_signal (&p->ck_wake);
+  i_mutex_unlock (&p->ck_l);
+
+  error e = error_create ();
+  if (i_thread_join (&p->ck_thread, &e))
+    {
+      i_log_warn ("Failed to join the checkpointer: %s\n", e.cause_msg);
+    }
+}
+
+/////////////////////////////////////////
+//// READ / WRITE PAGES
+
+/**
+ * Hit bookkeeping for a pinned, loaded [pgr]
+ *
+ * Caller holds [part->l] in S - every field touched here is only
+ * otherwise written under X, so S holders just race each other
+ */
+static inline void
+pgr_on_hit (struct pager *p, struct pgr_partition *part, struct page_frame *pgr)
+{
+  __atomic_fetch_add (&part->stats.hits, 1, __ATOMIC_RELAXED);
+
+  u32 was = __atomic_fetch_and (&pgr->flags, ~(u32)PW_PREFETCH, __ATOMIC_RELAXED);
+  if ((was & PW_PREFETCH) != 0)
+    {
+      // First touch of a read-ahead page stands in for its load
+      __atomic_fetch_add (&part->stats.prefetch_hits, 1, __ATOMIC_RELAXED);
+      if (p->policy == PGR_POLICY_CLOCK)
+        {
+          __atomic_fetch_or (&pgr->flags, PW_ACCESS, __ATOMIC_RELAXED);
+        }
+    }
+  else
+    {
+      __atomic_fetch_or (&pgr->flags, PW_ACCESS, __ATOMIC_RELAXED);
+    }
+
+  if ((was & PW_STICKY) != 0)
+    {
+      __atomic_fetch_add (&part->stats.sticky_hits, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * Hits only take [part->l] in S. A miss installs a pinned PW_INFLIGHT
+ * frame in the hash table, holding the frame latch in X, and reads
+ * with the partition unlatched. Anyone who hits the frame meanwhile
+ * pins it and waits on the frame latch.
+ */
+static err_t
+pgr_get_impl (page_h *dest, int flags, pgno pg, bool validate, struct pager *p, error *e)
+{
+  DBG_ASSERT (page_h, dest);
+  ASSERT (dest->mode == PHM_NONE);
+
+  struct pgr_partition *part = pgr_partition_of (p, pg);
+  struct page_frame *pgr = NULL;
+  hdata_idx data;
+
+  err_t ret = SUCCESS;
+
+retry:
+  while (true)
+    {
+      spx_latch_lock_s (&part->l);
+
+      if (ht_get_idx (&part->pgno_to_value, &data, pg) == HTAR_DOESNT_EXIST)
+        {
+          spx_latch_unlock_s (&part->l);
+          break;
+        }
+
+      pgr = &p->pages[data.value];
+
+      // TODO BLOCK ON X
+      if (pgr->wsibling >= 0)
+        {
+          ASSERT (0 && "WOULD BLOCK ON X!");
+        }
+
+      __atomic_fetch_add (&pgr->pin, 1, __ATOMIC_RELAXED);
+
+      if ((__atomic_load_n (&pgr->flags, __ATOMIC_RELAXED) & PW_INFLIGHT) == 0)
+        {
+          // No operation would have let a pgr into an invalid state
+          ASSERT (!validate || page_validate_for_db (&pgr->page, flags, NULL) == SUCCESS);
+          pgr_on_hit (p, part, pgr);
+          spx_latch_unlock_s (&part->l);
+          goto found;
+        }
+
+      // Someone else is reading it in - wait for them
+      spx_latch_unlock_s (&part->l);
+      spx_latch_lock_s (&pgr->latch);
+      spx_latch_unlock_s (&pgr->latch);
+
+      spx_latch_lock_s (&part->l);
+      if ((__atomic_load_n (&pgr->flags, __ATOMIC_RELAXED) & PW_PRESENT) != 0)
+        {
+          ASSERT (!validate || page_validate_for_db (&pgr->page, flags, NULL) == SUCCESS);
+          pgr_on_hit (p, part, pgr);
+          spx_latch_unlock_s (&part->l);
+          goto found;
+        }
+      spx_latch_unlock_s (&part->l);
+
+      // Their read failed - the frame is already out of the table
+      spx_latch_lock_x (&part->l);
+      part->stats.x_latched++;
+      ASSERT (pgr->pin > 0);
+      if (--pgr->pin == 0)
+        {
+          pgr->flags = 0;
+        }
+      spx_latch_unlock_x (&part->l);
+    }
+
+  spx_latch_lock_x (&part->l);
+  part->stats.x_latched++;
+
+  // Somebody may have started loading it since
+  if (ht_get_idx (&part->pgno_to_value, &data, pg) == HTAR_SUCCESS)
+    {
+      spx_latch_unlock_x (&part->l);
+      goto retry;
+    }
+
+  // Then load into a new spot
+  u32 loc;
+  ret = pgr_reserve_at_clock (p, part, &loc, e);
+  if (ret)
+    {
+      spx_latch_unlock_x (&part->l);
+      return ret;
+    }
+
+  // Or while the reservation wrote back dirty pages
+  if (ht_get_idx (&part->pgno_to_value, &data, pg) == HTAR_SUCCESS)
+    {
+      spx_latch_unlock_x (&part->l);
+      goto retry;
+    }
+
+  pgr = &p->pages[loc];
+  pgr->pin = 1;
+  pgr->flags = PW_PRESENT | PW_INFLIGHT;
+  pgr->wsibling = -1;
+  pgr->wal_end = 0;
+  ASSERT (pgr->in_sums == NULL);
+  pgr->page.pg = pg;
+
+  hdata_idx hd = (hdata_idx){ .key = pg, .value = loc };
+  ht_insert_expect_idx (&part->pgno_to_value, hd);
+
+  // Be nice to the next caller and iterate clock
+  pgr_advance_clock (part);
+
+  spx_latch_lock_x (&pgr->latch);
+  spx_latch_unlock_x (&part->l);
+
+  // Read in data to the current page
+  ret = fpgr_read (&p->fp, pgr->page.raw, pg, e);
+
+  /**
+   * Validation is skipped during ARIES recovery
+   * to read pages that may be invalid
+   */
+  if (ret == SUCCESS && validate)
+    {
+      ret = page_validate_for_db (&pgr->page, flags, e);
+      if (ret)
+        {
+          /**
+           * Torn writes were already put back from the
+           * double-write file on open - this is real damage
+           */
+          i_log_error ("Cannot get page %" PRpgno " because it is invalid in the database file: %s\n", pg, e->cause_msg);
+        }
+    }
+  pgr->page.pg = pg;
+
+  spx_latch_lock_x (&part->l);
+  if (ret)
+    {
+      // Waiters see it isn't present and the last one out frees it
+      ht_delete_expect_idx (&part->pgno_to_value, NULL, pg);
+      pf_clr (pgr, PW_PRESENT);
+      if (--pgr->pin == 0)
+        {
+          pgr->flags = 0;
+        }
+    }
+  else
+    {
+      // pgr is now loaded
+      pf_clr (pgr, PW_INFLIGHT);
+      pgr_on_load (p, part, pgr);
+      part->stats.misses++;
+    }
+  spx_latch_unlock_x (&pgr->latch);
+  spx_latch_unlock_x (&part->l);
+
+  if (ret)
+    {
+      return ret;
+    }
+
+found:
+  // Initialize page_h
+  dest->pgr = pgr;
+  dest->pgw = NULL;
+  dest->mode = PHM_S;
+
+  return SUCCESS;
+}
+
+err_t
+pgr_get (page_h *dest, int flags, pgno pg, struct pager *p, error *e)
+{
+  return pgr_get_impl (dest, flags, pg, true, p, e);
+}
+
+err_t
+pgr_get_unverified (page_h *dest, pgno pg, struct pager *p, error *e)
+{
+  return pgr_get_impl (dest, PG_ANY, pg, false, p, e);
+}
+
+/////////////////////////////////////////
+//// READ-AHEAD
+
+void
+pgr_set_thread_pool (struct pager *p, struct thread_pool *tp)
+{
+  DBG_ASSERT (pager, p);
+
+  i_mutex_lock (&p->ra_l);
+
+  // Let tasks on the old pool finish before it can go away
+  while (p->ra_inflight > 0)
+    {
+      i_cond_wait (&p->ra_idle, &p->ra_l);
+    }
+
+  p->tp = tp;
+
+  i_mutex_unlock (&p->ra_l);
+}
+
+/**
+ * If [pg] is in the pool, sets [next] to the page after it (PGNO_NULL
+ * at the end of the chain or if [pg] isn't a data list page) and
+ * returns true. Otherwise records the partition's write back epoch in
+ * [wepoch] for pgr_prefetch_install.
+ */
+static bool
+pgr_prefetch_lookup (struct pager *p, pgno pg, pgno *next, u64 *wepoch)
+{
+  struct pgr_partition *part = pgr_partition_of (p, pg);
+  hdata_idx data;
+  bool ret = false;
+
+  spx_latch_lock_s (&part->l);
+  if (ht_get_idx (&part->pgno_to_value, &data, pg) == HTAR_SUCCESS)
+    {
+      const page *resident = &p->pages[data.value].page;
+      *next = page_get_type (resident) == PG_DATA_LIST ? dl_get_next (resident) : PGNO_NULL;
+      ret = true;
+    }
+  else
+    {
+      *wepoch = part->wepoch;
+    }
+  spx_latch_unlock_s (&part->l);
+
+  return ret;
+}
+
+/**
+ * Puts [buf], read from disk without the partition latch held, into the
+ * pool unpinned. If a dirty write back of the partition raced with the
+ * read the copy might be stale and is dropped.
+ */
+static err_t
+pgr_prefetch_install (struct pager *p, const page *buf, u64 wepoch, error *e)
+{
+  struct pgr_partition *part = pgr_partition_of (p, buf->pg);
+  hdata_idx data;
+  err_t ret = SUCCESS;
+
+  spx_latch_lock_x (&part->l);
+
+  // Someone loaded it in the mean time
+  if (ht_get_idx (&part->pgno_to_value, &data, buf->pg) == HTAR_SUCCESS)
+    {
+      goto theend;
+    }
+
+  // Maybe stale
+  if (part->wepoch != wepoch)
+    {
+      goto theend;
+    }
+
+  u32 loc;
+  ret = pgr_reserve_at_clock (p, part, &loc, e);
+  if (ret)
+    {
+      goto theend;
+    }
+
+  // Reserving might have dropped the latch to write back dirty pages
+  if (part->wepoch != wepoch || ht_get_idx (&part->pgno_to_value, &data, buf->pg) == HTAR_SUCCESS)
+    {
+      goto theend;
+    }
+
+  struct page_frame *pgr = &p->pages[loc];
+  i_memcpy (pgr->page.raw, buf->raw, PAGE_SIZE);
+  pgr->page.pg = buf->pg;
+  pgr->pin = 0;
+  pgr->flags = 0;
+  pgr->wsibling = -1;
+  pgr->wal_end = 0;
+
+  // Unreferenced until the reader gets here - first in line for eviction
+  pgr_on_load (p, part, pgr);
+  pf_clr (pgr, PW_ACCESS);
+  pf_set (pgr, PW_PRESENT | PW_PREFETCH);
+  part->stats.prefetches++;
+
+  hdata_idx hd = (hdata_idx){ .key = buf->pg, .value = loc };
+  ht_insert_expect_idx (&part->pgno_to_value, hd);
+
+  pgr_advance_clock (part);
+
+theend:
+  spx_latch_unlock_x (&part->l);
+  return ret;
+}
+
+/**
+ * Walks [s->count] pages of the chain after [s->from]. While the chain
+ * is laid out back to back on disk (the usual case for appended data)
+ * the next pages are read speculatively in batches of PGR_IO_BATCH and
+ * only the prefix that really is the chain is kept.
+ */
+static err_t
+pgr_readahead_walk (struct pgr_ra_stream *s, page *bufs, pgno *last, u32 *done, error *e)
+{
+  struct pager *p = s->p;
+  struct fpgr_io ios[PGR_IO_BATCH];
+  u64 wepoch[PGR_IO_BATCH];
+  pgno next;
+
+  if (!pgr_prefetch_lookup (p, *last, &next, &wepoch[0]))
+    {
+      ios[0] = (struct fpgr_io){ .pg = *last, .npages = 1, .buf = bufs[0].raw };
+      err_t_wrap (fpgr_read_batch (&p->fp, ios, 1, e), e);
+      bufs[0].pg = *last;
+      err_t_wrap (page_validate_for_db (&bufs[0], PG_DATA_LIST, e), e);
+      next = dl_get_next (&bufs[0]);
+    }
+  bool contiguous = next == *last + 1;
+
+  while (*done < s->count && next != PGNO_NULL)
+    {
+      u32 want = contiguous ? MIN (PGR_IO_BATCH, s->count - *done) : 1;
+      p_size npages = fpgr_get_npages (&p->fp);
+      pgno after = PGNO_NULL;
+      u32 n = 0;
+
+      for (pgno pg = next; n < want && pg < npages; ++pg)
+        {
+          if (pgr_prefetch_lookup (p, pg, &after, &wepoch[n]))
+            {
+              break;
+            }
+          ios[n] = (struct fpgr_io){ .pg = pg, .npages = 1, .buf = bufs[n].raw };
+          n++;
+        }
+
+      // Already resident - step over it
+      if (n == 0)
+        {
+          contiguous = after == next + 1;
+          *last = next;
+          next = after;
+          (*done)++;
+          continue;
+        }
+
+      err_t_wrap (fpgr_read_batch (&p->fp, ios, n, e), e);
+
+      for (u32 i = 0; i < n && ios[i].pg == next; ++i)
+        {
+          bufs[i].pg = ios[i].pg;
+          err_t_wrap (page_validate_for_db (&bufs[i], PG_DATA_LIST, e), e);
+          err_t_wrap (pgr_prefetch_install (p, &bufs[i], wepoch[i], e), e);
+
+          after = dl_get_next (&bufs[i]);
+          contiguous = after == next + 1;
+          *last = next;
+          next = after;
+          (*done)++;
+        }
+    }
+
+  return SUCCESS;
+}
+
+static void
+pgr_readahead_task (void *ctx)
+{
+  struct pgr_ra_stream *s = ctx;
+  struct pager *p = s->p;
+  error e = error_create ();
+
+  pgno last = s->from;
+  u32 done = 0;
+
+  page *bufs = i_malloc (PGR_IO_BATCH, sizeof *bufs, &e);
+  if (bufs)
+    {
+      pgr_readahead_walk (s, bufs, &last, &done, &e);
+      i_free (bufs);
+    }
+
+  // Only a hint - the reader faults the page in itself
+  if (e.cause_code)
+    {
+      i_log_debug ("Read-ahead stopped after page %" PRpgno ": %s\n", last, e.cause_msg);
+    }
+
+  i_mutex_lock (&p->ra_l);
+  s->frontier = last;
+  s->issued -= s->count - done;
+  s->inflight = false;
+  if (--p->ra_inflight == 0)
+    {
+      i_cond_broadcast (&p->ra_idle);
+    }
+  i_mutex_unlock (&p->ra_l);
+}
+
+void
+pgr_readahead (struct pager *p, pgno cur, pgno next)
+{
+  DBG_ASSERT (pager, p);
+
+  if (p->restarting)
+    {
+      return;
+    }
+
+  i_mutex_lock (&p->ra_l);
+
+  if (p->tp == NULL)
+    {
+      goto theend;
+    }
+
+  struct pgr_ra_stream *s = NULL;
+  for (u32 i = 0; i < PGR_READAHEAD_STREAMS; ++i)
+    {
+      if (p->streams[i].p && p->streams[i].expect == cur)
+        {
+          s = &p->streams[i];
+          break;
+        }
+    }
+
+  // Not sequential - start a new stream in an idle slot
+  if (s == NULL)
+    {
+      for (u32 i = 0; i < PGR_READAHEAD_STREAMS; ++i)
+        {
+          u32 slot = (p->ra_victim + i) % PGR_READAHEAD_STREAMS;
+          if (!p->streams[slot].inflight)
+            {
+              p->streams[slot] = (struct pgr_ra_stream){
+                .p = p,
+                .expect = next,
+                .frontier = PGNO_NULL,
+              };
+              p->ra_victim = (slot + 1) % PGR_READAHEAD_STREAMS;
+              break;
+            }
+        }
+      goto theend;
+    }
+
+  s->expect = next;
+  s->hops++;
+
+  // One hop could be anything
+  if (s->hops < 2 || s->inflight)
+    {
+      goto theend;
+    }
+
+  // Still more than half a window in front of the reader
+  u32 ahead = s->issued > s->hops ? s->issued - s->hops : 0;
+  if (s->window > 0 && ahead > s->window / 2)
+    {
+      goto theend;
+    }
+
+  u32 max = MIN (PGR_READAHEAD_MAX, p->pool_len / 4);
+  s->window = s->window == 0 ? PGR_READAHEAD_MIN : MIN (2 * s->window, max);
+
+  // Reader caught up with (or passed) the read-ahead - restart from it
+  if (ahead == 0)
+    {
+      s->frontier = next;
+      s->issued = s->hops;
+    }
+
+  s->from = s->frontier;
+  s->count = s->window - ahead;
+  s->issued += s->count;
+  s->inflight = true;
+  p->ra_inflight++;
+
+  i_mutex_unlock (&p->ra_l);
+
+  error e = error_create ();
+  if (tp_add_task (p->tp, pgr_readahead_task, s, &e))
+    {
+      i_mutex_lock (&p->ra_l);
+      s->issued = s->hops;
+      s->inflight = false;
+      if (--p->ra_inflight == 0)
+        {
+          i_cond_broadcast (&p->ra_idle);
+        }
+      goto theend;
+    }
+  return;
+
+theend:
+  i_mutex_unlock (&p->ra_l);
+}
+
+static err_t
+pgr_make_writable_no_tx (struct pager *p, page_h *h, error *e)
+{
+  DBG_ASSERT (pager, p);
+  ASSERT (h->mode == PHM_S);
+
+  i_log_trace ("Pager making page: %" PRpgno " writable\n", page_h_pgno (h));
+
+  err_t ret = SUCCESS;
+  struct pgr_partition *part = pgr_partition_of_frame (p, h->pgr);
+  u32 loc;
+
+  spx_latch_lock_x (&part->l);
+
+  // Reserve room for writable page
+  ret = pgr_reserve_at_clock (p, part, &loc, e);
+  if (ret)
+    {
+      spx_latch_unlock_x (&part->l);
+      return ret;
+    }
+
+  struct page_frame *pgw = &p->pages[loc];
+
+  // Mark page as dirty (will be added to DPT in pgr_save with proper LSN)
+  bool was_dirty = pf_check (h->pgr, PW_DIRTY);
+  if (!was_dirty)
+    {
+      pf_set (h->pgr, PW_DIRTY);
+    }
+
+  // Initialize w page
+  pgw->pin = 1;
+  pgw->wsibling = -1;
+  pgw->flags = 0;
+  pf_set (pgw, PW_PRESENT);
+  i_memcpy (pgw->page.raw, h->pgr->page.raw, PAGE_SIZE);
+  pgw->page.pg = h->pgr->page.pg;
+
+  // Set page_h
+  h->pgr->wsibling = loc;
+  h->pgw = pgw;
+  h->mode = PHM_X;
+  h->pgw->pin++;
+
+  // Increment clock to be nice to next consumers
+  pgr_advance_clock (part);
+
+  spx_latch_unlock_x (&part->l);
+
+  return SUCCESS;
+}
+
+err_t
+pgr_make_writable (struct pager *p, struct txn *tx, page_h *h, error *e)
+{
+  ASSERT (tx);
+  err_t_wrap (pgr_make_writable_no_tx (p, h, e), e);
+  h->tx = tx;
+  return SUCCESS;
+}
+
+err_t
+pgr_maybe_make_writable (struct pager *p, struct txn *tx, page_h *cur, error *e)
+{
+  ASSERT (tx);
+  if (cur->mode == PHM_S)
+    {
+      return pgr_make_writable (p, tx, cur, e);
+    }
+  return SUCCESS;
+}
+
+/**
+ * Frees the write sibling of [h] and puts it back into S mode
+ *
+ * Caller holds the partition latch of [h] in X
+ */
+static inline void
+pgr_drop_pgw (page_h *h)
+{
+  h->pgw->flags = 0;
+  h->pgw->pin = 0;
+  pf_clr (h->pgw, PW_PRESENT);
+  h->pgr->wsibling = -1;
+  h->pgw = NULL;
+  h->mode = PHM_S;
+}
+
+static inline void
+pgr_unpin (struct pager *p, page_h *h)
+{
+  struct pgr_partition *part = pgr_partition_of_frame (p, h->pgr);
+
+  // S is enough - everything that reads a pin to evict or move a frame holds X
+  spx_latch_lock_s (&part->l);
+  u32 was = __atomic_fetch_sub (&h->pgr->pin, 1, __ATOMIC_RELAXED);
+  ASSERT (was > 0);
+  spx_latch_unlock_s (&part->l);
+
+  h->pgr = NULL;
+  h->mode = PHM_NONE;
+}
+
+// No transaction version for recovery - no WAL logging
+static err_t
+pgr_release_no_tx (struct pager *p, page_h *h, int flags, error *e)
+{
+  DBG_ASSERT (pager, p);
+  ASSERT (h->mode == PHM_X || h->mode == PHM_S);
+
+  i_log_trace ("Releasing (no tx) %" PRpgno "\n", page_h_pgno (h));
+
+  if (h->mode == PHM_X)
+    {
+      // Save without WAL logging (recovery doesn't need WAL)
+      ASSERTF (page_validate_for_db (page_h_w (h), flags, NULL) == SUCCESS,
+               "%.*s\n", e->cmlen, e->cause_msg);
+
+      lsn wal_end = p->wal_enabled ? wal_get_next_lsn (&p->ww) : 0;
+
+      struct pgr_partition *part = pgr_partition_of_frame (p, h->pgr);
+      spx_latch_lock_x (&part->l);
+      part->stats.x_latched++;
+      i_memcpy (h->pgr->page.raw, h->pgw->page.raw, PAGE_SIZE);
+      h->pgr->wal_end = MAX (h->pgr->wal_end, wal_end);
+      pgr_sticky_update (part, h->pgr);
+      pgr_in_sums_update (part, h->pgr);
+      pgr_drop_pgw (h);
+      spx_latch_unlock_x (&part->l);
+    }
+
+  err_t_wrap (page_validate_for_db (&h->pgr->page, flags, e), e);
+
+  DBG_ASSERT (pager, p);
+
+  pgr_unpin (p, h);
+
+  return SUCCESS;
+}
+
+// No transaction version for recovery
+err_t
+pgr_get_writable_no_tx (page_h *dest, int flags, pgno pg, struct pager *p, error *e)
+{
+  err_t_wrap (pgr_get (dest, flags, pg, p, e), e);
+  err_t ret = pgr_make_writable_no_tx (p, dest, e);
+
+  // Couldn't allocate writable page - release dest
+  if (ret != SUCCESS)
+    {
+      pgr_release_no_tx (p, dest, flags, e);
+    }
+
+  return ret;
+}
+
+err_t
+pgr_get_writable (page_h *dest, struct txn *tx, int flags, pgno pg, struct pager *p, error *e)
+{
+  err_t_wrap (pgr_get (dest, flags, pg, p, e), e);
+  err_t ret = pgr_make_writable (p, tx, dest, e);
+
+  // Couldn't allocate writable page - release dest
+  if (ret != SUCCESS)
+    {
+      pgr_release_no_tx (p, dest, flags, e);
+    }
+
+  return ret;
+}
+
+/**
+ * Logs the change from pgr to pgw in the smallest form redo can use.
+ *
+ * A page that's already in the DPT was logged in full since it was last
+ * written out, so redo can rebuild it from just the change: a logical
+ * insert for data list appends and inserts, otherwise the byte ranges
+ * that differ. The first update after that logs the whole page (the page
+ * on disk may not match pgr, e.g. a freshly extended page)
+ */
+static slsn
+pgr_append_update_log (struct pager *p, page_h *h, error *e)
+{
+  const page *before = &h->pgr->page;
+  const page *after = &h->pgw->page;
+
+  struct dpg_entry dpe;
+  bool logged = dpe_get (&dpe, p->dpt, page_h_pgno (h));
+
+  if (logged
+      && page_get_type (before) == PG_DATA_LIST
+      && page_get_type (after) == PG_DATA_LIST)
+    {
+      p_size ofst, nbytes;
+      if (dl_diff_insert (before, after, &ofst, &nbytes))
+        {
+          struct wal_dl_insert_write ins = {
+            .tid = h->tx->tid,
+            .pg = page_h_pgno (h),
+            .prev = h->tx->data.last_lsn,
+            .ofst = ofst,
+            .len = nbytes,
+            .data = (const u8 *)dl_get_data (after) + ofst,
+          };
+          return wal_append_dl_insert_log (&p->ww, ins, e);
+        }
+    }
+
+  struct wal_range ranges[WAL_DELTA_MAX_RANGES];
+  struct wal_update_write update = {
+    .tid = h->tx->tid,
+    .pg = page_h_pgno (h),
+    .prev = h->tx->data.last_lsn,
+    .undo = h->pgr->page.raw,
+    .redo = h->pgw->page.raw,
+    .ranges = ranges,
+  };
+
+  p_size nbytes;
+  if (logged
+      && wrh_diff_ranges (ranges, &update.nranges, &nbytes, before->raw, after->raw)
+      && WL_UPDATE_DELTA_LEN (update.nranges, nbytes) < WL_UPDATE_LEN)
+    {
+      return wal_append_update_delta_log (&p->ww, update, e);
+    }
+
+  return wal_append_update_log (&p->ww, update, e);
+}
+
+err_t
+pgr_save (struct pager *p, page_h *h, int flags, error *e)
+{
+  DBG_ASSERT (pager, p);
+  ASSERT (h->mode == PHM_X);
+  ASSERTF (page_validate_for_db (page_h_w (h), flags, NULL) == SUCCESS, "%.*s\n", e->cmlen, e->cause_msg);
+
+  lsn wal_end = 0;
+
+  // Save log
+  if (p->wal_enabled)
+    {
+      // Ahead of the txn latch - a checkpoint latches txns while holding it in X
+      spx_latch_lock_s (&p->ckpt_latch);
+      spx_latch_lock_x (&h->tx->l);
+
+      // Append an update to the wal and get it's lsn
+      slsn page_lsn = pgr_append_update_log (p, h, e);
+      if (page_lsn < 0)
+        {
+          spx_latch_unlock_x (&h->tx->l);
+          spx_latch_unlock_s (&p->ckpt_latch);
+          return e->cause_code;
+        }
+
+      // Update the page lsn
+      page_set_page_lsn (page_h_w (h), (lsn)page_lsn);
+
+      // Somewhere past the end of the record
+      wal_end = wal_get_next_lsn (&p->ww);
+
+      h->tx->data.last_lsn = page_lsn;
+      h->tx->data.undo_next_lsn = page_lsn;
+
+      // Add page to DPT if this is the first update (RecLSN = LSN of first update)
+      struct dpg_entry dpe;
+      if (!dpe_get (&dpe, p->dpt, page_h_pgno (h)))
+        {
+          if (dpgt_add (p->dpt, page_h_pgno (h), (lsn)page_lsn, e))
+            {
+              spx_latch_unlock_x (&h->tx->l);
+              spx_latch_unlock_s (&p->ckpt_latch);
+              return e->cause_code;
+            }
+        }
+
+      spx_latch_unlock_x (&h->tx->l);
+      spx_latch_unlock_s (&p->ckpt_latch);
+    }
+
+  struct pgr_partition *part = pgr_partition_of_frame (p, h->pgr);
+  spx_latch_lock_x (&part->l);
+  part->stats.x_latched++;
+  i_memcpy (&h->pgr->page.raw, h->pgw->page.raw, PAGE_SIZE);
+  h->pgr->wal_end = MAX (h->pgr->wal_end, wal_end);
+  pgr_sticky_update (part, h->pgr);
+  pgr_in_sums_update (part, h->pgr);
+  pgr_drop_pgw (h);
+  spx_latch_unlock_x (&part->l);
+
+  return SUCCESS;
+}
+
+static void
+pgr_cancel_w (struct pager *p, page_h *h)
+{
+  DBG_ASSERT (pager, p);
+  ASSERT (h->mode == PHM_X);
+
+  struct pgr_partition *part = pgr_partition_of_frame (p, h->pgr);
+  spx_latch_lock_x (&part->l);
+  pgr_drop_pgw (h);
+  spx_latch_unlock_x (&part->l);
+}
+
+/**
+ * Caller holds [p->rn_l]
+ */
+static err_t
+pgr_new_impl (page_h *dest, struct pager *p, struct txn *tx, enum page_type type, error *e)
+{
+  DBG_ASSERT (pager, p);
+  DBG_ASSERT (page_h, dest);
+  ASSERT (dest->mode == PHM_NONE);
+
+  err_t ret = SUCCESS;
+  page_h root_node = page_h_create ();
+
+  /**
+   * First, we'll check the tombstone to see if we can
+   * dish out a new page that's already been deleted
+   */
+  err_t_wrap (pgr_get (&root_node, PG_ROOT_NODE, 0, p, e), e);
+
+  pgno ftpg = rn_get_first_tmbst (page_h_ro (&root_node));
+  ret = pgr_make_writable (p, tx, &root_node, e);
+  if (ret)
+    {
+      pgr_release_no_tx (p, &root_node, PG_ROOT_NODE, e);
+      return ret;
+    }
+
+  if (ftpg < fpgr_get_npages (&p->fp))
+    {
+      // Pop the first tombstone - this is our result page
+      ret = pgr_get_writable (dest, tx, PG_TOMBSTONE, ftpg, p, e);
+      if (ret)
+        {
+          pgr_cancel_w (p, &root_node);
+          pgr_release_no_tx (p, &root_node, PG_ROOT_NODE, e);
+          return ret;
+        }
+    }
+  else
+    {
+      if ((ret = pgr_new_extend (dest, p, tx, e)))
+        {
+          pgr_cancel_w (p, &root_node);
+          pgr_release_no_tx (p, &root_node, PG_ROOT_NODE, e);
+          return ret;
+        }
+    }
+
+  // Update root node's first tombstone link
+  pgno ntbst = tmbst_get_next (page_h_ro (dest));
+  rn_set_first_tmbst (page_h_w (&root_node), ntbst);
+  ret = pgr_save (p, &root_node, PG_ROOT_NODE, e);
+
+  if (ret)
+    {
+      pgr_cancel_w (p, dest);
+      pgr_cancel_w (p, &root_node);
+      pgr_release (p, &root_node, PG_ROOT_NODE, e);
+      pgr_release (p, dest, type, e);
+      return ret;
+    }
+
+  pgr_release (p, &root_node, PG_ROOT_NODE, e);
+  page_init_empty (page_h_w (dest), type);
+
+  return ret;
+}
+
+err_t
+pgr_new (page_h *dest, struct pager *p, struct txn *tx, enum page_type type, error *e)
+{
+  // The checkpointer writes the root too
+  i_mutex_lock (&p->rn_l);
+  err_t ret = pgr_new_impl (dest, p, tx, type, e);
+  i_mutex_unlock (&p->rn_l);
+
+  return ret;
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, pgr_new_get_save)
+{
+  struct pgr_fixture f;
+  page_h h = page_h_create ();
+  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, f.p, &f.e), &f.e);
+
+  pgr_new (&h, f.p, &tx, PG_DATA_LIST, &f.e);
+  test_assert_int_equal ((int)pgr_get_npages (f.p), 2);
+
+  // Make it valid
+  dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+
+  test_err_t_wrap (pgr_release (f.p, &h, PG_DATA_LIST, &f.e), &f.e);
+
+  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
+}
+#endif
+
+/**
+ * Caller holds [p->rn_l]
+ */
+static err_t
+pgr_delete_and_release_impl (struct pager *p, struct txn *tx, page_h *h, error *e)
+{
+  DBG_ASSERT (pager, p);
+
+  err_t ret = SUCCESS;
+  page_h root_node = page_h_create ();
+
+  // Upgrade nodes to X
+  err_t_wrap (pgr_get (&root_node, PG_ROOT_NODE, 0, p, e), e);
+  ret = pgr_make_writable (p, tx, &root_node, e);
+  if (ret)
+    {
+      return ret;
+    }
+  if (h->mode == PHM_S)
+    {
+      ret = pgr_make_writable (p, tx, h, e);
+      if (ret)
+        {
+          pgr_cancel_w (p, &root_node);
+          pgr_release (p, &root_node, PG_ROOT_NODE, e);
+          return ret;
+        }
+    }
+
+  pgno ftpg = rn_get_first_tmbst (page_h_ro (&root_node));
+  page_init_empty (&h->pgw->page, PG_TOMBSTONE);
+  tmbst_set_next (page_h_w (h), ftpg);
+  ftpg = page_h_pgno (h);
+
+  ret = pgr_release (p, h, PG_TOMBSTONE, e);
+
+  /**
+   * TODO - The following error handling logic doesn't look right
+   */
+  if (ret)
+    {
+      pgr_cancel_w (p, &root_node);
+      pgr_release (p, &root_node, PG_ROOT_NODE, e);
+      return ret;
+    }
+
+  rn_set_first_tmbst (page_h_w (&root_node), ftpg);
+  ret = pgr_save (p, &root_node, PG_ROOT_NODE, e);
+  if (ret)
+    {
+      pgr_cancel_w (p, &root_node);
+      pgr_release (p, &root_node, PG_ROOT_NODE, e);
+      return ret;
+    }
+
+  pgr_release (p, &root_node, PG_ROOT_NODE, e);
+
+  return ret;
+}
+
+err_t
+pgr_delete_and_release (struct pager *p, struct txn *tx, page_h *h, error *e)
+{
+  i_mutex_lock (&p->rn_l);
+  err_t ret = pgr_delete_and_release_impl (p, tx, h, e);
+  i_mutex_unlock (&p->rn_l);
+
+  return ret;
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, pgr_delete)
+{
+  struct pgr_fixture f;
+  error *e = &f.e;
+  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, f.p, e), e);
+
+  page_h a = page_h_create ();
+  page_h b = page_h_create ();
+  page_h c = page_h_create ();
+  page_h d = page_h_create ();
+
+  test_err_t_wrap (pgr_new (&a, f.p, &tx, PG_DATA_LIST, e), e);
+  test_err_t_wrap (pgr_new (&b, f.p, &tx, PG_DATA_LIST, e), e);
+  test_err_t_wrap (pgr_new (&c, f.p, &tx, PG_DATA_LIST, e), e);
+  test_err_t_wrap (pgr_new (&d, f.p, &tx, PG_DATA_LIST, e), e);
+
+  pgno apg = page_h_pgno (&a);
+  pgno bpg = page_h_pgno (&b);
+  pgno cpg = page_h_pgno (&c);
+  pgno dpg = page_h_pgno (&d);
+
+  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &a, e), e);
+  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &b, e), e);
+  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &c, e), e);
+  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &d, e), e);
+
+  test_err_t_wrap (pgr_new (&a, f.p, &tx, PG_DATA_LIST, e), e);
+  test_err_t_wrap (pgr_new (&b, f.p, &tx, PG_DATA_LIST, e), e);
+  test_err_t_wrap (pgr_new (&c, f.p, &tx, PG_DATA_LIST, e), e);
+  test_err_t_wrap (pgr_new (&d, f.p, &tx, PG_DATA_LIST, e), e);
+
+  test_assert_equal (page_h_pgno (&a), dpg);
+  test_assert_equal (page_h_pgno (&b), cpg);
+  test_assert_equal (page_h_pgno (&c), bpg);
+  test_assert_equal (page_h_pgno (&d), apg);
 
-    // Open the dirty page table
-    err_t_wrap_null_goto (dpt = dpgt_open (e), failed, e);
+  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &a, e), e);
+  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &b, e), e);
+  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &c, e), e);
+  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &d, e), e);
 
-    // Initialize the WAL
-    if (walname)
-      {
-        err_t_wrap_goto (wal_open (&ret->ww, walname, e), failed, e);
-        ret->wal_enabled = true;
-      }
-    else
-      {
-        ret->wal_enabled = false;
-      }
+  test_err_t_wrap (pgr_new (&a, f.p, &tx, PG_DATA_LIST, e), e);
+  test_err_t_wrap (pgr_new (&b, f.p, &tx, PG_DATA_LIST, e), e);
+  test_err_t_wrap (pgr_new (&c, f.p, &tx, PG_DATA_LIST, e), e);
+  test_err_t_wrap (pgr_new (&d, f.p, &tx, PG_DATA_LIST, e), e);
 
-    // Initialize the hash table from pgno -> table index
-    ht_init_idx (&ret->pgno_to_value, ret->_hdata, MEMORY_PAGE_LEN);
+  test_assert_equal (page_h_pgno (&a), apg);
+  test_assert_equal (page_h_pgno (&b), bpg);
+  test_assert_equal (page_h_pgno (&c), cpg);
+  test_assert_equal (page_h_pgno (&d), dpg);
 
-    // Initialize internal latch
-    spx_latch_init (&ret->l);
+  dl_set_used (page_h_w (&a), DL_DATA_SIZE);
+  dl_set_used (page_h_w (&b), DL_DATA_SIZE);
+  dl_set_used (page_h_w (&c), DL_DATA_SIZE);
+  dl_set_used (page_h_w (&d), DL_DATA_SIZE);
 
-    // Initialize page frame latches
-    for (u32 i = 0; i < MEMORY_PAGE_LEN; ++i)
-      {
-        spx_latch_init (&ret->pages[i].latch);
-      }
+  test_err_t_wrap (pgr_release (f.p, &a, PG_DATA_LIST, e), e);
+  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &b, e), e);
+  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &c, e), e);
+  test_err_t_wrap (pgr_release (f.p, &d, PG_DATA_LIST, e), e);
 
-    // Simple variables
-    ret->dpt = dpt;
-    ret->clock = 0;
-    ret->next_tid = 1;
-  }
+  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
+}
+#endif
 
-  if (is_new)
-    {
-      err_t_wrap_null_goto (pgr_open_new (fname, walname, ret, e), failed, e);
-    }
-  else
+err_t
+pgr_release_if_exists (struct pager *p, page_h *h, int flags, error *e)
+{
+  if (h->mode != PHM_NONE)
     {
-      err_t_wrap_null_goto (pgr_open_existing (fname, walname, ret, e), failed, e);
+      return pgr_release (p, h, flags, e);
     }
+  return SUCCESS;
+}
 
-  DBG_ASSERT (pager, ret);
-  return ret;
+err_t
+pgr_release (struct pager *p, page_h *h, int flags, error *e)
+{
+  DBG_ASSERT (pager, p);
+  ASSERT (h->mode == PHM_X || h->mode == PHM_S);
 
-failed:
-  ASSERT (e->cause_code);
-  // spx_latch doesn't need cleanup
-  if (dpt)
-    {
-      dpgt_close (dpt);
-    }
-  if (ret && ret->wal_enabled)
-    {
-      wal_close (&ret->ww, e);
-    }
-  if (ret && fpgr_opened)
-    {
-      fpgr_close (&ret->fp, e);
-    }
-  if (ret)
+  i_log_trace ("Releasing %" PRpgno "\n", page_h_pgno (h));
+
+  if (h->mode == PHM_X)
     {
-      i_free (ret);
+      err_t_wrap (pgr_save (p, h, flags, e), e);
     }
-  if (is_new)
+
+  err_t_wrap (page_validate_for_db (&h->pgr->page, flags, e), e);
+
+  DBG_ASSERT (pager, p);
+
+  pgr_unpin (p, h);
+
+  return SUCCESS;
+}
+
+err_t
+pgr_flush_wall (struct pager *p, error *e)
+{
+  if (p->wal_enabled)
     {
-      i_remove_quiet (fname, e);
-      i_remove_quiet (walname, e);
+      return wal_flush_all (&p->ww, e);
     }
-  return NULL;
+  UNREACHABLE ();
 }
 
 #ifndef NTEST
-TEST (TT_UNIT, pager_open)
+
+TEST (TT_UNIT, pager_fill_ht)
 {
-  error e = error_create ();
+  struct pgr_fixture f;
+  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+
+  struct txn tx;
+  pgr_begin_txn (&tx, f.p, &f.e);
+
+  page_h pgs[MEMORY_PAGE_LEN];
+  page_h bad = page_h_create ();
 
-  /* Green path */
   {
-    test_fail_if (i_remove_quiet ("test.db", &e));
-    test_fail_if (i_remove_quiet ("test.wal", &e));
+    // Fill up - there is already one page in the pool, the root
+    u32 i = 0;
+    for (; i < MEMORY_PAGE_LEN / 2 - 1; ++i)
+      {
+        pgs[i] = page_h_create ();
+        test_err_t_wrap (pgr_new (&pgs[i], f.p, &tx, PG_DATA_LIST, &f.e), &f.e);
+        test_assert_equal (pgs[i].mode, PHM_X);
+      }
 
-    struct pager *p = pgr_open ("test.db", "test.wal", &e);
+    // Next page will be full
+    test_err_t_check (pgr_new (&bad, f.p, &tx, PG_DATA_LIST, &f.e), ERR_PAGER_FULL, &f.e);
 
-    test_fail_if_null (p);
-    test_err_t_wrap (pgr_close (p, &e), &e);
+    // Release them all
+    for (i = 0; i < MEMORY_PAGE_LEN / 2 - 1; ++i)
+      {
+        dl_set_used (page_h_w (&pgs[i]), DL_DATA_SIZE);
+        test_err_t_wrap (pgr_release (f.p, &pgs[i], PG_DATA_LIST, &f.e), &f.e);
+      }
+  }
+
+  // Repeat above
+  {
+    // Fill half way up - good
+    for (u32 i = 0; i < MEMORY_PAGE_LEN / 2 - 1; ++i)
+      {
+        test_err_t_wrap (pgr_new (&pgs[i], f.p, &tx, PG_DATA_LIST, &f.e), &f.e);
+        test_assert_equal (pgs[i].mode, PHM_X);
+      }
+
+    // Next page will be full
+    test_err_t_check (pgr_new (&bad, f.p, &tx, PG_DATA_LIST, &f.e), ERR_PAGER_FULL, &f.e);
+
+    // Release them all
+    for (u32 i = 0; i < MEMORY_PAGE_LEN / 2 - 1; ++i)
+      {
+        dl_set_used (page_h_w (&pgs[i]), DL_DATA_SIZE);
+        test_err_t_wrap (pgr_release (f.p, &pgs[i], PG_DATA_LIST, &f.e), &f.e);
+      }
   }
+
+  test_err_t_wrap (pgr_close (f.p, &f.e), &f.e);
 }
 #endif
 
 #ifndef NTEST
-TEST (TT_UNIT, pgr_open_basic)
-{
-  error e = error_create ();
-  test_fail_if (i_remove_quiet ("test.db", &e));
-  test_fail_if (i_remove_quiet ("test.wal", &e));
-
-  i_file fp;
-  test_err_t_wrap (i_open_rw (&fp, "test.db", &e), &e);
 
+struct pgr_reader_ctx
+{
   struct pager *p;
+  pgno npages;
+  u32 seed;
+  u32 count;
+  int failed;
+};
 
-  /* File is shorter than page size */
-  test_fail_if (i_truncate (&fp, PAGE_SIZE - 1, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
-  test_assert_int_equal (e.cause_code, ERR_CORRUPT);
-  test_assert_equal (p, NULL);
-  e.cause_code = SUCCESS;
+static void *
+pgr_reader_thread (void *arg)
+{
+  struct pgr_reader_ctx *ctx = arg;
+  error e = error_create ();
+  u32 x = ctx->seed;
 
-  /* Half a page */
-  test_fail_if (i_truncate (&fp, PAGE_SIZE / 2, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
-  test_assert_int_equal (e.cause_code, ERR_CORRUPT);
-  test_assert_equal (p, NULL);
-  e.cause_code = SUCCESS;
+  for (u32 i = 0; i < ctx->count; ++i)
+    {
+      // xorshift - rand () isn't thread safe
+      x ^= x << 13;
+      x ^= x >> 17;
+      x ^= x << 5;
 
-  /* 0 pages */
-  test_fail_if (i_truncate (&fp, 0, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
-  test_assert_int_equal (e.cause_code, SUCCESS);
-  test_fail_if_null (p);
-  test_assert_int_equal ((int)pgr_get_npages (p), 1);
-  test_fail_if (pgr_close (p, &e));
+      pgno pg = 1 + x % (ctx->npages - 1);
 
-  /* Tear down */
-  test_fail_if (i_close (&fp, &e));
-  test_fail_if (i_unlink ("test.db", &e));
+      page_h h = page_h_create ();
+      if (pgr_get (&h, PG_DATA_LIST, pg, ctx->p, &e) || page_h_pgno (&h) != pg)
+        {
+          ctx->failed++;
+          e.cause_code = SUCCESS;
+          continue;
+        }
+      if (pgr_release (ctx->p, &h, PG_DATA_LIST, &e))
+        {
+          ctx->failed++;
+          e.cause_code = SUCCESS;
+        }
+    }
+
+  return NULL;
 }
-#endif
 
-err_t
-pgr_close (struct pager *p, error *e)
+TEST (TT_UNIT, pgr_concurrent_readers)
 {
-  DBG_ASSERT (pager, p);
+  struct pgr_fixture f;
+  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
 
-  // Save all in memory pages
-  pgr_evict_all (p, e);
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, f.p, &f.e), &f.e);
 
-  if (p->wal_enabled)
+  // More pages than frames so readers evict under each other
+  for (u32 i = 0; i < 3 * MEMORY_PAGE_LEN / 2; ++i)
     {
-      wal_close (&p->ww, e);
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_new (&h, f.p, &tx, PG_DATA_LIST, &f.e), &f.e);
+      dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+      test_err_t_wrap (pgr_release (f.p, &h, PG_DATA_LIST, &f.e), &f.e);
     }
-  fpgr_close (&p->fp, e);
+  test_err_t_wrap (pgr_commit (f.p, &tx, &f.e), &f.e);
 
-  txnt_close (&p->tnxt);
-  dpgt_close (p->dpt);
+  struct pgr_reader_ctx ctx[4];
+  i_thread threads[4];
 
-  i_free (p);
+  for (u32 i = 0; i < arrlen (ctx); ++i)
+    {
+      ctx[i] = (struct pgr_reader_ctx){
+        .p = f.p,
+        .npages = pgr_get_npages (f.p),
+        .seed = 2463534242u + i,
+        .count = 2000,
+        .failed = 0,
+      };
+      test_err_t_wrap (i_thread_create (&threads[i], pgr_reader_thread, &ctx[i], &f.e), &f.e);
+    }
 
-  return e->cause_code;
+  for (u32 i = 0; i < arrlen (ctx); ++i)
+    {
+      test_err_t_wrap (i_thread_join (&threads[i], &f.e), &f.e);
+      test_assert_int_equal (ctx[i].failed, 0);
+    }
+
+  // Every pin was given back
+  for (u32 i = 0; i < f.p->pool_len; ++i)
+    {
+      test_assert_int_equal (f.p->pages[i].pin, 0);
+    }
+
+  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
 }
+#endif
 
 #ifndef NTEST
-TEST (TT_UNIT, pgr_close_success)
+struct pgr_hits_ctx
 {
-  error e = error_create ();
-  test_fail_if (i_remove_quiet ("test.db", &e));
-  test_fail_if (i_remove_quiet ("test.wal", &e));
+  struct pgr_reader_ctx r;
+  i_mutex m;
+  i_cond c;
+  bool done;
+};
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
-  test_fail_if_null (p);
+static void *
+pgr_hits_thread (void *arg)
+{
+  struct pgr_hits_ctx *ctx = arg;
 
-  /* Delete file i_close should fail */
-  test_assert_equal (pgr_close (p, &e), SUCCESS);
-  test_fail_if (i_remove_quiet ("foo.db", &e));
+  pgr_reader_thread (&ctx->r);
+
+  i_mutex_lock (&ctx->m);
+  ctx->done = true;
+  i_cond_signal (&ctx->c);
+  i_mutex_unlock (&ctx->m);
+
+  return NULL;
 }
-#endif
 
-///////////////////////////////////////////////////////////
-////// COMMON
+TEST (TT_UNIT, pgr_concurrent_hits)
+{
+  enum
+  {
+    NPAGES = MEMORY_PAGE_LEN / 4,
+    NTHREADS = 4,
+    COUNT = 5000,
+  };
+
+  struct pgr_fixture f;
+  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, f.p, &f.e), &f.e);
+  for (u32 i = 0; i < NPAGES; ++i)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_new (&h, f.p, &tx, PG_DATA_LIST, &f.e), &f.e);
+      dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+      test_err_t_wrap (pgr_release (f.p, &h, PG_DATA_LIST, &f.e), &f.e);
+    }
+  test_err_t_wrap (pgr_commit (f.p, &tx, &f.e), &f.e);
+
+  // Everything fits - after this every get is a hit
+  for (pgno pg = 1; pg < pgr_get_npages (f.p); ++pg)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, f.p, &f.e), &f.e);
+      test_err_t_wrap (pgr_release (f.p, &h, PG_DATA_LIST, &f.e), &f.e);
+    }
+  pgr_reset_stats (f.p);
 
-p_size
-pgr_get_npages (const struct pager *p)
-{
-  DBG_ASSERT (pager, p);
-  return fpgr_get_npages (&p->fp);
-}
+  struct pgr_reader_ctx ctx[NTHREADS];
+  i_thread threads[NTHREADS];
 
-///////////////////////////////////////////////////////////
-////// TRANSACTION CONTROL
+  for (u32 i = 0; i < NTHREADS; ++i)
+    {
+      ctx[i] = (struct pgr_reader_ctx){
+        .p = f.p,
+        .npages = pgr_get_npages (f.p),
+        .seed = 88675123u + i,
+        .count = COUNT,
+        .failed = 0,
+      };
+      test_err_t_wrap (i_thread_create (&threads[i], pgr_reader_thread, &ctx[i], &f.e), &f.e);
+    }
+  for (u32 i = 0; i < NTHREADS; ++i)
+    {
+      test_err_t_wrap (i_thread_join (&threads[i], &f.e), &f.e);
+      test_assert_int_equal (ctx[i].failed, 0);
+    }
 
-err_t
-pgr_begin_txn (struct txn *tx, struct pager *p, error *e)
-{
-  DBG_ASSERT (pager, p);
+  // Neither the gets nor the releases ever took a partition latch in X
+  struct pgr_stats stats;
+  pgr_get_stats (f.p, &stats);
+  test_assert_int_equal (stats.hits, NTHREADS * COUNT);
+  test_assert_int_equal (stats.misses, 0);
+  test_assert_int_equal (stats.x_latched, 0);
 
-  if (p->wal_enabled)
+  for (u32 i = 0; i < f.p->pool_len; ++i)
     {
-      // Generate a new transaction ID
-      txid tid = p->next_tid++;
+      test_assert_int_equal (f.p->pages[i].pin, 0);
+    }
 
-      // Append begin record
-      slsn l = wal_append_begin_log (&p->ww, tid, e);
-      if (l < 0)
-        {
-          return e->cause_code;
-        }
+  TEST_CASE ("Hits go through while another reader holds the partition latch")
+  {
+    struct pgr_hits_ctx hc = {
+      .r = {
+          .p = f.p,
+          .npages = pgr_get_npages (f.p),
+          .seed = 362436069u,
+          .count = 100,
+          .failed = 0,
+      },
+      .done = false,
+    };
+    test_err_t_wrap (i_mutex_create (&hc.m, &f.e), &f.e);
+    test_err_t_wrap (i_cond_create (&hc.c, &f.e), &f.e);
+
+    for (u32 i = 0; i < f.p->nparts; ++i)
+      {
+        spx_latch_lock_s (&f.p->parts[i].l);
+      }
 
-      txn_init (tx, tid, (struct txn_data){
-                             .last_lsn = l,
-                             .undo_next_lsn = 0,
-                             .state = TX_RUNNING,
-                         });
+    i_thread t;
+    test_err_t_wrap (i_thread_create (&t, pgr_hits_thread, &hc, &f.e), &f.e);
 
-      // Create a new transaction entry
-      err_t_wrap (txnt_insert_txn (&p->tnxt, tx, e), e);
+    // Anything in X would wait for us
+    i_mutex_lock (&hc.m);
+    while (!hc.done && i_cond_timedwait (&hc.c, &hc.m, 5 * 1000 * 1000))
+      {
+      }
+    bool done = hc.done;
+    i_mutex_unlock (&hc.m);
 
-      return SUCCESS;
-    }
-  return SUCCESS;
+    for (u32 i = 0; i < f.p->nparts; ++i)
+      {
+        spx_latch_unlock_s (&f.p->parts[i].l);
+      }
+
+    test_err_t_wrap (i_thread_join (&t, &f.e), &f.e);
+    test_assert (done);
+    test_assert_int_equal (hc.r.failed, 0);
+
+    i_cond_free (&hc.c);
+    i_mutex_free (&hc.m);
+  }
+
+  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
 }
+#endif
 
-err_t
-pgr_commit (struct pager *p, struct txn *tx, error *e)
+#ifndef NTEST
+static void *
+pgr_scan_thread (void *arg)
 {
-  DBG_ASSERT (pager, p);
+  struct pgr_reader_ctx *ctx = arg;
+  error e = error_create ();
 
-  if (p->wal_enabled)
+  for (pgno pg = 1; pg < ctx->npages; ++pg)
     {
-      spx_latch_lock_s (&tx->l);
-
-      if (tx->data.state != TX_RUNNING)
+      page_h h = page_h_create ();
+      if (pgr_get (&h, PG_DATA_LIST, pg, ctx->p, &e) || page_h_pgno (&h) != pg)
         {
-          spx_latch_unlock_s (&tx->l);
-          return error_causef (e, ERR_DUPLICATE_COMMIT, "Committing a transaction that is already committed\n");
+          ctx->failed++;
+          e.cause_code = SUCCESS;
+          continue;
         }
-
-      // Append a commit log for this transaction
-      slsn l = wal_append_commit_log (&p->ww, tx->tid, tx->data.last_lsn, e);
-      if (l < 0)
+      if (dl_used (page_h_ro (&h)) != pg % DL_DATA_SIZE)
         {
-          spx_latch_unlock_s (&tx->l);
-          return e->cause_code;
+          ctx->failed++;
         }
-
-      // Flush the wal to the expected lsn
-      err_t_wrap (wal_flush_all (&p->ww, e), e);
-
-      // Append an end log to the wal
-      l = wal_append_end_log (&p->ww, tx->tid, l, e);
-      if (l < 0)
+      if (pgr_release (ctx->p, &h, PG_DATA_LIST, &e))
         {
-          spx_latch_unlock_x (&tx->l);
-          return e->cause_code;
+          ctx->failed++;
+          e.cause_code = SUCCESS;
         }
+    }
 
-      err_t_wrap (txnt_remove_txn_expect (&p->tnxt, tx, e), e);
-
-      spx_latch_upgrade_s_x (&tx->l);
+  return NULL;
+}
 
-      tx->data.state = TX_DONE;
+TEST (TT_UNIT, pgr_concurrent_misses_read_once)
+{
+  enum
+  {
+    NTHREADS = 4,
+    NPAGES = MEMORY_PAGE_LEN / 2,
+  };
 
-      spx_latch_unlock_x (&tx->l);
+  struct pgr_fixture f;
+  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
 
-      return SUCCESS;
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, f.p, &f.e), &f.e);
+  for (u32 i = 0; i < NPAGES; ++i)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_new (&h, f.p, &tx, PG_DATA_LIST, &f.e), &f.e);
+      dl_set_used (page_h_w (&h), page_h_pgno (&h) % DL_DATA_SIZE);
+      test_err_t_wrap (pgr_release (f.p, &h, PG_DATA_LIST, &f.e), &f.e);
     }
-  return SUCCESS;
-}
+  test_err_t_wrap (pgr_commit (f.p, &tx, &f.e), &f.e);
 
-err_t
-pgr_checkpoint (struct pager *p, error *e)
-{
-  if (p->wal_enabled)
+  // Everything fits, so each page is read once no matter who gets there first
+  test_err_t_wrap (pgr_evict_all (f.p, &f.e), &f.e);
+  pgr_reset_stats (f.p);
+
+  struct pgr_reader_ctx ctx[NTHREADS];
+  i_thread threads[NTHREADS];
+
+  for (u32 i = 0; i < NTHREADS; ++i)
     {
-      slsn l = wal_append_ckpt_begin (&p->ww, e);
-      err_t_wrap (l, e);
+      ctx[i] = (struct pgr_reader_ctx){
+        .p = f.p,
+        .npages = pgr_get_npages (f.p),
+        .failed = 0,
+      };
+      test_err_t_wrap (i_thread_create (&threads[i], pgr_scan_thread, &ctx[i], &f.e), &f.e);
+    }
 
-      // Store the begin LSN for use in checkpoint_end
-      p->ckpt_begin_lsn = l;
+  for (u32 i = 0; i < NTHREADS; ++i)
+    {
+      test_err_t_wrap (i_thread_join (&threads[i], &f.e), &f.e);
+      test_assert_int_equal (ctx[i].failed, 0);
+    }
 
-      // Write the checkpoint end record
-      slsn ckpt_lsn = wal_append_ckpt_end (&p->ww, &p->tnxt, p->dpt, e);
-      if (ckpt_lsn < 0)
-        {
-          return e->cause_code;
-        }
+  struct pgr_stats stats;
+  pgr_get_stats (f.p, &stats);
+  test_assert_int_equal (stats.misses, NPAGES);
+  test_assert_int_equal (stats.hits, (NTHREADS - 1) * NPAGES);
 
-      struct txn tx;
-      err_t_wrap (pgr_begin_txn (&tx, p, e), e);
+  for (u32 i = 0; i < f.p->pool_len; ++i)
+    {
+      test_assert_int_equal (f.p->pages[i].pin, 0);
+      test_assert (!pf_check (&f.p->pages[i], PW_INFLIGHT));
+    }
 
-      // Update the master LSN on the root page to point to this checkpoint
-      // This is NOT part of a transaction - it's a system-level operation
-      page_h root = page_h_create ();
-      err_t ret = pgr_get_writable (&root, &tx, PG_ROOT_NODE, 0, p, e);
-      if (ret)
-        {
-          return ret;
-        }
+  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
+}
+#endif
 
-      // Set the master LSN to point to the BEGIN checkpoint LSN
-      // (not the END checkpoint LSN - recovery expects BEGIN)
-      rn_set_master_lsn (page_h_w (&root), p->ckpt_begin_lsn);
+#ifndef NTEST
+/**
+ * Touches a small working set a few times, scans many one-touch pages
+ * then returns how many working set pages had to be read back from disk
+ */
+static err_t
+pgr_scan_after_working_set (u64 *misses, enum pgr_policy policy, error *e)
+{
+  enum
+  {
+    POOL = 2 * PGR_PARTITION_MIN_LEN - 1,
+    HOT = 16,
+    SCAN = 4 * POOL,
+  };
 
-      // Save the root page to log the change and update the page LSN
-      ret = pgr_save (p, &root, PG_ROOT_NODE, e);
-      if (ret)
-        {
-          pgr_release (p, &root, PG_ROOT_NODE, e);
-          return ret;
-        }
+  err_t_wrap (i_remove_quiet ("test.db", e), e);
+  err_t_wrap (i_remove_quiet ("test.wal", e), e);
 
-      // Get the page LSN after saving
-      lsn root_lsn = page_get_page_lsn (page_h_ro (&root));
+  struct pager *p = pgr_open ("test.db", "test.wal", POOL, e);
+  if (p == NULL)
+    {
+      return e->cause_code;
+    }
+  pgr_set_policy (p, policy);
 
-      // Flush the root page to disk immediately so master_lsn persists across crashes
-      ret = fpgr_write (&p->fp, page_h_ro (&root)->raw, 0, e);
-      if (ret)
-        {
-          pgr_release (p, &root, PG_ROOT_NODE, e);
-          return ret;
-        }
+  struct txn tx;
+  err_t_wrap_goto (pgr_begin_txn (&tx, p, e), theend, e);
+  for (u32 i = 0; i < HOT + SCAN; ++i)
+    {
+      page_h h = page_h_create ();
+      err_t_wrap_goto (pgr_new (&h, p, &tx, PG_DATA_LIST, e), theend, e);
+      dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+      err_t_wrap_goto (pgr_release (p, &h, PG_DATA_LIST, e), theend, e);
+    }
+  err_t_wrap_goto (pgr_commit (p, &tx, e), theend, e);
 
-      // Release the page
-      ret = pgr_release (p, &root, PG_ROOT_NODE, e);
-      if (ret)
+  // Pages 1 .. HOT are the working set, the rest are scanned once
+  for (u32 round = 0; round < 3; ++round)
+    {
+      for (pgno pg = 1; pg < 1 + HOT; ++pg)
         {
-          return ret;
+          page_h h = page_h_create ();
+          err_t_wrap_goto (pgr_get (&h, PG_DATA_LIST, pg, p, e), theend, e);
+          err_t_wrap_goto (pgr_release (p, &h, PG_DATA_LIST, e), theend, e);
         }
+    }
 
-      // Flush WAL to ensure all records are persisted
-      ret = wal_flush_all (&p->ww, e);
-      if (ret)
-        {
-          return ret;
-        }
+  for (pgno pg = 1 + HOT; pg < 1 + HOT + SCAN; ++pg)
+    {
+      page_h h = page_h_create ();
+      err_t_wrap_goto (pgr_get (&h, PG_DATA_LIST, pg, p, e), theend, e);
+      err_t_wrap_goto (pgr_release (p, &h, PG_DATA_LIST, e), theend, e);
+    }
 
-      err_t_wrap (pgr_commit (p, &tx, e), e);
+  pgr_reset_stats (p);
+  for (pgno pg = 1; pg < 1 + HOT; ++pg)
+    {
+      page_h h = page_h_create ();
+      err_t_wrap_goto (pgr_get (&h, PG_DATA_LIST, pg, p, e), theend, e);
+      err_t_wrap_goto (pgr_release (p, &h, PG_DATA_LIST, e), theend, e);
+    }
 
-      i_log_info ("Checkpoint written at LSN %" PRlsn "\n", ckpt_lsn);
+  struct pgr_stats stats;
+  pgr_get_stats (p, &stats);
+  *misses = stats.misses;
 
-      return SUCCESS;
-    }
-  return SUCCESS;
+theend:
+  pgr_close (p, e);
+  return e->cause_code;
 }
 
-/////////////////////////////////////////
-//// READ / WRITE PAGES
-
-err_t
-pgr_get (page_h *dest, int flags, pgno pg, struct pager *p, error *e)
+TEST (TT_UNIT, pgr_2q_scan_resistant)
 {
-  DBG_ASSERT (page_h, dest);
-  ASSERT (dest->mode == PHM_NONE);
-
-  struct page_frame *pgr = NULL;
-
-  err_t ret = SUCCESS;
-
-  // Try to fetch from memory first
-  hdata_idx data;
-  switch (ht_get_idx (&p->pgno_to_value, &data, pg))
-    {
-    case HTAR_SUCCESS:
-      {
-        pgr = &p->pages[data.value];
-
-        // TODO BLOCK ON X
-        if (pgr->wsibling >= 0)
-          {
-            ASSERT (0 && "WOULD BLOCK ON X!");
-          }
+  error e = error_create ();
+  u64 misses;
 
-        // No operation would have let a pgr into an invalid state
-        ASSERT (page_validate_for_db (&pgr->page, flags, NULL) == SUCCESS);
-        pgr->pin++;
-        break;
-      }
-    case HTAR_DOESNT_EXIST:
-      {
-        // Then load into a new spot
-        ret = pgr_reserve_at_clock_thread_unsafe (p, e);
-        if (ret)
-          {
-            return ret;
-          }
+  TEST_CASE ("CLOCK loses the working set to a scan")
+  {
+    test_err_t_wrap (pgr_scan_after_working_set (&misses, PGR_POLICY_CLOCK, &e), &e);
+    test_assert (misses > 0);
+  }
 
-        // Read in data to the current page
-        pgr = &p->pages[p->clock];
+  TEST_CASE ("2Q keeps the working set through a scan")
+  {
+    test_err_t_wrap (pgr_scan_after_working_set (&misses, PGR_POLICY_2Q, &e), &e);
+    test_assert_int_equal (misses, 0);
+  }
+}
+#endif
 
-        ret = fpgr_read (&p->fp, pgr->page.raw, pg, e);
-        if (ret)
-          {
-            return ret;
-          }
+#ifndef NTEST
+TEST (TT_UNIT, pgr_stats_count_hits_and_misses)
+{
+  struct pgr_fixture f;
+  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
 
-        ret = page_validate_for_db (&pgr->page, flags, e);
-        if (ret)
-          {
-            /**
-             * Maybe here we could try to recover the page
-             */
-            i_log_error ("Cannot get page %" PRpgno " because it is invalid in the database file: %s\n", pg, e->cause_msg);
-            return ret;
-          }
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, f.p, &f.e), &f.e);
+  page_h h = page_h_create ();
+  test_err_t_wrap (pgr_new (&h, f.p, &tx, PG_DATA_LIST, &f.e), &f.e);
+  dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+  pgno pg = page_h_pgno (&h);
+  test_err_t_wrap (pgr_release (f.p, &h, PG_DATA_LIST, &f.e), &f.e);
+  test_err_t_wrap (pgr_commit (f.p, &tx, &f.e), &f.e);
 
-        // pgr is now loaded
-        pgr->pin = 1;
-        pgr->flags = 0;
-        pgr->wsibling = -1;
-        pgr->page.pg = pg;
+  pgr_reset_stats (f.p);
 
-        // Start page at access_bit = 1
-        pf_set (pgr, PW_ACCESS);
-        pf_set (pgr, PW_PRESENT);
+  // Resident - a hit
+  test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, f.p, &f.e), &f.e);
+  test_err_t_wrap (pgr_release (f.p, &h, PG_DATA_LIST, &f.e), &f.e);
 
-        hdata_idx hd = (hdata_idx){ .key = pg, .value = p->clock };
-        ht_insert_expect_idx (&p->pgno_to_value, hd);
+  struct pgr_stats stats;
+  pgr_get_stats (f.p, &stats);
+  test_assert_int_equal (stats.hits, 1);
+  test_assert_int_equal (stats.misses, 0);
 
-        // Be nice to the next caller and iterate clock
-        p->clock = (p->clock + 1) % MEMORY_PAGE_LEN;
-        break;
-      }
-    }
+  // Switching policy keeps resident pages
+  pgr_set_policy (f.p, PGR_POLICY_CLOCK);
+  test_assert_int_equal (pgr_get_policy (f.p), PGR_POLICY_CLOCK);
+  test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, f.p, &f.e), &f.e);
+  test_err_t_wrap (pgr_release (f.p, &h, PG_DATA_LIST, &f.e), &f.e);
 
-  // Initialize page_h
-  dest->pgr = pgr;
-  dest->pgw = NULL;
-  dest->mode = PHM_S;
+  pgr_get_stats (f.p, &stats);
+  test_assert_int_equal (stats.hits, 2);
+  test_assert_int_equal (stats.misses, 0);
 
-  return SUCCESS;
+  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
 }
+#endif
 
-err_t
-pgr_get_unverified (page_h *dest, pgno pg, struct pager *p, error *e)
+#ifndef NTEST
+TEST (TT_UNIT, pgr_sticky_inner_nodes)
 {
-  DBG_ASSERT (page_h, dest);
-  ASSERT (dest->mode == PHM_NONE);
-
-  struct page_frame *pgr = NULL;
+  enum
+  {
+    POOL = 2 * PGR_PARTITION_MIN_LEN - 1,
+    NINNER = 8,
+    SCAN = 4 * POOL,
+  };
 
-  err_t ret = SUCCESS;
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  // Try to fetch from memory first
-  hdata_idx data;
-  switch (ht_get_idx (&p->pgno_to_value, &data, pg))
-    {
-    case HTAR_SUCCESS:
-      {
-        pgr = &p->pages[data.value];
+  struct pager *p = pgr_open ("test.db", "test.wal", POOL, &e);
+  test_fail_if_null (p);
 
-        // TODO BLOCK ON X
-        if (pgr->wsibling >= 0)
-          {
-            ASSERT (0 && "WOULD BLOCK ON X!");
-          }
+  // Plain CLOCK - the sticky region works under any policy
+  pgr_set_policy (p, PGR_POLICY_CLOCK);
+  test_assert_int_equal (pgr_get_sticky_len (p), POOL * PGR_STICKY_PCT / 100);
 
-        pgr->pin++;
-        break;
-      }
-    case HTAR_DOESNT_EXIST:
-      {
-        // Then load into a new spot
-        ret = pgr_reserve_at_clock_thread_unsafe (p, e);
-        if (ret)
-          {
-            return ret;
-          }
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
 
-        // Read in data to the current page
-        pgr = &p->pages[p->clock];
+  // Pages 1 .. NINNER are inner nodes
+  for (u32 i = 0; i < NINNER + SCAN; ++i)
+    {
+      enum page_type type = i < NINNER ? PG_INNER_NODE : PG_DATA_LIST;
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_new (&h, p, &tx, type, &e), &e);
+      if (type == PG_DATA_LIST)
+        {
+          dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+        }
+      else
+        {
+          in_push_end (page_h_w (&h), DL_DATA_SIZE, NINNER + 1);
+        }
+      test_err_t_wrap (pgr_release (p, &h, type, &e), &e);
+    }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
 
-        ret = fpgr_read (&p->fp, pgr->page.raw, pg, e);
-        if (ret)
-          {
-            return ret;
-          }
+  struct pgr_stats stats;
+  pgr_get_stats (p, &stats);
+  test_assert_int_equal (stats.sticky_resident, NINNER);
 
-        // NOTE: Skip validation - this is the difference from pgr_get
-        // Used during ARIES recovery to read pages that may be invalid
+  // Inner nodes survived creating SCAN data pages, and survive reading them
+  for (pgno pg = 1 + NINNER; pg < 1 + NINNER + SCAN; ++pg)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+    }
 
-        // pgr is now loaded
-        pgr->pin = 1;
-        pgr->flags = 0;
-        pgr->wsibling = -1;
-        pgr->page.pg = pg;
+  pgr_reset_stats (p);
+  for (pgno pg = 1; pg < 1 + NINNER; ++pg)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_get (&h, PG_INNER_NODE, pg, p, &e), &e);
+      test_err_t_wrap (pgr_release (p, &h, PG_INNER_NODE, &e), &e);
+    }
 
-        // Start page at access_bit = 1
-        pf_set (pgr, PW_ACCESS);
-        pf_set (pgr, PW_PRESENT);
+  pgr_get_stats (p, &stats);
+  test_assert_int_equal (stats.misses, 0);
+  test_assert_int_equal (stats.sticky_hits, NINNER);
 
-        hdata_idx hd = (hdata_idx){ .key = pg, .value = p->clock };
-        ht_insert_expect_idx (&p->pgno_to_value, hd);
+  // Shrinking the region gives frames back
+  pgr_set_sticky_len (p, NINNER / 2);
+  test_assert_int_equal (pgr_get_sticky_len (p), NINNER / 2);
+  pgr_get_stats (p, &stats);
+  test_assert_int_equal (stats.sticky_resident, NINNER / 2);
 
-        // Be nice to the next caller and iterate clock
-        p->clock = (p->clock + 1) % MEMORY_PAGE_LEN;
-        break;
-      }
+  // Deleting an inner node takes it out of the region
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (pgno pg = 1; pg < 1 + NINNER; ++pg)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_get_writable (&h, &tx, PG_INNER_NODE, pg, p, &e), &e);
+      test_err_t_wrap (pgr_delete_and_release (p, &tx, &h, &e), &e);
     }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
 
-  // Initialize page_h
-  dest->pgr = pgr;
-  dest->pgw = NULL;
-  dest->mode = PHM_S;
+  pgr_get_stats (p, &stats);
+  test_assert_int_equal (stats.sticky_resident, 0);
 
-  return SUCCESS;
+  test_err_t_wrap (pgr_close (p, &e), &e);
 }
+#endif
 
-static err_t
-pgr_make_writable_no_tx (struct pager *p, page_h *h, error *e)
+#ifndef NTEST
+TEST (TT_UNIT, pgr_in_sums_slots)
 {
-  DBG_ASSERT (pager, p);
-  ASSERT (h->mode == PHM_S);
-
-  i_log_trace ("Pager making page: %" PRpgno " writable\n", page_h_pgno (h));
+  enum
+  {
+    POOL = PGR_PARTITION_MIN_LEN,
+    NSLOTS = POOL * PGR_STICKY_MAX_PCT / 100,
+    NNODES = NSLOTS + 8,
+  };
 
-  err_t ret = SUCCESS;
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  // Reserve room for writable page
-  ret = pgr_reserve_at_clock_thread_unsafe (p, e);
-  if (ret)
-    {
-      return ret;
-    }
+  struct pager *p = pgr_open ("test.db", "test.wal", POOL, &e);
+  test_fail_if_null (p);
+  test_assert_int_equal (p->nparts, 1);
+  test_assert_int_equal (p->parts[0].sums_len, NSLOTS);
 
-  struct page_frame *pgw = &p->pages[p->clock];
+  pgno pgs[NNODES];
+  struct txn tx;
+  page_h h = page_h_create ();
 
-  // Mark page as dirty (will be added to DPT in pgr_save with proper LSN)
-  bool was_dirty = pf_check (h->pgr, PW_DIRTY);
-  if (!was_dirty)
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (u32 i = 0; i < NNODES; ++i)
     {
-      pf_set (h->pgr, PW_DIRTY);
+      test_err_t_wrap (pgr_new (&h, p, &tx, PG_INNER_NODE, &e), &e);
+      in_push_end (page_h_w (&h), 1, 100);
+      in_push_end (page_h_w (&h), 2, 101);
+      pgs[i] = page_h_pgno (&h);
+      test_err_t_wrap (pgr_release (p, &h, PG_INNER_NODE, &e), &e);
     }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
 
-  // Initialize w page
-  pgw->pin = 1;
-  pgw->wsibling = -1;
-  pgw->flags = 0;
-  pf_set (pgw, PW_PRESENT);
-  i_memcpy (pgw->page.raw, h->pgr->page.raw, PAGE_SIZE);
-  pgw->page.pg = h->pgr->page.pg;
-
-  // Set page_h
-  h->pgr->wsibling = p->clock;
-  h->pgw = pgw;
-  h->mode = PHM_X;
-  h->pgw->pin++;
+  TEST_CASE ("Inner nodes past the slots go without totals")
+  {
+    u32 nsums = 0;
+    for (u32 i = 0; i < NNODES; ++i)
+      {
+        test_err_t_wrap (pgr_get (&h, PG_INNER_NODE, pgs[i], p, &e), &e);
+        nsums += page_h_in_sums (&h) != NULL;
+        test_err_t_wrap (pgr_release (p, &h, PG_INNER_NODE, &e), &e);
+      }
+    test_assert_int_equal (nsums, NSLOTS);
+    test_assert_int_equal (p->parts[0].nsums_free, 0);
+  }
 
-  // Increment clock to be nice to next consumers
-  p->clock = (p->clock + 1) % MEMORY_PAGE_LEN;
+  TEST_CASE ("Evicted inner nodes give their slots back")
+  {
+    test_err_t_wrap (pgr_evict_all (p, &e), &e);
+    test_assert_int_equal (p->parts[0].nsums_free, NSLOTS);
 
-  return SUCCESS;
-}
+    test_err_t_wrap (pgr_get (&h, PG_INNER_NODE, pgs[NNODES - 1], p, &e), &e);
+    test_fail_if_null (page_h_in_sums (&h));
+    test_err_t_wrap (pgr_release (p, &h, PG_INNER_NODE, &e), &e);
+    test_assert_int_equal (p->parts[0].nsums_free, NSLOTS - 1);
+  }
 
-err_t
-pgr_make_writable (struct pager *p, struct txn *tx, page_h *h, error *e)
-{
-  ASSERT (tx);
-  err_t_wrap (pgr_make_writable_no_tx (p, h, e), e);
-  h->tx = tx;
-  return SUCCESS;
+  test_err_t_wrap (pgr_close (p, &e), &e);
 }
+#endif
 
-err_t
-pgr_maybe_make_writable (struct pager *p, struct txn *tx, page_h *cur, error *e)
+#ifndef NTEST
+TEST (TT_UNIT, pgr_in_sums_follow_saves)
 {
-  ASSERT (tx);
-  if (cur->mode == PHM_S)
-    {
-      return pgr_make_writable (p, tx, cur, e);
-    }
-  return SUCCESS;
-}
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
 
-// No transaction version for recovery - no WAL logging
-static err_t
-pgr_release_no_tx (struct pager *p, page_h *h, int flags, error *e)
-{
-  DBG_ASSERT (pager, p);
-  ASSERT (h->mode == PHM_X || h->mode == PHM_S);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
 
-  i_log_trace ("Releasing (no tx) %" PRpgno "\n", page_h_pgno (h));
+  b_size expect[IN_MAX_KEYS];
+  struct txn tx;
+  page_h h = page_h_create ();
 
-  if (h->mode == PHM_X)
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  test_err_t_wrap (pgr_new (&h, p, &tx, PG_INNER_NODE, &e), &e);
+  test_assert (page_h_in_sums (&h) == NULL);
+  for (p_size i = 0; i < 10; ++i)
     {
-      // Save without WAL logging (recovery doesn't need WAL)
-      ASSERTF (page_validate_for_db (page_h_w (h), flags, NULL) == SUCCESS,
-               "%.*s\n", e->cmlen, e->cause_msg);
-
-      i_memcpy (h->pgr->page.raw, h->pgw->page.raw, PAGE_SIZE);
-      h->pgw->flags = 0;
-      pf_clr (h->pgw, PW_PRESENT);
-      h->pgr->wsibling = -1;
-      h->pgw = NULL;
-      h->mode = PHM_S;
+      in_push_end (page_h_w (&h), (b_size)randu32r (0, 100), 100 + i);
     }
+  pgno pg = page_h_pgno (&h);
+  test_err_t_wrap (pgr_release (p, &h, PG_INNER_NODE, &e), &e);
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
 
-  err_t_wrap (page_validate_for_db (&h->pgr->page, flags, e), e);
+  TEST_CASE ("Saving an inner node builds its totals")
+  {
+    test_err_t_wrap (pgr_get (&h, PG_INNER_NODE, pg, p, &e), &e);
+    const b_size *sums = page_h_in_sums (&h);
+    test_fail_if_null (sums);
+    in_prefix_sums (expect, page_h_ro (&h));
+    test_assert_memequal (sums, expect, 10 * sizeof (b_size));
+    test_err_t_wrap (pgr_release (p, &h, PG_INNER_NODE, &e), &e);
+  }
 
-  DBG_ASSERT (pager, p);
+  TEST_CASE ("Totals follow a rewrite")
+  {
+    test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+    test_err_t_wrap (pgr_get_writable (&h, &tx, PG_INNER_NODE, pg, p, &e), &e);
+    test_assert (page_h_in_sums (&h) == NULL);
+    in_set_key (page_h_w (&h), 0, 12345);
+    in_push_end (page_h_w (&h), 7, 200);
+    test_err_t_wrap (pgr_release (p, &h, PG_INNER_NODE, &e), &e);
+    test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+
+    test_err_t_wrap (pgr_get (&h, PG_INNER_NODE, pg, p, &e), &e);
+    const b_size *sums = page_h_in_sums (&h);
+    test_fail_if_null (sums);
+    in_prefix_sums (expect, page_h_ro (&h));
+    test_assert_memequal (sums, expect, 11 * sizeof (b_size));
+    test_assert_int_equal (sums[10], in_get_size (page_h_ro (&h)));
+    test_err_t_wrap (pgr_release (p, &h, PG_INNER_NODE, &e), &e);
+  }
 
-  h->pgr->pin--;
-  h->pgr = NULL;
-  h->mode = PHM_NONE;
+  TEST_CASE ("Totals are rebuilt when the page is read back in")
+  {
+    test_err_t_wrap (pgr_evict_all (p, &e), &e);
+    pgr_reset_stats (p);
+
+    test_err_t_wrap (pgr_get (&h, PG_INNER_NODE, pg, p, &e), &e);
+    struct pgr_stats stats;
+    pgr_get_stats (p, &stats);
+    test_assert_int_equal (stats.misses, 1);
+    const b_size *sums = page_h_in_sums (&h);
+    test_fail_if_null (sums);
+    in_prefix_sums (expect, page_h_ro (&h));
+    test_assert_memequal (sums, expect, 11 * sizeof (b_size));
+    test_err_t_wrap (pgr_release (p, &h, PG_INNER_NODE, &e), &e);
+  }
 
-  return SUCCESS;
+  test_err_t_wrap (pgr_close (p, &e), &e);
 }
+#endif
 
-// No transaction version for recovery
-err_t
-pgr_get_writable_no_tx (page_h *dest, int flags, pgno pg, struct pager *p, error *e)
+#ifndef NTEST
+TEST (TT_UNIT, pgr_clean_durable_pages)
 {
-  err_t_wrap (pgr_get (dest, flags, pg, p, e), e);
-  err_t ret = pgr_make_writable_no_tx (p, dest, e);
+  enum
+  {
+    POOL = PGR_PARTITION_MIN_LEN,
+    NPAGES = 3 * POOL,
+  };
 
-  // Couldn't allocate writable page - release dest
-  if (ret != SUCCESS)
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
+
+  struct pager *p = pgr_open ("test.db", "test.wal", POOL, &e);
+  test_fail_if_null (p);
+
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (u32 i = 0; i < NPAGES; ++i)
     {
-      pgr_release_no_tx (p, dest, flags, e);
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+      dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
     }
 
-  return ret;
-}
+  struct pgr_stats stats;
+  pgr_get_stats (p, &stats);
+  test_assert (stats.dirty_evictions > 0);
+
+  // The last updates are only in the WAL buffer - nothing to clean
+  pgr_reset_stats (p);
+  test_err_t_wrap (pgr_clean (p, &e), &e);
+  pgr_get_stats (p, &stats);
+  test_assert_int_equal (stats.cleaned, 0);
+
+  // Durable after the commit
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+  test_err_t_wrap (pgr_clean (p, &e), &e);
+  pgr_get_stats (p, &stats);
+  test_assert (stats.cleaned > 0);
+
+  // Reading the pages back only ever finds clean victims
+  pgr_reset_stats (p);
+  for (pgno pg = 1; pg < 1 + NPAGES; ++pg)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+      test_assert_int_equal (dl_used (page_h_ro (&h)), DL_DATA_SIZE);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+    }
+  pgr_get_stats (p, &stats);
+  test_assert (stats.evictions > 0);
+  test_assert_int_equal (stats.dirty_evictions, 0);
+
+  // Same thing on the cleaner thread
+  test_err_t_wrap (pgr_start_cleaner (p, &e), &e);
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (u32 i = 0; i < POOL; ++i)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+      dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+    }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+  pgr_stop_cleaner (p);
 
-err_t
-pgr_get_writable (page_h *dest, struct txn *tx, int flags, pgno pg, struct pager *p, error *e)
-{
-  err_t_wrap (pgr_get (dest, flags, pg, p, e), e);
-  err_t ret = pgr_make_writable (p, tx, dest, e);
+  // Closing with it running stops it
+  test_err_t_wrap (pgr_start_cleaner (p, &e), &e);
+  test_err_t_wrap (pgr_close (p, &e), &e);
 
-  // Couldn't allocate writable page - release dest
-  if (ret != SUCCESS)
+  // Everything made it to disk either way
+  p = pgr_open ("test.db", "test.wal", POOL, &e);
+  test_fail_if_null (p);
+  test_assert_int_equal ((int)pgr_get_npages (p), 1 + NPAGES + POOL);
+  for (pgno pg = 1; pg < 1 + NPAGES + POOL; ++pg)
     {
-      pgr_release_no_tx (p, dest, flags, e);
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+      test_assert_int_equal (dl_used (page_h_ro (&h)), DL_DATA_SIZE);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
     }
-
-  return ret;
+  test_err_t_wrap (pgr_close (p, &e), &e);
 }
+#endif
 
-err_t
-pgr_save (struct pager *p, page_h *h, int flags, error *e)
+#ifndef NTEST
+TEST (TT_UNIT, pgr_dirty_evictions_batch)
 {
-  DBG_ASSERT (pager, p);
-  ASSERT (h->mode == PHM_X);
-  ASSERTF (page_validate_for_db (page_h_w (h), flags, NULL) == SUCCESS, "%.*s\n", e->cmlen, e->cause_msg);
+  enum
+  {
+    POOL = PGR_PARTITION_MIN_LEN,
+    NPAGES = 4 * POOL,
+  };
 
-  // Save log
-  if (p->wal_enabled)
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
+
+  struct pager *p = pgr_open ("test.db", "test.wal", POOL, &e);
+  test_fail_if_null (p);
+
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (u32 i = 0; i < NPAGES; ++i)
     {
-      spx_latch_lock_x (&h->tx->l);
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+      dl_set_used (page_h_w (&h), 1 + i % (DL_DATA_SIZE - 1));
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+    }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
 
-      // Construct an update log record
-      struct wal_update_write update = {
-        .tid = h->tx->tid,
-        .pg = page_h_pgno (h),
-        .prev = h->tx->data.last_lsn,
-        .undo = h->pgr->page.raw,
-        .redo = h->pgw->page.raw,
-      };
+  TEST_CASE ("A dirty victim takes the next ones along in its write")
+  {
+    struct pgr_stats stats;
+    pgr_get_stats (p, &stats);
+    test_assert (stats.dirty_evictions > 0);
+    test_assert (stats.dirty_evictions < stats.evictions);
 
-      // Append that update to the wal and get it's lsn
-      slsn page_lsn = wal_append_update_log (&p->ww, update, e);
-      if (page_lsn < 0)
-        {
-          spx_latch_unlock_x (&h->tx->l);
-          return e->cause_code;
-        }
+    // Nothing is left pinned once the writes land
+    for (u32 i = 0; i < p->pool_len; ++i)
+      {
+        test_assert (!pf_check (&p->pages[i], PW_WRITING));
+        test_assert_int_equal (p->pages[i].pin, 0);
+      }
+  }
 
-      // Update the page lsn
-      page_set_page_lsn (page_h_w (h), (lsn)page_lsn);
+  TEST_CASE ("Pages written back without the latch read back")
+  {
+    test_err_t_wrap (pgr_evict_all (p, &e), &e);
+    for (u32 i = 0; i < NPAGES; ++i)
+      {
+        page_h h = page_h_create ();
+        test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, 1 + i, p, &e), &e);
+        test_assert_int_equal (dl_used (page_h_ro (&h)), 1 + i % (DL_DATA_SIZE - 1));
+        test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+      }
+  }
 
-      h->tx->data.last_lsn = page_lsn;
-      h->tx->data.undo_next_lsn = page_lsn;
+  test_err_t_wrap (pgr_close (p, &e), &e);
+}
+#endif
 
-      // Add page to DPT if this is the first update (RecLSN = LSN of first update)
-      struct dpg_entry dpe;
-      if (!dpe_get (&dpe, p->dpt, page_h_pgno (h)))
-        {
-          if (dpgt_add (p->dpt, page_h_pgno (h), (lsn)page_lsn, e))
-            {
-              spx_latch_unlock_x (&h->tx->l);
-              return e->cause_code;
-            }
-        }
+#ifndef NTEST
+TEST (TT_UNIT, pgr_evict_flushes_to_page_lsn)
+{
+  enum
+  {
+    POOL = PGR_PARTITION_MIN_LEN,
+    NPAGES = 3 * POOL,
+  };
 
-      spx_latch_unlock_x (&h->tx->l);
-    }
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  i_memcpy (&h->pgr->page.raw, h->pgw->page.raw, PAGE_SIZE);
-  h->pgw->flags = 0;
-  pf_clr (h->pgw, PW_PRESENT);
-  h->pgr->wsibling = -1;
-  h->pgw = NULL;
-  h->mode = PHM_S;
+  struct pager *p = pgr_open ("test.db", "test.wal", POOL, &e);
+  test_fail_if_null (p);
 
-  return SUCCESS;
-}
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (u32 i = 0; i < NPAGES; ++i)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+      dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+    }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+
+  // An update that isn't durable yet, pinned so it stays put
+  page_h upd = page_h_create ();
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  test_err_t_wrap (pgr_get_writable (&upd, &tx, PG_DATA_LIST, 1, p, &e), &e);
+  dl_set_used (page_h_w (&upd), DL_DATA_SIZE / 2);
+  test_err_t_wrap (pgr_save (p, &upd, PG_DATA_LIST, &e), &e);
+
+  // Evicting committed pages doesn't sync the pending update
+  u64 nsyncs = p->ww.wf.current_ostream->nsyncs;
+  pgr_reset_stats (p);
+  for (pgno pg = 2; pg < 1 + NPAGES; ++pg)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+    }
 
-static void
-pgr_cancel_w (struct pager *p, page_h *h)
-{
-  DBG_ASSERT (pager, p);
-  ASSERT (h->mode == PHM_X);
+  struct pgr_stats stats;
+  pgr_get_stats (p, &stats);
+  test_assert (stats.dirty_evictions > 0);
+  test_assert_int_equal (p->ww.wf.current_ostream->nsyncs, nsyncs);
 
-  h->pgw->flags = 0;
-  pf_clr (h->pgw, PW_PRESENT);
-  h->pgr->wsibling = -1;
-  h->pgw = NULL;
-  h->mode = PHM_S;
+  test_err_t_wrap (pgr_release (p, &upd, PG_DATA_LIST, &e), &e);
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+  test_err_t_wrap (pgr_close (p, &e), &e);
 }
+#endif
 
-err_t
-pgr_new (page_h *dest, struct pager *p, struct txn *tx, enum page_type type, error *e)
+#ifndef NTEST
+TEST (TT_UNIT, pgr_save_logs_changed_bytes)
 {
-  DBG_ASSERT (pager, p);
-  DBG_ASSERT (page_h, dest);
-  ASSERT (dest->mode == PHM_NONE);
+  enum
+  {
+    NWRITES = 8,
+    STRIDE = DL_DATA_SIZE / NWRITES,
+  };
 
-  err_t ret = SUCCESS;
-  page_h root_node = page_h_create ();
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  /**
-   * First, we'll check the tombstone to see if we can
-   * dish out a new page that's already been deleted
-   */
-  err_t_wrap (pgr_get (&root_node, PG_ROOT_NODE, 0, p, e), e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
+
+  u8 data[DL_DATA_SIZE];
+  u8 word[8];
+  rand_bytes (data, sizeof (data));
 
-  pgno ftpg = rn_get_first_tmbst (page_h_ro (&root_node));
-  ret = pgr_make_writable (p, tx, &root_node, e);
-  if (ret)
+  // The first update logs the whole page
+  struct txn tx;
+  page_h h = page_h_create ();
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+  dl_set_data (page_h_w (&h), (struct dl_data){ .data = data, .blen = DL_DATA_SIZE });
+  pgno pg = page_h_pgno (&h);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+
+  // Small strided writes only log the bytes they touch
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (u32 i = 0; i < NWRITES; ++i)
     {
-      pgr_release_no_tx (p, &root_node, PG_ROOT_NODE, e);
-      return ret;
+      rand_bytes (word, sizeof (word));
+      i_memcpy (&data[i * STRIDE], word, sizeof (word));
+
+      lsn before = wal_get_next_lsn (&p->ww);
+      test_err_t_wrap (pgr_get_writable (&h, &tx, PG_DATA_LIST, pg, p, &e), &e);
+      dl_write (page_h_w (&h), word, i * STRIDE, sizeof (word));
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+      test_assert (wal_get_next_lsn (&p->ww) - before <= WL_UPDATE_DELTA_LEN (1, sizeof (word)));
     }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
 
-  if (ftpg < fpgr_get_npages (&p->fp))
+  // Redo rebuilds the page from the full image and the deltas
+  test_err_t_wrap (pgr_crash (p, &e), &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
+
+  test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+  test_assert_memequal (dl_get_data (page_h_ro (&h)), data, DL_DATA_SIZE);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+
+  // Rolling back a delta only restores the bytes it changed
+  i_memset (word, 0xAB, sizeof (word));
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (u32 i = 0; i < 2; ++i)
     {
-      // Pop the first tombstone - this is our result page
-      ret = pgr_get_writable (dest, tx, PG_TOMBSTONE, ftpg, p, e);
-      if (ret)
+      lsn before = wal_get_next_lsn (&p->ww);
+      test_err_t_wrap (pgr_get_writable (&h, &tx, PG_DATA_LIST, pg, p, &e), &e);
+      dl_write (page_h_w (&h), word, STRIDE / 2 + i * sizeof (word), sizeof (word));
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+
+      // Recovery wrote the page out, so the first update is in full again
+      if (i > 0)
         {
-          pgr_cancel_w (p, &root_node);
-          pgr_release_no_tx (p, &root_node, PG_ROOT_NODE, e);
-          return ret;
+          test_assert (wal_get_next_lsn (&p->ww) - before <= WL_UPDATE_DELTA_LEN (1, sizeof (word)));
         }
     }
-  else
+  test_err_t_wrap (pgr_flush_wall (p, &e), &e);
+  test_err_t_wrap (pgr_rollback (p, &tx, 0, &e), &e);
+
+  test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+  test_assert_memequal (dl_get_data (page_h_ro (&h)), data, DL_DATA_SIZE);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+
+  test_err_t_wrap (pgr_close (p, &e), &e);
+}
+#endif
+
+#ifndef NTEST
+TEST (TT_UNIT, pgr_save_logs_data_list_inserts)
+{
+  enum
+  {
+    CHUNK = 16,
+    NAPPENDS = 8,
+  };
+
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
+
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
+
+  u8 data[(NAPPENDS + 2) * CHUNK];
+  rand_bytes (data, sizeof (data));
+
+  // The first update logs the whole page
+  struct txn tx;
+  page_h h = page_h_create ();
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+  dl_append (page_h_w (&h), &data[CHUNK], CHUNK);
+  pgno pg = page_h_pgno (&h);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+
+  // Appends log just the appended bytes
+  for (u32 i = 0; i < NAPPENDS; ++i)
     {
-      if ((ret = pgr_new_extend (dest, p, tx, e)))
-        {
-          pgr_cancel_w (p, &root_node);
-          pgr_release_no_tx (p, &root_node, PG_ROOT_NODE, e);
-          return ret;
-        }
+      lsn before = wal_get_next_lsn (&p->ww);
+      test_err_t_wrap (pgr_get_writable (&h, &tx, PG_DATA_LIST, pg, p, &e), &e);
+      dl_append (page_h_w (&h), &data[(i + 2) * CHUNK], CHUNK);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+      test_assert_int_equal (wal_get_next_lsn (&p->ww) - before, WL_DL_INSERT_LEN (CHUNK));
     }
 
-  // Update root node's first tombstone link
-  pgno ntbst = tmbst_get_next (page_h_ro (dest));
-  rn_set_first_tmbst (page_h_w (&root_node), ntbst);
-  ret = pgr_save (p, &root_node, PG_ROOT_NODE, e);
+  // So does shifting right to insert at the front
+  lsn before = wal_get_next_lsn (&p->ww);
+  test_err_t_wrap (pgr_get_writable (&h, &tx, PG_DATA_LIST, pg, p, &e), &e);
+  dl_shift_right (page_h_w (&h), CHUNK);
+  i_memcpy (dl_get_data (page_h_w (&h)), data, CHUNK);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+  test_assert_int_equal (wal_get_next_lsn (&p->ww) - before, WL_DL_INSERT_LEN (CHUNK));
 
-  if (ret)
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+
+  // Redo replays the inserts on top of the full image
+  test_err_t_wrap (pgr_crash (p, &e), &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
+
+  test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+  test_assert_int_equal (dl_used (page_h_ro (&h)), sizeof (data));
+  test_assert_memequal (dl_get_data (page_h_ro (&h)), data, sizeof (data));
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+
+  // Undo removes the inserted bytes
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (u32 i = 0; i < 2; ++i)
     {
-      pgr_cancel_w (p, dest);
-      pgr_cancel_w (p, &root_node);
-      pgr_release (p, &root_node, PG_ROOT_NODE, e);
-      pgr_release (p, dest, type, e);
-      return ret;
+      test_err_t_wrap (pgr_get_writable (&h, &tx, PG_DATA_LIST, pg, p, &e), &e);
+      dl_insert (page_h_w (&h), data, CHUNK, CHUNK);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
     }
+  test_err_t_wrap (pgr_flush_wall (p, &e), &e);
+  test_err_t_wrap (pgr_rollback (p, &tx, 0, &e), &e);
 
-  pgr_release (p, &root_node, PG_ROOT_NODE, e);
-  page_init_empty (page_h_w (dest), type);
+  test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+  test_assert_int_equal (dl_used (page_h_ro (&h)), sizeof (data));
+  test_assert_memequal (dl_get_data (page_h_ro (&h)), data, sizeof (data));
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
 
-  return ret;
+  test_err_t_wrap (pgr_close (p, &e), &e);
 }
+#endif
 
 #ifndef NTEST
-TEST (TT_UNIT, pgr_new_get_save)
+TEST (TT_UNIT, pgr_save_compresses_page_images)
 {
-  struct pgr_fixture f;
-  page_h h = page_h_create ();
-  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+  enum
+  {
+    CHUNK = 64,
+  };
+
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
+
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
 
+  u8 data[CHUNK];
+  rand_bytes (data, sizeof (data));
+
+  // A mostly empty page logs a full image far smaller than the raw record
   struct txn tx;
-  test_err_t_wrap (pgr_begin_txn (&tx, f.p, &f.e), &f.e);
+  page_h h = page_h_create ();
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  lsn before = wal_get_next_lsn (&p->ww);
+  test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+  dl_append (page_h_w (&h), data, CHUNK);
+  pgno pg = page_h_pgno (&h);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+  test_assert (wal_get_next_lsn (&p->ww) - before < WL_UPDATE_LEN / 2);
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+
+  // Redo inflates the image
+  test_err_t_wrap (pgr_crash (p, &e), &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
 
-  pgr_new (&h, f.p, &tx, PG_DATA_LIST, &f.e);
-  test_assert_int_equal ((int)pgr_get_npages (f.p), 2);
+  test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+  test_assert_int_equal (dl_used (page_h_ro (&h)), CHUNK);
+  test_assert_memequal (dl_get_data (page_h_ro (&h)), data, CHUNK);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
 
-  // Make it valid
-  dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+  // So does undo, and the compensation records it writes
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  test_err_t_wrap (pgr_get_writable (&h, &tx, PG_DATA_LIST, pg, p, &e), &e);
+  dl_append (page_h_w (&h), data, CHUNK);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+  test_err_t_wrap (pgr_flush_wall (p, &e), &e);
 
-  test_err_t_wrap (pgr_release (f.p, &h, PG_DATA_LIST, &f.e), &f.e);
+  before = wal_get_next_lsn (&p->ww);
+  test_err_t_wrap (pgr_rollback (p, &tx, 0, &e), &e);
+  test_assert (wal_get_next_lsn (&p->ww) - before < WL_CLR_LEN / 2 + WL_END_LEN);
 
-  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
+  test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+  test_assert_int_equal (dl_used (page_h_ro (&h)), CHUNK);
+  test_assert_memequal (dl_get_data (page_h_ro (&h)), data, CHUNK);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+
+  test_err_t_wrap (pgr_close (p, &e), &e);
 }
 #endif
 
-err_t
-pgr_delete_and_release (struct pager *p, struct txn *tx, page_h *h, error *e)
+#ifndef NTEST
+TEST (TT_UNIT, pgr_checkpoint_truncates_wal)
 {
-  DBG_ASSERT (pager, p);
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_err_t_wrap (wal_remove ("test.wal", &e), &e);
 
-  err_t ret = SUCCESS;
-  page_h root_node = page_h_create ();
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
 
-  // Upgrade nodes to X
-  err_t_wrap (pgr_get (&root_node, PG_ROOT_NODE, 0, p, e), e);
-  ret = pgr_make_writable (p, tx, &root_node, e);
-  if (ret)
-    {
-      return ret;
-    }
-  if (h->mode == PHM_S)
+  u8 data[DL_DATA_SIZE];
+  rand_bytes (data, sizeof (data));
+
+  struct txn tx;
+  page_h h = page_h_create ();
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+  dl_set_data (page_h_w (&h), (struct dl_data){ .data = data, .blen = DL_DATA_SIZE });
+  pgno pg = page_h_pgno (&h);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+
+  // Rewrite the page until the log runs into a second segment
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  while (wal_get_next_lsn (&p->ww) < WAL_SEGMENT_SIZE + WAL_SEGMENT_SIZE / 8)
     {
-      ret = pgr_make_writable (p, tx, h, e);
-      if (ret)
-        {
-          pgr_cancel_w (p, &root_node);
-          pgr_release (p, &root_node, PG_ROOT_NODE, e);
-          return ret;
-        }
+      rand_bytes (data, sizeof (data));
+      test_err_t_wrap (pgr_get_writable (&h, &tx, PG_DATA_LIST, pg, p, &e), &e);
+      dl_set_data (page_h_w (&h), (struct dl_data){ .data = data, .blen = DL_DATA_SIZE });
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
     }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+
+  // The page is still dirty - restart would redo it from the first segment
+  test_err_t_wrap (pgr_checkpoint (p, &e), &e);
+  u64 first;
+  test_err_t_wrap (walseg_read_anchor (&first, "test.wal", &e), &e);
+  test_assert_int_equal (first, 0);
+
+  // Once it's on disk nothing needs the first segment
+  test_err_t_wrap (pgr_evict_all (p, &e), &e);
+  test_err_t_wrap (pgr_checkpoint (p, &e), &e);
+  test_err_t_wrap (walseg_read_anchor (&first, "test.wal", &e), &e);
+  test_assert_int_equal (first, 1);
+
+  // Restart from the checkpoint doesn't miss it
+  test_err_t_wrap (pgr_crash (p, &e), &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
 
-  pgno ftpg = rn_get_first_tmbst (page_h_ro (&root_node));
-  page_init_empty (&h->pgw->page, PG_TOMBSTONE);
-  tmbst_set_next (page_h_w (h), ftpg);
-  ftpg = page_h_pgno (h);
+  test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+  test_assert_memequal (dl_get_data (page_h_ro (&h)), data, DL_DATA_SIZE);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
 
-  ret = pgr_release (p, h, PG_TOMBSTONE, e);
+  test_err_t_wrap (pgr_close (p, &e), &e);
 
-  /**
-   * TODO - The following error handling logic doesn't look right
-   */
-  if (ret)
-    {
-      pgr_cancel_w (p, &root_node);
-      pgr_release (p, &root_node, PG_ROOT_NODE, e);
-      return ret;
-    }
+  // Removing just the anchor would strand the later segments
+  test_err_t_wrap (wal_remove ("test.wal", &e), &e);
+}
+#endif
 
-  rn_set_first_tmbst (page_h_w (&root_node), ftpg);
-  ret = pgr_save (p, &root_node, PG_ROOT_NODE, e);
-  if (ret)
+#ifndef NTEST
+struct pgr_ckpt_writer_ctx
+{
+  struct pager *p;
+  pgno *pgs;
+  u32 npages;
+  u32 count;
+  u8 *last; // Fill byte of each page's last committed write
+  bool done;
+  u32 failed;
+};
+
+static void *
+pgr_ckpt_writer_thread (void *arg)
+{
+  struct pgr_ckpt_writer_ctx *ctx = arg;
+  error e = error_create ();
+  u8 data[DL_DATA_SIZE];
+
+  for (u32 i = 0; i < ctx->count; ++i)
     {
-      pgr_cancel_w (p, &root_node);
-      pgr_release (p, &root_node, PG_ROOT_NODE, e);
-      return ret;
+      u32 j = i % ctx->npages;
+      struct txn tx;
+      page_h h = page_h_create ();
+
+      i_memset (data, (u8)i, sizeof (data));
+      if (pgr_begin_txn (&tx, ctx->p, &e)
+          || pgr_get_writable (&h, &tx, PG_DATA_LIST, ctx->pgs[j], ctx->p, &e))
+        {
+          ctx->failed++;
+          break;
+        }
+      dl_set_data (page_h_w (&h), (struct dl_data){ .data = data, .blen = DL_DATA_SIZE });
+      if (pgr_release (ctx->p, &h, PG_DATA_LIST, &e) || pgr_commit (ctx->p, &tx, &e))
+        {
+          ctx->failed++;
+          break;
+        }
+      ctx->last[j] = (u8)i;
     }
 
-  pgr_release (p, &root_node, PG_ROOT_NODE, e);
+  __atomic_store_n (&ctx->done, true, __ATOMIC_RELEASE);
+  return NULL;
+}
 
-  return ret;
+struct pgr_ckpt_thread_ctx
+{
+  struct pager *p;
+  err_t ret;
+};
+
+static void *
+pgr_ckpt_thread (void *arg)
+{
+  struct pgr_ckpt_thread_ctx *ctx = arg;
+  error e = error_create ();
+  ctx->ret = pgr_checkpoint (ctx->p, &e);
+  return NULL;
 }
 
-#ifndef NTEST
-TEST (TT_UNIT, pgr_delete)
+TEST (TT_UNIT, pgr_checkpoint_during_saves)
 {
-  struct pgr_fixture f;
-  error *e = &f.e;
-  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+  enum
+  {
+    NPAGES = 4 * PGR_MIN_POOL_LEN,
+  };
+
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_err_t_wrap (wal_remove ("test.wal", &e), &e);
 
+  struct pager *p = pgr_open ("test.db", "test.wal", PGR_MIN_POOL_LEN, &e);
+  test_fail_if_null (p);
+
+  pgno pgs[NPAGES];
+  u8 last[NPAGES];
+  u8 data[DL_DATA_SIZE];
   struct txn tx;
-  test_err_t_wrap (pgr_begin_txn (&tx, f.p, e), e);
+  page_h h = page_h_create ();
 
-  page_h a = page_h_create ();
-  page_h b = page_h_create ();
-  page_h c = page_h_create ();
-  page_h d = page_h_create ();
+  i_memset (data, 0xFF, sizeof (data));
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (u32 i = 0; i < NPAGES; ++i)
+    {
+      test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+      dl_set_data (page_h_w (&h), (struct dl_data){ .data = data, .blen = DL_DATA_SIZE });
+      pgs[i] = page_h_pgno (&h);
+      last[i] = 0xFF;
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+    }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
 
-  test_err_t_wrap (pgr_new (&a, f.p, &tx, PG_DATA_LIST, e), e);
-  test_err_t_wrap (pgr_new (&b, f.p, &tx, PG_DATA_LIST, e), e);
-  test_err_t_wrap (pgr_new (&c, f.p, &tx, PG_DATA_LIST, e), e);
-  test_err_t_wrap (pgr_new (&d, f.p, &tx, PG_DATA_LIST, e), e);
+  TEST_CASE ("A checkpoint waits out a save between its log append and table insert")
+  {
+    i_mutex m;
+    i_cond c;
+    test_err_t_wrap (i_mutex_create (&m, &e), &e);
+    test_err_t_wrap (i_cond_create (&c, &e), &e);
 
-  pgno apg = page_h_pgno (&a);
-  pgno bpg = page_h_pgno (&b);
-  pgno cpg = page_h_pgno (&c);
-  pgno dpg = page_h_pgno (&d);
+    // Where pgr_save sits right after appending its record
+    spx_latch_lock_s (&p->ckpt_latch);
+    lsn next = wal_get_next_lsn (&p->ww);
 
-  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &a, e), e);
-  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &b, e), e);
-  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &c, e), e);
-  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &d, e), e);
+    struct pgr_ckpt_thread_ctx ctx = { .p = p, .ret = SUCCESS };
+    i_thread t;
+    test_err_t_wrap (i_thread_create (&t, pgr_ckpt_thread, &ctx, &e), &e);
 
-  test_err_t_wrap (pgr_new (&a, f.p, &tx, PG_DATA_LIST, e), e);
-  test_err_t_wrap (pgr_new (&b, f.p, &tx, PG_DATA_LIST, e), e);
-  test_err_t_wrap (pgr_new (&c, f.p, &tx, PG_DATA_LIST, e), e);
-  test_err_t_wrap (pgr_new (&d, f.p, &tx, PG_DATA_LIST, e), e);
+    i_mutex_lock (&m);
+    i_cond_timedwait (&c, &m, 20 * 1000);
+    i_mutex_unlock (&m);
 
-  test_assert_equal (page_h_pgno (&a), dpg);
-  test_assert_equal (page_h_pgno (&b), cpg);
-  test_assert_equal (page_h_pgno (&c), bpg);
-  test_assert_equal (page_h_pgno (&d), apg);
+    // No begin record ahead of the pending insert
+    test_assert_int_equal (wal_get_next_lsn (&p->ww), next);
 
-  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &a, e), e);
-  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &b, e), e);
-  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &c, e), e);
-  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &d, e), e);
+    spx_latch_unlock_s (&p->ckpt_latch);
+    test_err_t_wrap (i_thread_join (&t, &e), &e);
+    test_assert_int_equal (ctx.ret, SUCCESS);
+    test_assert (wal_get_next_lsn (&p->ww) > next);
 
-  test_err_t_wrap (pgr_new (&a, f.p, &tx, PG_DATA_LIST, e), e);
-  test_err_t_wrap (pgr_new (&b, f.p, &tx, PG_DATA_LIST, e), e);
-  test_err_t_wrap (pgr_new (&c, f.p, &tx, PG_DATA_LIST, e), e);
-  test_err_t_wrap (pgr_new (&d, f.p, &tx, PG_DATA_LIST, e), e);
+    i_cond_free (&c);
+    i_mutex_free (&m);
+  }
 
-  test_assert_equal (page_h_pgno (&a), apg);
-  test_assert_equal (page_h_pgno (&b), bpg);
-  test_assert_equal (page_h_pgno (&c), cpg);
-  test_assert_equal (page_h_pgno (&d), dpg);
+  TEST_CASE ("Every record logged around a checkpoint is redone")
+  {
+    struct pgr_ckpt_writer_ctx ctx = {
+      .p = p,
+      .pgs = pgs,
+      .npages = NPAGES,
+      .count = 2000,
+      .last = last,
+      .done = false,
+      .failed = 0,
+    };
+    i_thread writer;
+    test_err_t_wrap (i_thread_create (&writer, pgr_ckpt_writer_thread, &ctx, &e), &e);
+
+    /**
+     * Checkpoints land between saves' log appends and table inserts.
+     * The pool is smaller than the pages, so write backs keep taking
+     * them out of the dirty page table and saves keep adding them back
+     */
+    u32 nckpts = 0;
+    while (!__atomic_load_n (&ctx.done, __ATOMIC_ACQUIRE))
+      {
+        test_err_t_wrap (pgr_checkpoint (p, &e), &e);
+        nckpts++;
+      }
+    test_err_t_wrap (i_thread_join (&writer, &e), &e);
+    test_assert_int_equal (ctx.failed, 0);
+    test_assert (nckpts > 0);
 
-  dl_set_used (page_h_w (&a), DL_DATA_SIZE);
-  dl_set_used (page_h_w (&b), DL_DATA_SIZE);
-  dl_set_used (page_h_w (&c), DL_DATA_SIZE);
-  dl_set_used (page_h_w (&d), DL_DATA_SIZE);
+    test_err_t_wrap (pgr_crash (p, &e), &e);
+    p = pgr_open ("test.db", "test.wal", PGR_MIN_POOL_LEN, &e);
+    test_fail_if_null (p);
 
-  test_err_t_wrap (pgr_release (f.p, &a, PG_DATA_LIST, e), e);
-  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &b, e), e);
-  test_err_t_wrap (pgr_delete_and_release (f.p, &tx, &c, e), e);
-  test_err_t_wrap (pgr_release (f.p, &d, PG_DATA_LIST, e), e);
+    for (u32 i = 0; i < NPAGES; ++i)
+      {
+        i_memset (data, last[i], sizeof (data));
+        test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pgs[i], p, &e), &e);
+        test_assert_memequal (dl_get_data (page_h_ro (&h)), data, DL_DATA_SIZE);
+        test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+      }
+  }
 
-  test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
+  test_err_t_wrap (pgr_close (p, &e), &e);
 }
 #endif
 
-err_t
-pgr_release_if_exists (struct pager *p, page_h *h, int flags, error *e)
+#ifndef NTEST
+TEST (TT_UNIT, pgr_concurrent_commits)
 {
-  if (h->mode != PHM_NONE)
-    {
-      return pgr_release (p, h, flags, e);
-    }
-  return SUCCESS;
-}
+  enum
+  {
+    NTHREADS = 8,
+    NCOMMITS = 25,
+    NPAGES = 2 * NTHREADS,
+  };
 
-err_t
-pgr_release (struct pager *p, page_h *h, int flags, error *e)
-{
-  DBG_ASSERT (pager, p);
-  ASSERT (h->mode == PHM_X || h->mode == PHM_S);
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_err_t_wrap (wal_remove ("test.wal", &e), &e);
+
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
 
-  i_log_trace ("Releasing %" PRpgno "\n", page_h_pgno (h));
+  pgno pgs[NPAGES];
+  u8 last[NPAGES];
+  u8 data[DL_DATA_SIZE];
+  struct txn tx;
+  page_h h = page_h_create ();
 
-  if (h->mode == PHM_X)
+  i_memset (data, 0xFF, sizeof (data));
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (u32 i = 0; i < NPAGES; ++i)
     {
-      err_t_wrap (pgr_save (p, h, flags, e), e);
+      test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+      dl_set_data (page_h_w (&h), (struct dl_data){ .data = data, .blen = DL_DATA_SIZE });
+      pgs[i] = page_h_pgno (&h);
+      last[i] = 0xFF;
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
     }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
 
-  err_t_wrap (page_validate_for_db (&h->pgr->page, flags, e), e);
+  // Each thread commits to pages of its own
+  struct pgr_ckpt_writer_ctx ctx[NTHREADS];
+  i_thread threads[NTHREADS];
+  u64 nsyncs = p->ww.wf.current_ostream->nsyncs;
 
-  DBG_ASSERT (pager, p);
+  for (u32 i = 0; i < NTHREADS; ++i)
+    {
+      ctx[i] = (struct pgr_ckpt_writer_ctx){
+        .p = p,
+        .pgs = pgs + 2 * i,
+        .npages = 2,
+        .count = NCOMMITS,
+        .last = last + 2 * i,
+        .done = false,
+        .failed = 0,
+      };
+      test_err_t_wrap (i_thread_create (&threads[i], pgr_ckpt_writer_thread, &ctx[i], &e), &e);
+    }
+  for (u32 i = 0; i < NTHREADS; ++i)
+    {
+      test_err_t_wrap (i_thread_join (&threads[i], &e), &e);
+      test_assert_int_equal (ctx[i].failed, 0);
+    }
 
-  h->pgr->pin--;
-  h->pgr = NULL;
-  h->mode = PHM_NONE;
+  // Commits waiting on the same sync went out together
+  test_assert (p->ww.wf.current_ostream->nsyncs - nsyncs < NTHREADS * NCOMMITS / 2);
 
-  return SUCCESS;
-}
+  // And every one of them is durable
+  test_err_t_wrap (pgr_crash (p, &e), &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
 
-err_t
-pgr_flush_wall (struct pager *p, error *e)
-{
-  if (p->wal_enabled)
+  for (u32 i = 0; i < NPAGES; ++i)
     {
-      return wal_flush_all (&p->ww, e);
+      i_memset (data, last[i], sizeof (data));
+      test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pgs[i], p, &e), &e);
+      test_assert_memequal (dl_get_data (page_h_ro (&h)), data, DL_DATA_SIZE);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
     }
-  UNREACHABLE ();
+
+  test_err_t_wrap (pgr_close (p, &e), &e);
 }
+#endif
 
 #ifndef NTEST
-
-TEST (TT_UNIT, pager_fill_ht)
+TEST (TT_UNIT, pgr_recovery_dpt_grows)
 {
-  struct pgr_fixture f;
-  test_err_t_wrap (pgr_fixture_create (&f), &f.e);
+  enum
+  {
+    NPAGES = 3 * PGR_PARTITION_MIN_LEN,
+  };
+
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_err_t_wrap (wal_remove ("test.wal", &e), &e);
 
+  struct pager *p = pgr_open ("test.db", "test.wal", 4 * PGR_PARTITION_MIN_LEN, &e);
+  test_fail_if_null (p);
+
+  pgno pgs[NPAGES];
+  u8 data[DL_DATA_SIZE];
   struct txn tx;
-  pgr_begin_txn (&tx, f.p, &f.e);
+  page_h h = page_h_create ();
 
-  page_h pgs[MEMORY_PAGE_LEN];
-  page_h bad = page_h_create ();
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  for (u32 i = 0; i < NPAGES; ++i)
+    {
+      i_memset (data, (u8)i, sizeof (data));
+      test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+      dl_set_data (page_h_w (&h), (struct dl_data){ .data = data, .blen = DL_DATA_SIZE });
+      pgs[i] = page_h_pgno (&h);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+    }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
 
+  TEST_CASE ("Checkpoint table bigger than the restarting pool")
   {
-    // Fill up - there is already one page in the pool, the root
-    u32 i = 0;
-    for (; i < MEMORY_PAGE_LEN / 2 - 1; ++i)
-      {
-        pgs[i] = page_h_create ();
-        test_err_t_wrap (pgr_new (&pgs[i], f.p, &tx, PG_DATA_LIST, &f.e), &f.e);
-        test_assert_equal (pgs[i].mode, PHM_X);
-      }
+    // Every page is still dirty, so the checkpoint records all of them
+    test_err_t_wrap (pgr_checkpoint (p, &e), &e);
+    test_err_t_wrap (pgr_crash (p, &e), &e);
 
-    // Next page will be full
-    test_err_t_check (pgr_new (&bad, f.p, &tx, PG_DATA_LIST, &f.e), ERR_PAGER_FULL, &f.e);
+    p = pgr_open ("test.db", "test.wal", PGR_MIN_POOL_LEN, &e);
+    test_fail_if_null (p);
 
-    // Release them all
-    for (i = 0; i < MEMORY_PAGE_LEN / 2 - 1; ++i)
+    for (u32 i = 0; i < NPAGES; ++i)
       {
-        dl_set_used (page_h_w (&pgs[i]), DL_DATA_SIZE);
-        test_err_t_wrap (pgr_release (f.p, &pgs[i], PG_DATA_LIST, &f.e), &f.e);
+        i_memset (data, (u8)i, sizeof (data));
+        test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pgs[i], p, &e), &e);
+        test_assert_memequal (dl_get_data (page_h_ro (&h)), data, DL_DATA_SIZE);
+        test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
       }
   }
 
-  // Repeat above
+  TEST_CASE ("Analysis finds more dirty pages than the pool holds")
   {
-    // Fill half way up - good
-    for (u32 i = 0; i < MEMORY_PAGE_LEN / 2 - 1; ++i)
+    test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+    for (u32 i = 0; i < NPAGES; ++i)
       {
-        test_err_t_wrap (pgr_new (&pgs[i], f.p, &tx, PG_DATA_LIST, &f.e), &f.e);
-        test_assert_equal (pgs[i].mode, PHM_X);
+        i_memset (data, (u8)~i, sizeof (data));
+        test_err_t_wrap (pgr_get_writable (&h, &tx, PG_DATA_LIST, pgs[i], p, &e), &e);
+        dl_set_data (page_h_w (&h), (struct dl_data){ .data = data, .blen = DL_DATA_SIZE });
+        test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
       }
+    test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+    test_err_t_wrap (pgr_crash (p, &e), &e);
 
-    // Next page will be full
-    test_err_t_check (pgr_new (&bad, f.p, &tx, PG_DATA_LIST, &f.e), ERR_PAGER_FULL, &f.e);
+    p = pgr_open ("test.db", "test.wal", PGR_MIN_POOL_LEN, &e);
+    test_fail_if_null (p);
 
-    // Release them all
-    for (u32 i = 0; i < MEMORY_PAGE_LEN / 2 - 1; ++i)
+    for (u32 i = 0; i < NPAGES; ++i)
       {
-        dl_set_used (page_h_w (&pgs[i]), DL_DATA_SIZE);
-        test_err_t_wrap (pgr_release (f.p, &pgs[i], PG_DATA_LIST, &f.e), &f.e);
+        i_memset (data, (u8)~i, sizeof (data));
+        test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pgs[i], p, &e), &e);
+        test_assert_memequal (dl_get_data (page_h_ro (&h)), data, DL_DATA_SIZE);
+        test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
       }
   }
 
-  test_err_t_wrap (pgr_close (f.p, &f.e), &f.e);
+  test_err_t_wrap (pgr_close (p, &e), &e);
+  test_err_t_wrap (wal_remove ("test.wal", &e), &e);
+}
+#endif
+
+#ifndef NTEST
+TEST (TT_UNIT, pgr_background_checkpoint)
+{
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_err_t_wrap (wal_remove ("test.wal", &e), &e);
+
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
+  test_err_t_wrap (pgr_start_checkpointer (p, &e), &e);
+
+  u8 data[DL_DATA_SIZE];
+  struct txn tx;
+  page_h h = page_h_create ();
+
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+  test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+  rand_bytes (data, sizeof (data));
+  dl_set_data (page_h_w (&h), (struct dl_data){ .data = data, .blen = DL_DATA_SIZE });
+  pgno pg = page_h_pgno (&h);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+
+  // Log enough for the commit to wake the checkpointer
+  while (wal_get_next_lsn (&p->ww) < PGR_CKPT_WAL_BYTES)
+    {
+      rand_bytes (data, sizeof (data));
+      test_err_t_wrap (pgr_get_writable (&h, &tx, PG_DATA_LIST, pg, p, &e), &e);
+      dl_set_data (page_h_w (&h), (struct dl_data){ .data = data, .blen = DL_DATA_SIZE });
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+    }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+
+  // Keep writing while it runs
+  i_mutex m;
+  i_cond c;
+  test_err_t_wrap (i_mutex_create (&m, &e), &e);
+  test_err_t_wrap (i_cond_create (&c, &e), &e);
+
+  lsn master = 0;
+  for (u32 i = 0; i < 10000 && master == 0; ++i)
+    {
+      test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+      rand_bytes (data, sizeof (data));
+      test_err_t_wrap (pgr_get_writable (&h, &tx, PG_DATA_LIST, pg, p, &e), &e);
+      dl_set_data (page_h_w (&h), (struct dl_data){ .data = data, .blen = DL_DATA_SIZE });
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+      test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+
+      test_err_t_wrap (pgr_get (&h, PG_ROOT_NODE, ROOT_PGNO, p, &e), &e);
+      master = rn_get_master_lsn (page_h_ro (&h));
+      test_err_t_wrap (pgr_release (p, &h, PG_ROOT_NODE, &e), &e);
+
+      i_mutex_lock (&m);
+      i_cond_timedwait (&c, &m, 1000);
+      i_mutex_unlock (&m);
+    }
+  test_assert (master > 0);
+
+  i_cond_free (&c);
+  i_mutex_free (&m);
+
+  // Restart from the background checkpoint
+  test_err_t_wrap (pgr_crash (p, &e), &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
+
+  test_err_t_wrap (pgr_get (&h, PG_DATA_LIST, pg, p, &e), &e);
+  test_assert_memequal (dl_get_data (page_h_ro (&h)), data, DL_DATA_SIZE);
+  test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+
+  test_err_t_wrap (pgr_close (p, &e), &e);
+  test_err_t_wrap (wal_remove ("test.wal", &e), &e);
 }
 #endif
 
@@ -1614,16 +5212,18 @@ i_log_page_table (int log_level, struct pager *p)
 {
   DBG_ASSERT (pager, p);
   i_log (log_level, "Page Table:\n");
-  for (u32 i = 0; i < MEMORY_PAGE_LEN; ++i)
+  for (u32 i = 0; i < p->pool_len; ++i)
     {
       struct page_frame *mp = &p->pages[i];
       if (pf_check (mp, PW_PRESENT))
         {
-          i_printf (log_level, "%u |(PAGE)    pg: %" PRpgno " pin: %d ax: %d drt: %d prsn: %d sib: %d type: %d|\n",
+          i_printf (log_level, "%u |(PAGE)    pg: %" PRpgno " pin: %d ax: %d hot: %d stk: %d drt: %d prsn: %d sib: %d type: %d|\n",
                     i,
                     mp->page.pg,
                     mp->pin,
                     pf_check (mp, PW_ACCESS),
+                    pf_check (mp, PW_HOT),
+                    pf_check (mp, PW_STICKY),
                     pf_check (mp, PW_DIRTY),
                     pf_check (mp, PW_PRESENT),
                     mp->wsibling,
@@ -1638,6 +5238,46 @@ i_log_page_table (int log_level, struct pager *p)
   i_log_dpgt (log_level, p->dpt);
 }
 
+// Redo_Update(Page, LogRec)
+static void
+pgr_redo_update (page *dest, const struct wal_rec_hdr_read *log_rec)
+{
+  switch (log_rec->type)
+    {
+    case WL_DL_INSERT:
+      {
+        dl_insert (dest, log_rec->dl_insert.data, log_rec->dl_insert.ofst, log_rec->dl_insert.len);
+        break;
+      }
+    default:
+      {
+        ASSERT (log_rec->type == WL_UPDATE || log_rec->type == WL_UPDATE_DELTA);
+        wrh_apply_ranges (dest->raw, log_rec->update.ranges, log_rec->update.nranges, log_rec->update.redo);
+        break;
+      }
+    }
+}
+
+// Undo_Update(Page, LogRec)
+static void
+pgr_undo_update (page *dest, const struct wal_rec_hdr_read *log_rec)
+{
+  switch (log_rec->type)
+    {
+    case WL_DL_INSERT:
+      {
+        dl_remove (dest, log_rec->dl_insert.ofst, log_rec->dl_insert.len);
+        break;
+      }
+    default:
+      {
+        ASSERT (log_rec->type == WL_UPDATE || log_rec->type == WL_UPDATE_DELTA);
+        wrh_apply_ranges (dest->raw, log_rec->update.ranges, log_rec->update.nranges, log_rec->update.undo);
+        break;
+      }
+    }
+}
+
 // (ARIES Figure 8)
 err_t
 pgr_rollback (struct pager *p, struct txn *tx, lsn save_lsn, error *e)
@@ -1672,11 +5312,13 @@ pgr_rollback (struct pager *p, struct txn *tx, lsn save_lsn, error *e)
 
           // WHEN('update') DO;
         case WL_UPDATE:
+        case WL_UPDATE_DELTA:
+        case WL_DL_INSERT:
           {
             // Save values that might be overwritten when we write the CLR
-            pgno pg = log_rec->update.pg;
-            lsn prev_lsn = log_rec->update.prev;
-            txid update_tid = log_rec->update.tid;
+            pgno pg = wrh_get_pgno (log_rec);
+            lsn prev_lsn = wrh_get_prev_lsn (log_rec);
+            txid update_tid = wrh_get_tid (log_rec);
 
             // IF LogRec is undoable THEN DO
             {
@@ -1684,17 +5326,17 @@ pgr_rollback (struct pager *p, struct txn *tx, lsn save_lsn, error *e)
               err_t_wrap (pgr_get_writable_no_tx (&ph, PG_ANY, pg, p, e), e);
 
               // Undo_Update(Page, LogRec)
-              i_memcpy (ph.pgw->page.raw, log_rec->update.undo, PAGE_SIZE);
+              pgr_undo_update (&ph.pgw->page, log_rec);
 
               // Log_Write
               clr_lsn = wal_append_clr_log (
                   &p->ww,
                   (struct wal_clr_write){
-                      .tid = update_tid,            // LogRec.TransID
-                      .prev = tx->data.last_lsn,    // Trans_Table[TransID].LastLSN
-                      .pg = pg,                     // LogRec.PageID
-                      .undo_next = prev_lsn,        // LogRec.PrevLSN
-                      .redo = log_rec->update.undo, // Data
+                      .tid = update_tid,         // LogRec.TransID
+                      .prev = tx->data.last_lsn, // Trans_Table[TransID].LastLSN
+                      .pg = pg,                  // LogRec.PageID
+                      .undo_next = prev_lsn,     // LogRec.PrevLSN
+                      .redo = ph.pgw->page.raw,  // Data
                   },
                   e);
 
@@ -1815,6 +5457,24 @@ analaysis_end_phase_flush_ends (struct txn *tx, void *ctx)
     }
 }
 
+struct collect_done_ctx
+{
+  struct dbl_buffer *done;
+  error *e;
+};
+
+static void
+analysis_end_phase_collect_done (struct txn *tx, void *ctx)
+{
+  struct collect_done_ctx *_ctx = ctx;
+  if (_ctx->e->cause_code || tx->data.state != TX_DONE)
+    {
+      return;
+    }
+
+  dblb_append (_ctx->done, &tx, 1, _ctx->e);
+}
+
 // (ARIES Figure 10)
 static err_t
 pgr_restart_analysis (struct pager *p, struct aries_ctx *ctx, error *e)
@@ -1869,10 +5529,10 @@ pgr_restart_analysis (struct pager *p, struct aries_ctx *ctx, error *e)
       stxid tid = wrh_get_tid (log_rec);
       struct txn *tx = NULL;
 
-      if (tid != -1)
+      if (tid != -1 && !txnt_get (&tx, &ctx->txt, tid))
         {
           // Create a new transaction object
-          tx = dblb_append_alloc (&ctx->txns, 1, e);
+          tx = chunk_malloc (&ctx->txns, 1, sizeof *tx, e);
           if (tx == NULL)
             {
               return e->cause_code;
@@ -1889,12 +5549,14 @@ pgr_restart_analysis (struct pager *p, struct aries_ctx *ctx, error *e)
                              });
 
           // Insert this transaction
-          err_t_wrap (txnt_insert_txn_if_not_exists (&ctx->txt, tx, e), e);
+          err_t_wrap (txnt_insert_txn (&ctx->txt, tx, e), e);
         }
 
       switch (log_rec->type)
         {
         case WL_UPDATE:
+        case WL_UPDATE_DELTA:
+        case WL_DL_INSERT:
           {
             // Trans_Table[LogRec.TransID].LastLSN := LogRec.LSN
             // Trans_Table[LogRec.TransID].UndoNxtLSN := LogRec.LSN
@@ -1908,7 +5570,7 @@ pgr_restart_analysis (struct pager *p, struct aries_ctx *ctx, error *e)
 
             // IF LogRec.PageID not in Dirty_Page_Table THEN
             //   Dirty_Page_Table[LogRec.PageID].RecLSN := LogRec.LSN
-            pgno pg = log_rec->update.pg;
+            pgno pg = wrh_get_pgno (log_rec);
             struct dpg_entry dpe;
             if (!dpe_get (&dpe, ctx->dpt, pg))
               {
@@ -1943,7 +5605,7 @@ pgr_restart_analysis (struct pager *p, struct aries_ctx *ctx, error *e)
 
             // FOR each entry in LogRec.Dirty_PageLst
             u32 ckpt_dpt_count = 0;
-            for (p_size i = 0; i < arrlen (log_rec->ckpt_end.dpt->_table); ++i)
+            for (p_size i = 0; i < log_rec->ckpt_end.dpt->cap; ++i)
               {
                 if (log_rec->ckpt_end.dpt->_table[i].present)
                   {
@@ -1951,7 +5613,7 @@ pgr_restart_analysis (struct pager *p, struct aries_ctx *ctx, error *e)
                   }
               }
 
-            dpgt_merge_into (ctx->dpt, log_rec->ckpt_end.dpt);
+            dpgt_merge_into (ctx->dpt, log_rec->ckpt_end.dpt, e);
 
             txnt_close (&log_rec->ckpt_end.att);
             if (log_rec->ckpt_end.txn_bank)
@@ -1960,6 +5622,11 @@ pgr_restart_analysis (struct pager *p, struct aries_ctx *ctx, error *e)
               }
             dpgt_close (log_rec->ckpt_end.dpt);
 
+            if (e->cause_code)
+              {
+                goto theend;
+              }
+
             break;
           }
         case WL_COMMIT:
@@ -2013,14 +5680,22 @@ theend:
       return e->cause_code;
     }
 
-  // Remove them all from the table
-  struct txn *txns = ctx->txns.data;
-  for (u32 i = 0; i < ctx->txns.nelem; ++i)
+  // Remove them all from the table - collected first, the table can't
+  // change under txnt_foreach
+  struct dbl_buffer done;
+  err_t_wrap (dblb_create (&done, sizeof (struct txn *), 8, e), e);
+  txnt_foreach (&ctx->txt, analysis_end_phase_collect_done, &(struct collect_done_ctx){ .done = &done, .e = e });
+
+  struct txn **txns = done.data;
+  for (u32 i = 0; i < done.nelem && !e->cause_code; ++i)
     {
-      if (txns[i].data.state == TX_DONE)
-        {
-          err_t_wrap (txnt_remove_txn_expect (&ctx->txt, &txns[i], e), e);
-        }
+      txnt_remove_txn_expect (&ctx->txt, txns[i], e);
+    }
+  dblb_free (&done);
+
+  if (e->cause_code)
+    {
+      return e->cause_code;
     }
 
   ctx->redo_lsn = dpgt_min_rec_lsn (ctx->dpt);
@@ -2028,6 +5703,140 @@ theend:
   return e->cause_code;
 }
 
+// Restart redo workers for later pgr_open calls
+static u32 pgr_redo_nthreads = PGR_REDO_THREADS;
+
+void
+pgr_set_redo_threads (u32 nthreads)
+{
+  pgr_redo_nthreads = nthreads;
+}
+
+/**
+ * Redoes the update, delta, data list insert or CLR [log_rec] at [l]
+ * unless its page already has it
+ */
+static err_t
+pgr_redo_apply (struct pager *p, struct aries_ctx *ctx, struct wal_rec_hdr_read *log_rec, lsn l, error *e)
+{
+  pgno pg = wrh_get_pgno (log_rec);
+
+  // fix&latch(LogRec.PageID, 'X')
+  page_h ph = page_h_create ();
+  err_t_wrap (pgr_get_unverified (&ph, pg, p, e), e);
+  err_t_wrap (pgr_make_writable_no_tx (p, &ph, e), e);
+
+  // IF Page.LSN < LogRec.LSN
+  lsn page_lsn = page_get_page_lsn (page_h_ro (&ph));
+  if (page_lsn < l)
+    {
+      // Redo_Update(Page, LogRec)
+      if (log_rec->type == WL_CLR)
+        {
+          i_memcpy (page_h_w (&ph)->raw, log_rec->clr.redo, PAGE_SIZE);
+        }
+      else
+        {
+          pgr_redo_update (page_h_w (&ph), log_rec);
+        }
+      page_set_page_lsn (page_h_w (&ph), l);
+    }
+  else
+    {
+      dpgt_update (ctx->dpt, pg, page_lsn + 1);
+    }
+
+  // unfix&unlatch(page)
+  pgr_release_no_tx (p, &ph, PG_ANY, NULL);
+
+  return SUCCESS;
+}
+
+struct pgr_redo_rec
+{
+  lsn l;
+  struct wal_rec_hdr_read rec;
+};
+
+/**
+ * Records for the pages that hash to one worker, in log order. At
+ * most one drain task runs per queue, so each page sees its records in
+ * the order they were logged
+ */
+struct pgr_redo_queue
+{
+  struct pager *p;
+  struct aries_ctx *ctx;
+
+  struct pgr_redo_rec recs[PGR_REDO_QUEUE_LEN];
+  u32 head;
+  u32 len;
+  bool scheduled; // A drain task is queued or running
+
+  i_mutex l;
+  i_cond changed; // Room freed or drained
+  error e;        // First failure
+};
+
+static void
+pgr_redo_drain (void *ctx)
+{
+  struct pgr_redo_queue *q = ctx;
+
+  i_mutex_lock (&q->l);
+  while (q->len > 0)
+    {
+      // The producer only writes past the tail, so the head is stable
+      struct pgr_redo_rec *r = &q->recs[q->head];
+      bool failed = q->e.cause_code != SUCCESS;
+      i_mutex_unlock (&q->l);
+
+      error e = error_create ();
+      if (!failed)
+        {
+          pgr_redo_apply (q->p, q->ctx, &r->rec, r->l, &e);
+        }
+
+      i_mutex_lock (&q->l);
+      if (e.cause_code && !q->e.cause_code)
+        {
+          q->e = e;
+        }
+      q->head = (q->head + 1) % PGR_REDO_QUEUE_LEN;
+      q->len--;
+      i_cond_broadcast (&q->changed);
+    }
+  q->scheduled = false;
+  i_cond_broadcast (&q->changed);
+  i_mutex_unlock (&q->l);
+}
+
+static err_t
+pgr_redo_dispatch (struct thread_pool *tp, struct pgr_redo_queue *q, struct wal_rec_hdr_read *log_rec, lsn l, error *e)
+{
+  i_mutex_lock (&q->l);
+  while (q->len == PGR_REDO_QUEUE_LEN)
+    {
+      i_cond_wait (&q->changed, &q->l);
+    }
+
+  struct pgr_redo_rec *r = &q->recs[(q->head + q->len) % PGR_REDO_QUEUE_LEN];
+  r->l = l;
+  r->rec = *log_rec;
+  q->len++;
+
+  bool schedule = !q->scheduled;
+  q->scheduled = true;
+  i_mutex_unlock (&q->l);
+
+  if (schedule)
+    {
+      err_t_wrap (tp_add_task (tp, pgr_redo_drain, q, e), e);
+    }
+
+  return SUCCESS;
+}
+
 // (ARIES Figure 11)
 static err_t
 pgr_restart_redo (struct pager *p, struct aries_ctx *ctx, error *e)
@@ -2039,12 +5848,48 @@ pgr_restart_redo (struct pager *p, struct aries_ctx *ctx, error *e)
       return SUCCESS;
     }
 
+  /**
+   * Records only depend on earlier records for the same page, so with
+   * workers they're split up by page and each queue is applied in order
+   * while this thread keeps reading the log
+   */
+  u32 nthreads = pgr_redo_nthreads;
+  struct thread_pool *tp = NULL;
+  struct pgr_redo_queue *queues = NULL;
+  u32 nqueues = 0;
+
+  if (nthreads > 0)
+    {
+      err_t_wrap_null_goto (queues = i_calloc (nthreads, sizeof *queues, e), theend, e);
+      for (; nqueues < nthreads; ++nqueues)
+        {
+          struct pgr_redo_queue *q = &queues[nqueues];
+          q->p = p;
+          q->ctx = ctx;
+          q->e = error_create ();
+          err_t_wrap_goto (i_mutex_create (&q->l, e), theend, e);
+          if (i_cond_create (&q->changed, e))
+            {
+              i_mutex_free (&q->l);
+              goto theend;
+            }
+        }
+
+      err_t_wrap_null_goto (tp = tp_open (e), theend, e);
+      if (tp_spin (tp, nthreads, e))
+        {
+          tp_free (tp, e);
+          tp = NULL;
+          goto theend;
+        }
+    }
+
   // Open_Log_Scan(RedoLSN)
   // LogRec = Next_Log()
   struct wal_rec_hdr_read *log_rec = wal_read_entry (&p->ww, ctx->redo_lsn, e);
   if (log_rec == NULL)
     {
-      return e->cause_code;
+      goto theend;
     }
 
   // While NOT(End_Of_Log) DO;
@@ -2055,62 +5900,25 @@ pgr_restart_redo (struct pager *p, struct aries_ctx *ctx, error *e)
       switch (log_rec->type)
         {
         case WL_UPDATE:
-          {
-            struct dpg_entry dpe;
-            bool in_dpt = dpe_get (&dpe, ctx->dpt, log_rec->update.pg);
-
-            if (in_dpt && ctx->redo_lsn >= dpe.rec_lsn)
-              {
-                // fix&latch(LogRec.PageID, 'X')
-                page_h ph = page_h_create ();
-                err_t_wrap (pgr_get_unverified (&ph, log_rec->update.pg, p, e), e);
-                err_t_wrap (pgr_make_writable_no_tx (p, &ph, e), e);
-
-                // IF Page.LSN < LogRec.LSN
-                lsn page_lsn = page_get_page_lsn (page_h_ro (&ph));
-                if (page_lsn < ctx->redo_lsn)
-                  {
-                    // Redo_Update(Page, LogRec)
-                    i_memcpy (page_h_w (&ph)->raw, log_rec->update.redo, PAGE_SIZE);
-                    page_set_page_lsn (page_h_w (&ph), ctx->redo_lsn);
-                  }
-                else
-                  {
-                    dpgt_update (ctx->dpt, log_rec->update.pg, page_lsn + 1);
-                  }
-
-                // unfix&unlatch(page)
-                pgr_release_no_tx (p, &ph, PG_ANY, NULL);
-              }
-            break;
-          }
+        case WL_UPDATE_DELTA:
+        case WL_DL_INSERT:
         case WL_CLR:
           {
+            pgno pg = wrh_get_pgno (log_rec);
             struct dpg_entry dpe;
-            bool in_dpt = dpe_get (&dpe, ctx->dpt, log_rec->clr.pg);
+            bool in_dpt = dpe_get (&dpe, ctx->dpt, pg);
 
             if (in_dpt && ctx->redo_lsn >= dpe.rec_lsn)
               {
-                // fix&latch(LogRec.PageID, 'X')
-                page_h ph = page_h_create ();
-                err_t_wrap (pgr_get_unverified (&ph, log_rec->clr.pg, p, e), e);
-                err_t_wrap (pgr_make_writable_no_tx (p, &ph, e), e);
-
-                // IF Page.LSN < LogRec.LSN
-                lsn page_lsn = page_get_page_lsn (page_h_ro (&ph));
-                if (page_lsn < ctx->redo_lsn)
+                if (tp == NULL)
                   {
-                    // Redo_Update(Page, LogRec)
-                    i_memcpy (page_h_w (&ph)->raw, log_rec->clr.redo, PAGE_SIZE);
-                    page_set_page_lsn (page_h_w (&ph), ctx->redo_lsn);
+                    err_t_wrap_goto (pgr_redo_apply (p, ctx, log_rec, ctx->redo_lsn, e), theend, e);
                   }
                 else
                   {
-                    dpgt_update (ctx->dpt, log_rec->clr.pg, page_lsn + 1);
+                    struct pgr_redo_queue *q = &queues[pgr_hash_pgno (pg) % nqueues];
+                    err_t_wrap_goto (pgr_redo_dispatch (tp, q, log_rec, ctx->redo_lsn, e), theend, e);
                   }
-
-                // unfix&unlatch(page)
-                pgr_release_no_tx (p, &ph, PG_ANY, NULL);
               }
             break;
           }
@@ -2133,12 +5941,34 @@ pgr_restart_redo (struct pager *p, struct aries_ctx *ctx, error *e)
       log_rec = wal_read_next (&p->ww, &ctx->redo_lsn, e);
       if (log_rec == NULL)
         {
-          return e->cause_code;
+          goto theend;
         }
     }
 
-  // Switch back to write mode
-  return SUCCESS;
+theend:
+  if (tp)
+    {
+      // Drains what's already queued
+      tp_stop (tp, e);
+      tp_free (tp, e);
+    }
+  for (u32 i = 0; i < nqueues; ++i)
+    {
+      struct pgr_redo_queue *q = &queues[i];
+      ASSERT (q->len == 0 && !q->scheduled);
+      if (q->e.cause_code && !e->cause_code)
+        {
+          error_causef (e, q->e.cause_code, "Redo failed: %.*s", q->e.cmlen, q->e.cause_msg);
+        }
+      i_cond_free (&q->changed);
+      i_mutex_free (&q->l);
+    }
+  if (queues)
+    {
+      i_free (queues);
+    }
+
+  return e->cause_code;
 }
 
 // (ARIES Figure 12)
@@ -2169,32 +5999,35 @@ pgr_restart_undo (struct pager *p, struct aries_ctx *ctx, error *e)
       switch (log_rec->type)
         {
         case WL_UPDATE:
+        case WL_UPDATE_DELTA:
+        case WL_DL_INSERT:
           {
             // Save these because they get overridden on write
             struct txn *tx;
-            txid tid = log_rec->update.tid;
-            pgno prev = log_rec->update.prev;
+            txid tid = wrh_get_tid (log_rec);
+            pgno prev = wrh_get_prev_lsn (log_rec);
+            pgno pg = wrh_get_pgno (log_rec);
 
             // IF LogRec is undoable THEN DO;
             {
               // fix&latch(LogRec.PageID, 'X')
               page_h ph = page_h_create ();
-              err_t_wrap (pgr_get_unverified (&ph, log_rec->update.pg, p, e), e);
+              err_t_wrap (pgr_get_unverified (&ph, pg, p, e), e);
               err_t_wrap (pgr_make_writable_no_tx (p, &ph, e), e);
 
               // Undo_Update(Page, LogRec)
-              i_memcpy (page_h_w (&ph)->raw, log_rec->update.undo, PAGE_SIZE);
+              pgr_undo_update (page_h_w (&ph), log_rec);
 
               txnt_get_expect (&tx, &ctx->txt, tid);
 
               slsn l = wal_append_clr_log (
                   &p->ww,
                   (struct wal_clr_write){
-                      .tid = log_rec->update.tid,
+                      .tid = tid,
                       .prev = tx->data.last_lsn,
-                      .pg = log_rec->update.pg,
-                      .undo_next = log_rec->update.prev,
-                      .redo = log_rec->update.undo,
+                      .pg = pg,
+                      .undo_next = prev,
+                      .redo = page_h_w (&ph)->raw,
                   },
                   e);
               err_t_wrap (l, e);
@@ -2302,7 +6135,7 @@ TEST (TT_UNIT, pager_wal_entries_correct)
   // UPDATE (tid1)
   // COMMIT (tid1)
   // END (tid1)
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // BEGIN (tid2)
@@ -2503,7 +6336,7 @@ TEST (TT_UNIT, pager_wal_entries_on_crash)
   // UPDATE (tid1)
   // COMMIT (tid1)
   // END (tid1)
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // BEGIN (tid2)
@@ -2676,6 +6509,10 @@ TEST (TT_UNIT, pager_wal_entries_on_crash)
 err_t
 pgr_crash (struct pager *p, error *e)
 {
+  pgr_set_thread_pool (p, NULL);
+  pgr_stop_checkpointer (p);
+  pgr_stop_cleaner (p);
+
   if (p->wal_enabled)
     {
       wal_crash (&p->ww, e);
@@ -2685,6 +6522,15 @@ pgr_crash (struct pager *p, error *e)
   txnt_crash (&p->tnxt);
   dpgt_crash (p->dpt);
 
+  i_cond_free (&p->ra_idle);
+  i_mutex_free (&p->ra_l);
+  i_cond_free (&p->cl_wake);
+  i_mutex_free (&p->cl_l);
+  i_mutex_free (&p->rn_l);
+  i_mutex_free (&p->ckpt_l);
+  i_cond_free (&p->ck_wake);
+  i_mutex_free (&p->ck_l);
+  pgr_pool_free (p);
   i_free (p);
 
   return e->cause_code;
@@ -554,6 +554,12 @@ pgr_dlgt_get_next (
 
   pgno npg = dlgt_get_next (page_h_ro (cur));
 
+  // Let the pager get ahead of a sequential reader
+  if (npg != PGNO_NULL && page_get_type (page_h_ro (cur)) == PG_DATA_LIST)
+    {
+      pgr_readahead (p, page_h_pgno (cur), npg);
+    }
+
   if (tx)
     {
       if (npg != PGNO_NULL)
@@ -721,6 +727,86 @@ TEST (TT_UNIT, pgr_dlgt_get_next)
   test_err_t_wrap (pgr_fixture_teardown (&f), &f.e);
 }
 
+TEST (TT_UNIT, pgr_dlgt_get_next_readahead)
+{
+  enum
+  {
+    NPAGES = 40,
+  };
+
+  error e = error_create ();
+  test_fail_if (i_remove_quiet ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
+
+  struct pager *p = pgr_open ("test.db", NULL, MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
+
+  struct txn tx;
+  test_err_t_wrap (pgr_begin_txn (&tx, p, &e), &e);
+
+  // A chain of NPAGES data list pages
+  pgno pgs[NPAGES];
+  for (u32 i = 0; i < NPAGES; ++i)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_new (&h, p, &tx, PG_DATA_LIST, &e), &e);
+      dl_set_used (page_h_w (&h), DL_DATA_SIZE);
+      pgs[i] = page_h_pgno (&h);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+    }
+  for (u32 i = 0; i < NPAGES; ++i)
+    {
+      page_h h = page_h_create ();
+      test_err_t_wrap (pgr_get_writable (&h, &tx, PG_DATA_LIST, pgs[i], p, &e), &e);
+      dl_set_prev (page_h_w (&h), i > 0 ? pgs[i - 1] : PGNO_NULL);
+      dl_set_next (page_h_w (&h), i + 1 < NPAGES ? pgs[i + 1] : PGNO_NULL);
+      test_err_t_wrap (pgr_release (p, &h, PG_DATA_LIST, &e), &e);
+    }
+  test_err_t_wrap (pgr_commit (p, &tx, &e), &e);
+  test_err_t_wrap (pgr_close (p, &e), &e);
+
+  // Cold pool
+  p = pgr_open ("test.db", NULL, MEMORY_PAGE_LEN, &e);
+  test_fail_if_null (p);
+
+  struct thread_pool *tp = tp_open (&e);
+  test_fail_if_null (tp);
+  test_err_t_wrap (tp_spin (tp, 1, &e), &e);
+  pgr_set_thread_pool (p, tp);
+
+  page_h cur = page_h_create ();
+  test_err_t_wrap (pgr_get (&cur, PG_DATA_LIST, pgs[0], p, &e), &e);
+
+  for (u32 i = 1; i < NPAGES; ++i)
+    {
+      page_h next = page_h_create ();
+      test_err_t_wrap (pgr_dlgt_get_next (&cur, &next, NULL, p, &e), &e);
+      test_assert_type_equal (page_h_pgno (&next), pgs[i], pgno, PRpgno);
+      test_err_t_wrap (pgr_release (p, &cur, PG_DATA_LIST, &e), &e);
+      page_h_xfer_ownership_ptr (&cur, &next);
+
+      // Wait out the first read-ahead so the reader can't beat it
+      if (i == 3)
+        {
+          pgr_set_thread_pool (p, tp);
+        }
+    }
+  test_err_t_wrap (pgr_release (p, &cur, PG_DATA_LIST, &e), &e);
+
+  struct pgr_stats stats;
+  pgr_get_stats (p, &stats);
+  test_assert (stats.prefetches >= PGR_READAHEAD_MIN);
+  test_assert (stats.prefetch_hits >= PGR_READAHEAD_MIN);
+  test_assert (stats.prefetch_hits <= stats.prefetches);
+
+  test_err_t_wrap (pgr_close (p, &e), &e);
+  test_err_t_wrap (tp_stop (tp, &e), &e);
+  test_err_t_wrap (tp_free (tp, &e), &e);
+
+  test_fail_if (i_unlink ("test.db", &e));
+  test_fail_if (i_remove_quiet ("test.wal", &e));
+}
+
 err_t
 pgr_dlgt_get_prev (page_h *cur, page_h *prev, struct txn *tx, struct pager *p, error *e)
 {
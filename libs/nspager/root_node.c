@@ -61,6 +61,7 @@ TEST (TT_UNIT, rn_init_empty)
 
   test_assert_equal (rn_get_first_tmbst (&p), 1);
   test_assert_equal (rn_get_master_lsn (&p), 0);
+  test_assert_equal (rn_get_page_size (&p), PAGE_SIZE);
 }
 #endif
 
@@ -71,6 +72,13 @@ rn_validate_for_db (const page *p, error *e)
     {
       return error_causef (e, ERR_CORRUPT, "Invalid page header for root node");
     }
+  if (rn_get_page_size (p) != PAGE_SIZE)
+    {
+      return error_causef (
+          e, ERR_CORRUPT,
+          "Database page size %" PRp_size " does not match this build's page size %" PRp_size,
+          rn_get_page_size (p), PAGE_SIZE);
+    }
   return SUCCESS;
 }
 
@@ -109,6 +117,25 @@ TEST (TT_UNIT, rn_validate_for_db)
     page_init_empty (&p, PG_ROOT_NODE);
     test_assert_int_equal (rn_validate_for_db (&p, &e), SUCCESS);
   }
+
+  TEST_CASE ("Legacy (unrecorded) page size reads as 2048")
+  {
+    rand_bytes (p.raw, PAGE_SIZE);
+    page_init_empty (&p, PG_ROOT_NODE);
+    rn_set_page_size (&p, 0);
+    test_assert_int_equal (rn_get_page_size (&p), RN_LEGACY_PAGE_SIZE);
+    test_assert_int_equal (rn_validate_for_db (&p, &e), PAGE_SIZE == RN_LEGACY_PAGE_SIZE ? SUCCESS : ERR_CORRUPT);
+    e.cause_code = SUCCESS;
+  }
+
+  TEST_CASE ("Page size mismatch -> ERR_CORRUPT")
+  {
+    rand_bytes (p.raw, PAGE_SIZE);
+    page_init_empty (&p, PG_ROOT_NODE);
+    rn_set_page_size (&p, PAGE_SIZE * 2);
+    test_assert_int_equal (rn_validate_for_db (&p, &e), ERR_CORRUPT);
+    e.cause_code = SUCCESS;
+  }
 }
 #endif
 
@@ -142,6 +169,7 @@ i_log_rn (int level, const page *rn)
   i_printf (level, "PGNO: %" PRpgno "\n", rn->pg);
   i_printf (level, "FIRST TMBST: %" PRpgno "\n", rn_get_first_tmbst (rn));
   i_printf (level, "MASTER_LSN:  %" PRlsn "\n", rn_get_master_lsn (rn));
+  i_printf (level, "PAGE_SIZE:   %" PRp_size "\n", rn_get_page_size (rn));
 
   i_log (level, "=== ROOT NODE PAGE END ===\n");
 }
@@ -35,14 +35,14 @@
 #include "wal.h"
 
 #ifndef NTEST
-TEST (TT_UNIT, aries_checkpoint_basic_recovery)
+ARIES_TEST (aries_checkpoint_basic_recovery)
 {
   error e = error_create ();
 
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   u8 data[5][DL_DATA_SIZE];
@@ -80,7 +80,7 @@ TEST (TT_UNIT, aries_checkpoint_basic_recovery)
 
   // Crash and recover
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // Verify data survived through checkpoint recovery
@@ -113,7 +113,7 @@ TEST_disabled (TT_UNIT, aries_checkpoint_with_active_transactions)
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   u8 data1[3][DL_DATA_SIZE];
@@ -157,7 +157,7 @@ TEST_disabled (TT_UNIT, aries_checkpoint_with_active_transactions)
 
   // Crash with uncommitted transaction
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // Verify: tx1 data should survive, tx2 should be rolled back
@@ -195,14 +195,14 @@ TEST_disabled (TT_UNIT, aries_checkpoint_with_active_transactions)
 }
 
 // Test multiple checkpoints and recovery from latest
-TEST (TT_UNIT, aries_checkpoint_multiple_checkpoints)
+ARIES_TEST (aries_checkpoint_multiple_checkpoints)
 {
   error e = error_create ();
 
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   u8 data1[2][DL_DATA_SIZE];
@@ -286,7 +286,7 @@ TEST (TT_UNIT, aries_checkpoint_multiple_checkpoints)
 
   // Crash and recover - should use latest checkpoint
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // Verify all data survived
@@ -328,14 +328,14 @@ TEST (TT_UNIT, aries_checkpoint_multiple_checkpoints)
 }
 
 // Test checkpoint followed by post-checkpoint activity before crash
-TEST (TT_UNIT, aries_checkpoint_with_post_checkpoint_activity)
+ARIES_TEST (aries_checkpoint_with_post_checkpoint_activity)
 {
   error e = error_create ();
 
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   u8 data_before[3][DL_DATA_SIZE];
@@ -380,7 +380,7 @@ TEST (TT_UNIT, aries_checkpoint_with_post_checkpoint_activity)
 
   // Crash - recovery should process checkpoint + post-checkpoint log
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // Verify both before and after checkpoint data survived
@@ -43,7 +43,7 @@ TEST_disabled (TT_UNIT, aries_crash_before_commit)
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // NORMAL PROCESSING
@@ -67,7 +67,7 @@ TEST_disabled (TT_UNIT, aries_crash_before_commit)
 
   // REOPEN
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // VALIDATION
@@ -100,7 +100,7 @@ TEST_disabled (TT_UNIT, aries_crash_before_commit_multiple)
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   struct txn tx1, tx2;
@@ -125,7 +125,7 @@ TEST_disabled (TT_UNIT, aries_crash_before_commit_multiple)
 
   // REOPEN
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // NORMAL PROCESSING
@@ -149,7 +149,7 @@ TEST_disabled (TT_UNIT, aries_crash_before_commit_multiple)
 
   // REOPEN
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // VALIDATION
@@ -175,14 +175,14 @@ TEST_disabled (TT_UNIT, aries_crash_before_commit_multiple)
   test_err_t_wrap (pgr_close (p, &e), &e);
 }
 
-TEST (TT_UNIT, aries_crash_after_commit_before_end)
+ARIES_TEST (aries_crash_after_commit_before_end)
 {
   error e = error_create ();
 
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   u8 data[5][DL_DATA_SIZE];
@@ -212,7 +212,7 @@ TEST (TT_UNIT, aries_crash_after_commit_before_end)
 
   // REOPEN
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // VALIDATION
@@ -240,14 +240,14 @@ TEST (TT_UNIT, aries_crash_after_commit_before_end)
   test_err_t_wrap (pgr_close (p, &e), &e);
 }
 
-TEST (TT_UNIT, aries_crash_after_commit_before_end_multiple)
+ARIES_TEST (aries_crash_after_commit_before_end_multiple)
 {
   error e = error_create ();
 
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   u8 data[10][DL_DATA_SIZE];
@@ -277,7 +277,7 @@ TEST (TT_UNIT, aries_crash_after_commit_before_end_multiple)
 
   // REOPEN
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // NORMAL PROCESSING
@@ -303,7 +303,7 @@ TEST (TT_UNIT, aries_crash_after_commit_before_end_multiple)
 
   // REOPEN
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // VALIDATION
@@ -342,14 +342,14 @@ TEST (TT_UNIT, aries_crash_after_commit_before_end_multiple)
   test_err_t_wrap (pgr_close (p, &e), &e);
 }
 
-TEST (TT_UNIT, aries_crash_after_commit_before_end_multiple_second_no_commit)
+ARIES_TEST (aries_crash_after_commit_before_end_multiple_second_no_commit)
 {
   error e = error_create ();
 
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   u8 data[10][DL_DATA_SIZE];
@@ -379,7 +379,7 @@ TEST (TT_UNIT, aries_crash_after_commit_before_end_multiple_second_no_commit)
 
   // REOPEN
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // NORMAL PROCESSING
@@ -403,7 +403,7 @@ TEST (TT_UNIT, aries_crash_after_commit_before_end_multiple_second_no_commit)
 
   // REOPEN
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
   return;
 
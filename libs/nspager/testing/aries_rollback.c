@@ -43,7 +43,7 @@ TEST (TT_UNIT, aries_rollback_basic)
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // Create transaction and make changes
@@ -83,7 +83,7 @@ TEST (TT_UNIT, aries_rollback_multiple_updates)
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // Create and commit initial data
@@ -148,7 +148,7 @@ TEST_disabled (TT_UNIT, aries_rollback_with_crash_recovery)
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // Transaction 1: commit data
@@ -180,7 +180,7 @@ TEST_disabled (TT_UNIT, aries_rollback_with_crash_recovery)
 
   // Crash without commit or rollback
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // Verify data is back to committed state (&tx2 was rolled back during recovery)
@@ -198,7 +198,7 @@ TEST_disabled (TT_UNIT, aries_rollback_clr_not_undone)
   test_fail_if (i_remove_quiet ("test.db", &e));
   test_fail_if (i_remove_quiet ("test.wal", &e));
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // Create and commit initial page
@@ -239,7 +239,7 @@ TEST_disabled (TT_UNIT, aries_rollback_clr_not_undone)
 
   // Crash and recover to ensure CLRs are handled correctly
   test_fail_if (pgr_crash (p, &e));
-  p = pgr_open ("test.db", "test.wal", &e);
+  p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &e);
   test_fail_if_null (p);
 
   // Verify data is still initial (CLRs were not undone during recovery)
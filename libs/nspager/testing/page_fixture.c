@@ -72,7 +72,7 @@ pgr_fixture_create (struct pgr_fixture *dest)
   err_t_wrap (i_remove_quiet ("test.db", &dest->e), &dest->e);
   err_t_wrap (i_remove_quiet ("test.wal", &dest->e), &dest->e);
 
-  struct pager *p = pgr_open ("test.db", "test.wal", &dest->e);
+  struct pager *p = pgr_open ("test.db", "test.wal", MEMORY_PAGE_LEN, &dest->e);
   if (p == NULL)
     {
       return dest->e.cause_code;
@@ -29,6 +29,7 @@ txn_init (struct txn *dest, txid tid, struct txn_data data)
 {
   dest->data = data;
   dest->tid = tid;
+  dest->first_lsn = data.last_lsn;
   hnode_init (&dest->node, tid);
   spx_latch_init (&dest->l);
 }
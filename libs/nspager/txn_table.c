@@ -23,7 +23,6 @@
 #include <numstore/core/alloc.h>
 #include <numstore/core/assert.h>
 #include <numstore/core/clock_allocator.h>
-#include <numstore/core/dbl_buffer.h>
 #include <numstore/core/deserializer.h>
 #include <numstore/core/error.h>
 #include <numstore/core/hash_table.h>
@@ -290,6 +289,28 @@ txnt_max_u_undo_lsn (struct txn_table *t)
   return ctx.max;
 }
 
+static void
+find_min_first (struct txn *tx, void *vctx)
+{
+  lsn *min = vctx;
+
+  spx_latch_lock_s (&tx->l);
+  *min = MIN (*min, tx->first_lsn);
+  spx_latch_unlock_s (&tx->l);
+}
+
+lsn
+txnt_min_first_lsn (struct txn_table *t)
+{
+  lsn ret = (lsn)-1;
+
+  spx_latch_lock_s (&t->l);
+  txnt_foreach (t, find_min_first, &ret);
+  spx_latch_unlock_s (&t->l);
+
+  return ret;
+}
+
 static void
 i_log_txn (struct hnode *node, void *_log_level)
 {
@@ -322,14 +343,13 @@ struct merge_ctx
 {
   struct txn_table *dest;
   error *e;
-  struct dbl_buffer *txn_dest;
+  struct chunk_alloc *txn_dest;
 };
 
 static void
 merge_txn (struct txn *tx, void *vctx)
 {
   struct merge_ctx *ctx = vctx;
-  ASSERT (ctx->txn_dest == NULL || ctx->txn_dest->size == sizeof (struct txn));
 
   if (ctx->e->cause_code)
     {
@@ -340,27 +360,25 @@ merge_txn (struct txn *tx, void *vctx)
 
   if (txn_exists (ctx->dest, tx->tid))
     {
-      return;
+      goto theend;
     }
 
   // Allocate a new transaction to copy over
   struct txn *target_txn = tx;
   if (ctx->txn_dest)
     {
-      target_txn = dblb_append_alloc (ctx->txn_dest, 1, ctx->e);
+      target_txn = chunk_malloc (ctx->txn_dest, 1, sizeof *target_txn, ctx->e);
       if (target_txn == NULL)
         {
-          return;
+          goto theend;
         }
       txn_init (target_txn, tx->tid, tx->data);
     }
 
   // Insert into the table
-  if (txnt_insert_txn (ctx->dest, target_txn, ctx->e))
-    {
-      return;
-    }
+  txnt_insert_txn (ctx->dest, target_txn, ctx->e);
 
+theend:
   spx_latch_unlock_s (&tx->l);
 }
 
@@ -368,7 +386,7 @@ err_t
 txnt_merge_into (
     struct txn_table *dest,
     struct txn_table *src,
-    struct dbl_buffer *txn_dest,
+    struct chunk_alloc *txn_dest,
     error *e)
 {
   struct merge_ctx ctx = {
@@ -384,6 +402,68 @@ txnt_merge_into (
   return ctx.e->cause_code;
 }
 
+struct snapshot_ctx
+{
+  struct txn *bank;
+  u32 len;
+};
+
+static void
+snapshot_txn (struct txn *tx, void *vctx)
+{
+  struct snapshot_ctx *ctx = vctx;
+  struct txn *dest = &ctx->bank[ctx->len++];
+
+  spx_latch_lock_s (&tx->l);
+  txn_init (dest, tx->tid, tx->data);
+  dest->first_lsn = tx->first_lsn;
+  spx_latch_unlock_s (&tx->l);
+}
+
+err_t
+txnt_snapshot (struct txn_table *dest, struct txn **txn_bank, struct txn_table *src, error *e)
+{
+  ASSERT (txn_bank);
+
+  // [src] is only latched for the copy
+  spx_latch_lock_s (&src->l);
+
+  u32 len = adptv_htable_size (&src->t);
+  struct snapshot_ctx ctx = {
+    .bank = i_malloc (MAX (len, 1), sizeof (struct txn), e),
+    .len = 0,
+  };
+  if (ctx.bank == NULL)
+    {
+      spx_latch_unlock_s (&src->l);
+      return e->cause_code;
+    }
+
+  txnt_foreach (src, snapshot_txn, &ctx);
+
+  spx_latch_unlock_s (&src->l);
+
+  if (txnt_open (dest, e))
+    {
+      i_free (ctx.bank);
+      return e->cause_code;
+    }
+
+  for (u32 i = 0; i < ctx.len; ++i)
+    {
+      if (txnt_insert_txn (dest, &ctx.bank[i], e))
+        {
+          txnt_close (dest);
+          i_free (ctx.bank);
+          return e->cause_code;
+        }
+    }
+
+  *txn_bank = ctx.bank;
+
+  return SUCCESS;
+}
+
 struct foreach_ctx
 {
   void (*action) (struct txn *, void *ctx);
@@ -1506,6 +1586,41 @@ TEST (TT_UNIT, txnt_merge_into_with_data)
   txnt_close (&src);
 }
 
+TEST (TT_UNIT, txnt_snapshot)
+{
+  error e = error_create ();
+  struct txn_table src, snap;
+  struct txn *bank = NULL;
+  test_err_t_wrap (txnt_open (&src, &e), &e);
+
+  struct txn txns[5];
+  for (int i = 0; i < 5; i++)
+    {
+      txn_init (&txns[i], i + 1, (struct txn_data){
+                                     .last_lsn = (i + 1) * 10,
+                                     .undo_next_lsn = (i + 1) * 10 - 1,
+                                     .state = TX_RUNNING,
+                                 });
+      test_err_t_wrap (txnt_insert_txn (&src, &txns[i], &e), &e);
+    }
+
+  test_err_t_wrap (txnt_snapshot (&snap, &bank, &src, &e), &e);
+  test_assert (txnt_equal (&snap, &src));
+
+  // Later changes to src don't show up in the copy
+  txns[0].data.last_lsn = 1000;
+  test_err_t_wrap (txnt_remove_txn_expect (&src, &txns[4], &e), &e);
+
+  struct txn *tx;
+  test_assert (txnt_get (&tx, &snap, 1));
+  test_assert_int_equal (tx->data.last_lsn, 10);
+  test_assert (txn_exists (&snap, 5));
+
+  txnt_close (&snap);
+  i_free (bank);
+  txnt_close (&src);
+}
+
 TEST (TT_UNIT, txnt_merge_into_no_duplicate_insert)
 {
   error e = error_create ();
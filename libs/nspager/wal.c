@@ -70,137 +70,145 @@ wal_write_mode (struct wal *w, error *e)
   return walf_write_mode (&w->wf, e);
 }
 
+err_t
+wal_truncate (struct wal *w, lsn l, error *e)
+{
+  DBG_ASSERT (wal, w);
+  return walf_truncate (&w->wf, l, e);
+}
+
+err_t
+wal_remove (const char *fname, error *e)
+{
+  return walf_remove (fname, e);
+}
+
 //////////////////////////////////////////////////////////////
 //////// Append Primitives
 
 slsn
 wal_append_begin_log (struct wal *w, txid tid, error *e)
 {
-  latch_lock (&w->latch);
-
   DBG_ASSERT (wal, w);
 
-  w->whdr.type = WL_BEGIN;
-  w->whdr.begin = (struct wal_begin){
+  struct wal_rec_hdr_write whdr;
+  whdr.type = WL_BEGIN;
+  whdr.begin = (struct wal_begin){
     .tid = tid,
   };
 
-  slsn result = walf_write (&w->wf, &w->whdr, e);
-
-  latch_unlock (&w->latch);
-
-  return result;
+  return walf_write (&w->wf, &whdr, e);
 }
 
 slsn
 wal_append_commit_log (struct wal *w, txid tid, lsn prev, error *e)
 {
-  latch_lock (&w->latch);
-
   DBG_ASSERT (wal, w);
 
-  w->whdr.type = WL_COMMIT;
-  w->whdr.commit = (struct wal_commit){
+  struct wal_rec_hdr_write whdr;
+  whdr.type = WL_COMMIT;
+  whdr.commit = (struct wal_commit){
     .prev = prev,
     .tid = tid,
   };
 
-  slsn result = walf_write (&w->wf, &w->whdr, e);
-
-  latch_unlock (&w->latch);
+  return walf_write (&w->wf, &whdr, e);
+}
 
-  return result;
+lsn
+wal_commit_log_end (lsn l)
+{
+  return walf_commit_end (l);
 }
 
 slsn
 wal_append_end_log (struct wal *w, txid tid, lsn prev, error *e)
 {
-  latch_lock (&w->latch);
-
   DBG_ASSERT (wal, w);
 
-  w->whdr.type = WL_END;
-  w->whdr.end = (struct wal_end){
+  struct wal_rec_hdr_write whdr;
+  whdr.type = WL_END;
+  whdr.end = (struct wal_end){
     .prev = prev,
     .tid = tid,
   };
 
-  slsn result = walf_write (&w->wf, &w->whdr, e);
-
-  latch_unlock (&w->latch);
-
-  return result;
+  return walf_write (&w->wf, &whdr, e);
 }
 
 slsn
 wal_append_update_log (struct wal *w, struct wal_update_write update, error *e)
 {
-  latch_lock (&w->latch);
-
   DBG_ASSERT (wal, w);
 
-  w->whdr.type = WL_UPDATE;
-  w->whdr.update = update;
+  struct wal_rec_hdr_write whdr;
+  whdr.type = WL_UPDATE;
+  whdr.update = update;
 
-  slsn result = walf_write (&w->wf, &w->whdr, e);
+  return walf_write (&w->wf, &whdr, e);
+}
 
-  latch_unlock (&w->latch);
+slsn
+wal_append_update_delta_log (struct wal *w, struct wal_update_write update, error *e)
+{
+  DBG_ASSERT (wal, w);
+
+  struct wal_rec_hdr_write whdr;
+  whdr.type = WL_UPDATE_DELTA;
+  whdr.update = update;
 
-  return result;
+  return walf_write (&w->wf, &whdr, e);
 }
 
 slsn
-wal_append_clr_log (struct wal *w, struct wal_clr_write clr, error *e)
+wal_append_dl_insert_log (struct wal *w, struct wal_dl_insert_write ins, error *e)
 {
-  latch_lock (&w->latch);
-
   DBG_ASSERT (wal, w);
 
-  w->whdr.type = WL_CLR;
-  w->whdr.clr = clr;
+  struct wal_rec_hdr_write whdr;
+  whdr.type = WL_DL_INSERT;
+  whdr.dl_insert = ins;
 
-  slsn result = walf_write (&w->wf, &w->whdr, e);
+  return walf_write (&w->wf, &whdr, e);
+}
 
-  latch_unlock (&w->latch);
+slsn
+wal_append_clr_log (struct wal *w, struct wal_clr_write clr, error *e)
+{
+  DBG_ASSERT (wal, w);
 
-  return result;
+  struct wal_rec_hdr_write whdr;
+  whdr.type = WL_CLR;
+  whdr.clr = clr;
+
+  return walf_write (&w->wf, &whdr, e);
 }
 
 slsn
 wal_append_ckpt_begin (struct wal *w, error *e)
 {
-  latch_lock (&w->latch);
-
   DBG_ASSERT (wal, w);
 
-  w->whdr.type = WL_CKPT_BEGIN;
-
-  slsn result = walf_write (&w->wf, &w->whdr, e);
+  struct wal_rec_hdr_write whdr;
+  whdr.type = WL_CKPT_BEGIN;
 
-  latch_unlock (&w->latch);
-
-  return result;
+  return walf_write (&w->wf, &whdr, e);
 }
 
 slsn
 wal_append_ckpt_end (struct wal *w, struct txn_table *att, struct dpg_table *dpt, error *e)
 {
-  latch_lock (&w->latch);
-
   DBG_ASSERT (wal, w);
 
-  w->whdr.type = WL_CKPT_END;
+  struct wal_rec_hdr_write whdr;
+  whdr.type = WL_CKPT_END;
 
-  w->whdr.ckpt_end = (struct wal_ckpt_end_write){
+  whdr.ckpt_end = (struct wal_ckpt_end_write){
     .att = att,
     .dpt = dpt,
   };
 
-  slsn result = walf_write (&w->wf, &w->whdr, e);
-
-  latch_unlock (&w->latch);
-
-  return result;
+  return walf_write (&w->wf, &whdr, e);
 }
 
 slsn
@@ -224,6 +232,14 @@ wal_append_log (struct wal *ww, struct wal_rec_hdr_write *whdr, error *e)
       {
         return wal_append_update_log (ww, whdr->update, e);
       }
+    case WL_UPDATE_DELTA:
+      {
+        return wal_append_update_delta_log (ww, whdr->update, e);
+      }
+    case WL_DL_INSERT:
+      {
+        return wal_append_dl_insert_log (ww, whdr->dl_insert, e);
+      }
     case WL_CLR:
       {
         return wal_append_clr_log (ww, whdr->clr, e);
@@ -255,6 +271,27 @@ wal_flush_all (struct wal *w, error *e)
   return walf_flush_all (&w->wf, e);
 }
 
+err_t
+wal_flush_to (struct wal *w, lsn l, error *e)
+{
+  DBG_ASSERT (wal, w);
+  return walf_flush_to (&w->wf, l, e);
+}
+
+lsn
+wal_get_next_lsn (struct wal *w)
+{
+  DBG_ASSERT (wal, w);
+  return walf_get_next_lsn (&w->wf);
+}
+
+lsn
+wal_get_flushed_lsn (struct wal *w)
+{
+  DBG_ASSERT (wal, w);
+  return walf_get_flushed_lsn (&w->wf);
+}
+
 //////////////////////////////////////////////////////////////
 //////// Read Primitive
 
@@ -304,7 +341,7 @@ TEST_disabled (TT_UNIT, wal)
   struct txn_table att2;
   struct dpg_table *dpt1 = NULL, *dpt2 = NULL;
 
-  test_err_t_wrap (i_remove_quiet ("test.wal", &e), &e);
+  test_err_t_wrap (wal_remove ("test.wal", &e), &e);
   test_err_t_wrap (wal_open (&ww, "test.wal", &e), &e);
 
   decl_rand_buffer (undo1, u8, PAGE_SIZE);
@@ -372,9 +409,9 @@ TEST_disabled (TT_UNIT, wal)
 
   // Allocate and store in variables for proper cleanup
   test_err_t_wrap (txnt_open (&att1, &e), &e);
-  dpt1 = dpgt_open (&e);
+  dpt1 = dpgt_open (MEMORY_PAGE_LEN, &e);
   test_err_t_wrap (txnt_open (&att2, &e), &e);
-  dpt2 = dpgt_open (&e);
+  dpt2 = dpgt_open (MEMORY_PAGE_LEN, &e);
 
   test_fail_if_null (dpt1);
   test_fail_if_null (dpt2);
@@ -25,10 +25,9 @@
 
 struct wal
 {
-  struct latch latch;
+  struct latch latch; // Reads share [rhdr] - appends don't lock
   struct wal_file wf;
   struct wal_rec_hdr_read rhdr;
-  struct wal_rec_hdr_write whdr;
   struct thread_pool *tp;
 };
 
@@ -38,9 +37,14 @@ void wal_set_thread_pool (struct wal *w, struct thread_pool *tp);
 err_t wal_reset (struct wal *dest, error *e);
 err_t wal_close (struct wal *w, error *e);
 err_t wal_write_mode (struct wal *w, error *e);
+err_t wal_truncate (struct wal *w, lsn l, error *e); // Drops segments wholly before [l]
+err_t wal_remove (const char *fname, error *e);      // Deletes the anchor and every segment
 
 // FLUSH
 err_t wal_flush_all (struct wal *w, error *e);
+err_t wal_flush_to (struct wal *w, lsn l, error *e); // No-op if [l] is already durable
+lsn wal_get_next_lsn (struct wal *w);    // End of everything appended so far
+lsn wal_get_flushed_lsn (struct wal *w); // End of everything durable
 
 // READ
 struct wal_rec_hdr_read *wal_read_next (struct wal *w, lsn *read_lsn, error *e);
@@ -51,6 +55,7 @@ slsn wal_append_begin_log (struct wal *w, txid tid, error *e);
 
 // COMMIT
 slsn wal_append_commit_log (struct wal *w, txid tid, lsn prev, error *e);
+lsn wal_commit_log_end (lsn l); // End of the commit log at [l] - what has to be durable
 
 // END
 slsn wal_append_end_log (struct wal *w, txid tid, lsn prev, error *e);
@@ -64,6 +69,12 @@ slsn wal_append_ckpt_end (struct wal *w, struct txn_table *att, struct dpg_table
 // UPDATE
 slsn wal_append_update_log (struct wal *w, struct wal_update_write update, error *e);
 
+// UPDATE (changed byte ranges only)
+slsn wal_append_update_delta_log (struct wal *w, struct wal_update_write update, error *e);
+
+// DATA LIST INSERT
+slsn wal_append_dl_insert_log (struct wal *w, struct wal_dl_insert_write ins, error *e);
+
 // CLR
 slsn wal_append_clr_log (struct wal *w, struct wal_clr_write clr, error *e);
 
@@ -22,6 +22,7 @@
 #include <numstore/core/assert.h>
 #include <numstore/core/checksums.h>
 #include <numstore/core/error.h>
+#include <numstore/core/lz4.h>
 #include <numstore/core/spx_latch.h>
 #include <numstore/intf/logging.h>
 #include <numstore/intf/os.h>
@@ -31,6 +32,7 @@
 #include <numstore/pager/wal_stream.h>
 #include <numstore/test/testing.h>
 
+
 DEFINE_DBG_ASSERT (
     struct wal_file, wal_file, w, {
       ASSERT (w);
@@ -104,11 +106,17 @@ err_t
 walf_reset (struct wal_file *dest, error *e)
 {
   err_t_wrap (walf_close (dest, e), e);
-  err_t_wrap (i_remove_quiet (dest->fname, e), e);
+  err_t_wrap (walseg_remove_all (dest->fname, e), e);
   err_t_wrap (walf_open (dest, dest->fname, e), e);
   return SUCCESS;
 }
 
+err_t
+walf_remove (const char *fname, error *e)
+{
+  return walseg_remove_all (fname, e);
+}
+
 err_t
 walf_close (struct wal_file *w, error *e)
 {
@@ -120,6 +128,31 @@ walf_close (struct wal_file *w, error *e)
   return e->cause_code;
 }
 
+lsn
+walf_get_next_lsn (struct wal_file *w)
+{
+  DBG_ASSERT (wal_file, w);
+
+  // Nothing written yet
+  if (w->current_ostream == NULL)
+    {
+      return 0;
+    }
+  return walos_get_next_lsn (w->current_ostream);
+}
+
+lsn
+walf_get_flushed_lsn (struct wal_file *w)
+{
+  DBG_ASSERT (wal_file, w);
+
+  if (w->current_ostream == NULL)
+    {
+      return 0;
+    }
+  return walos_get_flushed_lsn (w->current_ostream);
+}
+
 err_t
 walf_write_mode (struct wal_file *w, error *e)
 {
@@ -128,258 +161,417 @@ walf_write_mode (struct wal_file *w, error *e)
   return walf_lazy_istream_close (w, e);
 }
 
+err_t
+walf_truncate (struct wal_file *w, lsn l, error *e)
+{
+  DBG_ASSERT (wal_file, w);
+
+  spx_latch_lock_x (&w->l);
+
+  // The reader may hold a segment that's about to be recycled
+  err_t_wrap_goto (walf_lazy_istream_close (w, e), theend, e);
+  err_t_wrap_goto (walf_lazy_ostream_init (w, e), theend, e);
+  err_t_wrap_goto (walos_truncate (w->current_ostream, l, e), theend, e);
+
+theend:
+  spx_latch_unlock_x (&w->l);
+  return e->cause_code;
+}
+
 /////////////////////////////////////////////
 /// WRITE
 
+/**
+ * Compresses [len] bytes of [src] into [dest] (at least [len] bytes).
+ * Returns the compressed length, or 0 if compressing doesn't save
+ * at least WAL_COMPRESS_MIN_SAVING bytes over the raw record
+ */
+static inline u32
+walf_compress (u8 *dest, const u8 *src, u32 len)
+{
+  if (len <= WAL_COMPRESS_MIN_SAVING + sizeof (u32))
+    {
+      return 0;
+    }
+
+  // The compressed record also stores its length
+  u32 cap = len - WAL_COMPRESS_MIN_SAVING - sizeof (u32);
+
+  return lz4_compress (dest, cap, src, len);
+}
+
+/**
+ * A record built up in one contiguous buffer, so it goes into the log
+ * with a single reservation instead of a latched write per field
+ */
+struct walf_rec
+{
+  u8 *data;
+  u32 len;
+  u32 cap;
+};
+
+// Headers, the delta range table and the crc on top of two page images
+#define WALF_REC_OVERHEAD ((u32)512)
+#define WALF_REC_CAP (2 * PAGE_SIZE + WALF_REC_OVERHEAD)
+
+static inline void
+walf_put (struct walf_rec *r, const void *src, u32 len)
+{
+  ASSERT (r->len + len <= r->cap);
+  i_memcpy (r->data + r->len, src, len);
+  r->len += len;
+}
+
+/**
+ * Returns with [w->l] held in S and the ostream open. Appends only
+ * need S - the ostream orders them itself
+ */
 static inline err_t
-walf_write_update (struct wal_file *w, const struct wal_rec_hdr_write *r, error *e)
+walf_lock_ostream (struct wal_file *w, error *e)
 {
-  DBG_ASSERT (wal_file, w);
+  spx_latch_lock_s (&w->l);
+  if (w->current_ostream != NULL)
+    {
+      return SUCCESS;
+    }
+  spx_latch_unlock_s (&w->l);
 
   spx_latch_lock_x (&w->l);
+  if (walf_lazy_ostream_init (w, e))
+    {
+      spx_latch_unlock_x (&w->l);
+      return e->cause_code;
+    }
+  spx_latch_downgrade_x_s (&w->l);
 
-  err_t_wrap_goto (walf_lazy_ostream_init (w, e), theend, e);
+  return SUCCESS;
+}
 
+/**
+ * Seals [r] with its crc and appends it
+ */
+static inline slsn
+walf_append (struct wal_file *w, struct walf_rec *r, error *e)
+{
   u32 checksum = checksum_init ();
+  checksum_execute (&checksum, r->data, r->len);
+  walf_put (r, &checksum, sizeof (u32));
+
+  err_t_wrap (walf_lock_ostream (w, e), e);
+
+  lsn ret;
+  err_t err = walos_append (w->current_ostream, &ret, r->data, r->len, e);
+
+  spx_latch_unlock_s (&w->l);
+
+  err_t_wrap (err, e);
+
+  return ret;
+}
+
+static inline slsn
+walf_write_update (struct wal_file *w, const struct wal_rec_hdr_write *r, error *e)
+{
+  DBG_ASSERT (wal_file, w);
+
+  u8 raw[2 * PAGE_SIZE];
+  u8 buf[WALF_REC_CAP];
+  struct walf_rec rec = { .data = buf, .len = 0, .cap = sizeof (buf) };
+
+  i_memcpy (raw, r->update.undo, PAGE_SIZE);
+  i_memcpy (raw + PAGE_SIZE, r->update.redo, PAGE_SIZE);
+
   wlh t = (wlh)r->type;
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &t, sizeof (wlh), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &r->update.tid, sizeof (txid), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &r->update.prev, sizeof (lsn), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &r->update.pg, sizeof (pgno), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, r->update.undo, PAGE_SIZE, e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, r->update.redo, PAGE_SIZE, e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, NULL, &checksum, sizeof (u32), e), theend, e);
+  walf_put (&rec, &t, sizeof (wlh));
+  walf_put (&rec, &r->update.tid, sizeof (txid));
+  walf_put (&rec, &r->update.prev, sizeof (lsn));
+  walf_put (&rec, &r->update.pg, sizeof (pgno));
+
+  // Compressed straight into the record, past where its length goes
+  u32 clen = walf_compress (buf + rec.len + sizeof (u32), raw, 2 * PAGE_SIZE);
+  if (clen > 0)
+    {
+      t |= WL_COMPRESSED;
+      i_memcpy (buf, &t, sizeof (wlh));
+      walf_put (&rec, &clen, sizeof (u32));
+      rec.len += clen;
+    }
+  else
+    {
+      walf_put (&rec, raw, 2 * PAGE_SIZE);
+    }
 
-theend:
-  spx_latch_unlock_x (&w->l);
-  return e->cause_code;
+  return walf_append (w, &rec, e);
 }
 
-static inline err_t
+static inline slsn
+walf_write_update_delta (struct wal_file *w, const struct wal_rec_hdr_write *r, error *e)
+{
+  DBG_ASSERT (wal_file, w);
+  ASSERT (r->type == WL_UPDATE_DELTA);
+  ASSERT (r->update.nranges <= WAL_DELTA_MAX_RANGES);
+
+  u8 buf[WALF_REC_CAP];
+  struct walf_rec rec = { .data = buf, .len = 0, .cap = sizeof (buf) };
+
+  wlh t = (wlh)r->type;
+  walf_put (&rec, &t, sizeof (wlh));
+  walf_put (&rec, &r->update.tid, sizeof (txid));
+  walf_put (&rec, &r->update.prev, sizeof (lsn));
+  walf_put (&rec, &r->update.pg, sizeof (pgno));
+  walf_put (&rec, &r->update.nranges, sizeof (u32));
+
+  // Range table, then the undo bytes, then the redo bytes
+  for (u32 i = 0; i < r->update.nranges; ++i)
+    {
+      const struct wal_range *rg = &r->update.ranges[i];
+      walf_put (&rec, &rg->ofst, sizeof (p_size));
+      walf_put (&rec, &rg->len, sizeof (p_size));
+    }
+  for (u32 i = 0; i < r->update.nranges; ++i)
+    {
+      const struct wal_range *rg = &r->update.ranges[i];
+      walf_put (&rec, r->update.undo + rg->ofst, rg->len);
+    }
+  for (u32 i = 0; i < r->update.nranges; ++i)
+    {
+      const struct wal_range *rg = &r->update.ranges[i];
+      walf_put (&rec, r->update.redo + rg->ofst, rg->len);
+    }
+
+  return walf_append (w, &rec, e);
+}
+
+static inline slsn
+walf_write_dl_insert (struct wal_file *w, const struct wal_rec_hdr_write *r, error *e)
+{
+  DBG_ASSERT (wal_file, w);
+  ASSERT (r->type == WL_DL_INSERT);
+  ASSERT (r->dl_insert.len <= PAGE_SIZE);
+
+  u8 buf[PAGE_SIZE + WALF_REC_OVERHEAD];
+  struct walf_rec rec = { .data = buf, .len = 0, .cap = sizeof (buf) };
+
+  wlh t = (wlh)r->type;
+  walf_put (&rec, &t, sizeof (wlh));
+  walf_put (&rec, &r->dl_insert.tid, sizeof (txid));
+  walf_put (&rec, &r->dl_insert.prev, sizeof (lsn));
+  walf_put (&rec, &r->dl_insert.pg, sizeof (pgno));
+  walf_put (&rec, &r->dl_insert.ofst, sizeof (p_size));
+  walf_put (&rec, &r->dl_insert.len, sizeof (p_size));
+  if (r->dl_insert.len > 0)
+    {
+      walf_put (&rec, r->dl_insert.data, r->dl_insert.len);
+    }
+
+  return walf_append (w, &rec, e);
+}
+
+static inline slsn
 walf_write_clr (struct wal_file *w, const struct wal_rec_hdr_write *r, error *e)
 {
   DBG_ASSERT (wal_file, w);
   ASSERT (r->type == WL_CLR);
   ASSERT (r->clr.undo_next != 0);
 
-  spx_latch_lock_x (&w->l);
-
-  err_t_wrap_goto (walf_lazy_ostream_init (w, e), theend, e);
+  u8 buf[PAGE_SIZE + WALF_REC_OVERHEAD];
+  struct walf_rec rec = { .data = buf, .len = 0, .cap = sizeof (buf) };
 
-  u32 checksum = checksum_init ();
   wlh t = r->type;
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &t, sizeof (wlh), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &r->clr.tid, sizeof (txid), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &r->clr.prev, sizeof (lsn), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &r->clr.pg, sizeof (pgno), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &r->clr.undo_next, sizeof (lsn), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, r->clr.redo, PAGE_SIZE, e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, NULL, &checksum, sizeof (u32), e), theend, e);
+  walf_put (&rec, &t, sizeof (wlh));
+  walf_put (&rec, &r->clr.tid, sizeof (txid));
+  walf_put (&rec, &r->clr.prev, sizeof (lsn));
+  walf_put (&rec, &r->clr.pg, sizeof (pgno));
+  walf_put (&rec, &r->clr.undo_next, sizeof (lsn));
+
+  u32 clen = walf_compress (buf + rec.len + sizeof (u32), r->clr.redo, PAGE_SIZE);
+  if (clen > 0)
+    {
+      t |= WL_COMPRESSED;
+      i_memcpy (buf, &t, sizeof (wlh));
+      walf_put (&rec, &clen, sizeof (u32));
+      rec.len += clen;
+    }
+  else
+    {
+      walf_put (&rec, r->clr.redo, PAGE_SIZE);
+    }
 
-theend:
-  spx_latch_unlock_x (&w->l);
-  return e->cause_code;
+  return walf_append (w, &rec, e);
 }
 
-static inline err_t
+static inline slsn
 walf_write_begin (struct wal_file *w, const struct wal_rec_hdr_write *r, error *e)
 {
   DBG_ASSERT (wal_file, w);
   ASSERT (r->type == WL_BEGIN);
 
-  spx_latch_lock_x (&w->l);
-
-  err_t_wrap_goto (walf_lazy_ostream_init (w, e), theend, e);
+  u8 buf[WALF_REC_OVERHEAD];
+  struct walf_rec rec = { .data = buf, .len = 0, .cap = sizeof (buf) };
 
-  u32 checksum = checksum_init ();
   wlh t = r->type;
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &t, sizeof (wlh), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &r->begin.tid, sizeof (txid), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, NULL, &checksum, sizeof (u32), e), theend, e);
+  walf_put (&rec, &t, sizeof (wlh));
+  walf_put (&rec, &r->begin.tid, sizeof (txid));
 
-theend:
-  spx_latch_unlock_x (&w->l);
-  return e->cause_code;
+  return walf_append (w, &rec, e);
 }
 
-static inline err_t
+static inline slsn
 walf_write_commit (struct wal_file *w, const struct wal_rec_hdr_write *r, error *e)
 {
   DBG_ASSERT (wal_file, w);
   ASSERT (r->type == WL_COMMIT);
 
-  spx_latch_lock_x (&w->l);
-
-  err_t_wrap_goto (walf_lazy_ostream_init (w, e), theend, e);
+  u8 buf[WALF_REC_OVERHEAD];
+  struct walf_rec rec = { .data = buf, .len = 0, .cap = sizeof (buf) };
 
-  u32 checksum = checksum_init ();
   wlh t = r->type;
-  txid tid = r->commit.tid;
-  lsn prev = r->commit.prev;
+  walf_put (&rec, &t, sizeof (wlh));
+  walf_put (&rec, &r->commit.tid, sizeof (txid));
+  walf_put (&rec, &r->commit.prev, sizeof (lsn));
 
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &t, sizeof (wlh), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &tid, sizeof (txid), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &prev, sizeof (lsn), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, NULL, &checksum, sizeof (u32), e), theend, e);
+  return walf_append (w, &rec, e);
+}
 
-theend:
-  spx_latch_unlock_x (&w->l);
-  return e->cause_code;
+lsn
+walf_commit_end (lsn start)
+{
+  // Type, tid, prev and the crc - commit records never compress
+  return start + sizeof (wlh) + sizeof (txid) + sizeof (lsn) + sizeof (u32);
 }
 
-static inline err_t
+static inline slsn
 walf_write_end (struct wal_file *w, const struct wal_rec_hdr_write *r, error *e)
 {
   DBG_ASSERT (wal_file, w);
   ASSERT (r->type == WL_END);
 
-  spx_latch_lock_x (&w->l);
-
-  err_t_wrap_goto (walf_lazy_ostream_init (w, e), theend, e);
+  u8 buf[WALF_REC_OVERHEAD];
+  struct walf_rec rec = { .data = buf, .len = 0, .cap = sizeof (buf) };
 
-  u32 checksum = checksum_init ();
   wlh t = r->type;
-  txid tid = r->end.tid;
-  lsn prev = r->end.prev;
-
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &t, sizeof (wlh), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &tid, sizeof (txid), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &prev, sizeof (lsn), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, NULL, &checksum, sizeof (u32), e), theend, e);
+  walf_put (&rec, &t, sizeof (wlh));
+  walf_put (&rec, &r->end.tid, sizeof (txid));
+  walf_put (&rec, &r->end.prev, sizeof (lsn));
 
-theend:
-  spx_latch_unlock_x (&w->l);
-  return e->cause_code;
+  return walf_append (w, &rec, e);
 }
 
-static inline err_t
+static inline slsn
 walf_write_ckpt_begin (struct wal_file *w, const struct wal_rec_hdr_write *r, error *e)
 {
   DBG_ASSERT (wal_file, w);
   ASSERT (r->type == WL_CKPT_BEGIN);
 
-  spx_latch_lock_x (&w->l);
-
-  err_t_wrap_goto (walf_lazy_ostream_init (w, e), theend, e);
+  u8 buf[WALF_REC_OVERHEAD];
+  struct walf_rec rec = { .data = buf, .len = 0, .cap = sizeof (buf) };
 
-  u32 checksum = checksum_init ();
   wlh t = r->type;
-  err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, &t, sizeof (wlh), e), theend, e);
-  err_t_wrap_goto (walos_write_all (w->current_ostream, NULL, &checksum, sizeof (u32), e), theend, e);
+  walf_put (&rec, &t, sizeof (wlh));
 
-theend:
-  spx_latch_unlock_x (&w->l);
-  return e->cause_code;
+  return walf_append (w, &rec, e);
 }
 
-static inline err_t
+static inline slsn
 walf_write_ckpt_end (struct wal_file *w, const struct wal_rec_hdr_write *r, error *e)
 {
   DBG_ASSERT (wal_file, w);
   ASSERT (r->type == WL_CKPT_END);
 
-  spx_latch_lock_x (&w->l);
-
-  err_t_wrap_goto (walf_lazy_ostream_init (w, e), theend, e);
-
-  u32 checksum = checksum_init ();
-  wlh t = r->type;
-
   u32 attsize = txnt_get_serialize_size (r->ckpt_end.att);
-  u8 dpgt_serialized[MAX_DPGT_SRL_SIZE];
-  u32 dptsize = dpgt_serialize (dpgt_serialized, r->ckpt_end.dpt);
 
-  err_t_wrap (walos_write_all (w->current_ostream, &checksum, &t, sizeof (wlh), e), e);
-  err_t_wrap (walos_write_all (w->current_ostream, &checksum, &attsize, sizeof (attsize), e), e);
-  err_t_wrap (walos_write_all (w->current_ostream, &checksum, &dptsize, sizeof (dptsize), e), e);
+  // Bounded by the table's capacity, which follows the buffer pool size
+  u32 dptcap = dpgt_max_serialize_size (r->ckpt_end.dpt);
 
-  // Transaction table
-  if (attsize > 0)
+  u32 cap = sizeof (wlh) + 3 * sizeof (u32) + attsize + dptcap;
+  u8 *buf = i_malloc (cap, 1, e);
+  if (buf == NULL)
     {
-      void *att_serialized = i_malloc (attsize, 1, e);
-      if (att_serialized == NULL)
-        {
-          goto theend;
-        }
-      txnt_serialize (att_serialized, attsize, r->ckpt_end.att);
-
-      err_t ret = walos_write_all (w->current_ostream, &checksum, att_serialized, attsize, e);
-      i_free (att_serialized);
-
-      err_t_wrap_goto (ret, theend, e);
+      return e->cause_code;
     }
+  struct walf_rec rec = { .data = buf, .len = 0, .cap = cap };
 
-  // Dirty page table
-  if (dptsize > 0)
+  // Tables are serialized in place once their sizes are written
+  u32 head = sizeof (wlh) + 2 * sizeof (u32);
+  if (attsize > 0)
     {
-      err_t_wrap_goto (walos_write_all (w->current_ostream, &checksum, dpgt_serialized, dptsize, e), theend, e);
+      txnt_serialize (buf + head, attsize, r->ckpt_end.att);
     }
+  u32 dptsize = dpgt_serialize (buf + head + attsize, dptcap, r->ckpt_end.dpt);
+
+  wlh t = r->type;
+  walf_put (&rec, &t, sizeof (wlh));
+  walf_put (&rec, &attsize, sizeof (attsize));
+  walf_put (&rec, &dptsize, sizeof (dptsize));
+  rec.len += attsize + dptsize;
 
-  err_t_wrap (walos_write_all (w->current_ostream, NULL, &checksum, sizeof (u32), e), e);
+  slsn ret = walf_append (w, &rec, e);
 
-theend:
-  spx_latch_unlock_x (&w->l);
-  return SUCCESS;
+  i_free (buf);
+
+  return ret;
 }
 
 slsn
 walf_write (struct wal_file *w, const struct wal_rec_hdr_write *r, error *e)
 {
   DBG_ASSERT (wal_file, w);
-  err_t_wrap (walf_lazy_ostream_init (w, e), e);
-
-  lsn ret = walos_get_next_lsn (w->current_ostream);
 
   switch (r->type)
     {
     case WL_BEGIN:
       {
-        err_t_wrap (walf_write_begin (w, r, e), e);
-        break;
+        return walf_write_begin (w, r, e);
       }
 
     case WL_COMMIT:
       {
-        err_t_wrap (walf_write_commit (w, r, e), e);
-        break;
+        return walf_write_commit (w, r, e);
       }
 
     case WL_END:
       {
-        err_t_wrap (walf_write_end (w, r, e), e);
-        break;
+        return walf_write_end (w, r, e);
       }
 
     case WL_UPDATE:
       {
-        err_t_wrap (walf_write_update (w, r, e), e);
-        break;
+        return walf_write_update (w, r, e);
+      }
+
+    case WL_UPDATE_DELTA:
+      {
+        return walf_write_update_delta (w, r, e);
+      }
+
+    case WL_DL_INSERT:
+      {
+        return walf_write_dl_insert (w, r, e);
       }
 
     case WL_CLR:
       {
-        err_t_wrap (walf_write_clr (w, r, e), e);
-        break;
+        return walf_write_clr (w, r, e);
       }
 
     case WL_CKPT_BEGIN:
       {
-        err_t_wrap (walf_write_ckpt_begin (w, r, e), e);
-        break;
+        return walf_write_ckpt_begin (w, r, e);
       }
 
     case WL_CKPT_END:
       {
-        err_t_wrap (walf_write_ckpt_end (w, r, e), e);
-        break;
+        return walf_write_ckpt_end (w, r, e);
       }
+
     case WL_EOF:
       {
         UNREACHABLE ();
       }
     }
 
-  return ret;
+  UNREACHABLE ();
 }
 
 /////////////////////////////////////////////
@@ -489,6 +681,151 @@ walf_read_ckpt_end_full (
   return SUCCESS;
 }
 
+/**
+ * Delta updates are read in three steps since the range
+ * table sizes the rest of the record
+ */
+static inline int
+walf_read_update_delta_full (struct wal_file *w, u32 *checksum, u8 buf[WL_UPDATE_DELTA_MAX_LEN], error *e)
+{
+  DBG_ASSERT (wal_file, w);
+
+  wlh type = WL_UPDATE_DELTA;
+  u8 *head = buf;
+  bool iseof;
+
+  i_memcpy (head, &type, sizeof (wlh));
+  head += sizeof (wlh);
+
+  // tid, prev, pg, nranges
+  u32 toread = WL_UPDATE_DELTA_LEN (0, 0) - sizeof (wlh) - sizeof (u32);
+  err_t_wrap (walis_read_all (&w->istream, &iseof, NULL, checksum, head, toread, e), e);
+  if (iseof)
+    {
+      return WL_EOF;
+    }
+  head += toread;
+
+  u32 nranges;
+  i_memcpy (&nranges, head - sizeof (u32), sizeof (u32));
+  if (nranges > WAL_DELTA_MAX_RANGES)
+    {
+      return error_causef (e, ERR_CORRUPT, "Invalid delta range count: %u", nranges);
+    }
+
+  // Range table
+  toread = nranges * 2 * sizeof (p_size);
+  if (toread > 0)
+    {
+      err_t_wrap (walis_read_all (&w->istream, &iseof, NULL, checksum, head, toread, e), e);
+      if (iseof)
+        {
+          return WL_EOF;
+        }
+    }
+
+  p_size nbytes = 0;
+  for (u32 i = 0; i < nranges; ++i)
+    {
+      p_size rng[2];
+      i_memcpy (rng, head + i * sizeof (rng), sizeof (rng));
+      if (rng[0] > PAGE_SIZE || rng[1] > PAGE_SIZE - rng[0] || rng[1] > PAGE_SIZE - nbytes)
+        {
+          return error_causef (e, ERR_CORRUPT, "Invalid delta range");
+        }
+      nbytes += rng[1];
+    }
+  head += toread;
+
+  // Undo and redo bytes
+  toread = 2 * nbytes;
+  if (toread > 0)
+    {
+      err_t_wrap (walis_read_all (&w->istream, &iseof, NULL, checksum, head, toread, e), e);
+      if (iseof)
+        {
+          return WL_EOF;
+        }
+    }
+  head += toread;
+
+  // Checksum
+  err_t_wrap (walis_read_all (&w->istream, &iseof, NULL, NULL, head, sizeof (u32), e), e);
+  if (iseof)
+    {
+      return WL_EOF;
+    }
+
+  u32 actual_crc;
+  i_memcpy (&actual_crc, head, sizeof (u32));
+
+  if (*checksum != actual_crc)
+    {
+      return error_causef (e, ERR_CORRUPT, "Invalid CRC");
+    }
+
+  return SUCCESS;
+}
+
+// The length field sizes the rest of the record
+static inline int
+walf_read_dl_insert_full (struct wal_file *w, u32 *checksum, u8 buf[WL_DL_INSERT_MAX_LEN], error *e)
+{
+  DBG_ASSERT (wal_file, w);
+
+  wlh type = WL_DL_INSERT;
+  u8 *head = buf;
+  bool iseof;
+
+  i_memcpy (head, &type, sizeof (wlh));
+  head += sizeof (wlh);
+
+  // tid, prev, pg, ofst, len
+  u32 toread = WL_DL_INSERT_LEN (0) - sizeof (wlh) - sizeof (u32);
+  err_t_wrap (walis_read_all (&w->istream, &iseof, NULL, checksum, head, toread, e), e);
+  if (iseof)
+    {
+      return WL_EOF;
+    }
+  head += toread;
+
+  p_size rng[2];
+  i_memcpy (rng, head - sizeof (rng), sizeof (rng));
+  if (rng[0] > PAGE_SIZE || rng[1] > PAGE_SIZE - rng[0])
+    {
+      return error_causef (e, ERR_CORRUPT, "Invalid data list insert range");
+    }
+
+  // Data
+  toread = rng[1];
+  if (toread > 0)
+    {
+      err_t_wrap (walis_read_all (&w->istream, &iseof, NULL, checksum, head, toread, e), e);
+      if (iseof)
+        {
+          return WL_EOF;
+        }
+    }
+  head += toread;
+
+  // Checksum
+  err_t_wrap (walis_read_all (&w->istream, &iseof, NULL, NULL, head, sizeof (u32), e), e);
+  if (iseof)
+    {
+      return WL_EOF;
+    }
+
+  u32 actual_crc;
+  i_memcpy (&actual_crc, head, sizeof (u32));
+
+  if (*checksum != actual_crc)
+    {
+      return error_causef (e, ERR_CORRUPT, "Invalid CRC");
+    }
+
+  return SUCCESS;
+}
+
 static inline int
 walf_read_full (struct wal_file *w, u32 *checksum, wlh type, u8 *buf, u32 total_len, error *e)
 {
@@ -535,17 +872,106 @@ walf_read_full (struct wal_file *w, u32 *checksum, wlh type, u8 *buf, u32 total_
   return SUCCESS;
 }
 
+/**
+ * Reads a compressed UPDATE or CLR and inflates it into the same
+ * [total_len] layout walf_read_full produces. [fixed_len] is the
+ * number of uncompressed bytes after the header
+ */
+static inline int
+walf_read_compressed_full (
+    struct wal_file *w,
+    u32 *checksum,
+    wlh type,
+    u8 *buf,
+    u32 total_len,
+    u32 fixed_len,
+    error *e)
+{
+  DBG_ASSERT (wal_file, w);
+  ASSERT (total_len > sizeof (wlh) + fixed_len + sizeof (u32));
+
+  u32 rawlen = total_len - sizeof (wlh) - fixed_len - sizeof (u32);
+  u8 *head = buf;
+  bool iseof;
+
+  ASSERT (rawlen <= 2 * PAGE_SIZE);
+
+  i_memcpy (head, &type, sizeof (wlh));
+  head += sizeof (wlh);
+
+  // Uncompressed fields
+  err_t_wrap (walis_read_all (&w->istream, &iseof, NULL, checksum, head, fixed_len, e), e);
+  if (iseof)
+    {
+      return WL_EOF;
+    }
+  head += fixed_len;
+
+  u32 clen;
+  err_t_wrap (walis_read_all (&w->istream, &iseof, NULL, checksum, &clen, sizeof (u32), e), e);
+  if (iseof)
+    {
+      return WL_EOF;
+    }
+  if (clen == 0 || clen > rawlen)
+    {
+      return error_causef (e, ERR_CORRUPT, "Invalid compressed length: %u", clen);
+    }
+
+  // Payload - decompressed straight out of the read buffer, before the
+  // next read can move it
+  const u8 *packed;
+  err_t_wrap (walis_read_view (&w->istream, &iseof, checksum, &packed, clen, e), e);
+  if (iseof)
+    {
+      return WL_EOF;
+    }
+  i32 ret = lz4_decompress (head, rawlen, packed, clen);
+
+  // Checksum
+  u32 actual_crc;
+  err_t_wrap (walis_read_all (&w->istream, &iseof, NULL, NULL, &actual_crc, sizeof (u32), e), e);
+  if (iseof)
+    {
+      return WL_EOF;
+    }
+
+  if (*checksum != actual_crc)
+    {
+      return error_causef (e, ERR_CORRUPT, "Invalid CRC");
+    }
+
+  if (ret != (i32)rawlen)
+    {
+      return error_causef (e, ERR_CORRUPT, "Invalid compressed payload");
+    }
+  head += rawlen;
+
+  i_memcpy (head, &actual_crc, sizeof (u32));
+
+  return SUCCESS;
+}
+
 /////////////////////////////////////////////
 /// PREAD
 
 static inline err_t
-walf_read_update (struct wal_file *w, u32 *checksum, struct wal_rec_hdr_read *r, error *e)
+walf_read_update (struct wal_file *w, u32 *checksum, struct wal_rec_hdr_read *r, bool compressed, error *e)
 {
   DBG_ASSERT (wal_file, w);
   ASSERT (r->type == WL_UPDATE);
 
   u8 buf[WL_UPDATE_LEN];
-  int ret = walf_read_full (w, checksum, r->type, buf, WL_UPDATE_LEN, e);
+  int ret;
+  if (compressed)
+    {
+      u32 fixed = sizeof (txid) + sizeof (lsn) + sizeof (pgno);
+      ret = walf_read_compressed_full (w, checksum, r->type, buf, WL_UPDATE_LEN, fixed, e);
+    }
+  else
+    {
+      ret = walf_read_full (w, checksum, r->type, buf, WL_UPDATE_LEN, e);
+    }
   err_t_wrap (ret, e);
   if (ret == WL_EOF)
     {
@@ -563,13 +989,70 @@ walf_read_update (struct wal_file *w, u32 *checksum, struct wal_rec_hdr_read *r,
 }
 
 static inline err_t
-walf_read_clr (struct wal_file *w, u32 *checksum, struct wal_rec_hdr_read *r, error *e)
+walf_read_update_delta (struct wal_file *w, u32 *checksum, struct wal_rec_hdr_read *r, error *e)
+{
+  DBG_ASSERT (wal_file, w);
+  ASSERT (r->type == WL_UPDATE_DELTA);
+
+  u8 buf[WL_UPDATE_DELTA_MAX_LEN];
+  int ret = walf_read_update_delta_full (w, checksum, buf, e);
+  err_t_wrap (ret, e);
+  if (ret == WL_EOF)
+    {
+      r->type = WL_EOF;
+      return SUCCESS;
+    }
+  else
+    {
+      ASSERT (ret == SUCCESS);
+    }
+
+  walf_decode_update_delta (r, buf);
+
+  return SUCCESS;
+}
+
+static inline err_t
+walf_read_dl_insert (struct wal_file *w, u32 *checksum, struct wal_rec_hdr_read *r, error *e)
+{
+  DBG_ASSERT (wal_file, w);
+  ASSERT (r->type == WL_DL_INSERT);
+
+  u8 buf[WL_DL_INSERT_MAX_LEN];
+  int ret = walf_read_dl_insert_full (w, checksum, buf, e);
+  err_t_wrap (ret, e);
+  if (ret == WL_EOF)
+    {
+      r->type = WL_EOF;
+      return SUCCESS;
+    }
+  else
+    {
+      ASSERT (ret == SUCCESS);
+    }
+
+  walf_decode_dl_insert (r, buf);
+
+  return SUCCESS;
+}
+
+static inline err_t
+walf_read_clr (struct wal_file *w, u32 *checksum, struct wal_rec_hdr_read *r, bool compressed, error *e)
 {
   DBG_ASSERT (wal_file, w);
   ASSERT (r->type == WL_CLR);
 
   u8 buf[WL_CLR_LEN];
-  int ret = walf_read_full (w, checksum, r->type, buf, WL_CLR_LEN, e);
+  int ret;
+  if (compressed)
+    {
+      u32 fixed = sizeof (txid) + sizeof (lsn) + sizeof (pgno) + sizeof (lsn);
+      ret = walf_read_compressed_full (w, checksum, r->type, buf, WL_CLR_LEN, fixed, e);
+    }
+  else
+    {
+      ret = walf_read_full (w, checksum, r->type, buf, WL_CLR_LEN, e);
+    }
   err_t_wrap (ret, e);
   if (ret == WL_EOF)
     {
@@ -741,15 +1224,29 @@ walf_pread (struct wal_rec_hdr_read *dest, struct wal_file *w, lsn ofst, error *
   switch (t)
     {
     case WL_UPDATE:
+    case WL_UPDATE | WL_COMPRESSED:
+      {
+        dest->type = WL_UPDATE;
+        err_t_wrap (walf_read_update (w, &checksum, dest, t & WL_COMPRESSED, e), e);
+        break;
+      }
+    case WL_UPDATE_DELTA:
       {
         dest->type = t;
-        err_t_wrap (walf_read_update (w, &checksum, dest, e), e);
+        err_t_wrap (walf_read_update_delta (w, &checksum, dest, e), e);
         break;
       }
-    case WL_CLR:
+    case WL_DL_INSERT:
       {
         dest->type = t;
-        err_t_wrap (walf_read_clr (w, &checksum, dest, e), e);
+        err_t_wrap (walf_read_dl_insert (w, &checksum, dest, e), e);
+        break;
+      }
+    case WL_CLR:
+    case WL_CLR | WL_COMPRESSED:
+      {
+        dest->type = WL_CLR;
+        err_t_wrap (walf_read_clr (w, &checksum, dest, t & WL_COMPRESSED, e), e);
         break;
       }
     case WL_BEGIN:
@@ -820,15 +1317,29 @@ walf_read (struct wal_rec_hdr_read *dest, lsn *rlsn, struct wal_file *w, error *
   switch (t)
     {
     case WL_UPDATE:
+    case WL_UPDATE | WL_COMPRESSED:
+      {
+        dest->type = WL_UPDATE;
+        err_t_wrap (walf_read_update (w, &checksum, dest, t & WL_COMPRESSED, e), e);
+        break;
+      }
+    case WL_UPDATE_DELTA:
       {
         dest->type = t;
-        err_t_wrap (walf_read_update (w, &checksum, dest, e), e);
+        err_t_wrap (walf_read_update_delta (w, &checksum, dest, e), e);
         break;
       }
-    case WL_CLR:
+    case WL_DL_INSERT:
       {
         dest->type = t;
-        err_t_wrap (walf_read_clr (w, &checksum, dest, e), e);
+        err_t_wrap (walf_read_dl_insert (w, &checksum, dest, e), e);
+        break;
+      }
+    case WL_CLR:
+    case WL_CLR | WL_COMPRESSED:
+      {
+        dest->type = WL_CLR;
+        err_t_wrap (walf_read_clr (w, &checksum, dest, t & WL_COMPRESSED, e), e);
         break;
       }
     case WL_BEGIN:
@@ -883,6 +1394,19 @@ walf_flush_all (struct wal_file *w, error *e)
   return walos_flush_all (w->current_ostream, e);
 }
 
+err_t
+walf_flush_to (struct wal_file *w, lsn l, error *e)
+{
+  DBG_ASSERT (wal_file, w);
+
+  // Nothing appended since open - everything in the file is durable
+  if (w->current_ostream == NULL)
+    {
+      return SUCCESS;
+    }
+  return walos_flush_to (w->current_ostream, l, e);
+}
+
 #ifndef NTEST
 err_t
 walf_crash (struct wal_file *w, error *e)
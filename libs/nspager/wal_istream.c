@@ -40,23 +40,23 @@ walis_open (struct wal_istream *dest, const char *fname, error *e)
 {
   ASSERT (dest);
 
-  err_t_wrap (i_open_rw (&dest->fd, fname, e), e);
-
-  i64 len = i_file_size (&dest->fd, e);
-  if (len < 0)
-    {
-      i_close (&dest->fd, e);
-      return e->cause_code;
-    }
-
-  if (i_seek (&dest->fd, 0, I_SEEK_SET, e) < 0)
+  // Reading from the start begins at the first live segment
+  u64 first;
+  err_t_wrap (walseg_read_anchor (&first, fname, e), e);
+
+  // Segments are opened as reads reach them
+  dest->fname = fname;
+  dest->fd_open = false;
+  dest->seg = first;
+  dest->curlsn = first * WAL_SEGMENT_SIZE;
+  dest->lsnidx = 0;
+  dest->buf_lsn = 0;
+  dest->buf_len = 0;
+  dest->buf = i_malloc (WAL_READ_BUFFER_CAP, 1, e);
+  if (dest->buf == NULL)
     {
-      i_close (&dest->fd, e);
       return e->cause_code;
     }
-
-  dest->curlsn = 0;
-  dest->lsnidx = 0;
   latch_init (&dest->latch);
 
   DBG_ASSERT (wal_istream, dest);
@@ -64,35 +64,97 @@ walis_open (struct wal_istream *dest, const char *fname, error *e)
   return SUCCESS;
 }
 
+static err_t
+walis_close_segment (struct wal_istream *w, error *e)
+{
+  if (w->fd_open)
+    {
+      w->fd_open = false;
+      err_t_wrap (i_close (&w->fd, e), e);
+    }
+  return SUCCESS;
+}
+
 err_t
 walis_close (struct wal_istream *w, error *e)
 {
   DBG_ASSERT (wal_istream, w);
-  return i_close (&w->fd, e);
+  i_free (w->buf);
+  w->buf = NULL;
+  return walis_close_segment (w, e);
 }
 
-///////////////////////////////////////////////////////
-/// LOGW Mode
+/**
+ * Points [w->fd] at segment [seg]. Sets [exists] false
+ * if the log doesn't reach that far
+ */
+static err_t
+walis_open_segment (struct wal_istream *w, bool *exists, u64 seg, error *e)
+{
+  *exists = true;
+  if (w->fd_open && w->seg == seg)
+    {
+      return SUCCESS;
+    }
 
-err_t
-walis_seek (struct wal_istream *w, u64 pos, error *e)
+  err_t_wrap (walis_close_segment (w, e), e);
+
+  char name[WALSEG_FNAME_LEN];
+  walseg_fname (name, w->fname, seg);
+  if (!i_exists_rw (name))
+    {
+      *exists = false;
+      return SUCCESS;
+    }
+
+  err_t_wrap (i_open_rw (&w->fd, name, e), e);
+  w->fd_open = true;
+  w->seg = seg;
+
+  return SUCCESS;
+}
+
+/**
+ * Drops a torn record at the end of the log - everything from [l] on.
+ * Segments after the one holding [l] are emptied into spares.
+ */
+static err_t
+walis_cut (struct wal_istream *w, lsn l, error *e)
 {
-  latch_lock (&w->latch);
+  bool exists;
+  u64 seg = l / WAL_SEGMENT_SIZE;
 
-  DBG_ASSERT (wal_istream, w);
+  // Whatever was read past [l] is gone
+  w->buf_len = 0;
 
-  i64 res = i_seek (&w->fd, pos, I_SEEK_SET, e);
-  if (res < 0)
+  err_t_wrap (walis_open_segment (w, &exists, seg, e), e);
+  if (exists)
     {
-      latch_unlock (&w->latch);
-      return e->cause_code;
+      err_t_wrap (i_truncate (&w->fd, l % WAL_SEGMENT_SIZE, e), e);
+      err_t_wrap (i_fsync (&w->fd, e), e);
     }
 
-  if ((u64)res != pos)
+  while (true)
     {
-      latch_unlock (&w->latch);
-      return error_causef (e, ERR_CORRUPT, "Tried to seek to an invalid spot");
+      err_t_wrap (walis_open_segment (w, &exists, ++seg, e), e);
+      if (!exists)
+        {
+          return SUCCESS;
+        }
+      err_t_wrap (i_truncate (&w->fd, 0, e), e);
+      err_t_wrap (i_fsync (&w->fd, e), e);
     }
+}
+
+///////////////////////////////////////////////////////
+/// LOGW Mode
+
+err_t
+walis_seek (struct wal_istream *w, u64 pos, error *e)
+{
+  latch_lock (&w->latch);
+
+  DBG_ASSERT (wal_istream, w);
 
   w->curlsn = pos;
 
@@ -109,58 +171,168 @@ walis_mark_start_log (struct wal_istream *w)
   latch_unlock (&w->latch);
 }
 
-err_t
-walis_read_all (struct wal_istream *w, bool *iseof, lsn *rlsn, u32 *checksum, void *data, u32 len, error *e)
+/**
+ * Reads up to [len] bytes of the log at [pos] into [dest], crossing
+ * segments as needed. [bread] comes up short at the end of the log
+ */
+static err_t
+walis_pread (struct wal_istream *w, u32 *bread, u8 *dest, lsn pos, u32 len, error *e)
 {
-  latch_lock (&w->latch);
+  *bread = 0;
 
-  DBG_ASSERT (wal_istream, w);
+  while (*bread < len)
+    {
+      bool exists;
+      err_t_wrap (walis_open_segment (w, &exists, pos / WAL_SEGMENT_SIZE, e), e);
+      if (!exists)
+        {
+          return SUCCESS;
+        }
 
-  *iseof = false;
-  if (rlsn)
+      u64 ofst = pos % WAL_SEGMENT_SIZE;
+      u32 toread = (u32)MIN ((u64)(len - *bread), WAL_SEGMENT_SIZE - ofst);
+
+      i64 got = i_pread_all (&w->fd, dest + *bread, toread, ofst, e);
+      if (got < 0)
+        {
+          return e->cause_code;
+        }
+
+      *bread += got;
+      pos += got;
+
+      if ((u32)got < toread)
+        {
+          return SUCCESS;
+        }
+    }
+
+  return SUCCESS;
+}
+
+/**
+ * Makes [len] bytes at [pos] resident in [w->buf] if the log has them.
+ * Reads start on a block boundary. Scanning forward fills the whole
+ * buffer, jumping around (undo) reads only the blocks it needs
+ */
+static err_t
+walis_fill (struct wal_istream *w, lsn pos, u32 len, error *e)
+{
+  ASSERT (len <= WAL_READ_BUFFER_CAP - WAL_READ_BLOCK);
+
+  lsn buf_end = w->buf_lsn + w->buf_len;
+  if (pos >= w->buf_lsn && pos + len <= buf_end)
     {
-      *rlsn = w->curlsn;
+      return SUCCESS;
     }
 
-  i64 bread = i_read_all (&w->fd, data, len, e);
-  if (bread < 0)
+  lsn start = pos - pos % WAL_READ_BLOCK;
+  u32 want = WAL_READ_BUFFER_CAP;
+  if (w->buf_len > 0 && pos != buf_end)
     {
-      latch_unlock (&w->latch);
-      return e->cause_code;
+      lsn end = pos + len + WAL_READ_BLOCK - 1;
+      want = (u32)(end - end % WAL_READ_BLOCK - start);
+    }
+
+  w->buf_lsn = start;
+  w->buf_len = 0;
+
+  return walis_pread (w, &w->buf_len, w->buf, start, want, e);
+}
+
+/**
+ * Points [dest] at the next [len] bytes of the current record. Sets
+ * [iseof] and drops the torn tail of the log if it ends first
+ */
+static err_t
+walis_next (struct wal_istream *w, bool *iseof, const u8 **dest, u8 *scratch, u32 len, error *e)
+{
+  lsn pos = w->curlsn + w->lsnidx;
+  u32 bread;
+
+  *iseof = false;
+
+  if (len <= WAL_READ_BUFFER_CAP - WAL_READ_BLOCK)
+    {
+      err_t_wrap (walis_fill (w, pos, len, e), e);
+      lsn buf_end = w->buf_lsn + w->buf_len;
+      bread = buf_end > pos ? (u32)MIN ((u64)len, buf_end - pos) : 0;
+      *dest = w->buf + (pos - w->buf_lsn);
+    }
+  else
+    {
+      // Too big to buffer (checkpoint tables) - straight into the caller's memory
+      ASSERT (scratch);
+      err_t_wrap (walis_pread (w, &bread, scratch, pos, len, e), e);
+      *dest = scratch;
     }
 
   if (bread < len)
     {
       // Hit EOF - incomplete record
-      // Truncate to where this record started (before any bytes were copied)
-      if (bread > 0)
+      // Truncate to where this record started
+      if (bread > 0 || w->lsnidx > 0)
         {
-          if (i_truncate (&w->fd, w->curlsn, e))
-            {
-              latch_unlock (&w->latch);
-              return e->cause_code;
-            }
-          if (i_fsync (&w->fd, e))
-            {
-              latch_unlock (&w->latch);
-              return e->cause_code;
-            }
+          err_t_wrap (walis_cut (w, w->curlsn, e), e);
         }
       *iseof = true;
-      latch_unlock (&w->latch);
       return SUCCESS;
     }
 
-  if (checksum)
+  w->lsnidx += len;
+
+  return SUCCESS;
+}
+
+err_t
+walis_read_all (struct wal_istream *w, bool *iseof, lsn *rlsn, u32 *checksum, void *data, u32 len, error *e)
+{
+  latch_lock (&w->latch);
+
+  DBG_ASSERT (wal_istream, w);
+
+  if (rlsn)
+    {
+      *rlsn = w->curlsn;
+    }
+
+  const u8 *src;
+  err_t ret = walis_next (w, iseof, &src, data, len, e);
+  if (ret == SUCCESS && !*iseof)
     {
-      checksum_execute (checksum, data, len);
+      if (src != data)
+        {
+          i_memcpy (data, src, len);
+        }
+      if (checksum)
+        {
+          checksum_execute (checksum, data, len);
+        }
     }
 
-  w->lsnidx += len;
+  latch_unlock (&w->latch);
+
+  return ret;
+}
+
+err_t
+walis_read_view (struct wal_istream *w, bool *iseof, u32 *checksum, const u8 **dest, u32 len, error *e)
+{
+  ASSERT (len <= WAL_READ_BUFFER_CAP - WAL_READ_BLOCK);
+
+  latch_lock (&w->latch);
+
+  DBG_ASSERT (wal_istream, w);
+
+  err_t ret = walis_next (w, iseof, dest, NULL, len, e);
+  if (ret == SUCCESS && !*iseof && checksum)
+    {
+      checksum_execute (checksum, *dest, len);
+    }
 
   latch_unlock (&w->latch);
 
-  return SUCCESS;
+  return ret;
 }
 
 void
@@ -178,6 +350,91 @@ err_t
 walis_crash (struct wal_istream *w, error *e)
 {
   DBG_ASSERT (wal_istream, w);
-  return i_close (&w->fd, e);
+  i_free (w->buf);
+  w->buf = NULL;
+  return walis_close_segment (w, e);
+}
+#endif
+
+#ifndef NTEST
+static inline u8
+walis_test_byte (u64 i)
+{
+  return (u8)(i * 7 + i / 251);
+}
+
+TEST (TT_UNIT, walis_read_ahead)
+{
+  enum
+  {
+    PIECE = 1000,
+  };
+
+  error e = error_create ();
+  test_err_t_wrap (walseg_remove_all ("test.wal", &e), &e);
+
+  u64 total = 2 * WAL_READ_BUFFER_CAP + 100;
+  u8 *data = i_malloc (total, 1, &e);
+  test_fail_if_null (data);
+  for (u64 i = 0; i < total; ++i)
+    {
+      data[i] = walis_test_byte (i);
+    }
+
+  struct wal_ostream *o = walos_open ("test.wal", &e);
+  test_fail_if_null (o);
+  test_err_t_wrap (walos_append (o, NULL, data, total, &e), &e);
+  test_err_t_wrap (walos_close (o, &e), &e);
+
+  struct wal_istream r;
+  bool iseof;
+  u8 piece[PIECE];
+  test_err_t_wrap (walis_open (&r, "test.wal", &e), &e);
+
+  TEST_CASE ("Sequential reads cross buffer refills")
+  {
+    for (u64 i = 0; i + PIECE <= total; i += PIECE)
+      {
+        walis_mark_start_log (&r);
+        test_err_t_wrap (walis_read_all (&r, &iseof, NULL, NULL, piece, PIECE, &e), &e);
+        test_assert (!iseof);
+        test_assert_memequal (piece, data + i, PIECE);
+        walis_mark_end_log (&r);
+      }
+  }
+
+  TEST_CASE ("Seeking back serves a view of the same bytes")
+  {
+    const u8 *view;
+    u32 expected = checksum_init ();
+    u32 actual = checksum_init ();
+    checksum_execute (&expected, data + 12345, PIECE);
+
+    test_err_t_wrap (walis_seek (&r, 12345, &e), &e);
+    walis_mark_start_log (&r);
+    test_err_t_wrap (walis_read_view (&r, &iseof, &actual, &view, PIECE, &e), &e);
+    test_assert (!iseof);
+    test_assert_memequal (view, data + 12345, PIECE);
+    test_assert_int_equal (actual, expected);
+  }
+
+  TEST_CASE ("Reads bigger than the buffer go around it")
+  {
+    u64 big = WAL_READ_BUFFER_CAP + 10;
+    u8 *dest = i_malloc (big, 1, &e);
+    test_fail_if_null (dest);
+
+    test_err_t_wrap (walis_seek (&r, 50, &e), &e);
+    walis_mark_start_log (&r);
+    test_err_t_wrap (walis_read_all (&r, &iseof, NULL, NULL, dest, big, &e), &e);
+    test_assert (!iseof);
+    test_assert_memequal (dest, data + 50, big);
+
+    i_free (dest);
+  }
+
+  test_err_t_wrap (walis_close (&r, &e), &e);
+  test_err_t_wrap (walseg_remove_all ("test.wal", &e), &e);
+  i_free (data);
 }
 #endif
@@ -18,13 +18,13 @@
  */
 
 #include <numstore/core/assert.h>
-#include <numstore/core/cbuffer.h>
-#include <numstore/core/checksums.h>
-#include <numstore/core/spx_latch.h>
 #include <numstore/intf/logging.h>
 #include <numstore/intf/os.h>
 #include <numstore/intf/stdlib.h>
 #include <numstore/pager/wal_stream.h>
+#include <numstore/test/testing.h>
+
+#define WALOS_IDLE ((lsn)UINT64_MAX)
 
 DEFINE_DBG_ASSERT (
     struct wal_ostream, wal_ostream, w,
@@ -35,6 +35,100 @@ DEFINE_DBG_ASSERT (
 ///////////////////////////////////////////////////////
 /// LOGR Mode
 
+/**
+ * Opens segment [seg] for appending. Spares are already empty, anything
+ * else at this index is left over from a log that was since reset
+ */
+static err_t
+walos_open_segment (struct wal_ostream *w, u64 seg, bool append, error *e)
+{
+  char name[WALSEG_FNAME_LEN];
+  walseg_fname (name, w->fname, seg);
+
+  err_t_wrap (i_open_w (&w->fd, name, e), e);
+  if (!append)
+    {
+      err_t_wrap_goto (i_truncate (&w->fd, 0, e), failed, e);
+    }
+  if (i_seek (&w->fd, 0, I_SEEK_END, e) < 0)
+    {
+      goto failed;
+    }
+
+  w->seg = seg;
+
+  return SUCCESS;
+
+failed:
+  i_close (&w->fd, e);
+  return e->cause_code;
+}
+
+/**
+ * Finds the end of the log - the last non empty segment
+ * from the anchor on - and counts the spares after it
+ */
+static err_t
+walos_find_end (struct wal_ostream *w, u64 *last, u64 *len, error *e)
+{
+  char name[WALSEG_FNAME_LEN];
+
+  err_t_wrap (walseg_read_anchor (&w->first, w->fname, e), e);
+
+  // Left behind by a truncation that crashed part way
+  for (u64 seg = w->first; seg > 0; --seg)
+    {
+      walseg_fname (name, w->fname, seg - 1);
+      if (!i_exists_rw (name))
+        {
+          break;
+        }
+      err_t_wrap (i_remove_quiet (name, e), e);
+    }
+
+  *last = w->first;
+  *len = 0;
+  w->nspares = 0;
+
+  for (u64 seg = w->first;; ++seg)
+    {
+      walseg_fname (name, w->fname, seg);
+      if (!i_exists_rw (name))
+        {
+          break;
+        }
+
+      i_file fd;
+      err_t_wrap (i_open_r (&fd, name, e), e);
+      i64 size = i_file_size (&fd, e);
+      i_close (&fd, e);
+      if (size < 0)
+        {
+          return e->cause_code;
+        }
+
+      if (size > 0)
+        {
+          *last = seg;
+          *len = size;
+          w->nspares = 0;
+        }
+      else if (seg > *last)
+        {
+          w->nspares++;
+        }
+    }
+
+  if (*len > WAL_SEGMENT_SIZE)
+    {
+      return error_causef (e, ERR_CORRUPT, "WAL segment %" PRIu64 " is larger than a segment", *last);
+    }
+
+  return SUCCESS;
+}
+
+static void *walos_flusher_main (void *ctx);
+
 struct wal_ostream *
 walos_open (const char *fname, error *e)
 {
@@ -44,29 +138,136 @@ walos_open (const char *fname, error *e)
       return NULL;
     }
 
-  if (i_open_w (&ret->fd, fname, e))
+  ret->fname = fname;
+
+  u64 last, len;
+  if (walos_find_end (ret, &last, &len, e))
     {
       i_free (ret);
       return NULL;
     }
 
-  i64 len = i_seek (&ret->fd, 0, I_SEEK_END, e);
-
-  if (len < 0)
+  if (walos_open_segment (ret, last, true, e))
     {
-      i_close (&ret->fd, e);
       i_free (ret);
       return NULL;
     }
 
-  spx_latch_init (&ret->l);
+  if (i_mutex_create (&ret->gc_l, e))
+    {
+      goto failed_file;
+    }
+  if (i_cond_create (&ret->gc_done, e))
+    {
+      goto failed_mutex;
+    }
+  if (i_cond_create (&ret->gc_join, e))
+    {
+      goto failed_done;
+    }
+  if (i_mutex_create (&ret->seg_l, e))
+    {
+      goto failed_join;
+    }
+  if (i_mutex_create (&ret->wo_l, e))
+    {
+      goto failed_seg;
+    }
+  if (i_mutex_create (&ret->ring_l, e))
+    {
+      goto failed_wo;
+    }
+  if (i_cond_create (&ret->ring_moved, e))
+    {
+      goto failed_ring;
+    }
+  if (i_mutex_create (&ret->fl_l, e))
+    {
+      goto failed_moved;
+    }
+  if (i_cond_create (&ret->fl_wake, e))
+    {
+      goto failed_fl;
+    }
 
-  ret->buffer = cbuffer_create (ret->_buffer, sizeof (ret->_buffer));
-  ret->flushed_lsn = len;
+  lsn end = last * WAL_SEGMENT_SIZE + len;
+  atomic_init (&ret->next_lsn, end);
+  atomic_init (&ret->flushed_lsn, end);
+  for (u32 i = 0; i < WAL_APPEND_SLOTS; ++i)
+    {
+      atomic_init (&ret->slots[i], WALOS_IDLE);
+    }
+  atomic_init (&ret->slot_hint, 0);
+  atomic_init (&ret->ring_waiters, 0);
+  ret->fl_stop = false;
+  ret->fl_wanted = false;
+  ret->durable_lsn = end;
+  ret->gc_flushing = false;
+  ret->gc_waiting = 0;
+  ret->gc_last_group = 0;
+  ret->nsyncs = 0;
+
+  if (i_thread_create (&ret->fl_thread, walos_flusher_main, ret, e))
+    {
+      goto failed_wake;
+    }
 
   DBG_ASSERT (wal_ostream, ret);
 
   return ret;
+
+failed_wake:
+  i_cond_free (&ret->fl_wake);
+failed_fl:
+  i_mutex_free (&ret->fl_l);
+failed_moved:
+  i_cond_free (&ret->ring_moved);
+failed_ring:
+  i_mutex_free (&ret->ring_l);
+failed_wo:
+  i_mutex_free (&ret->wo_l);
+failed_seg:
+  i_mutex_free (&ret->seg_l);
+failed_join:
+  i_cond_free (&ret->gc_join);
+failed_done:
+  i_cond_free (&ret->gc_done);
+failed_mutex:
+  i_mutex_free (&ret->gc_l);
+failed_file:
+  i_close (&ret->fd, e);
+  i_free (ret);
+  return NULL;
+}
+
+static void
+walos_stop_flusher (struct wal_ostream *w)
+{
+  i_mutex_lock (&w->fl_l);
+  w->fl_stop = true;
+  i_cond_signal (&w->fl_wake);
+  i_mutex_unlock (&w->fl_l);
+
+  error e = error_create ();
+  if (i_thread_join (&w->fl_thread, &e))
+    {
+      i_log_warn ("Failed to join the WAL flusher: %s\n", e.cause_msg);
+    }
+}
+
+static void
+walos_free (struct wal_ostream *w)
+{
+  i_cond_free (&w->fl_wake);
+  i_mutex_free (&w->fl_l);
+  i_cond_free (&w->ring_moved);
+  i_mutex_free (&w->ring_l);
+  i_mutex_free (&w->wo_l);
+  i_mutex_free (&w->seg_l);
+  i_cond_free (&w->gc_join);
+  i_cond_free (&w->gc_done);
+  i_mutex_free (&w->gc_l);
+  i_free (w);
 }
 
 err_t
@@ -74,118 +275,745 @@ walos_close (struct wal_ostream *w, error *e)
 {
   DBG_ASSERT (wal_ostream, w);
 
-  err_t_wrap (walos_flush_to (w, w->flushed_lsn + cbuffer_len (&w->buffer), e), e);
+  err_t ret = walos_flush_all (w, e);
+  walos_stop_flusher (w);
 
-  return i_close (&w->fd, e);
+  if (ret == SUCCESS)
+    {
+      ret = i_close (&w->fd, e);
+    }
+  else
+    {
+      i_close (&w->fd, e);
+    }
+  walos_free (w);
+
+  return ret;
 }
 
 ///////////////////////////////////////////////////////
 /// LOGW Mode
 
+/**
+ * Moves on to the next segment once the current one is full. The full
+ * segment is synced first so only the current one needs a walos_sync.
+ *
+ * Caller holds [w->wo_l]
+ */
 static err_t
-walos_flush_to_impl (struct wal_ostream *w, lsn l, bool lock, error *e)
+walos_next_segment (struct wal_ostream *w, error *e)
 {
-  DBG_ASSERT (wal_ostream, w);
+  err_t ret = SUCCESS;
+
+  i_mutex_lock (&w->seg_l);
 
-  if (lock)
+  err_t_wrap_goto (i_fsync (&w->fd, e), theend, e);
+  err_t_wrap_goto (i_close (&w->fd, e), theend, e);
+  err_t_wrap_goto (walos_open_segment (w, w->seg + 1, false, e), theend, e);
+
+  if (w->nspares > 0)
     {
-      spx_latch_lock_x (&w->l);
+      w->nspares--;
     }
 
-  ASSERTF (l <= w->flushed_lsn + cbuffer_len (&w->buffer),
-           "Trying to flush past a written lsn. Attempt: %" PRlsn " actual last lsn: %" PRlsn "\n",
-           l, w->flushed_lsn + cbuffer_len (&w->buffer));
+theend:
+  ret = e->cause_code;
+  i_mutex_unlock (&w->seg_l);
+  return ret;
+}
 
-  // i_log_debug ("Flushing the WAL to lsn: %" PRlsn "\n", l);
+/**
+ * End of the complete prefix of the ring - nothing below it is still
+ * being copied
+ */
+static lsn
+walos_complete (struct wal_ostream *w)
+{
+  lsn ret = atomic_load (&w->next_lsn);
+  for (u32 i = 0; i < WAL_APPEND_SLOTS; ++i)
+    {
+      ret = MIN (ret, (lsn)atomic_load (&w->slots[i]));
+    }
+  return ret;
+}
 
-  if (l > w->flushed_lsn)
+/**
+ * Wakes anyone waiting on ring progress. Callers publish their progress
+ * before checking for waiters and waiters register before checking
+ * for progress, so one of the two always sees the other
+ */
+static void
+walos_ring_moved (struct wal_ostream *w)
+{
+  if (atomic_load (&w->ring_waiters) > 0)
+    {
+      i_mutex_lock (&w->ring_l);
+      i_cond_broadcast (&w->ring_moved);
+      i_mutex_unlock (&w->ring_l);
+    }
+}
+
+/**
+ * Waits for the complete prefix to move past [done]
+ */
+static void
+walos_wait_ring (struct wal_ostream *w, lsn done)
+{
+  i_mutex_lock (&w->ring_l);
+  atomic_fetch_add (&w->ring_waiters, 1);
+  while (walos_complete (w) <= done)
     {
-      u32 towrite = cbuffer_len (&w->buffer);
+      i_cond_wait (&w->ring_moved, &w->ring_l);
+    }
+  atomic_fetch_sub (&w->ring_waiters, 1);
+  i_mutex_unlock (&w->ring_l);
+}
+
+/**
+ * Moves the complete prefix of the ring into the file. Not durable
+ * until a walos_sync that starts after this returns.
+ *
+ * Caller holds [w->wo_l]
+ */
+static err_t
+walos_write_out (struct wal_ostream *w, error *e)
+{
+  lsn from = atomic_load (&w->flushed_lsn);
+  lsn to = walos_complete (w);
 
-      // Flush out the entire file to disk
-      if (cbuffer_write_to_file_1_expect (&w->fd, &w->buffer, towrite, e))
+  while (from < to)
+    {
+      u64 room = (w->seg + 1) * WAL_SEGMENT_SIZE - from;
+      if (room == 0)
         {
-          goto theend;
+          err_t_wrap (walos_next_segment (w, e), e);
+          continue;
         }
-      cbuffer_write_to_file_2 (&w->buffer, towrite);
 
-      w->flushed_lsn += towrite;
+      // Up to the segment end or the end of the ring, whichever is first
+      u64 ofst = from % WAL_BUFFER_CAP;
+      u64 len = MIN (MIN (to - from, room), WAL_BUFFER_CAP - ofst);
+      err_t_wrap (i_write_all (&w->fd, w->ring + ofst, len, e), e);
+
+      from += len;
+      atomic_store (&w->flushed_lsn, from);
+      walos_ring_moved (w);
     }
 
-  // Need to fsync every flush due to interleaving
-  // fsync's
-  if (i_fsync (&w->fd, e))
+  return SUCCESS;
+}
+
+/**
+ * Writes out at least everything before [l], waiting on any copies
+ * still in flight below it
+ */
+static err_t
+walos_write_through (struct wal_ostream *w, lsn l, error *e)
+{
+  while (true)
     {
-      goto theend;
+      i_mutex_lock (&w->wo_l);
+      err_t ret = walos_write_out (w, e);
+      i_mutex_unlock (&w->wo_l);
+      err_t_wrap (ret, e);
+
+      lsn done = atomic_load (&w->flushed_lsn);
+      if (done >= l)
+        {
+          return SUCCESS;
+        }
+
+      walos_wait_ring (w, done);
     }
+}
 
-theend:
-  spx_latch_unlock_x (&w->l);
-  return e->cause_code;
+static void *
+walos_flusher_main (void *ctx)
+{
+  struct wal_ostream *w = ctx;
+  error e = error_create ();
+
+  i_mutex_lock (&w->fl_l);
+  while (!w->fl_stop)
+    {
+      if (!w->fl_wanted)
+        {
+          i_cond_wait (&w->fl_wake, &w->fl_l);
+          continue;
+        }
+      w->fl_wanted = false;
+      i_mutex_unlock (&w->fl_l);
+
+      // Only makes room - appenders that run out write out themselves
+      i_mutex_lock (&w->wo_l);
+      if (walos_write_out (w, &e))
+        {
+          i_log_debug ("WAL flusher pass failed: %s\n", e.cause_msg);
+          error_reset (&e);
+        }
+      i_mutex_unlock (&w->wo_l);
+
+      i_mutex_lock (&w->fl_l);
+    }
+  i_mutex_unlock (&w->fl_l);
+
+  return NULL;
+}
+
+static void
+walos_flusher_kick (struct wal_ostream *w)
+{
+  i_mutex_lock (&w->fl_l);
+  if (!w->fl_wanted)
+    {
+      w->fl_wanted = true;
+      i_cond_signal (&w->fl_wake);
+    }
+  i_mutex_unlock (&w->fl_l);
+}
+
+/**
+ * Syncs the file and publishes [l], written out before the call, as durable
+ */
+static err_t
+walos_sync (struct wal_ostream *w, lsn l, error *e)
+{
+  // Segments before the current one were synced when it was opened
+  i_mutex_lock (&w->seg_l);
+  err_t ret = i_fsync (&w->fd, e);
+  i_mutex_unlock (&w->seg_l);
+  err_t_wrap (ret, e);
+
+  i_mutex_lock (&w->gc_l);
+  w->nsyncs++;
+  w->durable_lsn = MAX (w->durable_lsn, l);
+  i_mutex_unlock (&w->gc_l);
+
+  return SUCCESS;
 }
 
+/**
+ * Returns once everything up to [l] is durable. A caller that finds no
+ * flush in progress leads the next one and the rest wait for it. The
+ * leader writes out every record completed before it started, so the
+ * callers that waited on it usually have nothing left to do.
+ */
 err_t
 walos_flush_to (struct wal_ostream *w, lsn l, error *e)
 {
-  return walos_flush_to_impl (w, l, true, e);
+  DBG_ASSERT (wal_ostream, w);
+  ASSERTF (l <= walos_get_next_lsn (w),
+           "Trying to flush past a written lsn. Attempt: %" PRlsn " actual last lsn: %" PRlsn "\n",
+           l, walos_get_next_lsn (w));
+
+  err_t ret = SUCCESS;
+
+  i_mutex_lock (&w->gc_l);
+
+  w->gc_waiting++;
+  if (w->gc_flushing && w->gc_waiting >= w->gc_last_group)
+    {
+      i_cond_signal (&w->gc_join);
+    }
+
+  while (w->durable_lsn < l)
+    {
+      if (w->gc_flushing)
+        {
+          i_cond_wait (&w->gc_done, &w->gc_l);
+          continue;
+        }
+
+      w->gc_flushing = true;
+
+      // Others committed alongside the last group - give them time to append
+      if (w->gc_last_group > 1 && w->gc_waiting < w->gc_last_group)
+        {
+          i_cond_timedwait (&w->gc_join, &w->gc_l, WAL_GROUP_COMMIT_WAIT_US);
+        }
+
+      u32 group = w->gc_waiting;
+      i_mutex_unlock (&w->gc_l);
+
+      ret = walos_write_through (w, l, e);
+      lsn written = atomic_load (&w->flushed_lsn);
+
+      if (ret == SUCCESS)
+        {
+          ret = walos_sync (w, written, e);
+        }
+
+      i_mutex_lock (&w->gc_l);
+      w->gc_flushing = false;
+      w->gc_last_group = group;
+      i_cond_broadcast (&w->gc_done);
+
+      if (ret)
+        {
+          break;
+        }
+    }
+
+  w->gc_waiting--;
+
+  i_mutex_unlock (&w->gc_l);
+
+  return ret;
 }
 
 err_t
 walos_flush_all (struct wal_ostream *w, error *e)
 {
-  return walos_flush_to_impl (w, w->flushed_lsn + cbuffer_len (&w->buffer), true, e);
+  return walos_flush_to (w, walos_get_next_lsn (w), e);
 }
 
-err_t
-walos_write_all (struct wal_ostream *w, u32 *checksum, const void *data, u32 len, error *e)
+static bool
+walos_any_idle (struct wal_ostream *w)
 {
-  DBG_ASSERT (wal_ostream, w);
+  for (u32 i = 0; i < WAL_APPEND_SLOTS; ++i)
+    {
+      if (atomic_load (&w->slots[i]) == WALOS_IDLE)
+        {
+          return true;
+        }
+    }
+  return false;
+}
 
-  if (checksum)
+/**
+ * Claims a free append slot, marking it with a lower bound on the lsn
+ * about to be reserved so nothing at or after it is written out early
+ */
+static atomic_uint_fast64_t *
+walos_claim_slot (struct wal_ostream *w)
+{
+  u32 start = (u32)atomic_fetch_add (&w->slot_hint, 1);
+
+  while (true)
     {
-      checksum_execute (checksum, data, len);
+      for (u32 i = 0; i < WAL_APPEND_SLOTS; ++i)
+        {
+          atomic_uint_fast64_t *slot = &w->slots[(start + i) % WAL_APPEND_SLOTS];
+          uint_fast64_t expected = WALOS_IDLE;
+          if (atomic_compare_exchange_strong (slot, &expected, atomic_load (&w->next_lsn)))
+            {
+              return slot;
+            }
+        }
+
+      // More appenders than slots - wait for one to finish
+      i_mutex_lock (&w->ring_l);
+      atomic_fetch_add (&w->ring_waiters, 1);
+      while (!walos_any_idle (w))
+        {
+          i_cond_wait (&w->ring_moved, &w->ring_l);
+        }
+      atomic_fetch_sub (&w->ring_waiters, 1);
+      i_mutex_unlock (&w->ring_l);
     }
+}
+
+err_t
+walos_append (struct wal_ostream *w, lsn *start, const void *data, u32 len, error *e)
+{
+  DBG_ASSERT (wal_ostream, w);
+  ASSERT (len > 0);
 
-  u32 written = 0;
+  err_t ret = SUCCESS;
   const u8 *src = data;
 
-  spx_latch_lock_x (&w->l);
+  atomic_uint_fast64_t *slot = walos_claim_slot (w);
+  lsn s = atomic_fetch_add (&w->next_lsn, len);
+  atomic_store (slot, s);
 
-  while (written < len)
+  if (start)
     {
-      if (cbuffer_avail (&w->buffer) < (len - written))
+      *start = s;
+    }
+
+  u32 copied = 0;
+  while (copied < len)
+    {
+      lsn pos = s + copied;
+
+      // Ring is full - make room by writing out whatever is complete
+      // up to here (at worst everything before this record)
+      if (pos >= atomic_load (&w->flushed_lsn) + WAL_BUFFER_CAP)
         {
-          if (walos_flush_to_impl (w, w->flushed_lsn + cbuffer_len (&w->buffer), false, e))
-            {
-              spx_latch_unlock_x (&w->l);
-              return e->cause_code;
-            }
+          walos_flusher_kick (w);
+          err_t_wrap_goto (walos_write_through (w, pos + 1 - WAL_BUFFER_CAP, e), theend, e);
+          continue;
         }
 
-      u32 towrite = MIN (len - written, cbuffer_avail (&w->buffer));
-      ASSERT (towrite > 0); // Loop termination condition
+      u64 ofst = pos % WAL_BUFFER_CAP;
+      u64 room = atomic_load (&w->flushed_lsn) + WAL_BUFFER_CAP - pos;
+      u32 next = (u32)MIN (MIN ((u64)(len - copied), room), WAL_BUFFER_CAP - ofst);
 
-      cbuffer_write_expect (src + written, 1, towrite, &w->buffer);
+      i_memcpy (w->ring + ofst, src + copied, next);
+      copied += next;
 
-      written += towrite;
+      // Lets large records drain while they're still being copied
+      atomic_store (slot, s + copied);
+      walos_ring_moved (w);
     }
 
-  spx_latch_unlock_x (&w->l);
+theend:
+  ret = e->cause_code;
+  atomic_store (slot, WALOS_IDLE);
+  walos_ring_moved (w);
 
-  return SUCCESS;
+  if (atomic_load (&w->next_lsn) - atomic_load (&w->flushed_lsn) >= WAL_BUFFER_CAP / 2)
+    {
+      walos_flusher_kick (w);
+    }
+
+  return ret;
 }
 
 lsn
 walos_get_next_lsn (struct wal_ostream *w)
 {
-  return w->flushed_lsn + cbuffer_len (&w->buffer);
+  return atomic_load (&w->next_lsn);
+}
+
+lsn
+walos_get_flushed_lsn (struct wal_ostream *w)
+{
+  i_mutex_lock (&w->gc_l);
+  lsn ret = w->durable_lsn;
+  i_mutex_unlock (&w->gc_l);
+  return ret;
+}
+
+/**
+ * Recycles segments that end at or before [l] as spares for the end
+ * of the log, or deletes them once there are WAL_SEGMENT_SPARES.
+ * The anchor moves first, so a crash part way only leaves files
+ * below it behind
+ */
+err_t
+walos_truncate (struct wal_ostream *w, lsn l, error *e)
+{
+  DBG_ASSERT (wal_ostream, w);
+
+  err_t ret = SUCCESS;
+  char from[WALSEG_FNAME_LEN];
+  char to[WALSEG_FNAME_LEN];
+
+  i_mutex_lock (&w->seg_l);
+
+  // Never the segment being appended to
+  u64 first = MIN (l / WAL_SEGMENT_SIZE, w->seg);
+  if (first <= w->first)
+    {
+      goto theend;
+    }
+
+  err_t_wrap_goto (walseg_write_anchor (w->fname, first, e), theend, e);
+
+  for (u64 seg = w->first; seg < first; ++seg)
+    {
+      walseg_fname (from, w->fname, seg);
+
+      if (w->nspares < WAL_SEGMENT_SPARES)
+        {
+          walseg_fname (to, w->fname, w->seg + 1 + w->nspares);
+          err_t_wrap_goto (i_rename (from, to, e), theend, e);
+
+          i_file fd;
+          err_t_wrap_goto (i_open_w (&fd, to, e), theend, e);
+          ret = i_truncate (&fd, 0, e);
+          i_close (&fd, e);
+          err_t_wrap_goto (ret, theend, e);
+
+          w->nspares++;
+        }
+      else
+        {
+          err_t_wrap_goto (i_remove_quiet (from, e), theend, e);
+        }
+    }
+
+  w->first = first;
+
+theend:
+  ret = e->cause_code;
+  i_mutex_unlock (&w->seg_l);
+  return ret;
 }
 
 #ifndef NTEST
+struct walos_committer
+{
+  struct wal_ostream *w;
+  u32 ncommits;
+  error e;
+};
+
+static void *
+walos_commit_loop (void *ctx)
+{
+  struct walos_committer *c = ctx;
+  u8 rec[64];
+  i_memset (rec, 1, sizeof rec);
+
+  for (u32 i = 0; i < c->ncommits; ++i)
+    {
+      if (walos_append (c->w, NULL, rec, sizeof rec, &c->e))
+        {
+          break;
+        }
+      if (walos_flush_all (c->w, &c->e))
+        {
+          break;
+        }
+    }
+
+  return NULL;
+}
+
+TEST (TT_UNIT, walos_group_commit)
+{
+  enum
+  {
+    NTHREADS = 8,
+    NCOMMITS = 50,
+  };
+
+  error e = error_create ();
+  test_err_t_wrap (walseg_remove_all ("test.wal", &e), &e);
+
+  struct wal_ostream *w = walos_open ("test.wal", &e);
+  test_fail_if_null (w);
+
+  i_thread threads[NTHREADS];
+  struct walos_committer c[NTHREADS];
+  for (u32 i = 0; i < NTHREADS; ++i)
+    {
+      c[i] = (struct walos_committer){ .w = w, .ncommits = NCOMMITS, .e = error_create () };
+      test_err_t_wrap (i_thread_create (&threads[i], walos_commit_loop, &c[i], &e), &e);
+    }
+  for (u32 i = 0; i < NTHREADS; ++i)
+    {
+      test_err_t_wrap (i_thread_join (&threads[i], &e), &e);
+      test_assert_int_equal (c[i].e.cause_code, SUCCESS);
+    }
+
+  // Every commit is durable, with at most one sync each
+  test_assert_int_equal (walos_get_flushed_lsn (w), NTHREADS * NCOMMITS * 64);
+  test_assert (w->nsyncs <= NTHREADS * NCOMMITS);
+
+  // Already durable - nothing to sync
+  u64 nsyncs = w->nsyncs;
+  test_err_t_wrap (walos_flush_all (w, &e), &e);
+  test_assert_int_equal (w->nsyncs, nsyncs);
+
+  test_err_t_wrap (walos_close (w, &e), &e);
+  test_err_t_wrap (walseg_remove_all ("test.wal", &e), &e);
+}
+
+TEST (TT_UNIT, walos_segments)
+{
+  enum
+  {
+    CHUNK = 1 << 16,
+  };
+
+  error e = error_create ();
+  char name[WALSEG_FNAME_LEN];
+  u8 chunk[CHUNK];
+  test_err_t_wrap (walseg_remove_all ("test.wal", &e), &e);
+
+  // One and a half segments
+  struct wal_ostream *w = walos_open ("test.wal", &e);
+  test_fail_if_null (w);
+
+  u64 total = WAL_SEGMENT_SIZE + WAL_SEGMENT_SIZE / 2;
+  for (u64 i = 0; i < total; i += CHUNK)
+    {
+      i_memset (chunk, (u8)(i / CHUNK), CHUNK);
+      test_err_t_wrap (walos_append (w, NULL, chunk, CHUNK, &e), &e);
+    }
+  test_err_t_wrap (walos_flush_all (w, &e), &e);
+  test_assert_int_equal (w->seg, 1);
+  test_err_t_wrap (walos_close (w, &e), &e);
+
+  // Reopening picks up at the end of the second segment
+  w = walos_open ("test.wal", &e);
+  test_fail_if_null (w);
+  test_assert_int_equal (walos_get_next_lsn (w), total);
+
+  // Reads span the boundary
+  {
+    struct wal_istream r;
+    bool iseof;
+    u8 buf[16];
+    test_err_t_wrap (walis_open (&r, "test.wal", &e), &e);
+    test_err_t_wrap (walis_seek (&r, WAL_SEGMENT_SIZE - 8, &e), &e);
+    walis_mark_start_log (&r);
+    test_err_t_wrap (walis_read_all (&r, &iseof, NULL, NULL, buf, sizeof (buf), &e), &e);
+    test_assert (!iseof);
+    test_assert_int_equal (buf[0], (u8)((WAL_SEGMENT_SIZE - 8) / CHUNK));
+    test_assert_int_equal (buf[15], (u8)(WAL_SEGMENT_SIZE / CHUNK));
+    test_err_t_wrap (walis_close (&r, &e), &e);
+  }
+
+  // The first segment is recycled as a spare after the second
+  test_err_t_wrap (walos_truncate (w, WAL_SEGMENT_SIZE + 1, &e), &e);
+  test_assert_int_equal (w->first, 1);
+  test_assert_int_equal (w->nspares, 1);
+
+  u64 first;
+  test_err_t_wrap (walseg_read_anchor (&first, "test.wal", &e), &e);
+  test_assert_int_equal (first, 1);
+  walseg_fname (name, "test.wal", 0);
+  test_assert (!i_exists_rw (name));
+  walseg_fname (name, "test.wal", 2);
+  test_assert (i_exists_rw (name));
+
+  // Only the current segment is ever kept
+  test_err_t_wrap (walos_truncate (w, 3 * WAL_SEGMENT_SIZE, &e), &e);
+  test_assert_int_equal (w->first, 1);
+
+  // Appending into the third segment takes the spare
+  for (u64 i = 0; i < WAL_SEGMENT_SIZE; i += CHUNK)
+    {
+      test_err_t_wrap (walos_append (w, NULL, chunk, CHUNK, &e), &e);
+    }
+  test_err_t_wrap (walos_flush_all (w, &e), &e);
+  test_assert_int_equal (w->seg, 2);
+  test_assert_int_equal (w->nspares, 0);
+  test_err_t_wrap (walos_close (w, &e), &e);
+
+  w = walos_open ("test.wal", &e);
+  test_fail_if_null (w);
+  test_assert_int_equal (walos_get_next_lsn (w), total + WAL_SEGMENT_SIZE);
+  test_err_t_wrap (walos_close (w, &e), &e);
+
+  test_err_t_wrap (walseg_remove_all ("test.wal", &e), &e);
+  walseg_fname (name, "test.wal", 1);
+  test_assert (!i_exists_rw (name));
+}
+
+struct walos_appender
+{
+  struct wal_ostream *w;
+  u32 id;
+  u32 nrecs;
+  u32 len;  // Bytes per record
+  lsn *lsns; // Where each record landed
+  error e;
+};
+
+static inline u8
+walos_test_byte (u32 id, u32 rec, u32 i)
+{
+  return (u8)(id * 31 + rec * 7 + i);
+}
+
+static void *
+walos_append_loop (void *ctx)
+{
+  struct walos_appender *a = ctx;
+  u8 *rec = i_malloc (a->len, 1, &a->e);
+  if (rec == NULL)
+    {
+      return NULL;
+    }
+
+  for (u32 r = 0; r < a->nrecs; ++r)
+    {
+      for (u32 i = 0; i < a->len; ++i)
+        {
+          rec[i] = walos_test_byte (a->id, r, i);
+        }
+      if (walos_append (a->w, &a->lsns[r], rec, a->len, &a->e))
+        {
+          break;
+        }
+    }
+
+  i_free (rec);
+  return NULL;
+}
+
+TEST (TT_UNIT, walos_parallel_append)
+{
+  enum
+  {
+    NTHREADS = 8,
+    NRECS = 200,
+  };
+
+  error e = error_create ();
+  test_err_t_wrap (walseg_remove_all ("test.wal", &e), &e);
+
+  struct wal_ostream *w = walos_open ("test.wal", &e);
+  test_fail_if_null (w);
+
+  // Small records, plus one thread whose records don't fit in the ring
+  i_thread threads[NTHREADS];
+  struct walos_appender a[NTHREADS];
+  lsn lsns[NTHREADS][NRECS];
+  for (u32 t = 0; t < NTHREADS; ++t)
+    {
+      a[t] = (struct walos_appender){
+        .w = w,
+        .id = t,
+        .nrecs = t == 0 ? 2 : NRECS,
+        .len = t == 0 ? WAL_BUFFER_CAP + 1234 : 100 + t * 13,
+        .lsns = lsns[t],
+        .e = error_create (),
+      };
+      test_err_t_wrap (i_thread_create (&threads[t], walos_append_loop, &a[t], &e), &e);
+    }
+  for (u32 t = 0; t < NTHREADS; ++t)
+    {
+      test_err_t_wrap (i_thread_join (&threads[t], &e), &e);
+      test_assert_int_equal (a[t].e.cause_code, SUCCESS);
+    }
+
+  test_err_t_wrap (walos_flush_all (w, &e), &e);
+  test_assert_int_equal (walos_get_flushed_lsn (w), walos_get_next_lsn (w));
+  test_err_t_wrap (walos_close (w, &e), &e);
+
+  // Every record landed whole at the lsn it was given
+  struct wal_istream r;
+  bool iseof;
+  u8 *rec = i_malloc (WAL_BUFFER_CAP + 1234, 1, &e);
+  test_fail_if_null (rec);
+  test_err_t_wrap (walis_open (&r, "test.wal", &e), &e);
+
+  for (u32 t = 0; t < NTHREADS; ++t)
+    {
+      for (u32 n = 0; n < a[t].nrecs; ++n)
+        {
+          test_err_t_wrap (walis_seek (&r, lsns[t][n], &e), &e);
+          walis_mark_start_log (&r);
+          test_err_t_wrap (walis_read_all (&r, &iseof, NULL, NULL, rec, a[t].len, &e), &e);
+          test_assert (!iseof);
+          for (u32 i = 0; i < a[t].len; ++i)
+            {
+              test_fail_if (rec[i] != walos_test_byte (t, n, i));
+            }
+        }
+    }
+
+  test_err_t_wrap (walis_close (&r, &e), &e);
+  i_free (rec);
+  test_err_t_wrap (walseg_remove_all ("test.wal", &e), &e);
+}
+
 err_t
 walos_crash (struct wal_ostream *w, error *e)
 {
   DBG_ASSERT (wal_ostream, w);
-  return i_close (&w->fd, e);
+
+  walos_stop_flusher (w);
+
+  err_t ret = i_close (&w->fd, e);
+  walos_free (w);
+
+  return ret;
 }
 #endif
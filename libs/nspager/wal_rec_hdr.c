@@ -34,6 +34,14 @@ wal_rec_hdr_type_tostr (enum wal_rec_hdr_type type)
       {
         return "WL_UPDATE";
       }
+    case WL_UPDATE_DELTA:
+      {
+        return "WL_UPDATE_DELTA";
+      }
+    case WL_DL_INSERT:
+      {
+        return "WL_DL_INSERT";
+      }
     case WL_CLR:
       {
         return "WL_CLR";
@@ -106,6 +114,35 @@ wrhw_from_wrhr (struct wal_rec_hdr_read *src)
           },
         };
       }
+    case WL_UPDATE_DELTA:
+      {
+        return (struct wal_rec_hdr_write){
+          .type = WL_UPDATE_DELTA,
+          .update = {
+              .tid = src->update.tid,
+              .prev = src->update.prev,
+              .pg = src->update.pg,
+              .redo = src->update.redo,
+              .undo = src->update.undo,
+              .nranges = src->update.nranges,
+              .ranges = src->update.ranges,
+          },
+        };
+      }
+    case WL_DL_INSERT:
+      {
+        return (struct wal_rec_hdr_write){
+          .type = WL_DL_INSERT,
+          .dl_insert = {
+              .tid = src->dl_insert.tid,
+              .prev = src->dl_insert.prev,
+              .pg = src->dl_insert.pg,
+              .ofst = src->dl_insert.ofst,
+              .len = src->dl_insert.len,
+              .data = src->dl_insert.data,
+          },
+        };
+      }
     case WL_CLR:
       {
         return (struct wal_rec_hdr_write){
@@ -161,9 +198,14 @@ wrh_get_tid (struct wal_rec_hdr_read *h)
         return h->end.tid;
       }
     case WL_UPDATE:
+    case WL_UPDATE_DELTA:
       {
         return h->update.tid;
       }
+    case WL_DL_INSERT:
+      {
+        return h->dl_insert.tid;
+      }
     case WL_CLR:
       {
         return h->clr.tid;
@@ -202,9 +244,14 @@ wrh_get_prev_lsn (struct wal_rec_hdr_read *h)
         return h->end.prev;
       }
     case WL_UPDATE:
+    case WL_UPDATE_DELTA:
       {
         return h->update.prev;
       }
+    case WL_DL_INSERT:
+      {
+        return h->dl_insert.prev;
+      }
     case WL_CLR:
       {
         return h->clr.prev;
@@ -225,6 +272,40 @@ wrh_get_prev_lsn (struct wal_rec_hdr_read *h)
   UNREACHABLE ();
 }
 
+spgno
+wrh_get_pgno (struct wal_rec_hdr_read *h)
+{
+  switch (h->type)
+    {
+    case WL_UPDATE:
+    case WL_UPDATE_DELTA:
+      {
+        return h->update.pg;
+      }
+    case WL_DL_INSERT:
+      {
+        return h->dl_insert.pg;
+      }
+    case WL_CLR:
+      {
+        return h->clr.pg;
+      }
+    case WL_BEGIN:
+    case WL_COMMIT:
+    case WL_END:
+    case WL_CKPT_BEGIN:
+    case WL_CKPT_END:
+      {
+        return -1;
+      }
+    case WL_EOF:
+      {
+        UNREACHABLE ();
+      }
+    }
+  UNREACHABLE ();
+}
+
 #ifndef NTEST
 bool
 wal_rec_hdr_read_equal (struct wal_rec_hdr_read *left, struct wal_rec_hdr_read *right)
@@ -250,6 +331,34 @@ wal_rec_hdr_read_equal (struct wal_rec_hdr_read *left, struct wal_rec_hdr_read *
         break;
       }
 
+    case WL_UPDATE_DELTA:
+      {
+        match = match && left->update.tid == right->update.tid;
+        match = match && left->update.prev == right->update.prev;
+        match = match && left->update.pg == right->update.pg;
+        match = match && left->update.nranges == right->update.nranges;
+        for (u32 i = 0; match && i < left->update.nranges; ++i)
+          {
+            struct wal_range r = left->update.ranges[i];
+            match = match && r.ofst == right->update.ranges[i].ofst;
+            match = match && r.len == right->update.ranges[i].len;
+            match = match && i_memcmp (left->update.undo + r.ofst, right->update.undo + r.ofst, r.len) == 0;
+            match = match && i_memcmp (left->update.redo + r.ofst, right->update.redo + r.ofst, r.len) == 0;
+          }
+        break;
+      }
+
+    case WL_DL_INSERT:
+      {
+        match = match && left->dl_insert.tid == right->dl_insert.tid;
+        match = match && left->dl_insert.prev == right->dl_insert.prev;
+        match = match && left->dl_insert.pg == right->dl_insert.pg;
+        match = match && left->dl_insert.ofst == right->dl_insert.ofst;
+        match = match && left->dl_insert.len == right->dl_insert.len;
+        match = match && i_memcmp (left->dl_insert.data, right->dl_insert.data, left->dl_insert.len) == 0;
+        break;
+      }
+
     case WL_CLR:
       {
         match = match && left->clr.tid == right->clr.tid;
@@ -343,6 +452,36 @@ i_log_update (int log_level, const struct wal_rec_hdr_read *r)
   i_log (log_level, "------------------------------------\n");
 }
 
+static inline void
+i_log_update_delta (int log_level, const struct wal_rec_hdr_read *r)
+{
+  i_log (log_level, "------------------ %s:\n", wal_rec_hdr_type_tostr (r->type));
+  i_printf (log_level, "TID: %ld\n", r->update.tid);
+  i_printf (log_level, "PREV: %ld\n", r->update.prev);
+  i_printf (log_level, "PG: %ld\n", r->update.pg);
+  i_printf (log_level, "NRANGES: %u\n", r->update.nranges);
+  for (u32 i = 0; i < r->update.nranges; ++i)
+    {
+      i_printf (log_level, "[%" PRp_size ", %" PRp_size ") ",
+                r->update.ranges[i].ofst,
+                r->update.ranges[i].ofst + r->update.ranges[i].len);
+    }
+  i_printf (log_level, "\n");
+  i_log (log_level, "------------------------------------\n");
+}
+
+static inline void
+i_log_dl_insert (int log_level, const struct wal_rec_hdr_read *r)
+{
+  i_log (log_level, "------------------ %s:\n", wal_rec_hdr_type_tostr (r->type));
+  i_printf (log_level, "TID: %ld\n", r->dl_insert.tid);
+  i_printf (log_level, "PREV: %ld\n", r->dl_insert.prev);
+  i_printf (log_level, "PG: %ld\n", r->dl_insert.pg);
+  i_printf (log_level, "OFST: %" PRp_size "\n", r->dl_insert.ofst);
+  i_printf (log_level, "LEN: %" PRp_size "\n", r->dl_insert.len);
+  i_log (log_level, "------------------------------------\n");
+}
+
 static inline void
 i_log_clr (int log_level, const struct wal_rec_hdr_read *r)
 {
@@ -423,6 +562,18 @@ i_log_wal_rec_hdr_read (int log_level, struct wal_rec_hdr_read *r)
         break;
       }
 
+    case WL_UPDATE_DELTA:
+      {
+        i_log_update_delta (log_level, r);
+        break;
+      }
+
+    case WL_DL_INSERT:
+      {
+        i_log_dl_insert (log_level, r);
+        break;
+      }
+
     case WL_CLR:
       {
         i_log_clr (log_level, r);
@@ -477,6 +628,20 @@ i_print_wal_rec_hdr_read_light (int log_level, const struct wal_rec_hdr_read *r,
         break;
       }
 
+    case WL_UPDATE_DELTA:
+      {
+        i_printf (log_level, "%15" PRlsn "      DELTA      [ txid = %8" PRtxid ", pg = %8" PRpgno ", nranges = %8u  ] --> %" PRlsn "\n",
+                  l, r->update.tid, r->update.pg, r->update.nranges, r->update.prev);
+        break;
+      }
+
+    case WL_DL_INSERT:
+      {
+        i_printf (log_level, "%15" PRlsn "      DL_INSERT  [ txid = %8" PRtxid ", pg = %8" PRpgno ", len = %8" PRp_size "      ] --> %" PRlsn "\n",
+                  l, r->dl_insert.tid, r->dl_insert.pg, r->dl_insert.len, r->dl_insert.prev);
+        break;
+      }
+
     case WL_CLR:
       {
         i_printf (log_level, "%15" PRlsn "      CLR        [ txid = %8" PRtxid ", pg = %8" PRpgno ", undoNext = %8" PRpgno " ] --> %" PRlsn "\n",
@@ -520,6 +685,67 @@ i_print_wal_rec_hdr_read_light (int log_level, const struct wal_rec_hdr_read *r,
     }
 }
 
+/////////////////////////////////////////////
+/// DELTA
+
+/**
+ * Splits the bytes that differ between [before] and [after] into ranges.
+ * A new range costs two p_sizes in the log and a gap costs its length
+ * twice (undo and redo), so gaps shorter than a p_size are folded into the
+ * surrounding range.
+ *
+ * Returns false if it takes more than WAL_DELTA_MAX_RANGES ranges
+ */
+bool
+wrh_diff_ranges (struct wal_range *dest, u32 *nranges, p_size *nbytes, const u8 *before, const u8 *after)
+{
+  u32 n = 0;
+  p_size total = 0;
+  p_size i = 0;
+
+  while (i < PAGE_SIZE)
+    {
+      if (before[i] == after[i])
+        {
+          i++;
+          continue;
+        }
+
+      p_size start = i;
+      p_size end = i + 1;
+      for (p_size j = end; j < PAGE_SIZE && j - end < sizeof (p_size); ++j)
+        {
+          if (before[j] != after[j])
+            {
+              end = j + 1;
+            }
+        }
+
+      if (n == WAL_DELTA_MAX_RANGES)
+        {
+          return false;
+        }
+
+      dest[n++] = (struct wal_range){ .ofst = start, .len = end - start };
+      total += end - start;
+      i = end;
+    }
+
+  *nranges = n;
+  *nbytes = total;
+
+  return true;
+}
+
+void
+wrh_apply_ranges (u8 *dest, const struct wal_range *ranges, u32 nranges, const u8 *src)
+{
+  for (u32 i = 0; i < nranges; ++i)
+    {
+      i_memcpy (dest + ranges[i].ofst, src + ranges[i].ofst, ranges[i].len);
+    }
+}
+
 /////////////////////////////////////////////
 /// DECODE
 void
@@ -547,6 +773,91 @@ walf_decode_update (struct wal_rec_hdr_read *r, const u8 buf[WL_UPDATE_LEN])
 
   // REDO
   i_memcpy (r->update.redo, buf + head, PAGE_SIZE);
+
+  r->update.nranges = 1;
+  r->update.ranges[0] = (struct wal_range){ .ofst = 0, .len = PAGE_SIZE };
+}
+
+void
+walf_decode_update_delta (struct wal_rec_hdr_read *r, const u8 *buf)
+{
+  ASSERT (r->type == WL_UPDATE_DELTA);
+
+  u32 head = sizeof (wlh);
+
+  // TID
+  i_memcpy (&r->update.tid, buf + head, sizeof (r->update.tid));
+  head += sizeof (r->update.tid);
+
+  // PREV
+  i_memcpy (&r->update.prev, buf + head, sizeof (r->update.prev));
+  head += sizeof (r->update.prev);
+
+  // PG
+  i_memcpy (&r->update.pg, buf + head, sizeof (r->update.pg));
+  head += sizeof (r->update.pg);
+
+  // NRANGES
+  i_memcpy (&r->update.nranges, buf + head, sizeof (r->update.nranges));
+  head += sizeof (r->update.nranges);
+  ASSERT (r->update.nranges <= WAL_DELTA_MAX_RANGES);
+
+  // RANGES
+  for (u32 i = 0; i < r->update.nranges; ++i)
+    {
+      i_memcpy (&r->update.ranges[i].ofst, buf + head, sizeof (p_size));
+      head += sizeof (p_size);
+      i_memcpy (&r->update.ranges[i].len, buf + head, sizeof (p_size));
+      head += sizeof (p_size);
+    }
+
+  // UNDO
+  for (u32 i = 0; i < r->update.nranges; ++i)
+    {
+      struct wal_range rg = r->update.ranges[i];
+      i_memcpy (r->update.undo + rg.ofst, buf + head, rg.len);
+      head += rg.len;
+    }
+
+  // REDO
+  for (u32 i = 0; i < r->update.nranges; ++i)
+    {
+      struct wal_range rg = r->update.ranges[i];
+      i_memcpy (r->update.redo + rg.ofst, buf + head, rg.len);
+      head += rg.len;
+    }
+}
+
+void
+walf_decode_dl_insert (struct wal_rec_hdr_read *r, const u8 *buf)
+{
+  ASSERT (r->type == WL_DL_INSERT);
+
+  u32 head = sizeof (wlh);
+
+  // TID
+  i_memcpy (&r->dl_insert.tid, buf + head, sizeof (r->dl_insert.tid));
+  head += sizeof (r->dl_insert.tid);
+
+  // PREV
+  i_memcpy (&r->dl_insert.prev, buf + head, sizeof (r->dl_insert.prev));
+  head += sizeof (r->dl_insert.prev);
+
+  // PG
+  i_memcpy (&r->dl_insert.pg, buf + head, sizeof (r->dl_insert.pg));
+  head += sizeof (r->dl_insert.pg);
+
+  // OFST
+  i_memcpy (&r->dl_insert.ofst, buf + head, sizeof (r->dl_insert.ofst));
+  head += sizeof (r->dl_insert.ofst);
+
+  // LEN
+  i_memcpy (&r->dl_insert.len, buf + head, sizeof (r->dl_insert.len));
+  head += sizeof (r->dl_insert.len);
+  ASSERT (r->dl_insert.len <= PAGE_SIZE);
+
+  // DATA
+  i_memcpy (r->dl_insert.data, buf + head, r->dl_insert.len);
 }
 
 void
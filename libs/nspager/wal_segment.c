@@ -0,0 +1,181 @@
+/*
+ * Copyright 2025 Theo Lincke
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * Description:
+ *   WAL segment file names and the anchor recording the first live segment
+ */
+
+#include <numstore/core/assert.h>
+#include <numstore/core/checksums.h>
+#include <numstore/core/error.h>
+#include <numstore/intf/os.h>
+#include <numstore/intf/stdlib.h>
+#include <numstore/pager/wal_stream.h>
+#include <numstore/test/testing.h>
+
+#define WALSEG_ANCHOR_LEN (sizeof (u64) + sizeof (u32))
+
+void
+walseg_fname (char dest[WALSEG_FNAME_LEN], const char *fname, u64 seg)
+{
+  int len = i_snprintf (dest, WALSEG_FNAME_LEN, "%s.%06" PRIu64, fname, seg);
+  ASSERT (len > 0 && len < (int)WALSEG_FNAME_LEN);
+}
+
+err_t
+walseg_read_anchor (u64 *first, const char *fname, error *e)
+{
+  ASSERT (first);
+
+  // No anchor - nothing was ever truncated
+  *first = 0;
+  if (!i_exists_rw (fname))
+    {
+      return SUCCESS;
+    }
+
+  i_file fd;
+  err_t_wrap (i_open_r (&fd, fname, e), e);
+
+  u8 buf[WALSEG_ANCHOR_LEN];
+  i64 bread = i_pread_all (&fd, buf, sizeof (buf), 0, e);
+  if (bread < 0)
+    {
+      i_close (&fd, e);
+      return e->cause_code;
+    }
+  err_t_wrap (i_close (&fd, e), e);
+
+  if (bread == 0)
+    {
+      return SUCCESS;
+    }
+  if ((u64)bread != sizeof (buf))
+    {
+      return error_causef (e, ERR_CORRUPT, "WAL anchor %s is truncated", fname);
+    }
+
+  u32 checksum = checksum_init ();
+  checksum_execute (&checksum, buf, sizeof (u64));
+
+  u32 actual;
+  i_memcpy (&actual, buf + sizeof (u64), sizeof (u32));
+  if (checksum != actual)
+    {
+      return error_causef (e, ERR_CORRUPT, "WAL anchor %s: Invalid CRC", fname);
+    }
+
+  i_memcpy (first, buf, sizeof (u64));
+
+  return SUCCESS;
+}
+
+err_t
+walseg_write_anchor (const char *fname, u64 first, error *e)
+{
+  u8 buf[WALSEG_ANCHOR_LEN];
+  u32 checksum = checksum_init ();
+  i_memcpy (buf, &first, sizeof (u64));
+  checksum_execute (&checksum, buf, sizeof (u64));
+  i_memcpy (buf + sizeof (u64), &checksum, sizeof (u32));
+
+  i_file fd;
+  err_t_wrap (i_open_w (&fd, fname, e), e);
+
+  // Fits in a sector, so it either lands whole or not at all
+  err_t_wrap_goto (i_pwrite_all (&fd, buf, sizeof (buf), 0, e), failed, e);
+  err_t_wrap_goto (i_fsync (&fd, e), failed, e);
+
+  return i_close (&fd, e);
+
+failed:
+  i_close (&fd, e);
+  return e->cause_code;
+}
+
+err_t
+walseg_remove_all (const char *fname, error *e)
+{
+  u64 first;
+  err_t_wrap (walseg_read_anchor (&first, fname, e), e);
+
+  char name[WALSEG_FNAME_LEN];
+
+  // Live segments and spares
+  for (u64 seg = first;; ++seg)
+    {
+      walseg_fname (name, fname, seg);
+      if (!i_exists_rw (name))
+        {
+          break;
+        }
+      err_t_wrap (i_remove_quiet (name, e), e);
+    }
+
+  // Left behind by a truncation that crashed part way
+  for (u64 seg = first; seg > 0; --seg)
+    {
+      walseg_fname (name, fname, seg - 1);
+      if (!i_exists_rw (name))
+        {
+          break;
+        }
+      err_t_wrap (i_remove_quiet (name, e), e);
+    }
+
+  return i_remove_quiet (fname, e);
+}
+
+#ifndef NTEST
+TEST (TT_UNIT, walseg_anchor)
+{
+  error e = error_create ();
+  u64 first;
+
+  test_err_t_wrap (walseg_remove_all ("test.wal", &e), &e);
+
+  TEST_CASE ("No anchor -> first segment is 0")
+  {
+    test_err_t_wrap (walseg_read_anchor (&first, "test.wal", &e), &e);
+    test_assert_int_equal (first, 0);
+  }
+
+  TEST_CASE ("Anchor round trips")
+  {
+    test_err_t_wrap (walseg_write_anchor ("test.wal", 42, &e), &e);
+    test_err_t_wrap (walseg_read_anchor (&first, "test.wal", &e), &e);
+    test_assert_int_equal (first, 42);
+  }
+
+  TEST_CASE ("Remove all drops the anchor and every segment")
+  {
+    char name[WALSEG_FNAME_LEN];
+    for (u64 seg = 40; seg < 45; ++seg)
+      {
+        walseg_fname (name, "test.wal", seg);
+        test_err_t_wrap (i_touch (name, &e), &e);
+      }
+
+    test_err_t_wrap (walseg_remove_all ("test.wal", &e), &e);
+
+    test_assert (!i_exists_rw ("test.wal"));
+    for (u64 seg = 40; seg < 45; ++seg)
+      {
+        walseg_fname (name, "test.wal", seg);
+        test_assert (!i_exists_rw (name));
+      }
+  }
+}
+#endif
@@ -59,7 +59,7 @@ dl_contents (FILE *out, char *fname, pgno pg)
 {
   error e = error_create ();
 
-  struct pager *p = pgr_open (fname, "test.wal", &e);
+  struct pager *p = pgr_open (fname, "test.wal", 0, &e);
   if (p == NULL)
     {
       error_log_consume (&e);
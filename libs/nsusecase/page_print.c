@@ -54,7 +54,7 @@ page_print (char *fname, pp_params params)
 {
   error e = error_create ();
 
-  struct pager *p = pgr_open (fname, NULL, &e);
+  struct pager *p = pgr_open (fname, NULL, 0, &e);
   if (p == NULL)
     {
       error_log_consume (&e);
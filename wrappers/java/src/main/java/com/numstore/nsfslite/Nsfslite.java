@@ -33,21 +33,37 @@ public final class Nsfslite {
     // Lifecycle
 
     /**
-     * Open a connection to an nsfslite database.
-     * Equivalent to: nsfslite *nsfslite_open(const char *fname, const char *recovery_fname)
+     * Open a connection to an nsfslite database with the default buffer pool size.
+     * Equivalent to: nsfslite *nsfslite_open(const char *fname, const char *recovery_fname, 0)
      *
      * @param dbPath path to the database file
      * @param walPath path to the WAL (recovery) file
      * @return handle to the database connection
      */
     public static long open(String dbPath, String walPath) {
+        return open(dbPath, walPath, 0);
+    }
+
+    /**
+     * Open a connection to an nsfslite database.
+     * Equivalent to: nsfslite *nsfslite_open(const char *fname, const char *recovery_fname, size_t pool_size)
+     *
+     * @param dbPath path to the database file
+     * @param walPath path to the WAL (recovery) file
+     * @param poolSize buffer pool size in bytes, 0 for the default
+     * @return handle to the database connection
+     */
+    public static long open(String dbPath, String walPath, long poolSize) {
         if (dbPath == null || dbPath.isEmpty()) {
             throw new IllegalArgumentException("Database path cannot be null or empty");
         }
         if (walPath == null || walPath.isEmpty()) {
             throw new IllegalArgumentException("WAL path cannot be null or empty");
         }
-        return NsfsliteNative.open(dbPath, walPath);
+        if (poolSize < 0) {
+            throw new IllegalArgumentException("Pool size cannot be negative");
+        }
+        return NsfsliteNative.open(dbPath, walPath, poolSize);
     }
 
     /**
@@ -13,7 +13,7 @@ class NsfsliteNative {
     }
 
     // Lifecycle
-    static native long open(String dbPath, String walPath);
+    static native long open(String dbPath, String walPath, long poolSize);
     static native void close(long handle);
 
     // Higher Order Operations